@@ -0,0 +1,464 @@
+﻿#include "CpuRenderer.h"
+#include "Renderer.h"
+#include "SceneSuite.h"
+#include "Simd.h"
+#include "Tape.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#endif
+
+// Performance regression benchmark over the scene suite. CPU benchmarks time
+// the evaluation paths of every scene, render benchmarks draw a fixed orbit
+// headless on the GPU and, over its first frames, on the CPU renderer.
+// Results are printed in the console and JSON formats of Google Benchmark, so
+// nightly runs can be diffed with its compare.py.
+//
+// Usage: ImplicitBooleanCSG_bench [--frames=N] [--size=WxH]
+//            [--benchmark_filter=regex] [--benchmark_min_time=seconds]
+//            [--benchmark_format=console|json] [--benchmark_out=file.json]
+
+namespace {
+    struct Options {
+        size_t frames = 64;
+        int width = 640;
+        int height = 360;
+        double minTime = 0.2;
+        std::string filter = ".";
+        bool json = false;
+        std::string outputPath;
+    };
+
+    struct Counter {
+        std::string name;
+        double value;
+        bool rate; // Printed as a per-second rate
+    };
+
+    struct Result {
+        std::string name;
+        uint64_t iterations;
+        double realTime;
+        double cpuTime;
+        const char* timeUnit;
+        std::vector<Counter> counters;
+    };
+
+    const size_t pointsPerIteration = 4096;
+
+    // Sink for benchmark results so the compiler cannot drop the work
+    volatile double sink = 0.0;
+
+    bool parseOption(const char* argument, const char* name, std::string& value) {
+        size_t length = std::strlen(name);
+        if (std::strncmp(argument, name, length) != 0 || argument[length] != '=') {
+            return false;
+        }
+        value = argument + length + 1;
+        return true;
+    }
+
+    bool parseArguments(int argc, char** argv, Options& options) {
+        for (int i = 1; i < argc; ++i) {
+            std::string value;
+            if (parseOption(argv[i], "--frames", value)) {
+                options.frames = static_cast<size_t>(std::max(std::atoi(value.c_str()), 1));
+            }
+            else if (parseOption(argv[i], "--size", value)) {
+                if (std::sscanf(value.c_str(), "%dx%d", &options.width, &options.height) != 2 ||
+                    options.width <= 0 || options.height <= 0) {
+                    return false;
+                }
+            }
+            else if (parseOption(argv[i], "--benchmark_filter", value)) {
+                options.filter = value;
+            }
+            else if (parseOption(argv[i], "--benchmark_min_time", value)) {
+                options.minTime = std::max(std::atof(value.c_str()), 0.0);
+            }
+            else if (parseOption(argv[i], "--benchmark_format", value)) {
+                if (value != "console" && value != "json") {
+                    return false;
+                }
+                options.json = value == "json";
+            }
+            else if (parseOption(argv[i], "--benchmark_out", value)) {
+                options.outputPath = value;
+            }
+            else {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // CPU time of every thread of the process; std::clock measures that on
+    // POSIX systems but wall time on Windows
+    double processSeconds() {
+#ifdef _WIN32
+        FILETIME creation, exited, kernel, user;
+        if (!GetProcessTimes(GetCurrentProcess(), &creation, &exited, &kernel, &user)) {
+            return 0.0;
+        }
+        auto seconds = [](const FILETIME& time) {
+            return static_cast<double>((static_cast<uint64_t>(time.dwHighDateTime) << 32) | time.dwLowDateTime) * 1e-7;
+        };
+        return seconds(kernel) + seconds(user);
+#else
+        return static_cast<double>(std::clock()) / CLOCKS_PER_SEC;
+#endif
+    }
+
+    // Run body (which performs itemsPerIteration items) in growing batches of
+    // iterations until minTime has passed; times are per item in nanoseconds
+    template <typename Body>
+    Result measure(const std::string& name, double minTime, size_t itemsPerIteration, Body body) {
+        uint64_t iterations = 1;
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            double cpuStart = processSeconds();
+            for (uint64_t i = 0; i < iterations; ++i) {
+                body();
+            }
+            double real = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            double cpu = processSeconds() - cpuStart;
+
+            if (real >= minTime || iterations >= (1ull << 40)) {
+                double items = static_cast<double>(iterations) * itemsPerIteration;
+                Result result = { name, iterations * itemsPerIteration, real * 1e9 / items, cpu * 1e9 / items, "ns", {} };
+                result.counters.push_back({ "items_per_second", items / std::max(real, 1e-12), true });
+                return result;
+            }
+            // Aim for the minimum time with some headroom, like Google Benchmark
+            double factor = real > 0.0 ? 1.4 * minTime / real : 10.0;
+            iterations = static_cast<uint64_t>(static_cast<double>(iterations) * std::clamp(factor, 2.0, 10.0));
+        }
+    }
+
+    void evaluationBenchmarks(const SceneSuite::Scene& scene, const Options& options, const std::regex& filter,
+                              std::vector<Result>& results) {
+        Tape tape = Tape::compile(scene.surface);
+        const AABB& bounds = scene.surface->getBounds();
+        AABB region = bounds.isFinite() ? bounds.expand(0.5)
+                                        : AABB::around(Vec3<double>(0.0, 0.0, 0.0), Vec3<double>(3.0, 3.0, 3.0));
+        std::vector<Vec3<double>> points = SceneSuite::samplePoints(region, pointsPerIteration);
+
+        std::string name = "Evaluate/" + scene.name;
+        if (std::regex_search(name, filter)) {
+            results.push_back(measure(name, options.minTime, points.size(), [&]() {
+                double sum = 0.0;
+                for (const Vec3<double>& p : points) sum += tape.evaluate(p);
+                sink = sink + sum;
+            }));
+        }
+
+        name = "EvaluateBatch/" + scene.name;
+        if (std::regex_search(name, filter)) {
+            std::vector<double> xs, ys, zs, distances(points.size());
+            for (const Vec3<double>& p : points) {
+                xs.push_back(p.x);
+                ys.push_back(p.y);
+                zs.push_back(p.z);
+            }
+            results.push_back(measure(name, options.minTime, points.size(), [&]() {
+                tape.evaluateBatch(xs.data(), ys.data(), zs.data(), distances.data(), distances.size());
+                sink = sink + distances.back();
+            }));
+        }
+
+        name = "EvaluateBatchFloat/" + scene.name;
+        if (std::regex_search(name, filter)) {
+            std::vector<float> xs, ys, zs, distances(points.size());
+            for (const Vec3<double>& p : points) {
+                xs.push_back(static_cast<float>(p.x));
+                ys.push_back(static_cast<float>(p.y));
+                zs.push_back(static_cast<float>(p.z));
+            }
+            results.push_back(measure(name, options.minTime, points.size(), [&]() {
+                tape.evaluateBatch(xs.data(), ys.data(), zs.data(), distances.data(), distances.size());
+                sink = sink + distances.back();
+            }));
+        }
+
+        name = "EvaluateTree/" + scene.name;
+        if (std::regex_search(name, filter)) {
+            const ImplicitSurface& tree = *scene.surface;
+            results.push_back(measure(name, options.minTime, points.size(), [&]() {
+                double sum = 0.0;
+                for (const Vec3<double>& p : points) sum += tree.evaluate(p);
+                sink = sink + sum;
+            }));
+        }
+    }
+
+    // One run of the orbit per scene after a short warm-up; the time is per
+    // frame, the CPU time is the profiled draw stage
+    void renderBenchmarks(const std::vector<SceneSuite::Scene>& scenes, const Options& options,
+                          const std::regex& filter, std::vector<Result>& results) {
+        std::vector<const SceneSuite::Scene*> selected;
+        for (const SceneSuite::Scene& scene : scenes) {
+            if (std::regex_search("Render/" + scene.name, filter)) {
+                selected.push_back(&scene);
+            }
+        }
+        if (selected.empty()) {
+            return;
+        }
+
+        ImplicitRenderer renderer(options.width, options.height);
+        renderer.setHeadless(true);
+        if (!renderer.initialize()) {
+            std::cerr << "Skipping render benchmarks: no OpenGL context" << std::endl;
+            return;
+        }
+        // Same settings as the interactive demo
+        renderer.setLight(Vec3<float>(4, 4, 4), Vec3<float>(1, 1, 1), 0.2f);
+        renderer.setRaymarchingParams(100, 50.0f, 0.001f);
+        renderer.setMarchingStrategy(MarchingStrategy::OverRelaxed);
+        renderer.setPixelFootprintEpsilon(0.5f);
+        renderer.setConePrepass(true);
+        renderer.setProfiling(true);
+#ifdef USE_ADVANCED_OPENGL
+        renderer.setStepCounters(true);
+#endif
+
+        std::vector<Profiler::FrameReport> reports;
+        renderer.setProfileListener([&](const Profiler::FrameReport& report) { reports.push_back(report); });
+        auto ignore = [](size_t, const unsigned char*, int, int) {};
+        std::vector<CameraPose> path = SceneSuite::orbitPath(options.frames);
+        std::vector<CameraPose> warmUp(path.begin(), path.begin() + std::min<size_t>(path.size(), 4));
+
+        for (const SceneSuite::Scene* scene : selected) {
+            renderer.setScene(scene->surface);
+            renderer.renderFrames(warmUp, options.width, options.height, ignore);
+            reports.clear();
+
+            auto start = std::chrono::steady_clock::now();
+            bool rendered = renderer.renderFrames(path, options.width, options.height, ignore);
+            double real = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            if (!rendered) {
+                std::cerr << "Render/" << scene->name << " failed" << std::endl;
+                continue;
+            }
+
+            double cpu = 0.0, gpu = 0.0, steps = 0.0, pixels = 0.0;
+            for (const Profiler::FrameReport& report : reports) {
+                cpu += report.cpuTime("draw");
+                gpu += report.gpuTime("frame");
+                if (report.hasSteps) {
+                    steps += report.steps.totalSteps;
+                    pixels += report.steps.pixels;
+                }
+            }
+            double frames = static_cast<double>(path.size());
+            Result result = { "Render/" + scene->name, path.size(), real / frames, cpu / frames, "ms", {} };
+            result.counters.push_back({ "gpu_ms", reports.empty() ? 0.0 : gpu / reports.size(), false });
+            if (pixels > 0.0) {
+                result.counters.push_back({ "steps_per_pixel", steps / pixels, false });
+            }
+            result.counters.push_back({ "frames_per_second", frames * 1000.0 / std::max(real, 1e-9), true });
+            results.push_back(result);
+        }
+        renderer.setProfileListener(nullptr);
+    }
+
+    // The CPU renderer over the first frames of the orbit with the demo's
+    // settings; the time is per frame, the CPU time summed over all threads
+    void cpuRenderBenchmarks(const std::vector<SceneSuite::Scene>& scenes, const Options& options,
+                             const std::regex& filter, std::vector<Result>& results) {
+        CpuRenderer::Settings settings;
+        settings.lightPosition = Vec3<float>(4, 4, 4);
+        settings.ambientStrength = 0.2f;
+        settings.maxDistance = 50.0f;
+        settings.overRelaxation = 1.2f;
+        settings.pixelFootprintScale = 0.5f;
+        CpuRenderer renderer(settings);
+
+        std::vector<CameraPose> path = SceneSuite::orbitPath(options.frames);
+        path.resize(std::min<size_t>(path.size(), 8));
+        auto ignore = [](size_t, const unsigned char*, int, int) {};
+        double threads = static_cast<double>(ThreadPool::shared().getConcurrency());
+
+        for (const SceneSuite::Scene& scene : scenes) {
+            std::string name = "CpuRender/" + scene.name;
+            if (!std::regex_search(name, filter)) {
+                continue;
+            }
+            renderer.setScene(scene.surface);
+
+            auto start = std::chrono::steady_clock::now();
+            double cpuStart = processSeconds();
+            bool rendered = renderer.renderFrames(path, options.width, options.height, ignore);
+            double real = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+            double cpu = (processSeconds() - cpuStart) * 1000.0;
+            if (!rendered) {
+                std::cerr << name << " failed" << std::endl;
+                continue;
+            }
+
+            double frames = static_cast<double>(path.size());
+            Result result = { name, path.size(), real / frames, cpu / frames, "ms", {} };
+            result.counters.push_back({ "threads", threads, false });
+            // CPU time over real time and threads: 1 when every thread was busy throughout
+            result.counters.push_back({ "utilization", cpu / std::max(real * threads, 1e-9), false });
+            result.counters.push_back({ "frames_per_second", frames * 1000.0 / std::max(real, 1e-9), true });
+            results.push_back(result);
+        }
+    }
+
+    std::string humanReadable(double value) {
+        const char* suffixes[] = { "", "k", "M", "G", "T" };
+        int suffix = 0;
+        while (std::abs(value) >= 1000.0 && suffix < 4) {
+            value /= 1000.0;
+            ++suffix;
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.4g%s", value, suffixes[suffix]);
+        return text;
+    }
+
+    // Three significant digits for small times, whole units otherwise
+    int decimals(double value) {
+        return value < 10.0 ? 2 : value < 100.0 ? 1 : 0;
+    }
+
+    void printConsole(std::ostream& out, const std::vector<Result>& results) {
+        size_t nameWidth = 10;
+        for (const Result& result : results) {
+            nameWidth = std::max(nameWidth, result.name.size());
+        }
+        std::string rule(nameWidth + 52, '-');
+        char line[512];
+        out << rule << '\n';
+        std::snprintf(line, sizeof(line), "%-*s %13s %15s %12s UserCounters...", static_cast<int>(nameWidth),
+                      "Benchmark", "Time", "CPU", "Iterations");
+        out << line << '\n' << rule << '\n';
+        for (const Result& result : results) {
+            std::snprintf(line, sizeof(line), "%-*s %10.*f %-2s %12.*f %-2s %12llu", static_cast<int>(nameWidth),
+                          result.name.c_str(), decimals(result.realTime), result.realTime, result.timeUnit,
+                          decimals(result.cpuTime), result.cpuTime, result.timeUnit,
+                          static_cast<unsigned long long>(result.iterations));
+            out << line;
+            for (const Counter& counter : result.counters) {
+                out << ' ' << counter.name << '=' << humanReadable(counter.value) << (counter.rate ? "/s" : "");
+            }
+            out << '\n';
+        }
+        out.flush();
+    }
+
+    // Windows paths contain backslashes
+    std::string escapeJSON(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') escaped += '\\';
+            escaped += c;
+        }
+        return escaped;
+    }
+
+    void printJSON(std::ostream& out, const std::vector<Result>& results, const char* executable) {
+        char date[64];
+        std::time_t now = std::time(nullptr);
+        std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S%z", std::localtime(&now));
+
+        out << "{\n  \"context\": {\n";
+        out << "    \"date\": \"" << date << "\",\n";
+        out << "    \"executable\": \"" << escapeJSON(executable) << "\",\n";
+        out << "    \"num_cpus\": " << std::thread::hardware_concurrency() << ",\n";
+        out << "    \"simd\": \"" << IMPLICIT_SIMD_NAME << "\",\n";
+#ifdef NDEBUG
+        out << "    \"library_build_type\": \"release\"\n";
+#else
+        out << "    \"library_build_type\": \"debug\"\n";
+#endif
+        out << "  },\n  \"benchmarks\": [\n";
+        char number[64];
+        for (size_t i = 0; i < results.size(); ++i) {
+            const Result& result = results[i];
+            out << "    {\n";
+            out << "      \"name\": \"" << result.name << "\",\n";
+            out << "      \"run_name\": \"" << result.name << "\",\n";
+            out << "      \"run_type\": \"iteration\",\n";
+            out << "      \"repetitions\": 1,\n      \"repetition_index\": 0,\n      \"threads\": 1,\n";
+            out << "      \"iterations\": " << result.iterations << ",\n";
+            std::snprintf(number, sizeof(number), "%.17g", result.realTime);
+            out << "      \"real_time\": " << number << ",\n";
+            std::snprintf(number, sizeof(number), "%.17g", result.cpuTime);
+            out << "      \"cpu_time\": " << number << ",\n";
+            out << "      \"time_unit\": \"" << result.timeUnit << "\"";
+            for (const Counter& counter : result.counters) {
+                std::snprintf(number, sizeof(number), "%.17g", counter.value);
+                out << ",\n      \"" << counter.name << "\": " << number;
+            }
+            out << "\n    }" << (i + 1 < results.size() ? "," : "") << '\n';
+        }
+        out << "  ]\n}\n";
+        out.flush();
+    }
+}
+
+int main(int argc, char** argv) {
+    Options options;
+    if (!parseArguments(argc, argv, options)) {
+        std::cerr << "Usage: " << argv[0] << " [--frames=N] [--size=WxH] [--benchmark_filter=regex]"
+                  << " [--benchmark_min_time=seconds] [--benchmark_format=console|json] [--benchmark_out=file]"
+                  << std::endl;
+        return -1;
+    }
+
+    std::regex filter;
+    try {
+        filter = std::regex(options.filter);
+    }
+    catch (const std::regex_error& error) {
+        std::cerr << "Invalid benchmark filter " << options.filter << ": " << error.what() << std::endl;
+        return -1;
+    }
+
+    std::vector<SceneSuite::Scene> scenes = SceneSuite::standardScenes();
+    std::vector<Result> results;
+    for (const SceneSuite::Scene& scene : scenes) {
+        evaluationBenchmarks(scene, options, filter, results);
+    }
+    renderBenchmarks(scenes, options, filter, results);
+    cpuRenderBenchmarks(scenes, options, filter, results);
+
+    if (options.json) {
+        printJSON(std::cout, results, argv[0]);
+    }
+    else {
+        std::cout << "SIMD: " << IMPLICIT_SIMD_NAME << ", " << std::thread::hardware_concurrency() << " CPUs" << std::endl;
+        printConsole(std::cout, results);
+    }
+    if (!options.outputPath.empty()) {
+        std::ofstream file(options.outputPath, std::ios::trunc);
+        if (!file) {
+            std::cerr << "Could not write " << options.outputPath << std::endl;
+            return -1;
+        }
+        printJSON(file, results, argv[0]);
+    }
+    return results.empty() ? 1 : 0;
+}
@@ -0,0 +1,54 @@
+﻿#pragma once
+
+#include <GL/glew.h>
+
+// Compute shader backend of ImplicitRenderer (compute_march.comp, OpenGL 4.3).
+// The primary pass runs one 8x8 workgroup per tile: the tile's cone is marched
+// once into shared memory, tiles whose cone escapes are filled with the
+// background, and every pixel then marches with a small step budget. Rays that
+// exhaust it are appended to a queue that a fixed number of persistent
+// workgroups drain in a second pass, so the few slow rays no longer keep whole
+// warps of finished ones waiting. The image is blitted to the draw framebuffer.
+class ComputeMarcher {
+private:
+    static constexpr GLuint outputImageUnit = 0; // Image binding in compute_march.comp
+    static constexpr GLuint rayQueueBinding = 0; // Shader storage binding in compute_march.comp
+    static constexpr GLuint rayWords = 3;        // Queue words per ray
+
+    GLuint outputTexture;
+    GLuint readFramebuffer;
+    GLuint rayQueueBuffer;
+    int imageWidth, imageHeight;
+    GLuint rayQueueCapacity;
+    int primarySteps;
+    GLuint persistentGroups;
+
+    // Uniform locations of the configured program
+    GLint passLocation, primaryStepsLocation, capacityLocation;
+
+    bool resize(int width, int height);
+
+public:
+    static constexpr int groupSize = 8; // local_size_x and local_size_y of compute_march.comp
+
+    ComputeMarcher();
+    ~ComputeMarcher();
+
+    // Compute shaders and shader storage buffers are available in the current context
+    static bool supported();
+
+    // Resolve the uniforms of a newly built compute_march.comp program
+    void configure(GLuint program);
+
+    // Steps every ray gets in the primary pass before it is queued
+    void setPrimarySteps(int steps) { primarySteps = steps > 0 ? steps : 1; }
+    int getPrimarySteps() const { return primarySteps; }
+
+    // March a width x height frame with the configured program, whose frame
+    // parameters and scene textures must already be bound, and copy it into
+    // the viewport of the bound draw framebuffer
+    void render(GLuint program, int width, int height);
+
+    // Delete the GL objects; needs the context, like ShaderCache::clear
+    void release();
+};
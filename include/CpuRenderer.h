@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include "Renderer.h"
+#include "Tape.h"
+#include "ThreadPool.h"
+#include <memory>
+#include <vector>
+
+// Software renderer for machines without a GPU, e.g. batch nodes of a render
+// farm. It runs the algorithm of raymarch.glsl (getRayDir, rayMarch with
+// over-relaxation and pixel footprint, softShadow and calculateLighting) on
+// the scene's tape. The GPU-only accelerations (baked field, shadow volume,
+// cone pre-pass, temporal reuse) are not used, so frames match those of the
+// fragment backend without them up to float precision.
+//
+// Frames are split into tileSize^2 pixel tiles processed in parallel on a
+// work-stealing ThreadPool. Each tile marches its rays as one packet: every
+// step gathers the tile's rays that are still marching and evaluates them
+// together with the float kernels of Tape::evaluateBatch (the GPU's precision,
+// at twice the SIMD width of double), and the shadow rays of the tile's hits
+// are marched the same way. Tiles only write their own pixels, so the
+// result does not depend on the thread count or timing.
+class CpuRenderer {
+public:
+    // Same meaning and defaults as the corresponding ImplicitRenderer setters
+    struct Settings {
+        Vec3<float> lightPosition = Vec3<float>(3.0f, 5.0f, 5.0f);
+        Vec3<float> lightColor = Vec3<float>(1.0f, 1.0f, 1.0f);
+        float ambientStrength = 0.1f;
+        int maxSteps = 100;
+        float maxDistance = 100.0f;
+        float epsilon = 0.001f;
+        float overRelaxation = 1.0f;     // 1 is plain sphere tracing, see MarchingStrategy::OverRelaxed
+        float pixelFootprintScale = 0.0f; // Hit threshold in pixels (0 uses epsilon only)
+        float lipschitzBound = 1.0f;
+        int shadowMaxSteps = 48;
+        float shadowSoftness = 16.0f;
+        int tileSize = 16;               // Pixels per side of a tile
+    };
+
+    CpuRenderer();
+    explicit CpuRenderer(const Settings& settings);
+
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+    void setSettings(const Settings& newSettings) { settings = newSettings; }
+    const Settings& getSettings() const { return settings; }
+
+    // Compile the scene to the tape that is marched
+    void setScene(const std::shared_ptr<const ImplicitSurface>& surface);
+    void setScene(Tape sceneTape) { tape = std::move(sceneTape); }
+    const Tape& getTape() const { return tape; }
+
+    // Render one frame into tightly packed RGBA8 rows, bottom row first
+    bool renderFrame(const CameraPose& pose, int width, int height, std::vector<unsigned char>& pixels) const;
+
+    // Same contract as ImplicitRenderer::renderFrames, so batch output code
+    // works with either renderer
+    bool renderFrames(const std::vector<CameraPose>& path, int width, int height, const FrameConsumer& consumer) const;
+
+private:
+    struct Frame;
+
+    Settings settings;
+    ThreadPool* pool;
+    Tape tape;
+
+    void renderTile(const Frame& frame, int x0, int y0, int x1, int y1, unsigned char* pixels) const;
+};
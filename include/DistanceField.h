@@ -0,0 +1,76 @@
+﻿#pragma once
+
+#include "Tape.h"
+#include <vector>
+
+// Sparse distance field sampled on a regular grid and stored as bricks of
+// brickCells^3 cells. Bricks that interval arithmetic proves to be farther
+// than exactBand from the surface keep a single conservative distance; the
+// others store brickSamples^3 samples (corners included, so each brick can be
+// filtered on its own) in a 3D atlas ready for GL_LINEAR sampling.
+//
+// Reconstructed distances are only trusted outside exactBand: closer to the
+// surface the caller is expected to evaluate the scene exactly (marchSDF in
+// baked_sdf.glsl does this on the GPU).
+class DistanceField {
+public:
+    static constexpr int brickCells = 8;
+    static constexpr int brickSamples = brickCells + 1;
+
+    // Sample the tape over the bounds of a scene. resolution is the number of
+    // cells along the longest axis; maxTextureSize limits the atlas dimensions.
+    // Returns false for unbounded scenes or when the atlas would not fit.
+    bool bake(const Tape& tape, const AABB& sceneBounds, int resolution, int maxTextureSize = 2048);
+
+    // Rebake after an edit that left the field unchanged outside region,
+    // margin being the deepest smooth blend seen on the way to the root (see
+    // SceneEditor::Changes). A point p can only change when the previous field
+    // there was at least distance(p, region) - margin in magnitude, so only
+    // bricks whose range reached that far are classified and sampled again.
+    // Returns false when a full bake is needed instead: the scene grew out of
+    // the baked region, the region is unbounded or the atlas ran out of slots.
+    bool update(const Tape& tape, const AABB& sceneBounds, const AABB& region, double margin);
+    // Bricks whose index entry was rewritten and atlas slots that were sampled
+    // by the last update, for partial uploads
+    const std::vector<size_t>& getUpdatedBricks() const { return updatedBricks; }
+    const std::vector<size_t>& getUpdatedSlots() const { return updatedSlots; }
+
+    // Reconstructed distance, matching bakedSDF in baked_sdf.glsl
+    double sample(const Vec3<double>& point) const;
+
+    bool empty() const { return brickIndex.empty(); }
+    const AABB& getBounds() const { return bounds; }
+    double getVoxelSize() const { return voxelSize; }
+    // Distances below this are not accurate enough for sphere tracing
+    double getExactBand() const { return 2.0 * voxelSize; }
+    const int* getBrickGrid() const { return brickGrid; }
+    const int* getAtlasBricks() const { return atlasBricks; }
+    size_t getNearBrickCount() const { return nearBricks; }
+    // Atlas slots, including the spare ones kept free for updates
+    size_t getSlotCapacity() const { return static_cast<size_t>(atlasBricks[0]) * atlasBricks[1] * atlasBricks[2]; }
+
+    // Two floats per brick (x fastest): atlas slot or -1, and the conservative
+    // distance of bricks without samples
+    const std::vector<float>& getBrickIndex() const { return brickIndex; }
+    // Atlas samples, x fastest, atlasBricks * brickSamples texels per axis
+    const std::vector<float>& getAtlas() const { return atlas; }
+    void getAtlasSize(int size[3]) const;
+
+private:
+    AABB bounds;
+    double voxelSize = 0.0;
+    int brickGrid[3] = { 0, 0, 0 };
+    int atlasBricks[3] = { 0, 0, 0 };
+    size_t nearBricks = 0;
+    std::vector<float> brickIndex;
+    std::vector<float> atlas;
+    std::vector<double> brickReach; // Largest magnitude of the field over each brick
+    std::vector<size_t> freeSlots;
+    std::vector<size_t> updatedBricks, updatedSlots;
+
+    AABB brickRegion(size_t index) const;
+    // Interval test of one brick: stores the conservative distance and the
+    // reach of far bricks and returns whether the brick needs samples
+    bool classifyBrick(const Tape& tape, size_t index);
+    void sampleBrick(const Tape& tape, size_t index, size_t slot);
+};
@@ -0,0 +1,61 @@
+﻿#pragma once
+
+#include <GL/glew.h>
+
+// GPU frame timing and the resolution controller behind ImplicitRenderer's
+// dynamic resolution. Frames are timed with GL_TIME_ELAPSED queries kept in a
+// small ring and read only once available, so measuring never stalls the
+// pipeline; results lag the frame they measure by a few frames.
+//
+// The controller assumes frame cost proportional to the pixel count, steers
+// the resolution scale by the square root of budget / time, and only reacts
+// outside a dead band around the budget so the resolution does not oscillate.
+// Optionally the step budget is lowered once the scale reaches its minimum.
+class DynamicResolution {
+private:
+    static constexpr int queryRingSize = 4;
+    GLuint queries[queryRingSize];
+    bool pending[queryRingSize];
+    int nextQuery;
+    bool timing; // A query is open between beginFrame and endFrame
+
+    bool enabled;
+    float budgetMs;
+    float minScale;
+    bool scaleSteps;
+
+    float scale;
+    float stepScale;
+    float frameTimeMs; // Smoothed GPU time, 0 until the first result
+    int settleFrames;  // Results to ignore after a change, still measuring the old scale
+
+public:
+    DynamicResolution();
+    ~DynamicResolution();
+
+    // Smallest step budget fraction used when scaleSteps is enabled
+    static constexpr float minStepScale = 0.5f;
+
+    void configure(bool enabled, float budgetMs, float minScale, bool scaleSteps);
+    bool isEnabled() const { return enabled; }
+
+    // Bracket the GPU work of one frame; no-ops while disabled
+    void beginFrame();
+    void endFrame();
+
+    // Read finished queries and adapt the scales to them
+    void update();
+
+    // Feed one measured frame time to the controller
+    void adapt(float gpuMs);
+
+    // Fraction of the window resolution to render at, in [minScale, 1]
+    float getScale() const { return enabled ? scale : 1.0f; }
+    // Fraction of the step budget to march with, in [minStepScale, 1]
+    float getStepScale() const { return enabled ? stepScale : 1.0f; }
+    // Smoothed GPU time of recent frames in milliseconds
+    float getFrameTime() const { return frameTimeMs; }
+
+    // Delete the queries; needs the context, like ShaderCache::clear
+    void release();
+};
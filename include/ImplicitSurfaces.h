@@ -5,6 +5,7 @@
 #include <algorithm>
 #include <functional>
 #include <cmath>
+#include <limits>
 
 // 3D vector class with templated type
 template<typename T = double>
@@ -50,19 +51,140 @@ public:
     T dot(const Vec3<T>& other) const {
         return x * other.x + y * other.y + z * other.z;
     }
+
+    // Cross product
+    Vec3<T> cross(const Vec3<T>& other) const {
+        return Vec3<T>(y * other.z - z * other.y, z * other.x - x * other.z, x * other.y - y * other.x);
+    }
+};
+
+// Closed range of function values [lower, upper]
+struct Interval {
+    double lower, upper;
+
+    Interval() : lower(0), upper(0) {}
+    Interval(double lower, double upper) : lower(lower), upper(upper) {}
+
+    bool contains(double value) const { return lower <= value && value <= upper; }
+    Interval operator-() const { return Interval(-upper, -lower); }
+};
+
+// Axis-aligned bounding box, possibly unbounded along some axes
+struct AABB {
+    Vec3<double> min, max;
+
+    // Default box covers all of space
+    AABB() : AABB(infinite()) {}
+    AABB(const Vec3<double>& min, const Vec3<double>& max) : min(min), max(max) {}
+
+    static AABB infinite() {
+        const double inf = std::numeric_limits<double>::infinity();
+        return AABB(Vec3<double>(-inf, -inf, -inf), Vec3<double>(inf, inf, inf));
+    }
+
+    static AABB around(const Vec3<double>& center, const Vec3<double>& halfExtent) {
+        return AABB(center - halfExtent, center + halfExtent);
+    }
+
+    Vec3<double> center() const { return (min + max) * 0.5; }
+    Vec3<double> halfExtent() const { return (max - min) * 0.5; }
+
+    double volume() const {
+        return std::max(max.x - min.x, 0.0) * std::max(max.y - min.y, 0.0) * std::max(max.z - min.z, 0.0);
+    }
+
+    bool isFinite() const {
+        return std::isfinite(min.x) && std::isfinite(min.y) && std::isfinite(min.z) &&
+               std::isfinite(max.x) && std::isfinite(max.y) && std::isfinite(max.z);
+    }
+
+    AABB unite(const AABB& other) const {
+        return AABB(Vec3<double>(std::min(min.x, other.min.x), std::min(min.y, other.min.y), std::min(min.z, other.min.z)),
+                    Vec3<double>(std::max(max.x, other.max.x), std::max(max.y, other.max.y), std::max(max.z, other.max.z)));
+    }
+
+    AABB intersect(const AABB& other) const {
+        return AABB(Vec3<double>(std::max(min.x, other.min.x), std::max(min.y, other.min.y), std::max(min.z, other.min.z)),
+                    Vec3<double>(std::min(max.x, other.max.x), std::min(max.y, other.max.y), std::min(max.z, other.max.z)));
+    }
+
+    AABB expand(double amount) const {
+        Vec3<double> offset(amount, amount, amount);
+        return AABB(min - offset, max + offset);
+    }
+
+    bool contains(const Vec3<double>& point) const {
+        return point.x >= min.x && point.x <= max.x && point.y >= min.y &&
+               point.y <= max.y && point.z >= min.z && point.z <= max.z;
+    }
+
+    // Euclidean distance from a point to the box (0 inside)
+    double distance(const Vec3<double>& point) const {
+        double dx = std::max(std::max(min.x - point.x, point.x - max.x), 0.0);
+        double dy = std::max(std::max(min.y - point.y, point.y - max.y), 0.0);
+        double dz = std::max(std::max(min.z - point.z, point.z - max.z), 0.0);
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
+
+    // Smallest Euclidean distance between any two points of the boxes (0 if they overlap)
+    double distance(const AABB& other) const {
+        double dx = std::max(std::max(min.x - other.max.x, other.min.x - max.x), 0.0);
+        double dy = std::max(std::max(min.y - other.max.y, other.min.y - max.y), 0.0);
+        double dz = std::max(std::max(min.z - other.max.z, other.min.z - max.z), 0.0);
+        return std::sqrt(dx * dx + dy * dy + dz * dz);
+    }
 };
 
 // Implicit surface base class
 class ImplicitSurface {
+protected:
+    // Conservative bounds computed at construction. Every node guarantees that
+    // evaluate(p) >= bounds.distance(p) for points outside the box, so the
+    // surface and its interior lie inside it and the distance to the box is a
+    // lower bound of the field there.
+    AABB bounds;
+
+    // Interval of a child over a region, skipping the child entirely when the
+    // region lies outside its bounds (only the lower bound is then known)
+    static Interval boundedInterval(const ImplicitSurface& child, const AABB& region) {
+        double gap = child.bounds.distance(region);
+        if (gap > 0.0) {
+            return Interval(gap, std::numeric_limits<double>::infinity());
+        }
+        return child.evaluateInterval(region);
+    }
+
 public:
     virtual ~ImplicitSurface() = default;
 
+    const AABB& getBounds() const { return bounds; }
+
+    // Conservative range of the function over an axis-aligned region. The
+    // default assumes a 1-Lipschitz field (true for all exact and smooth
+    // CSG distance fields here): f(center) +/- half the region diagonal.
+    virtual Interval evaluateInterval(const AABB& region) const {
+        double value = evaluate(region.center());
+        double radius = region.halfExtent().length();
+        return Interval(value - radius, value + radius);
+    }
+
     // Evaluate the implicit function value at point (x,y,z)
     // Negative value indicates inside the object, 0 indicates on the surface, positive value indicates outside the object
     virtual double evaluate(const Vec3<double>& point) const = 0;
 
-    // Calculate the normal (gradient) at a given point
-    virtual Vec3<double> gradient(const Vec3<double>& point) const {
+    // Evaluate many points given in structure-of-arrays layout
+    // (see Tape::evaluateBatch for the vectorized implementation)
+    virtual void evaluateBatch(const double* xs, const double* ys, const double* zs,
+                               double* distances, size_t count) const {
+        for (size_t i = 0; i < count; ++i) {
+            distances[i] = evaluate(Vec3<double>(xs[i], ys[i], zs[i]));
+        }
+    }
+
+    // Evaluate the function value together with its (unnormalized) gradient.
+    // The default uses central differences; primitives and boolean operations
+    // override it with closed forms so a gradient costs a single pass.
+    virtual double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const {
         // Use numerical differentiation to calculate gradient
         const double h = 0.0001; // Small perturbation value
 
@@ -75,7 +197,15 @@ public:
         double dz = evaluate(Vec3<double>(point.x, point.y, point.z + h)) -
                     evaluate(Vec3<double>(point.x, point.y, point.z - h));
 
-        return Vec3<double>(dx, dy, dz).normalize();
+        grad = Vec3<double>(dx, dy, dz) * (0.5 / h);
+        return evaluate(point);
+    }
+
+    // Calculate the normal (normalized gradient) at a given point
+    virtual Vec3<double> gradient(const Vec3<double>& point) const {
+        Vec3<double> grad;
+        evaluateWithGradient(point, grad);
+        return grad.normalize();
     }
 };
 
@@ -87,12 +217,33 @@ private:
 
 public:
     Sphere(const Vec3<double>& center, double radius)
-        : center(center), radius(radius) {}
+        : center(center), radius(radius) {
+        bounds = AABB::around(center, Vec3<double>(radius, radius, radius));
+    }
+
+    // Accessor methods
+    const Vec3<double>& getCenter() const { return center; }
+    double getRadius() const { return radius; }
 
     double evaluate(const Vec3<double>& point) const override {
         Vec3<double> diff = point - center;
         return diff.length() - radius;
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> diff = point - center;
+        double length = diff.length();
+        grad = length > 0.0 ? diff * (1.0 / length) : Vec3<double>(0.0, 1.0, 0.0);
+        return length - radius;
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        // Nearest and farthest points of the region from the center
+        Vec3<double> far(std::max(std::abs(region.min.x - center.x), std::abs(region.max.x - center.x)),
+                         std::max(std::abs(region.min.y - center.y), std::abs(region.max.y - center.y)),
+                         std::max(std::abs(region.min.z - center.z), std::abs(region.max.z - center.z)));
+        return Interval(region.distance(center) - radius, far.length() - radius);
+    }
 };
 
 // Box implicit surface (using smooth approximation)
@@ -104,7 +255,14 @@ private:
 
 public:
     Box(const Vec3<double>& center, const Vec3<double>& dimensions, double smoothing = 0.1)
-        : center(center), dimensions(dimensions), smoothing(smoothing) {}
+        : center(center), dimensions(dimensions), smoothing(smoothing) {
+        bounds = AABB::around(center, dimensions).expand(std::max(smoothing, 0.0));
+    }
+
+    // Accessor methods
+    const Vec3<double>& getCenter() const { return center; }
+    const Vec3<double>& getDimensions() const { return dimensions; }
+    double getSmoothing() const { return smoothing; }
 
     double evaluate(const Vec3<double>& point) const override {
         Vec3<double> d = Vec3<double>(
@@ -116,6 +274,47 @@ public:
         Vec3<double> dMax = Vec3<double>(std::max(d.x, 0.0), std::max(d.y, 0.0), std::max(d.z, 0.0));
         return dMax.length() + std::min(std::max(d.x, std::max(d.y, d.z)), 0.0) - smoothing;
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> w = point - center;
+        Vec3<double> s(w.x < 0.0 ? -1.0 : 1.0, w.y < 0.0 ? -1.0 : 1.0, w.z < 0.0 ? -1.0 : 1.0);
+        Vec3<double> d(std::abs(w.x) - dimensions.x, std::abs(w.y) - dimensions.y, std::abs(w.z) - dimensions.z);
+        double g = std::max(d.x, std::max(d.y, d.z));
+
+        if (g > 0.0) {
+            // Outside: gradient points from the closest box point
+            Vec3<double> q(std::max(d.x, 0.0), std::max(d.y, 0.0), std::max(d.z, 0.0));
+            double length = q.length();
+            grad = Vec3<double>(s.x * q.x, s.y * q.y, s.z * q.z) * (1.0 / length);
+            return length - smoothing;
+        }
+
+        // Inside: gradient is the normal of the closest face
+        if (d.x >= d.y && d.x >= d.z) grad = Vec3<double>(s.x, 0.0, 0.0);
+        else if (d.y >= d.z) grad = Vec3<double>(0.0, s.y, 0.0);
+        else grad = Vec3<double>(0.0, 0.0, s.z);
+        return g - smoothing;
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        // Interval version of evaluate(): per-axis |p - c| - dimensions
+        auto axis = [](double lo, double hi, double c, double half) {
+            double a = lo - c, b = hi - c;
+            double nearest = (a <= 0.0 && b >= 0.0) ? 0.0 : std::min(std::abs(a), std::abs(b));
+            return Interval(nearest - half, std::max(std::abs(a), std::abs(b)) - half);
+        };
+        Interval dx = axis(region.min.x, region.max.x, center.x, dimensions.x);
+        Interval dy = axis(region.min.y, region.max.y, center.y, dimensions.y);
+        Interval dz = axis(region.min.z, region.max.z, center.z, dimensions.z);
+
+        auto outside = [](double x, double y, double z) {
+            return Vec3<double>(std::max(x, 0.0), std::max(y, 0.0), std::max(z, 0.0)).length();
+        };
+        double inLower = std::min(std::max(dx.lower, std::max(dy.lower, dz.lower)), 0.0);
+        double inUpper = std::min(std::max(dx.upper, std::max(dy.upper, dz.upper)), 0.0);
+        return Interval(outside(dx.lower, dy.lower, dz.lower) + inLower - smoothing,
+                        outside(dx.upper, dy.upper, dz.upper) + inUpper - smoothing);
+    }
 };
 
 // Plane implicit surface
@@ -128,9 +327,29 @@ public:
     Plane(const Vec3<double>& normal, double distance)
         : normal(normal.normalize()), distance(distance) {}
 
+    // Accessor methods
+    const Vec3<double>& getNormal() const { return normal; }
+    double getDistance() const { return distance; }
+
     double evaluate(const Vec3<double>& point) const override {
         return normal.dot(point) + distance;
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        grad = normal;
+        return normal.dot(point) + distance;
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        // Linear function: extremes are at the corners picked per axis by the normal's sign
+        auto term = [](double n, double lo, double hi) {
+            return n >= 0.0 ? Interval(n * lo, n * hi) : Interval(n * hi, n * lo);
+        };
+        Interval x = term(normal.x, region.min.x, region.max.x);
+        Interval y = term(normal.y, region.min.y, region.max.y);
+        Interval z = term(normal.z, region.min.z, region.max.z);
+        return Interval(x.lower + y.lower + z.lower + distance, x.upper + y.upper + z.upper + distance);
+    }
 };
 
 // Cylinder implicit surface
@@ -141,7 +360,16 @@ private:
 
 public:
     Cylinder(const Vec3<double>& start, const Vec3<double>& end, double radius)
-        : start(start), end(end), radius(radius) {}
+        : start(start), end(end), radius(radius) {
+        Vec3<double> r(radius, radius, radius);
+        bounds = AABB(Vec3<double>(std::min(start.x, end.x), std::min(start.y, end.y), std::min(start.z, end.z)) - r,
+                      Vec3<double>(std::max(start.x, end.x), std::max(start.y, end.y), std::max(start.z, end.z)) + r);
+    }
+
+    // Accessor methods
+    const Vec3<double>& getStart() const { return start; }
+    const Vec3<double>& getEnd() const { return end; }
+    double getRadius() const { return radius; }
 
     double evaluate(const Vec3<double>& point) const override {
         Vec3<double> axis = end - start;
@@ -155,6 +383,22 @@ public:
         Vec3<double> closestPoint = start + axis * dot;
         return (point - closestPoint).length() - radius;
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> axis = end - start;
+        double length = axis.length();
+        axis = axis.normalize();
+
+        Vec3<double> relativePos = point - start;
+        double dot = std::max(0.0, std::min(length, relativePos.dot(axis)));
+
+        // The offset from the closest axis point is perpendicular to the axis
+        // (or radial from an end point), so it is the gradient direction
+        Vec3<double> offset = point - (start + axis * dot);
+        double distanceToAxis = offset.length();
+        grad = distanceToAxis > 0.0 ? offset * (1.0 / distanceToAxis) : Vec3<double>(0.0, 1.0, 0.0);
+        return distanceToAxis - radius;
+    }
 };
 
 // Boolean operation class - CSG operations
@@ -168,45 +412,148 @@ public:
                     std::shared_ptr<ImplicitSurface> right)
         : left(left), right(right) {}
 
+    static AABB boundsOf(const std::shared_ptr<ImplicitSurface>& surface) {
+        return surface ? surface->getBounds() : AABB::infinite();
+    }
+
+    // Bounds for an intersection-like result: the result lies inside both
+    // operands, and its field is at least each operand's field, so the
+    // tighter operand box keeps the lower-bound guarantee
+    static AABB tighterBounds(const AABB& a, const AABB& b) {
+        return a.volume() <= b.volume() ? a : b;
+    }
+
     // Accessor methods
     std::shared_ptr<ImplicitSurface> getLeft() const { return left; }
     std::shared_ptr<ImplicitSurface> getRight() const { return right; }
+
+protected:
+    // Value and gradient of the cubic smooth minimum (or maximum) of two fields.
+    // The gradient blends the selected operand with the other one by h^2 / 2.
+    static double smoothCombine(double a, const Vec3<double>& gradA, double b, const Vec3<double>& gradB,
+                                double k, bool maximum, Vec3<double>& grad) {
+        bool selectA = maximum ? a >= b : a <= b;
+        double h = std::max(k - std::abs(a - b), 0.0) / k;
+        double w = 0.5 * h * h;
+        const Vec3<double>& selected = selectA ? gradA : gradB;
+        const Vec3<double>& other = selectA ? gradB : gradA;
+        grad = selected * (1.0 - w) + other * w;
+
+        double correction = h * h * h * k * (1.0 / 6.0);
+        return maximum ? std::max(a, b) + correction : std::min(a, b) - correction;
+    }
+
+    // Interval of the cubic smooth minimum (or maximum). The blend adds at most
+    // k / 6, and nothing when the operand ranges are at least k apart.
+    static Interval smoothInterval(const Interval& a, const Interval& b, double k, bool maximum) {
+        bool separated = a.lower - b.upper >= k || b.lower - a.upper >= k;
+        double correction = separated ? 0.0 : std::max(k, 0.0) / 6.0;
+        if (maximum) {
+            return Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper) + correction);
+        }
+        return Interval(std::min(a.lower, b.lower) - correction, std::min(a.upper, b.upper));
+    }
 };
 
 // Union operation
 class UnionOp : public BooleanOperation {
 public:
-    using BooleanOperation::BooleanOperation;
+    UnionOp(std::shared_ptr<ImplicitSurface> left, std::shared_ptr<ImplicitSurface> right)
+        : BooleanOperation(left, right) {
+        bounds = boundsOf(left).unite(boundsOf(right));
+    }
 
     double evaluate(const Vec3<double>& point) const override {
-        double leftVal = left->evaluate(point);
-        double rightVal = right->evaluate(point);
+        // Evaluate the nearer operand first; the other one is skipped when its
+        // bounding box is already farther away than the first result
+        double leftGap = left->getBounds().distance(point);
+        double rightGap = right->getBounds().distance(point);
+        const ImplicitSurface& first = leftGap <= rightGap ? *left : *right;
+        const ImplicitSurface& second = leftGap <= rightGap ? *right : *left;
+        double secondGap = std::max(leftGap, rightGap);
+
+        double firstVal = first.evaluate(point);
+        if (secondGap > 0.0 && firstVal <= secondGap) {
+            return firstVal;
+        }
+        return std::min(firstVal, second.evaluate(point));
+    }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = right->evaluateWithGradient(point, rightGrad);
+        grad = leftVal <= rightVal ? leftGrad : rightGrad;
         return std::min(leftVal, rightVal);
     }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        Interval b = boundedInterval(*right, region);
+        return Interval(std::min(a.lower, b.lower), std::min(a.upper, b.upper));
+    }
 };
 
 // Intersection operation
 class IntersectionOp : public BooleanOperation {
 public:
-    using BooleanOperation::BooleanOperation;
+    IntersectionOp(std::shared_ptr<ImplicitSurface> left, std::shared_ptr<ImplicitSurface> right)
+        : BooleanOperation(left, right) {
+        bounds = tighterBounds(boundsOf(left), boundsOf(right));
+    }
 
     double evaluate(const Vec3<double>& point) const override {
         double leftVal = left->evaluate(point);
         double rightVal = right->evaluate(point);
         return std::max(leftVal, rightVal);
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = right->evaluateWithGradient(point, rightGrad);
+        grad = leftVal >= rightVal ? leftGrad : rightGrad;
+        return std::max(leftVal, rightVal);
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        Interval b = boundedInterval(*right, region);
+        return Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper));
+    }
 };
 
 // Difference operation
 class DifferenceOp : public BooleanOperation {
 public:
-    using BooleanOperation::BooleanOperation;
+    // The result lies inside the left operand and its field is at least the left field
+    DifferenceOp(std::shared_ptr<ImplicitSurface> left, std::shared_ptr<ImplicitSurface> right)
+        : BooleanOperation(left, right) {
+        bounds = boundsOf(left);
+    }
 
     double evaluate(const Vec3<double>& point) const override {
         double leftVal = left->evaluate(point);
         double rightVal = right->evaluate(point);
         return std::max(leftVal, -rightVal);
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = right->evaluateWithGradient(point, rightGrad);
+        grad = leftVal >= -rightVal ? leftGrad : rightGrad * -1.0;
+        return std::max(leftVal, -rightVal);
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        if (a.lower > 0.0 && std::isinf(a.upper)) {
+            return a; // Region is outside the left operand's bounds, the right side cannot matter
+        }
+        Interval b = -boundedInterval(*right, region);
+        return Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper));
+    }
 };
 
 // Smooth boolean operations - CSG operations with smooth transitions
@@ -219,15 +566,40 @@ public:
     SmoothUnionOp(std::shared_ptr<ImplicitSurface> left,
                  std::shared_ptr<ImplicitSurface> right,
                  double smoothFactor = 0.1)
-        : BooleanOperation(left, right), k(smoothFactor) {}
+        : BooleanOperation(left, right), k(smoothFactor) {
+        // The blend lowers the field by at most k / 6
+        bounds = boundsOf(left).unite(boundsOf(right)).expand(std::max(k, 0.0) / 6.0);
+    }
+
+    double getSmoothFactor() const { return k; }
 
     double evaluate(const Vec3<double>& point) const override {
         double leftVal = left->evaluate(point);
+
+        // Outside the blend band the result is exactly the left operand
+        double rightGap = right->getBounds().distance(point);
+        if (rightGap > 0.0 && leftVal <= rightGap - std::max(k, 0.0)) {
+            return leftVal;
+        }
+
         double rightVal = right->evaluate(point);
 
         double h = std::max(k - std::abs(leftVal - rightVal), 0.0) / k;
         return std::min(leftVal, rightVal) - h * h * h * k * (1.0/6.0);
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = right->evaluateWithGradient(point, rightGrad);
+        return smoothCombine(leftVal, leftGrad, rightVal, rightGrad, k, false, grad);
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        Interval b = boundedInterval(*right, region);
+        return smoothInterval(a, b, k, false);
+    }
 };
 
 // Smooth intersection
@@ -239,7 +611,11 @@ public:
     SmoothIntersectionOp(std::shared_ptr<ImplicitSurface> left,
                         std::shared_ptr<ImplicitSurface> right,
                         double smoothFactor = 0.1)
-        : BooleanOperation(left, right), k(smoothFactor) {}
+        : BooleanOperation(left, right), k(smoothFactor) {
+        bounds = tighterBounds(boundsOf(left), boundsOf(right));
+    }
+
+    double getSmoothFactor() const { return k; }
 
     double evaluate(const Vec3<double>& point) const override {
         double leftVal = left->evaluate(point);
@@ -248,6 +624,19 @@ public:
         double h = std::max(k - std::abs(leftVal - rightVal), 0.0) / k;
         return std::max(leftVal, rightVal) + h * h * h * k * (1.0/6.0);
     }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = right->evaluateWithGradient(point, rightGrad);
+        return smoothCombine(leftVal, leftGrad, rightVal, rightGrad, k, true, grad);
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        Interval b = boundedInterval(*right, region);
+        return smoothInterval(a, b, k, true);
+    }
 };
 
 // Smooth difference
@@ -259,7 +648,11 @@ public:
     SmoothDifferenceOp(std::shared_ptr<ImplicitSurface> left,
                       std::shared_ptr<ImplicitSurface> right,
                       double smoothFactor = 0.1)
-        : BooleanOperation(left, right), k(smoothFactor) {}
+        : BooleanOperation(left, right), k(smoothFactor) {
+        bounds = boundsOf(left);
+    }
+
+    double getSmoothFactor() const { return k; }
 
     double evaluate(const Vec3<double>& point) const override {
         double leftVal = left->evaluate(point);
@@ -268,4 +661,143 @@ public:
         double h = std::max(k - std::abs(leftVal - rightVal), 0.0) / k;
         return std::max(leftVal, rightVal) + h * h * h * k * (1.0/6.0);
     }
-};
\ No newline at end of file
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> leftGrad, rightGrad;
+        double leftVal = left->evaluateWithGradient(point, leftGrad);
+        double rightVal = -right->evaluateWithGradient(point, rightGrad);
+        return smoothCombine(leftVal, leftGrad, rightVal, rightGrad * -1.0, k, true, grad);
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval a = boundedInterval(*left, region);
+        if (a.lower > 0.0 && std::isinf(a.upper)) {
+            return a;
+        }
+        Interval b = -boundedInterval(*right, region);
+        return smoothInterval(a, b, k, true);
+    }
+};
+
+// Rigid motion with uniform scale: parent = translation + scale * rotation * local.
+// The rotation is stored by rows and must be orthonormal; the scale must be positive.
+struct Transform {
+    Vec3<double> translation;
+    Vec3<double> rotation[3];
+    double scale;
+
+    Transform() : translation(), rotation{ Vec3<double>(1, 0, 0), Vec3<double>(0, 1, 0), Vec3<double>(0, 0, 1) }, scale(1.0) {}
+
+    static Transform translate(const Vec3<double>& offset) {
+        Transform t;
+        t.translation = offset;
+        return t;
+    }
+
+    // Rotation by angle (radians) around an axis through the origin
+    static Transform rotate(const Vec3<double>& axis, double angle) {
+        Vec3<double> u = axis.normalize();
+        double c = std::cos(angle), s = std::sin(angle), t = 1.0 - c;
+        Transform r;
+        r.rotation[0] = Vec3<double>(t * u.x * u.x + c, t * u.x * u.y - s * u.z, t * u.x * u.z + s * u.y);
+        r.rotation[1] = Vec3<double>(t * u.x * u.y + s * u.z, t * u.y * u.y + c, t * u.y * u.z - s * u.x);
+        r.rotation[2] = Vec3<double>(t * u.x * u.z - s * u.y, t * u.y * u.z + s * u.x, t * u.z * u.z + c);
+        return r;
+    }
+
+    static Transform uniformScale(double factor) {
+        Transform t;
+        t.scale = factor;
+        return t;
+    }
+
+    // Rotate a direction into the parent frame
+    Vec3<double> rotateToParent(const Vec3<double>& v) const {
+        return Vec3<double>(rotation[0].dot(v), rotation[1].dot(v), rotation[2].dot(v));
+    }
+
+    // Rotate a direction into the local frame (by the transposed rotation)
+    Vec3<double> rotateToLocal(const Vec3<double>& v) const {
+        return rotation[0] * v.x + rotation[1] * v.y + rotation[2] * v.z;
+    }
+
+    Vec3<double> toParent(const Vec3<double>& point) const {
+        return translation + rotateToParent(point) * scale;
+    }
+
+    Vec3<double> toLocal(const Vec3<double>& point) const {
+        return rotateToLocal(point - translation) * (1.0 / scale);
+    }
+
+    // Apply other first, then this transform
+    Transform operator*(const Transform& other) const {
+        Transform result;
+        for (int i = 0; i < 3; ++i) {
+            const Vec3<double>& row = rotation[i];
+            result.rotation[i] = other.rotation[0] * row.x + other.rotation[1] * row.y + other.rotation[2] * row.z;
+        }
+        result.translation = toParent(other.translation);
+        result.scale = scale * other.scale;
+        return result;
+    }
+
+    // Box enclosing a local box after mapping it into the parent frame, and back
+    AABB toParent(const AABB& local) const {
+        if (!local.isFinite()) return AABB::infinite();
+        Vec3<double> h = local.halfExtent();
+        return AABB::around(toParent(local.center()), absRotate(h, false) * scale);
+    }
+
+    AABB toLocal(const AABB& parent) const {
+        if (!parent.isFinite()) return AABB::infinite();
+        Vec3<double> h = parent.halfExtent();
+        return AABB::around(toLocal(parent.center()), absRotate(h, true) * (1.0 / scale));
+    }
+
+private:
+    // Half extent of a rotated box: |R| h (or |R^T| h)
+    Vec3<double> absRotate(const Vec3<double>& h, bool transposed) const {
+        auto entry = [&](int i, int j) {
+            const Vec3<double>& row = rotation[transposed ? j : i];
+            int k = transposed ? i : j;
+            return std::abs(k == 0 ? row.x : (k == 1 ? row.y : row.z));
+        };
+        return Vec3<double>(entry(0, 0) * h.x + entry(0, 1) * h.y + entry(0, 2) * h.z,
+                            entry(1, 0) * h.x + entry(1, 1) * h.y + entry(1, 2) * h.z,
+                            entry(2, 0) * h.x + entry(2, 1) * h.y + entry(2, 2) * h.z);
+    }
+};
+
+// Instance of a subtree under a transform. Several instances can share one
+// child, so a repeated component is stored (and compiled) once.
+class TransformOp : public ImplicitSurface {
+private:
+    std::shared_ptr<ImplicitSurface> child;
+    Transform transform;
+
+public:
+    TransformOp(std::shared_ptr<ImplicitSurface> child, const Transform& transform)
+        : child(child), transform(transform) {
+        bounds = child ? transform.toParent(child->getBounds()) : AABB::infinite();
+    }
+
+    std::shared_ptr<ImplicitSurface> getChild() const { return child; }
+    const Transform& getTransform() const { return transform; }
+
+    // Distances scale with the transform, so the field stays a distance field
+    double evaluate(const Vec3<double>& point) const override {
+        return transform.scale * child->evaluate(transform.toLocal(point));
+    }
+
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& grad) const override {
+        Vec3<double> localGrad;
+        double value = child->evaluateWithGradient(transform.toLocal(point), localGrad);
+        grad = transform.rotateToParent(localGrad);
+        return transform.scale * value;
+    }
+
+    Interval evaluateInterval(const AABB& region) const override {
+        Interval local = boundedInterval(*child, transform.toLocal(region));
+        return Interval(local.lower * transform.scale, local.upper * transform.scale);
+    }
+};
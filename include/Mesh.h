@@ -0,0 +1,21 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Indexed triangle mesh with per-vertex normals
+struct Mesh {
+    std::vector<Vec3<float>> vertices;
+    std::vector<Vec3<float>> normals;
+    std::vector<uint32_t> indices; // Three per triangle, counter-clockwise seen from outside
+
+    size_t getTriangleCount() const { return indices.size() / 3; }
+    bool empty() const { return indices.empty(); }
+
+    // Wavefront OBJ with normals; returns false if the file could not be written
+    bool writeOBJ(const std::string& path) const;
+    // Binary STL (facet normals are recomputed from the triangles)
+    bool writeSTL(const std::string& path) const;
+};
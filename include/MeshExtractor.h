@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "Mesh.h"
+#include "Tape.h"
+#include "ThreadPool.h"
+#include <memory>
+
+// Dual contouring of an implicit surface into a watertight indexed mesh.
+//
+// The region is divided into bricks of brickCells^3 cells. An octree over the
+// bricks discards every subtree that interval arithmetic proves to be entirely
+// inside or outside, so only bricks that the surface may cross are sampled;
+// all sampled cells share one resolution, which keeps the mesh free of cracks.
+// Each cell with a sign change gets one vertex minimizing the quadratic error
+// of the tangent planes at its edge crossings (positions from linear
+// interpolation, normals from the analytic gradient), and every crossing edge
+// emits a quad joining the four cells around it.
+//
+// Bricks are processed in parallel on a work-stealing ThreadPool. Each brick
+// writes into its own vertex and index arrays, which are concatenated in
+// brick order at the end, so the output does not depend on thread timing.
+class MeshExtractor {
+public:
+    static constexpr int brickCells = 8;
+
+    struct Settings {
+        int resolution = 128;    // Cells along the longest axis of the region
+        double regularization = 0.05; // Pull of the QEF towards the mass point
+    };
+
+    MeshExtractor();
+    explicit MeshExtractor(const Settings& settings);
+
+    void setThreadPool(ThreadPool* threadPool) { pool = threadPool; }
+
+    // Mesh a surface inside its own bounds. Unbounded surfaces produce an empty mesh.
+    Mesh extract(const std::shared_ptr<const ImplicitSurface>& surface) const;
+
+    // Mesh a tape inside a region; the surface is clipped open where it leaves the region
+    Mesh extract(const Tape& tape, const AABB& region) const;
+
+private:
+    Settings settings;
+    ThreadPool* pool;
+};
@@ -0,0 +1,138 @@
+﻿#pragma once
+
+#include <GL/glew.h>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Per-frame CPU and GPU stage timings of ImplicitRenderer. CPU stages are
+// timed with a steady clock around scopes; GPU stages with pairs of
+// GL_TIMESTAMP queries, which nest and, unlike GL_TIME_ELAPSED, do not collide
+// with the frame query of DynamicResolution. Frames wait in a small ring until
+// the GPU has finished them, so profiling does not stall the pipeline, and are
+// then reported and optionally appended to a file as one JSON object per line.
+//
+// CPU scopes outside a frame (scene builds, shader compiles) are reported
+// with the next frame. Step statistics come from the StepCounters buffer of
+// raymarch.glsl, which needs OpenGL 4.3 and USE_ADVANCED_OPENGL.
+class Profiler {
+public:
+    static constexpr int stepHistogramBins = 16;   // Bins of maxSteps / 16 steps, see raymarch.glsl
+    static constexpr GLuint stepCounterBinding = 1; // Shader storage binding of StepCounters
+
+    struct Stage {
+        std::string name;
+        double milliseconds;
+    };
+
+    // Mirrors the StepCounters block, over the pixels that were marched
+    struct StepStatistics {
+        uint32_t pixels;
+        uint32_t totalSteps;
+        uint32_t maxSteps;
+        uint32_t histogram[stepHistogramBins];
+    };
+
+    struct FrameReport {
+        uint64_t frame = 0;
+        std::vector<Stage> cpu;
+        std::vector<Stage> gpu;
+        bool hasSteps = false;
+        StepStatistics steps = {};
+
+        double cpuTime(const std::string& name) const;
+        double gpuTime(const std::string& name) const;
+        double meanSteps() const { return steps.pixels ? double(steps.totalSteps) / steps.pixels : 0.0; }
+    };
+
+    // Times its lifetime as a CPU stage; does nothing while profiling is off
+    class CpuScope {
+    public:
+        CpuScope(Profiler& profiler, const char* name);
+        ~CpuScope();
+        CpuScope(const CpuScope&) = delete;
+        CpuScope& operator=(const CpuScope&) = delete;
+    private:
+        Profiler& profiler;
+        const char* name;
+        std::chrono::steady_clock::time_point start;
+        bool active;
+    };
+
+    // Times the GPU commands issued during its lifetime; needs an open frame
+    class GpuScope {
+    public:
+        GpuScope(Profiler& profiler, const char* name);
+        ~GpuScope();
+        GpuScope(const GpuScope&) = delete;
+        GpuScope& operator=(const GpuScope&) = delete;
+    private:
+        Profiler& profiler;
+        int stage;
+    };
+
+    Profiler();
+    ~Profiler();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const { return enabled; }
+
+    // Append every report to this file as JSON Lines; empty stops writing
+    bool setOutputFile(const std::string& path);
+
+    // Collect step statistics into the StepCounters buffer of each frame.
+    // Returns false where shader storage buffers are unavailable.
+    bool setStepCounters(bool enable);
+    bool hasStepCounters() const { return stepCounters; }
+
+    void beginFrame();
+    void endFrame();
+    // Wait for the GPU and report every frame still in the ring
+    void finish();
+    void addCpuTime(const char* name, double milliseconds);
+
+    // Most recently completed frame
+    const FrameReport& getLastReport() const { return lastReport; }
+    // Called with every report as it completes, in frame order
+    void setListener(std::function<void(const FrameReport&)> callback) { listener = std::move(callback); }
+    static std::string toJSON(const FrameReport& report);
+
+    // Delete the queries and buffers; needs the context, like ShaderCache::clear
+    void release();
+
+private:
+    static constexpr int frameRingSize = 4;
+
+    struct GpuStage {
+        const char* name;
+        size_t query; // Index of the first query of the pair in the frame's pool
+    };
+
+    struct Frame {
+        bool open = false;
+        bool pending = false;
+        uint64_t index = 0;
+        std::vector<Stage> cpu;
+        std::vector<GpuStage> gpu;
+        std::vector<GLuint> queries; // Pool reused by every frame in this slot
+        size_t usedQueries = 0;
+        GLuint stepBuffer = 0;
+    };
+
+    bool enabled;
+    bool stepCounters;
+    Frame frames[frameRingSize];
+    int current;          // Slot of the open frame
+    uint64_t frameCount;
+    std::vector<Stage> earlyCpu; // CPU stages timed outside a frame
+    FrameReport lastReport;
+    std::ofstream output;
+    std::function<void(const FrameReport&)> listener;
+
+    int beginGpu(const char* name);
+    void endGpu(int stage);
+    void resolve(Frame& frame, bool wait);
+};
@@ -1,6 +1,19 @@
 ﻿#pragma once
 
 #include "ImplicitSurfaces.h"
+#include "ShaderGenerator.h"
+#include "ShaderCache.h"
+#include "SceneBVH.h"
+#include "DistanceField.h"
+#include "DynamicResolution.h"
+#include "Profiler.h"
+#include "SceneEditor.h"
+#include "ShadowVolume.h"
+#ifdef USE_ADVANCED_OPENGL
+#include "ComputeMarcher.h"
+#endif
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <memory>
 #include <string> // Add string header
@@ -10,16 +23,251 @@
 #include <sstream>
 #include <iostream>
 
+// Sphere tracing variants of the fragment shader's rayMarch
+enum class MarchingStrategy {
+    SphereTracing, // Step by the distance bound
+    OverRelaxed    // Step by a multiple of it while consecutive spheres overlap
+};
+
+// Pipeline that marches the primary rays
+enum class RenderBackend {
+    Fragment, // Fullscreen rectangle through fragment.frag
+    Compute   // compute_march.comp, needs USE_ADVANCED_OPENGL and OpenGL 4.3
+};
+
+// Reuse of the previous window frame by reprojection (fragment.frag). Every
+// frame re-marches a rotating quarter of the pixels in a 2x2 checkerboard, any
+// pixel whose previous surface sample cannot be validated and any color that
+// has been reused for several frames.
+enum class TemporalMode {
+    Off,
+    ReuseColor, // Valid pixels keep the previous frame's color
+    ReuseDepth  // Valid pixels are marched again starting near the reprojected depth
+};
+
+// Use of the tape interpreter (tape_interpreter.glsl), which evaluates any
+// scene on the same precompiled programs instead of generated code
+enum class InterpreterMode {
+    Off,      // Always compile generated code
+    Fallback, // Interpret while generated programs build in the background, or when they fail to build
+    Always    // Interpret every scene
+};
+
+// Camera of one frame of an offscreen batch (see ImplicitRenderer::renderFrames)
+struct CameraPose {
+    Vec3<float> position;
+    Vec3<float> target;
+    Vec3<float> up;
+    float fieldOfView;
+};
+
+// Receives each frame of a batch as tightly packed RGBA8 rows, bottom row first.
+// The pixels are only valid for the duration of the call.
+using FrameConsumer = std::function<void(size_t frame, const unsigned char* pixels, int width, int height)>;
+
 // Renderer for implicit surfaces using ray marching algorithm
 class ImplicitRenderer {
 private:
-    int width, height;
+    int width, height;               // Resolution of the frame being drawn
+    int windowWidth, windowHeight;   // Framebuffer size of the window
     GLFWwindow* window;
-    GLuint programID;
+    GLuint programID;     // Currently bound program, owned by programCache
+    ShaderCache programCache;
     GLuint vao, vbo;
-    GLuint framebufferTexture;
+    GLuint framebufferTexture; // Color target of offscreen batches
+
+    // Per-frame uniform buffer, the std140 FrameParameters block in raymarch.glsl.
+    // Every member is 4 bytes and each vec3 is followed by a scalar, so the
+    // declaration order reproduces the std140 offsets.
+    struct FrameParameters {
+        float cameraPosition[3];
+        float fieldOfView;
+        float cameraTarget[3];
+        float ambientStrength;
+        float cameraUp[3];
+        float maxDistance;
+        float lightPosition[3];
+        float epsilon;
+        float lightColor[3];
+        float overRelaxation;
+        float resolution[2];
+        float pixelFootprint;
+        float lipschitzBound;
+        int32_t maxSteps;
+        int32_t shadowMaxSteps;
+        float shadowSoftness;
+        int32_t coneTileSize;
+        float bakedBoundsMin[3];
+        float bakedVoxelSize;
+        float bakedBoundsMax[3];
+        float bakedExactBand;
+        int32_t bakedBrickGrid[3];
+        int32_t useBakedField;
+        int32_t bakedAtlasBricks[3];
+        int32_t useShadowVolume;
+        float shadowVolumeMin[3];
+        float shadowVolumeOffset;
+        float shadowVolumeMax[3];
+        int32_t useConeDepth;
+        float previousCameraPosition[3];
+        int32_t temporalFrame;
+        float previousCameraTarget[3];
+        int32_t temporalMode;
+        float previousCameraUp[3];
+        float previousFieldOfView;
+        int32_t stepHeatmap;
+        int32_t reserved[3];
+    };
+    static_assert(sizeof(FrameParameters) == 17 * 16, "FrameParameters must match the std140 block");
+
+    static constexpr GLuint frameParameterBinding = 1;
+    GLuint frameParameterBuffer;
+    FrameParameters uploadedFrameParameters; // Buffer contents, for uploading only what changed
+    bool frameParametersUploaded;
+
+    // Program the driver may still be compiling and linking
+    struct ProgramBuild {
+        uint64_t key;
+        GLuint program;
+        std::vector<GLuint> shaders;
+    };
+
+    // Scene parameter uniform buffer (SceneParameters block in the generated code)
+    static constexpr GLuint sceneParameterBinding = 0;
+    GLuint sceneParameterBuffer;
+    GLsizeiptr sceneParameterBufferSize;
+    size_t maxSceneParameterVec4s;
+    // Nodes of sceneEditor's graph in the block (empty when the scene goes through the BVH)
+    std::vector<ShaderGenerator::ParameterBinding> sceneParameterBindings;
+
+    // Bounding volume hierarchy of large scenes, read through buffer textures in scene_bvh.glsl
+    static constexpr GLint bvhNodeTextureUnit = 1;
+    static constexpr GLint bvhItemTextureUnit = 2;
+    SceneBVH sceneBVH;
+    GLuint bvhNodeBuffer, bvhNodeTexture;
+    GLuint bvhItemBuffer, bvhItemTexture;
+
+    // Tape interpreter: sceneTape in a buffer texture, read by programs built from tape_interpreter.glsl
+    static constexpr GLint tapeTextureUnit = 9;
+    InterpreterMode interpreterMode;
+    bool sceneInterpreted;            // The linked programs interpret the tape instead of sceneCode
+    std::vector<ProgramBuild> generatedBuilds; // Programs of sceneCode building while interpreted
+    GLuint tapeBuffer, tapeTexture;
+    std::vector<float> uploadedTape;  // Buffer contents
+
+    // Optional baked distance field of static scenes (baked_sdf.glsl)
+    static constexpr GLint bakedIndexTextureUnit = 3;
+    static constexpr GLint bakedAtlasTextureUnit = 4;
+    bool bakedFieldEnabled;
+    int bakedFieldResolution;
+    DistanceField bakedField;
+    GLuint bakedIndexTexture, bakedAtlasTexture;
+
+    // Shadow rays and the optional visibility volume of static lights and scenes
+    static constexpr GLint shadowVolumeTextureUnit = 6;
+    int shadowMaxSteps;
+    float shadowSoftness;
+    bool shadowVolumeEnabled;
+    int shadowVolumeResolution;
+    ShadowVolume shadowVolume;
+    GLuint shadowVolumeTexture;
+
+    // Optional cone marching pre-pass into a depth target with one texel per tile
+    static constexpr GLint coneDepthTextureUnit = 5;
+    bool conePrepassEnabled;
+    int coneTileSize;
+    GLuint coneProgramID; // Owned by programCache, 0 while disabled
+    GLuint coneFramebuffer, coneDepthTexture;
+    int coneTargetWidth, coneTargetHeight;
+
+    // Offscreen batch rendering with a ring of pixel buffers for readback
+    static constexpr int readbackRingSize = 3;
+    bool headless;
+    GLuint offscreenFramebuffer;
+    int offscreenWidth, offscreenHeight;
+    GLsizeiptr readbackFrameSize; // Bytes per buffer of the ring, allocated by renderFrames only
+    GLuint readbackBuffers[readbackRingSize];
+    GLsync readbackFences[readbackRingSize];
+
+    // Tiled rendering: frames are drawn as scissored tiles, nearest to the center first
+    struct Tile {
+        int x, y, width, height;
+    };
+    int tileSize; // 0 draws frames in one pass
+
+    // Temporal reprojection: window frames are drawn into one of two history
+    // targets (color and ray depth) while the other holds the previous frame
+    static constexpr GLint historyColorTextureUnit = 7;
+    static constexpr GLint historyDepthTextureUnit = 8;
+    TemporalMode temporalMode;
+    GLuint historyFramebuffers[2], historyColorTextures[2], historyDepthTextures[2];
+    int historyWidth, historyHeight;
+    int historyIndex;      // Target of the next frame
+    bool historyValid;     // The other target holds a frame seen from historyPose
+    CameraPose historyPose;
+    int32_t temporalFrame; // Selects the checkerboard quarter that is re-marched
+
+    // Dynamic resolution: window frames drawn at a scale chosen by GPU time and
+    // upscaled to the window, through the history target or this one
+    DynamicResolution dynamicResolution;
+    GLuint upscaleFramebuffer, upscaleTexture;
+    int upscaleWidth, upscaleHeight;
+    float frameStepScale; // Step budget fraction of the frame being drawn
+
+    // Stage timings, step statistics and the window title overlay
+    Profiler profiler;
+    bool stepHeatmap;
+    double overlayTime; // glfwGetTime of the last title update
+
+    RenderBackend renderBackend;
+#ifdef USE_ADVANCED_OPENGL
+    GLuint computeProgramID; // Owned by programCache, 0 unless the compute backend is active
+    ComputeMarcher computeMarcher;
+#endif
+
+    // Full resolution still rendered a few tiles per frame by run()
+    struct StillJob {
+        bool active = false;
+        CameraPose pose = {};
+        int width = 0, height = 0;
+        size_t tilesPerFrame = 1;
+        FrameConsumer consumer;
+        std::vector<Tile> tiles;
+        size_t nextTile = 0;
+    };
+    StillJob still;
 
     std::shared_ptr<ImplicitSurface> scene;
+    SceneEditor sceneEditor;             // The same scene as a graph, for incremental edits
+    Tape sceneTape;                      // Compiled from sceneEditor's graph, for the CPU bakes
+    std::string sceneCode;               // Generated sceneSDF source of the linked program
+    std::vector<float> sceneParameters;  // Current contents of the parameter buffer
+
+    // Scene functions generated for the GPU and the data they read
+    struct GeneratedScene {
+        std::string code;
+        std::vector<float> parameters;
+        std::vector<ShaderGenerator::ParameterBinding> bindings;
+        SceneBVH bvh;
+    };
+
+    // Sources of every program setupShaders builds (cone and compute empty when unused)
+    struct ProgramSources {
+        std::string vertex, fragment, cone, compute;
+    };
+
+    // Scene given to setScene whose programs are built in the background; the
+    // current scene is drawn until every build is complete
+    struct PendingScene {
+        std::shared_ptr<ImplicitSurface> surface;
+        SceneEditor editor;
+        Tape tape;
+        GeneratedScene generated;
+        std::vector<ProgramBuild> builds;
+        bool interpret = false; // Install now and interpret until the generated programs are built
+    };
+    bool asyncShaderCompile;
+    std::unique_ptr<PendingScene> pendingScene;
 
     // Camera parameters - using float instead of double
     Vec3<float> cameraPosition;
@@ -36,29 +284,220 @@ private:
     int maxSteps;
     float maxDistance;
     float epsilon;
+    MarchingStrategy marchingStrategy;
+    float overRelaxation;
+    float pixelFootprintScale; // Hit threshold in pixels (0 uses epsilon only)
+    float lipschitzBound;
 
     bool setupShaders();
+    void prepareInterpreterPrograms();
+    ProgramSources composePrograms(const std::string& code);
+    static GLuint startShader(GLenum type, const std::string& shaderCode);
+    static ProgramBuild startProgram(uint64_t programKey, const std::vector<GLuint>& shaders);
+    static bool isBuildComplete(const ProgramBuild& build);
+    GLuint finishProgram(const ProgramBuild& build);
+    static void cancelProgram(const ProgramBuild& build);
+    GLuint buildProgram(const std::string& vertexShaderCode, const std::string& fragmentShaderCode,
+                        std::vector<ProgramBuild>* background = nullptr);
+#ifdef USE_ADVANCED_OPENGL
+    GLuint buildComputeProgram(const std::string& computeShaderCode, std::vector<ProgramBuild>* background = nullptr);
+#endif
+    void configureProgram(GLuint program);
+    void updateFrameParameters(bool useConeDepth, bool useHistory);
+    bool prepareConeTarget();
+    void renderConePrepass(const Tile* tiles, size_t tileCount);
+    void drawFrame();
+    void beginFrame(bool useHistory = false, const Tile* tiles = nullptr, size_t tileCount = 0);
+    void bindSceneTextures();
+    void drawTile(int x, int y, int tileWidth, int tileHeight);
+    static std::vector<Tile> frameTiles(int frameWidth, int frameHeight, int size);
+    bool prepareHistoryTargets();
+    bool prepareUpscaleTarget();
+    void presentFrame(GLuint framebuffer);
+    std::string profileOverlay() const;
+    void drawTemporalFrame();
+    void progressStill(size_t maxTiles);
+    bool prepareOffscreenTarget(int targetWidth, int targetHeight);
     bool setupBuffers();
     std::string loadShaderFile(const std::string& filePath); // New helper function
     std::string getShaderPath(const std::string& shaderFile); // Helper function to find shader paths
-    std::string generateSceneSDFCode();
+    GeneratedScene generateScene(const std::shared_ptr<const ImplicitSurface>& surface, const SceneEditor& editor,
+                                 const SceneBVH* refit = nullptr);
+    void installScene(GeneratedScene& generated, bool background = false);
+    void setupScenePrograms(bool background);
+    void startProgramBuilds(const ProgramSources& sources, std::vector<ProgramBuild>& builds);
+    bool backgroundCompileAvailable() const;
+    void finishGeneratedBuilds(bool wait);
+    void cancelGeneratedBuilds();
+    void applyPendingScene(bool wait);
+    void cancelPendingScene();
+    void uploadSceneTape();
+    void uploadSceneParameters(const std::vector<float>& previous);
+    bool patchSceneParameters(const std::vector<NodeHandle>& nodes);
+    void uploadSceneBVH(const std::vector<float>& previousNodes, const std::vector<float>& previousItems);
+    void bakeSceneField();
+    void updateSceneField(const SceneEditor::Changes& changes);
+    void bakeShadowVolume();
+    void updateShadowVolume(const SceneEditor::Changes& changes);
 
 public:
     ImplicitRenderer(int width = 800, int height = 600);
     ~ImplicitRenderer();
 
+    // Create a hidden window without vsync, for batch rendering only.
+    // Must be called before initialize.
+    void setHeadless(bool enabled) { headless = enabled; }
+    bool isHeadless() const { return headless; }
+
     bool initialize();
+    // Set the scene to render. Scenes with the same topology as the current
+    // one only update the parameter buffer and do not recompile the shader.
+    // Window renderers compile new programs in the background where the
+    // driver supports it (see setAsyncShaderCompile).
     void setScene(std::shared_ptr<ImplicitSurface> scene);
+    // The scene last given to setScene, which may still be waiting for its programs
+    std::shared_ptr<ImplicitSurface> getScene() const { return pendingScene ? pendingScene->surface : scene; }
+
+    // Build the programs of a new scene with KHR_parallel_shader_compile and
+    // draw it with the tape interpreter until they are linked, or keep drawing
+    // the previous scene when it cannot be interpreted, so that switching
+    // scenes costs one frame instead of one compile. render() swaps the
+    // programs in once they are ready; renderFrames waits for them. Without
+    // the extension, and always for headless renderers, setScene compiles
+    // immediately. Edits made through getSceneEditor while a scene is pending
+    // apply to the scene being replaced.
+    void setAsyncShaderCompile(bool enabled) { asyncShaderCompile = enabled; }
+    // Whether the current context has KHR_parallel_shader_compile (or the ARB version)
+    static bool parallelShaderCompileSupported();
+    bool isScenePending() const { return pendingScene != nullptr; }
+
+    // Draw scenes with the tape interpreter, which needs no compile per scene
+    // but evaluates every node at every step. With Fallback it draws a new
+    // scene or structural edit right away while the generated programs build
+    // in the background (see setAsyncShaderCompile), and scenes whose
+    // generated programs fail to build, e.g. over driver limits. Scenes with
+    // external surfaces or too many registers (Tape::isInterpretable) always
+    // use generated code.
+    void setTapeInterpreter(InterpreterMode mode);
+    InterpreterMode getTapeInterpreter() const { return interpreterMode; }
+    bool isSceneInterpreted() const { return sceneInterpreted; }
+
+    // Edit the current scene in place (see SceneEditor). Pending edits are
+    // applied by commitSceneEdits, which render() calls first, and only redo
+    // what they invalidate: parameter edits patch the tape constants, the
+    // parameter buffer and the BVH and keep the shader; structural edits
+    // compile and generate again but skip linking when the source is
+    // unchanged. Baked fields and shadow volumes are rebaked only where the
+    // edited nodes can have changed the field.
+    SceneEditor& getSceneEditor() { return sceneEditor; }
+    void commitSceneEdits();
     void setCamera(const Vec3<float>& position, const Vec3<float>& target, const Vec3<float>& up, float fov);
     void setLight(const Vec3<float>& position, const Vec3<float>& color, float ambientStrength);
     void setRaymarchingParams(int maxSteps, float maxDistance, float epsilon);
 
+    // Over-relaxed tracing steps relaxation (in [1, 2)) times the distance and
+    // falls back to plain steps where that would skip past the surface
+    void setMarchingStrategy(MarchingStrategy strategy, float relaxation = 1.2f);
+    MarchingStrategy getMarchingStrategy() const { return marchingStrategy; }
+
+    // Accept hits closer than this many pixels at the hit depth (never below
+    // epsilon), so distant rays stop at the precision they can display. 0 disables.
+    void setPixelFootprintEpsilon(float pixels);
+
+    // Largest gradient length of the scene field. The built-in nodes give
+    // distance bounds (1); fields that can overestimate need a larger bound.
+    void setLipschitzBound(float bound);
+
+    // Ray march against a distance field baked from the scene (resolution cells
+    // along its longest axis), falling back to exact evaluation near the surface.
+    // The field is rebaked by every setScene while enabled.
+    void setBakedDistanceField(bool enabled, int resolution = 128);
+    bool isBakedDistanceFieldEnabled() const { return bakedFieldEnabled; }
+
+    // Shadow rays stop at the first occluder or after maxSteps; larger
+    // softness gives narrower penumbrae (hard shadows in the limit)
+    void setShadowParams(int maxSteps, float softness);
+
+    // Look shadows up in a visibility volume (resolution cells along the
+    // scene's longest axis) baked for the current light. The volume is rebaked
+    // by setScene and whenever the light moves while enabled.
+    void setShadowVolume(bool enabled, int resolution = 64);
+    bool isShadowVolumeEnabled() const { return shadowVolumeEnabled; }
+
+    // March one cone per tileSize x tileSize pixel tile at reduced resolution
+    // first, so each pixel starts at the depth its tile's cone proved empty
+    void setConePrepass(bool enabled, int tileSize = 8);
+    bool isConePrepassEnabled() const { return conePrepassEnabled; }
+
+    // March primary rays in the fragment shader or in compute shaders with ray
+    // compaction. Without compute support this warns and keeps the fragment backend.
+    // Tiled frames and progressive stills always use the fragment backend.
+    void setRenderBackend(RenderBackend backend);
+    RenderBackend getRenderBackend() const { return renderBackend; }
+
+    // Reproject the previous frame into window frames instead of marching every
+    // pixel. Only untiled frames of the fragment backend use it; offscreen
+    // batches and stills are always marched in full.
+    void setTemporalReprojection(TemporalMode mode);
+    TemporalMode getTemporalReprojection() const { return temporalMode; }
+
+    // Draw window frames at the fraction of the window resolution that keeps
+    // their GPU time near budgetMs, upscaled to the window. With scaleSteps the
+    // step budget is lowered as well once the scale reaches minScale.
+    void setDynamicResolution(bool enabled, float budgetMs = 14.0f, float minScale = 0.5f, bool scaleSteps = false);
+    bool isDynamicResolutionEnabled() const { return dynamicResolution.isEnabled(); }
+    float getResolutionScale() const { return dynamicResolution.getScale(); }
+    // Smoothed GPU time of recent window frames in milliseconds (dynamic resolution only)
+    float getGPUFrameTime() const { return dynamicResolution.getFrameTime(); }
+
+    // Time frame stages on the CPU and GPU. With an output path every frame is
+    // appended to that file as one JSON object per line; while running, the
+    // window title shows the latest timings.
+    void setProfiling(bool enabled, const std::string& outputPath = "");
+    bool isProfiling() const { return profiler.isEnabled(); }
+    const Profiler::FrameReport& getLastProfile() const { return profiler.getLastReport(); }
+    // Receive every profiled frame, including each frame of renderFrames
+    void setProfileListener(std::function<void(const Profiler::FrameReport&)> listener) {
+        profiler.setListener(std::move(listener));
+    }
+
+    // Count march steps per pixel into the profile while profiling
+    // (USE_ADVANCED_OPENGL and OpenGL 4.3). Every marched pixel adds atomics,
+    // so timings get slower.
+    void setStepCounters(bool enabled);
+
+    // Color pixels by their march steps, blue for few through red for the whole budget
+    void setStepHeatmap(bool enabled) { stepHeatmap = enabled; }
+    bool isStepHeatmapEnabled() const { return stepHeatmap; }
+
+    // Persist linked programs in this directory so later runs skip compilation
+    void setShaderCacheDirectory(const std::string& directory);
+
     // Get GLFW window for setting callback functions
     GLFWwindow* getWindow() { return window; }
 
     void render();
     void run();
 
+    // Render one frame per pose into an offscreen target of the given size.
+    // Frames are read back through a ring of pixel buffers, so the consumer
+    // processes each frame while the GPU renders the following ones. The
+    // window's camera and size are restored afterwards.
+    bool renderFrames(const std::vector<CameraPose>& path, int width, int height, const FrameConsumer& consumer);
+
+    // Draw frames as size x size pixel tiles, flushed one at a time, so heavy
+    // scenes at high resolutions do not exceed driver timeouts. 0 disables.
+    void setTileSize(int size);
+    int getTileSize() const { return tileSize; }
+
+    // Render a still of any size progressively: run() draws tilesPerFrame
+    // tiles of it per frame into the offscreen target, center first, and
+    // hands it to the consumer once complete. A new request replaces a pending one.
+    void requestStill(const CameraPose& pose, int width, int height, const FrameConsumer& consumer,
+                      int tileSize = 256, int tilesPerFrame = 4);
+    bool isStillPending() const { return still.active; }
+    CameraPose getCameraPose() const;
+
     // Scene creation helper functions
     static std::shared_ptr<ImplicitSurface> createSphereScene();
     static std::shared_ptr<ImplicitSurface> createCSGUnionScene();
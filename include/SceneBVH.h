@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Bounding volume hierarchy over the top-level union items of a scene, laid
+// out for texelFetch from two RGBA32F buffer textures (see scene_bvh.glsl).
+//
+// A scene built as a long chain of UnionOp nodes is flattened into its
+// items. Bounded spheres, boxes and cylinders are stored as plain data and
+// evaluated by a generic shader routine; other bounded items become
+// generated functions selected by index; unbounded items (planes, or any
+// subtree without finite bounds) are evaluated for every sample.
+//
+// Node layout, two texels per node in depth-first order (left child follows
+// its parent):
+//   texel 0: bounds.min.xyz, index of the right child (internal nodes) or of
+//            the first item (leaves)
+//   texel 1: bounds.max.xyz, item count (0 for internal nodes)
+// Item layout, three texels per item:
+//   texel 0: type, then center (sphere, box) or start (cylinder)
+//   texel 1: radius (sphere), dimensions + smoothing (box) or axis + 1 / |axis|^2 (cylinder)
+//   texel 2: radius (cylinder)
+// Generated items store their function index in texel 0.y.
+class SceneBVH {
+public:
+    enum ItemType { SphereItem = 0, BoxItem = 1, CylinderItem = 2, GeneratedItem = 3 };
+
+    // Scenes with fewer bounded items are faster as straight-line code
+    static constexpr size_t minimumItems = 16;
+    static constexpr size_t texelsPerNode = 2;
+    static constexpr size_t texelsPerItem = 3;
+    // Must match the traversal stack size in scene_bvh.glsl
+    static constexpr int maxDepth = 24;
+
+    // Flatten the sharp UnionOp chain below node into its operands
+    static void collectUnionItems(const std::shared_ptr<const ImplicitSurface>& node,
+                                  std::vector<std::shared_ptr<const ImplicitSurface>>& items);
+
+    // Build the hierarchy for a scene. Returns false (and leaves the BVH empty)
+    // when the scene has too few bounded items to benefit from it.
+    bool build(const std::shared_ptr<const ImplicitSurface>& root);
+
+    // Keep the hierarchy's structure for a scene that differs from the built
+    // one only in parameters: item data and node bounds are recomputed in
+    // place, so items keep their slots and an upload only has to cover what
+    // moved. Returns false (leaving the BVH unchanged) when the scene's items
+    // no longer match, in which case it has to be built again.
+    bool refit(const std::shared_ptr<const ImplicitSurface>& root);
+
+    bool empty() const { return nodeCount == 0; }
+    size_t getNodeCount() const { return nodeCount; }
+    size_t getItemCount() const { return itemData.size() / (4 * texelsPerItem); }
+
+    // Items without a data representation, in generated function index order
+    const std::vector<std::shared_ptr<const ImplicitSurface>>& getGeneratedItems() const { return generatedItems; }
+    // Items evaluated outside the hierarchy
+    const std::vector<std::shared_ptr<const ImplicitSurface>>& getUnboundedItems() const { return unboundedItems; }
+
+    const std::vector<float>& getNodeData() const { return nodeData; }
+    const std::vector<float>& getItemData() const { return itemData; }
+
+private:
+    struct BuildItem {
+        const ImplicitSurface* surface;
+        int function; // Generated function index, -1 for data items
+        AABB bounds;
+        Vec3<double> centroid;
+        uint32_t sceneIndex; // Position among the scene's union items
+    };
+
+    size_t nodeCount = 0;
+    std::vector<float> nodeData;
+    std::vector<float> itemData;
+    std::vector<std::shared_ptr<const ImplicitSurface>> generatedItems;
+    std::vector<std::shared_ptr<const ImplicitSurface>> unboundedItems;
+    std::vector<uint32_t> itemSceneIndices; // Scene item stored in each item slot
+    size_t sceneItemCount = 0;
+
+    void buildNode(std::vector<BuildItem>& items, size_t begin, size_t end, int depth);
+    AABB refitNode(size_t nodeIndex, const std::vector<std::shared_ptr<const ImplicitSurface>>& surfaces);
+    void appendItem(const BuildItem& item);
+    static void writeItem(const ImplicitSurface* surface, int function, float* texels);
+};
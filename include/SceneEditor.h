@@ -0,0 +1,78 @@
+﻿#pragma once
+
+#include "SceneGraph.h"
+#include <memory>
+#include <vector>
+
+// Edits a scene held in a SceneGraph and records what they invalidate, so
+// that only the affected work has to be redone (see
+// ImplicitRenderer::commitSceneEdits).
+//
+// Parameter edits change nodes in place. replace and insertBoolean keep
+// children ahead of their parents by copying the path from the edited node to
+// the root: the copies are appended, untouched subtrees keep their handles and
+// current() maps a handle of a copied ancestor to its copy. Replaced nodes
+// stay in the pool, unreachable, until the editor is reset.
+//
+// Every edit also notes a world-space region outside which the scene field is
+// unchanged, up to a margin. Outside its bounds the field of any node is at
+// least the distance to them, so above an edited node a sharp boolean or a
+// transform can only change at points where both its old and its new value
+// are at least the distance to the region in magnitude. Each smooth blend on
+// the way can lower that by 7/6 k, which is collected in the margin.
+class SceneEditor {
+public:
+    // What the edits since the last takeChanges() invalidated
+    struct Changes {
+        bool structure = false;                 // Nodes were replaced or inserted
+        std::vector<NodeHandle> parameterNodes; // Nodes whose parameters changed in place
+        AABB region = AABB(Vec3<double>(1, 1, 1), Vec3<double>(-1, -1, -1)); // Empty (min > max) without changes
+        double margin = 0.0;
+
+        bool empty() const { return !structure && parameterNodes.empty(); }
+    };
+
+    void reset(const std::shared_ptr<const ImplicitSurface>& surface);
+    // Edit a copy of a graph; without a root its last node is the scene
+    void reset(SceneGraph graph);
+
+    const SceneGraph& getGraph() const { return graph; }
+    NodeHandle getRoot() const { return graph.getRoot(); }
+    // Nodes for replace and insertBoolean are added here. Changing existing
+    // nodes directly bypasses the change tracking.
+    SceneGraph& builder() { return graph; }
+
+    // The class-based tree of the scene. After an edit only the edited nodes
+    // and their ancestors are rebuilt; everything else is shared.
+    std::shared_ptr<ImplicitSurface> getSurface();
+
+    // Handle a node is found under after replace or insertBoolean copied it
+    NodeHandle current(NodeHandle handle) const;
+
+    // Change all parameters of a node (SceneGraph::parameterCount values) or one of them
+    bool setParameters(NodeHandle node, const std::vector<double>& values);
+    bool setParameter(NodeHandle node, uint32_t index, double value);
+
+    // Make every parent of node (or the scene, for the root) use replacement instead
+    bool replace(NodeHandle node, NodeHandle replacement);
+
+    // Put a boolean of node and operand in node's place, returning the new
+    // node. k is the smoothing factor of smooth operations.
+    NodeHandle insertBoolean(NodeHandle node, SceneNodeType type, NodeHandle operand, double k = 0.0);
+
+    bool hasChanges() const { return !changes.empty(); }
+    const Changes& getChanges() const { return changes; }
+    // Return the pending changes and start recording anew
+    Changes takeChanges();
+
+private:
+    SceneGraph graph;
+    std::vector<std::shared_ptr<ImplicitSurface>> surfaces; // Built nodes, indexed by handle
+    std::vector<NodeHandle> forwarding;                     // Copy of a node, or invalidNode
+    Changes changes;
+
+    void ensureSurfaces();
+    // Rebuild seed and its ancestors and carry the local region of an edit of
+    // seed up to the root. Returns false if the scene does not use seed.
+    bool noteEdit(NodeHandle seed, const AABB& before);
+};
@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "SceneGraph.h"
+#include <cstdint>
+#include <string>
+
+// Header of the binary scene format. The node table (SceneNode records in
+// handle order) and the parameter pool (doubles) follow as stored in memory,
+// so a mapped file is used by SceneGraph, Tape and ShaderGenerator as is.
+struct SceneFileHeader {
+    char magic[8];            // "ICSGSCN1"
+    uint32_t byteOrder;       // 0x01020304 as written; files from other byte orders are rejected
+    uint32_t version;
+    uint32_t nodeCount;
+    NodeHandle root;
+    uint64_t parameterCount;
+    uint64_t nodeOffset;      // Byte offsets from the start of the file
+    uint64_t parameterOffset;
+};
+
+// Reading and writing SceneGraph pools. The binary form is memory-mapped on
+// load and viewed in place: loading only checks the header and every node's
+// handles and parameter range, without copying or converting anything. The
+// JSON form is for authoring and lists nodes in the same order, e.g.
+//
+//   { "root": 2, "nodes": [
+//     { "type": "sphere", "center": [0, 0, 0], "radius": 1 },
+//     { "type": "box", "center": [0.5, 0, 0], "dimensions": [1, 1, 1], "smoothing": 0.1 },
+//     { "type": "smoothUnion", "left": 0, "right": 1, "k": 0.2 } ] }
+//
+// Planes take "normal" and "distance", cylinders "start", "end" and "radius",
+// booleans "left" and "right" (indices of earlier nodes), transforms a
+// "child" with optional "translation", "rotation" (three rows, or "axis" and
+// "angle" in radians) and "scale". Without "root" the last node is the root.
+//
+// External nodes wrap arbitrary ImplicitSurface objects and cannot be stored.
+class SceneFile {
+public:
+    static constexpr uint32_t version = 1;
+
+    // Write the binary form; the root is the graph's root, or its last node when unset
+    static bool save(const SceneGraph& graph, const std::string& path);
+    // Write the JSON form
+    static bool saveJSON(const SceneGraph& graph, const std::string& path);
+    static std::string toJSON(const SceneGraph& graph);
+
+    // Load either form, told apart by the magic; graph is left empty on failure
+    static bool load(const std::string& path, SceneGraph& graph);
+    static bool parseJSON(const std::string& text, SceneGraph& graph);
+
+private:
+    static bool loadBinary(const std::string& path, SceneGraph& graph);
+};
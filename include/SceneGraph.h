@@ -0,0 +1,145 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+// 32-bit handle of a node inside a SceneGraph
+using NodeHandle = uint32_t;
+constexpr NodeHandle invalidNode = 0xffffffffu;
+
+enum class SceneNodeType : uint32_t {
+    Sphere,             // parameters: center.xyz, radius
+    Box,                // parameters: center.xyz, dimensions.xyz, smoothing
+    Plane,              // parameters: normal.xyz, distance
+    Cylinder,           // parameters: start.xyz, end.xyz, radius
+    Union,
+    Intersection,
+    Difference,
+    SmoothUnion,        // parameters: k
+    SmoothIntersection, // parameters: k
+    SmoothDifference,   // parameters: k
+    Transform,          // parameters: translation.xyz, rotation rows (9), scale; left is the instanced child
+    External            // Any other ImplicitSurface, parameters: index into externals
+};
+
+// One node of the arena: 16 bytes, children referenced by handle
+// (invalidNode where the type has fewer children)
+struct SceneNode {
+    SceneNodeType type;
+    uint32_t parameters; // Offset into the parameter pool
+    NodeHandle left;
+    NodeHandle right;
+};
+
+// Contiguous storage for CSG trees and DAGs. Nodes live in one array and their
+// parameters in another, so building, copying and walking a scene touches a
+// few linear allocations instead of one heap block and refcount per node.
+//
+// Nodes can only reference nodes created before them, so handle order is a
+// valid bottom-up evaluation order and passes over a graph need no recursion.
+// Sharing a handle between several parents stores the subtree once; with
+// Transform nodes one subtree can be instanced anywhere in the scene.
+//
+// The ImplicitSurface classes remain the convenient builder facade:
+// import() converts a tree (keeping shared subtrees shared) and toSurface()
+// converts back.
+//
+// A graph can also view arrays it does not own, such as the pools of a
+// memory-mapped scene file (see SceneFile). Reading a view costs the same as
+// reading owned pools; adding a node copies the arrays first.
+class SceneGraph {
+public:
+    using ImportMap = std::unordered_map<const ImplicitSurface*, NodeHandle>;
+
+    NodeHandle addSphere(const Vec3<double>& center, double radius);
+    NodeHandle addBox(const Vec3<double>& center, const Vec3<double>& dimensions, double smoothing = 0.1);
+    // The normal is normalized like Plane's; a zero normal gives invalidNode
+    NodeHandle addPlane(const Vec3<double>& normal, double distance);
+    NodeHandle addCylinder(const Vec3<double>& start, const Vec3<double>& end, double radius);
+    NodeHandle addUnion(NodeHandle a, NodeHandle b);
+    NodeHandle addIntersection(NodeHandle a, NodeHandle b);
+    NodeHandle addDifference(NodeHandle a, NodeHandle b);
+    NodeHandle addSmoothUnion(NodeHandle a, NodeHandle b, double k);
+    NodeHandle addSmoothIntersection(NodeHandle a, NodeHandle b, double k);
+    NodeHandle addSmoothDifference(NodeHandle a, NodeHandle b, double k);
+    NodeHandle addTransform(NodeHandle child, const Transform& transform);
+    NodeHandle addExternal(const std::shared_ptr<const ImplicitSurface>& surface);
+
+    // Append a class-based tree. Nodes already in imported (from earlier
+    // calls sharing the map) are reused instead of being stored again.
+    NodeHandle import(const std::shared_ptr<const ImplicitSurface>& surface);
+    NodeHandle import(const std::shared_ptr<const ImplicitSurface>& surface, ImportMap& imported);
+
+    // Rebuild the class-based tree of a node (shared nodes stay shared)
+    std::shared_ptr<ImplicitSurface> toSurface(NodeHandle handle) const;
+    // The same, reusing the non-null entries of built (indexed by handle) and
+    // storing every node it creates there, so that only edited nodes and their
+    // ancestors have to be cleared and rebuilt after an edit
+    std::shared_ptr<ImplicitSurface> toSurface(NodeHandle handle, std::vector<std::shared_ptr<ImplicitSurface>>& built) const;
+
+    // Overwrite the parameterCount(type) parameters of a node in place. Plane
+    // normals are normalized like addPlane's; a zero one is refused.
+    bool setParameters(NodeHandle handle, const double* values);
+    // Append a copy of a node (type and parameters) with other children, which
+    // must precede the new node like those of any other node
+    NodeHandle addCopy(NodeHandle handle, NodeHandle left, NodeHandle right);
+
+    // Use node and parameter arrays kept alive by storage (or by the caller,
+    // when it is null) instead of owned pools. The arrays must already be
+    // valid, see SceneFile::load.
+    void view(std::shared_ptr<const void> storage, const SceneNode* nodeData, size_t nodeCount,
+              const double* parameterData, size_t parameterCount, NodeHandle rootHandle);
+    bool isView() const { return storage != nullptr; }
+
+    void setRoot(NodeHandle handle) { root = handle; }
+    NodeHandle getRoot() const { return root; }
+
+    bool isValid(NodeHandle handle) const { return handle < size(); }
+    const SceneNode& getNode(NodeHandle handle) const { return getNodeData()[handle]; }
+    const double* getParameters(NodeHandle handle) const { return getParameterData() + getNode(handle).parameters; }
+    Transform getTransform(NodeHandle handle) const;
+    const std::shared_ptr<const ImplicitSurface>& getExternal(NodeHandle handle) const {
+        return externals[nodes[handle].parameters];
+    }
+
+    static bool isBoolean(SceneNodeType type) { return type >= SceneNodeType::Union && type <= SceneNodeType::SmoothDifference; }
+    static bool isSmooth(SceneNodeType type) { return type >= SceneNodeType::SmoothUnion && type <= SceneNodeType::SmoothDifference; }
+    static uint32_t parameterCount(SceneNodeType type);
+
+    // The whole node and parameter pools, in handle order
+    const SceneNode* getNodeData() const { return storage ? viewNodes : nodes.data(); }
+    const double* getParameterData() const { return storage ? viewParameters : parameters.data(); }
+    size_t getParameterPoolSize() const { return storage ? viewParameterCount : parameters.size(); }
+    size_t getExternalCount() const { return externals.size(); }
+
+    size_t size() const { return storage ? viewNodeCount : nodes.size(); }
+    bool empty() const { return size() == 0; }
+    void reserve(size_t nodeCount, size_t parameterCount);
+    void clear();
+
+    // Bytes held by the owned node and parameter pools (not the arrays of a view)
+    size_t getMemoryUsage() const {
+        return nodes.capacity() * sizeof(SceneNode) + parameters.capacity() * sizeof(double);
+    }
+
+private:
+    std::vector<SceneNode> nodes;
+    std::vector<double> parameters;
+    std::vector<std::shared_ptr<const ImplicitSurface>> externals;
+    NodeHandle root = invalidNode;
+
+    // Borrowed arrays while viewing
+    std::shared_ptr<const void> storage;
+    const SceneNode* viewNodes = nullptr;
+    const double* viewParameters = nullptr;
+    size_t viewNodeCount = 0;
+    size_t viewParameterCount = 0;
+
+    // Copy the arrays of a view into owned pools before they are modified
+    void detach();
+    NodeHandle addNode(SceneNodeType type, std::initializer_list<double> values);
+    NodeHandle addBoolean(SceneNodeType type, NodeHandle a, NodeHandle b, std::initializer_list<double> values);
+};
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include "Renderer.h"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Reproducible scenes, camera paths and sample points shared by the --test
+// self test and the benchmark. Everything is generated from a fixed seed
+// with a portable generator, so runs on different machines and standard
+// libraries measure exactly the same work.
+class SceneSuite {
+public:
+    struct Scene {
+        std::string name;
+        std::shared_ptr<ImplicitSurface> surface;
+    };
+
+    // The demo scenes, then synthetic scenes of 16, 64 and 256 primitives
+    static std::vector<Scene> standardScenes();
+
+    // count spheres, boxes and cylinders scattered through [-1.5, 1.5]^3 and
+    // combined by a balanced tree of unions, every fourth one smooth
+    static std::shared_ptr<ImplicitSurface> syntheticScene(size_t count, uint32_t seed = 1);
+
+    // frames poses evenly spaced on a circle around the origin, slightly above it
+    static std::vector<CameraPose> orbitPath(size_t frames, float radius = 5.0f);
+
+    // Points spread uniformly through a region
+    static std::vector<Vec3<double>> samplePoints(const AABB& region, size_t count, uint32_t seed = 1);
+};
@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include <ostream>
+
+// Checks behind `ImplicitBooleanCSG --test`, the CTest target. The CPU checks
+// compare every compiled evaluation path of the scene suite against the
+// ImplicitSurface trees it came from and render one small frame on the CPU
+// renderer; a smoke test then renders it headless on the GPU and is skipped
+// where no OpenGL context can be created.
+class SelfTest {
+public:
+    // Run every check, logging one line per result; returns the number of failures
+    static int run(std::ostream& log);
+};
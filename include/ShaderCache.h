@@ -0,0 +1,68 @@
+﻿#pragma once
+
+#include <GL/glew.h>
+#include <cstdint>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Cache of linked shader programs keyed by a hash of their complete source.
+// Programs are kept in an in-memory LRU and, when a cache directory is set
+// and the driver supports program binaries, persisted to disk so that a
+// later run can skip compiling and linking entirely.
+//
+// The cache owns every program it holds. The most recently used program is
+// never evicted, so the program returned by the last find()/insert() stays
+// valid until another one is requested. Pinned programs are never evicted.
+class ShaderCache {
+private:
+    struct Entry {
+        uint64_t key;
+        GLuint program;
+        bool pinned;
+    };
+
+    size_t capacity;
+    std::string cacheDirectory;
+    std::list<Entry> entries; // Most recently used first
+    std::unordered_map<uint64_t, std::list<Entry>::iterator> index;
+
+    std::string binaryPath(uint64_t key) const;
+    GLuint loadBinary(uint64_t key);
+    void storeBinary(uint64_t key, GLuint program);
+    void evict();
+
+public:
+    explicit ShaderCache(size_t capacity = 16);
+    ~ShaderCache();
+
+    ShaderCache(const ShaderCache&) = delete;
+    ShaderCache& operator=(const ShaderCache&) = delete;
+
+    // Directory for persisted program binaries (empty disables disk persistence)
+    void setCacheDirectory(const std::string& directory);
+    void setCapacity(size_t newCapacity);
+
+    // Whether the current context can retrieve and reload program binaries
+    static bool binariesSupported();
+
+    // Hash of the program sources combined with the driver identification,
+    // so binaries from another GPU or driver version are never reused
+    static uint64_t hashSources(const std::string& vertexSource, const std::string& fragmentSource);
+
+    // Look up a linked program, first in memory then on disk. Returns 0 on a miss.
+    GLuint find(uint64_t key);
+
+    // Take ownership of a freshly linked program and persist it
+    void insert(uint64_t key, GLuint program);
+
+    // Keep these cached programs out of eviction, in place of the ones pinned
+    // before. Pinned programs do not count against the capacity.
+    void setPinned(const std::vector<GLuint>& programs);
+
+    // Delete all cached programs (requires a current GL context)
+    void clear();
+
+    size_t size() const { return entries.size(); }
+};
@@ -0,0 +1,110 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include "SceneBVH.h"
+#include "SceneGraph.h"
+#include <string>
+#include <sstream>
+#include <vector>
+
+// Translates a SceneGraph node (or an ImplicitSurface tree) into the GLSL bodies of sceneSDF and
+// sceneSDFGradient. The generated functions are straight-line code against
+// common_sdf.glsl with one local per node; the gradient variant carries
+// vec4(distance, gradient) pairs so normals cost a single evaluation. Primitive parameters are either folded into
+// literals or, when the parameter block is enabled, read from the
+// SceneParameters uniform block so that trees with the same topology
+// generate identical source and only the block contents change.
+//
+// The child of every Transform node becomes its own function pair, emitted
+// once and called with the transformed point by each instance.
+class ShaderGenerator {
+public:
+    // Where the parameters of one emitted node start in the parameter block
+    // (in floats). A node emitted into several functions has several bindings.
+    struct ParameterBinding {
+        NodeHandle node;
+        uint32_t offset;
+    };
+
+private:
+    const SceneGraph* source; // Graph being translated
+    SceneGraph imported;      // Storage for scenes given as ImplicitSurface trees
+
+    std::ostringstream body;         // sceneSDF statements
+    std::ostringstream gradientBody; // sceneSDFGradient statements
+    int nextVariable;
+
+    // Parameter block state
+    bool useParameterBlock;
+    std::vector<float> parameters; // vec4-packed (std140 array of vec4)
+    int scalarSlot;                 // vec4 currently receiving packed scalars
+    int scalarComponent;
+    std::vector<ParameterBinding> bindings;
+
+    // Id of each node already emitted in the current function (-1 if not),
+    // indexed by handle, so shared subtrees are evaluated once
+    std::vector<int> emitted;
+
+    void reset();
+    void beginFunction();
+    // Write "float <name>SDF(...)" and "vec4 <name>SDFGradient(...)" from the current bodies
+    void writeFunctionPair(std::ostringstream& code, const std::string& name,
+                           const std::string& signature, int result) const;
+    std::string parameterBlockCode() const;
+    // Function pairs for the children of all Transform nodes reachable from roots
+    std::string generateInstanceFunctions(const std::vector<NodeHandle>& roots);
+    static std::string instanceName(NodeHandle handle) { return "instance" + std::to_string(handle); }
+
+    // Each node gets an id with a float local "d<id>" and a vec4 local "g<id>"
+    int emitNode(NodeHandle handle);
+    int emitPrimitive(NodeHandle handle);
+    int emitBoolean(NodeHandle handle);
+    int emitTransform(NodeHandle handle);
+    int declare(const std::string& valueExpression, const std::string& gradientExpression);
+    int declareCall(const std::string& function, const std::string& arguments);
+    static std::string valueName(int id) { return "d" + std::to_string(id); }
+    static std::string gradientName(int id) { return "g" + std::to_string(id); }
+
+    // Bind a vec3 + scalar pair, returning GLSL expressions for both parts
+    void bindVec4(const Vec3<double>& xyz, double w, std::string& xyzExpr, std::string& wExpr);
+    std::string bindScalar(double value);
+    void recordBinding(NodeHandle handle, size_t offset);
+
+public:
+    // Name of the uniform block holding primitive parameters
+    static constexpr const char* parameterBlockName = "SceneParameters";
+
+    ShaderGenerator();
+
+    // Read primitive parameters from the SceneParameters block instead of literals
+    void setUseParameterBlock(bool enabled) { useParameterBlock = enabled; }
+
+    // Generate complete "float sceneSDF(vec3 p)" and "vec4 sceneSDFGradient(vec3 p)"
+    // definitions for the given node
+    std::string generateSceneSDF(const SceneGraph& graph, NodeHandle root);
+    std::string generateSceneSDF(const std::shared_ptr<const ImplicitSurface>& root);
+
+    // Generate the scene functions used by scene_bvh.glsl: sceneItemSDF(item, p)
+    // for the hierarchy's generated items and sceneUnboundedSDF(p) for the items
+    // outside it, each with its gradient variant. Data items live in the BVH
+    // buffers, so moving them does not change the generated source.
+    std::string generateSceneBVHFunctions(const SceneBVH& bvh);
+
+    // Parameter block contents of the last generated scene (empty in literal mode)
+    const std::vector<float>& getParameters() const { return parameters; }
+    size_t getParameterVec4Count() const { return parameters.size() / 4; }
+    // Nodes of the graph given to generateSceneSDF with parameters in the block,
+    // in emission order. Scenes generated from ImplicitSurface trees or through
+    // a BVH refer to internal graphs instead.
+    const std::vector<ParameterBinding>& getParameterBindings() const { return bindings; }
+
+    // Block contents of one node as laid out at its bindings (at most
+    // maxPackedParameters floats), so that parameter edits can be written into
+    // the block without generating the scene again. Returns the float count.
+    static constexpr size_t maxPackedParameters = 16;
+    static size_t packParameters(const SceneGraph& graph, NodeHandle handle, float* values);
+
+    // Literal formatting helpers (always produce valid GLSL float literals)
+    static std::string formatFloat(double value);
+    static std::string formatVec3(const Vec3<double>& value);
+};
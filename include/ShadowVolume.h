@@ -0,0 +1,66 @@
+﻿#pragma once
+
+#include "Tape.h"
+#include <vector>
+
+// Visibility of a point light sampled at the cell centers of a regular grid
+// around a static scene. Each sample is the soft shadow factor of a ray from
+// the cell center to the light, so shading can replace its shadow march with
+// a single filtered texture fetch while the light and scene stay unchanged.
+//
+// Cells inside the surface are fully shadowed; lookups are expected to move
+// the shaded point out along the normal by getLookupOffset() first so that
+// none of the interpolated samples lies inside.
+class ShadowVolume {
+public:
+    // Soft shadow factor in [0, 1] of the segment from origin towards the
+    // light: 0 once the ray comes within epsilon of the surface, otherwise the
+    // narrowest penumbra cone seen along it (softness scales the cone). Field
+    // values are divided by lipschitzBound to give distances. Matches
+    // softShadow in raymarch.glsl. With sweep, the box around every sphere
+    // the march evaluated is united into it.
+    static double softShadow(const Tape& tape, const Vec3<double>& origin, const Vec3<double>& direction,
+                             double maxDistance, int maxSteps, double softness, double epsilon,
+                             double lipschitzBound, AABB* sweep = nullptr);
+
+    // Sample visibility over the bounds of a scene, resolution cells along the
+    // longest axis. Returns false for unbounded scenes or when the volume
+    // would exceed maxTextureSize along an axis.
+    bool bake(const Tape& tape, const AABB& sceneBounds, const Vec3<double>& lightPosition, int resolution,
+              int maxSteps, double softness, double epsilon, double lipschitzBound, int maxTextureSize = 2048);
+
+    // Trace again after an edit that left the field unchanged outside region
+    // (see DistanceField::update). A march only depends on the field at its
+    // samples, and a sample whose sphere stays more than margin away from the
+    // region sees the same value, so only cells whose swept spheres come that
+    // close are traced again. Returns false when a full bake is needed instead.
+    bool update(const Tape& tape, const AABB& sceneBounds, const AABB& region, double margin);
+    // Box of cells traced by the last update (min > max when none was)
+    const int* getUpdatedMin() const { return updatedMin; }
+    const int* getUpdatedMax() const { return updatedMax; }
+
+    bool empty() const { return visibility.empty(); }
+    const AABB& getBounds() const { return bounds; }
+    double getVoxelSize() const { return voxelSize; }
+    // Distance along the normal that keeps all eight filtered samples outside a locally flat surface
+    double getLookupOffset() const { return 1.75 * voxelSize; }
+    const Vec3<double>& getLightPosition() const { return lightPosition; }
+    const int* getSize() const { return size; }
+    // One float per cell, x fastest
+    const std::vector<float>& getVisibility() const { return visibility; }
+
+private:
+    AABB bounds;
+    double voxelSize = 0.0;
+    int size[3] = { 0, 0, 0 };
+    Vec3<double> lightPosition;
+    int maxSteps = 0;
+    double softness = 0.0, epsilon = 0.0, lipschitzBound = 1.0;
+    std::vector<float> visibility;
+    std::vector<float> sweeps; // Per cell the box swept by its march: min.xyz, max.xyz
+    int updatedMin[3] = { 0, 0, 0 };
+    int updatedMax[3] = { -1, -1, -1 };
+
+    // Trace one cell into visibility and sweeps
+    void traceCell(const Tape& tape, int x, int y, int z);
+};
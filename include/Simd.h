@@ -0,0 +1,274 @@
+﻿#pragma once
+
+#include <cmath>
+#include <algorithm>
+
+// Thin wrapper over the widest SIMD registers available at compile time
+// (AVX-512, AVX, SSE2 or NEON), with a scalar fallback. Double holds doubles
+// and Float twice as many floats; Vector<T> names the one for a scalar type.
+// Only the handful of operations needed by the SDF kernels are provided; min,
+// max, sqrt and abs are found through argument-dependent lookup.
+#if defined(__AVX512F__)
+#include <immintrin.h>
+#define IMPLICIT_SIMD_NAME "AVX-512"
+
+namespace simd {
+
+struct Double {
+    static constexpr int width = 8;
+    __m512d v;
+
+    Double() = default;
+    Double(__m512d v) : v(v) {}
+    explicit Double(double s) : v(_mm512_set1_pd(s)) {}
+
+    static Double load(const double* p) { return _mm512_loadu_pd(p); }
+    void store(double* p) const { _mm512_storeu_pd(p, v); }
+};
+
+inline Double operator+(Double a, Double b) { return _mm512_add_pd(a.v, b.v); }
+inline Double operator-(Double a, Double b) { return _mm512_sub_pd(a.v, b.v); }
+inline Double operator*(Double a, Double b) { return _mm512_mul_pd(a.v, b.v); }
+inline Double operator-(Double a) { return _mm512_sub_pd(_mm512_setzero_pd(), a.v); }
+inline Double min(Double a, Double b) { return _mm512_min_pd(a.v, b.v); }
+inline Double max(Double a, Double b) { return _mm512_max_pd(a.v, b.v); }
+inline Double sqrt(Double a) { return _mm512_sqrt_pd(a.v); }
+inline Double abs(Double a) {
+    return _mm512_castsi512_pd(_mm512_and_si512(_mm512_castpd_si512(a.v), _mm512_set1_epi64(0x7fffffffffffffffll)));
+}
+
+struct Float {
+    static constexpr int width = 16;
+    __m512 v;
+
+    Float() = default;
+    Float(__m512 v) : v(v) {}
+    explicit Float(float s) : v(_mm512_set1_ps(s)) {}
+
+    static Float load(const float* p) { return _mm512_loadu_ps(p); }
+    void store(float* p) const { _mm512_storeu_ps(p, v); }
+};
+
+inline Float operator+(Float a, Float b) { return _mm512_add_ps(a.v, b.v); }
+inline Float operator-(Float a, Float b) { return _mm512_sub_ps(a.v, b.v); }
+inline Float operator*(Float a, Float b) { return _mm512_mul_ps(a.v, b.v); }
+inline Float operator-(Float a) { return _mm512_sub_ps(_mm512_setzero_ps(), a.v); }
+inline Float min(Float a, Float b) { return _mm512_min_ps(a.v, b.v); }
+inline Float max(Float a, Float b) { return _mm512_max_ps(a.v, b.v); }
+inline Float sqrt(Float a) { return _mm512_sqrt_ps(a.v); }
+inline Float abs(Float a) {
+    return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a.v), _mm512_set1_epi32(0x7fffffff)));
+}
+
+} // namespace simd
+
+#elif defined(__AVX__)
+#include <immintrin.h>
+#define IMPLICIT_SIMD_NAME "AVX"
+
+namespace simd {
+
+struct Double {
+    static constexpr int width = 4;
+    __m256d v;
+
+    Double() = default;
+    Double(__m256d v) : v(v) {}
+    explicit Double(double s) : v(_mm256_set1_pd(s)) {}
+
+    static Double load(const double* p) { return _mm256_loadu_pd(p); }
+    void store(double* p) const { _mm256_storeu_pd(p, v); }
+};
+
+inline Double operator+(Double a, Double b) { return _mm256_add_pd(a.v, b.v); }
+inline Double operator-(Double a, Double b) { return _mm256_sub_pd(a.v, b.v); }
+inline Double operator*(Double a, Double b) { return _mm256_mul_pd(a.v, b.v); }
+inline Double operator-(Double a) { return _mm256_sub_pd(_mm256_setzero_pd(), a.v); }
+inline Double min(Double a, Double b) { return _mm256_min_pd(a.v, b.v); }
+inline Double max(Double a, Double b) { return _mm256_max_pd(a.v, b.v); }
+inline Double sqrt(Double a) { return _mm256_sqrt_pd(a.v); }
+inline Double abs(Double a) { return _mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v); }
+
+struct Float {
+    static constexpr int width = 8;
+    __m256 v;
+
+    Float() = default;
+    Float(__m256 v) : v(v) {}
+    explicit Float(float s) : v(_mm256_set1_ps(s)) {}
+
+    static Float load(const float* p) { return _mm256_loadu_ps(p); }
+    void store(float* p) const { _mm256_storeu_ps(p, v); }
+};
+
+inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+inline Float operator-(Float a) { return _mm256_sub_ps(_mm256_setzero_ps(), a.v); }
+inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+
+} // namespace simd
+
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define IMPLICIT_SIMD_NAME "SSE2"
+
+namespace simd {
+
+struct Double {
+    static constexpr int width = 2;
+    __m128d v;
+
+    Double() = default;
+    Double(__m128d v) : v(v) {}
+    explicit Double(double s) : v(_mm_set1_pd(s)) {}
+
+    static Double load(const double* p) { return _mm_loadu_pd(p); }
+    void store(double* p) const { _mm_storeu_pd(p, v); }
+};
+
+inline Double operator+(Double a, Double b) { return _mm_add_pd(a.v, b.v); }
+inline Double operator-(Double a, Double b) { return _mm_sub_pd(a.v, b.v); }
+inline Double operator*(Double a, Double b) { return _mm_mul_pd(a.v, b.v); }
+inline Double operator-(Double a) { return _mm_sub_pd(_mm_setzero_pd(), a.v); }
+inline Double min(Double a, Double b) { return _mm_min_pd(a.v, b.v); }
+inline Double max(Double a, Double b) { return _mm_max_pd(a.v, b.v); }
+inline Double sqrt(Double a) { return _mm_sqrt_pd(a.v); }
+inline Double abs(Double a) { return _mm_andnot_pd(_mm_set1_pd(-0.0), a.v); }
+
+struct Float {
+    static constexpr int width = 4;
+    __m128 v;
+
+    Float() = default;
+    Float(__m128 v) : v(v) {}
+    explicit Float(float s) : v(_mm_set1_ps(s)) {}
+
+    static Float load(const float* p) { return _mm_loadu_ps(p); }
+    void store(float* p) const { _mm_storeu_ps(p, v); }
+};
+
+inline Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+inline Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+inline Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+inline Float operator-(Float a) { return _mm_sub_ps(_mm_setzero_ps(), a.v); }
+inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+
+} // namespace simd
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define IMPLICIT_SIMD_NAME "NEON"
+
+namespace simd {
+
+struct Double {
+    static constexpr int width = 2;
+    float64x2_t v;
+
+    Double() = default;
+    Double(float64x2_t v) : v(v) {}
+    explicit Double(double s) : v(vdupq_n_f64(s)) {}
+
+    static Double load(const double* p) { return vld1q_f64(p); }
+    void store(double* p) const { vst1q_f64(p, v); }
+};
+
+inline Double operator+(Double a, Double b) { return vaddq_f64(a.v, b.v); }
+inline Double operator-(Double a, Double b) { return vsubq_f64(a.v, b.v); }
+inline Double operator*(Double a, Double b) { return vmulq_f64(a.v, b.v); }
+inline Double operator-(Double a) { return vnegq_f64(a.v); }
+inline Double min(Double a, Double b) { return vminq_f64(a.v, b.v); }
+inline Double max(Double a, Double b) { return vmaxq_f64(a.v, b.v); }
+inline Double sqrt(Double a) { return vsqrtq_f64(a.v); }
+inline Double abs(Double a) { return vabsq_f64(a.v); }
+
+struct Float {
+    static constexpr int width = 4;
+    float32x4_t v;
+
+    Float() = default;
+    Float(float32x4_t v) : v(v) {}
+    explicit Float(float s) : v(vdupq_n_f32(s)) {}
+
+    static Float load(const float* p) { return vld1q_f32(p); }
+    void store(float* p) const { vst1q_f32(p, v); }
+};
+
+inline Float operator+(Float a, Float b) { return vaddq_f32(a.v, b.v); }
+inline Float operator-(Float a, Float b) { return vsubq_f32(a.v, b.v); }
+inline Float operator*(Float a, Float b) { return vmulq_f32(a.v, b.v); }
+inline Float operator-(Float a) { return vnegq_f32(a.v); }
+inline Float min(Float a, Float b) { return vminq_f32(a.v, b.v); }
+inline Float max(Float a, Float b) { return vmaxq_f32(a.v, b.v); }
+inline Float sqrt(Float a) { return vsqrtq_f32(a.v); }
+inline Float abs(Float a) { return vabsq_f32(a.v); }
+
+} // namespace simd
+
+#else
+#define IMPLICIT_SIMD_NAME "scalar"
+
+namespace simd {
+
+struct Double {
+    static constexpr int width = 1;
+    double v;
+
+    Double() = default;
+    explicit Double(double s) : v(s) {}
+
+    static Double load(const double* p) { return Double(*p); }
+    void store(double* p) const { *p = v; }
+};
+
+inline Double operator+(Double a, Double b) { return Double(a.v + b.v); }
+inline Double operator-(Double a, Double b) { return Double(a.v - b.v); }
+inline Double operator*(Double a, Double b) { return Double(a.v * b.v); }
+inline Double operator-(Double a) { return Double(-a.v); }
+inline Double min(Double a, Double b) { return Double(std::min(a.v, b.v)); }
+inline Double max(Double a, Double b) { return Double(std::max(a.v, b.v)); }
+inline Double sqrt(Double a) { return Double(std::sqrt(a.v)); }
+inline Double abs(Double a) { return Double(std::abs(a.v)); }
+
+struct Float {
+    static constexpr int width = 1;
+    float v;
+
+    Float() = default;
+    explicit Float(float s) : v(s) {}
+
+    static Float load(const float* p) { return Float(*p); }
+    void store(float* p) const { *p = v; }
+};
+
+inline Float operator+(Float a, Float b) { return Float(a.v + b.v); }
+inline Float operator-(Float a, Float b) { return Float(a.v - b.v); }
+inline Float operator*(Float a, Float b) { return Float(a.v * b.v); }
+inline Float operator-(Float a) { return Float(-a.v); }
+inline Float min(Float a, Float b) { return Float(std::min(a.v, b.v)); }
+inline Float max(Float a, Float b) { return Float(std::max(a.v, b.v)); }
+inline Float sqrt(Float a) { return Float(std::sqrt(a.v)); }
+inline Float abs(Float a) { return Float(std::abs(a.v)); }
+
+} // namespace simd
+
+#endif
+
+namespace simd {
+
+template <typename T> struct VectorOf;
+template <> struct VectorOf<double> { using type = Double; };
+template <> struct VectorOf<float> { using type = Float; };
+
+// Register type of the kernels for scalar type T
+template <typename T>
+using Vector = typename VectorOf<T>::type;
+
+} // namespace simd
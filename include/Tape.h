@@ -0,0 +1,148 @@
+﻿#pragma once
+
+#include "ImplicitSurfaces.h"
+#include "SceneGraph.h"
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Opcodes of the flattened evaluation tape. Primitives are evaluated at the
+// point register given by lhs (0 is the input point).
+enum class TapeOp : uint32_t {
+    Sphere,             // constants: center.xyz, radius
+    Box,                // constants: center.xyz, dimensions.xyz, smoothing
+    Plane,              // constants: normal.xyz, distance
+    Cylinder,           // constants: start.xyz, axis.xyz, 1 / dot(axis, axis), radius
+    Union,
+    Intersection,
+    Difference,
+    SmoothUnion,        // constants: k
+    SmoothIntersection, // constants: k
+    SmoothDifference,   // constants: k
+    Surface,            // Fallback for unknown node types, constants: index into externals
+    Negate,             // out = -lhs (produced by specialization of differences)
+    Transform,          // Point register out = lhs point mapped into an instance's local frame,
+                        // constants: translation.xyz, rotation rows (9), 1 / scale, scale
+    Rescale             // out = scale * lhs with the gradient rotated back to the parent frame,
+                        // constants: the rotation, 1 / scale and scale of the matching Transform
+};
+
+// One tape instruction: out = op(lhs, rhs, constants[constants...])
+// Primitives ignore rhs; boolean operations ignore constants unless smooth.
+struct TapeInstruction {
+    TapeOp op;
+    uint32_t out;
+    uint32_t lhs;
+    uint32_t rhs;
+    uint32_t constants;
+};
+
+// A flattened, register-based program equivalent to an ImplicitSurface tree.
+// The tree is lowered once into a linear instruction array with all parameters
+// packed into a contiguous constant pool; evaluation is then a single loop
+// with no virtual calls or pointer chasing. Registers are reused as soon as
+// their value is consumed, and subtrees needing more registers are scheduled
+// first, so the register file stays small even for very large trees.
+//
+// Transform nodes are lowered into a Transform instruction, which computes
+// the instance's local point into a separate point register, and a Rescale of
+// the instanced subtree's result. The subtree is inlined once per instance
+// so every copy can be specialized on its own.
+class Tape {
+private:
+    // Node whose parameters were lowered into the constants at an offset
+    struct ConstantSource {
+        NodeHandle node;
+        uint32_t constants;
+    };
+
+    std::vector<TapeInstruction> instructions;
+    std::vector<double> constants;
+    std::vector<std::shared_ptr<const ImplicitSurface>> externals;
+    std::vector<ConstantSource> sources; // Empty for specialized tapes
+    uint32_t registerCount;
+    uint32_t pointCount; // Point registers, including the input point
+    uint32_t resultRegister;
+
+    // Interval of a single primitive instruction over a region
+    Interval primitiveInterval(const TapeInstruction& ins, const AABB& region) const;
+
+    friend class TapeCompiler;
+
+public:
+    Tape();
+
+    // Lower a scene graph node into a tape
+    static Tape compile(const SceneGraph& graph, NodeHandle root);
+    // Lower an ImplicitSurface tree into a tape (imported into a SceneGraph first)
+    static Tape compile(const std::shared_ptr<const ImplicitSurface>& root);
+
+    // Lower the parameters of edited nodes again after they were changed in
+    // place (SceneGraph::setParameters) in the graph this tape was compiled
+    // from; the instructions stay as they are. Returns false for tapes that do
+    // not know their nodes (specialized ones), which must be compiled again.
+    bool updateConstants(const SceneGraph& graph, const std::vector<NodeHandle>& nodes);
+
+    // Evaluate the compiled function at a point (same result as the source tree)
+    double evaluate(const Vec3<double>& point) const;
+
+    // Forward-mode evaluation: returns the value and writes the (unnormalized)
+    // analytic gradient, both computed in a single pass over the tape
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& gradient) const;
+
+    // Number of points evaluated together by evaluateBatch
+    static constexpr size_t batchSize = 16;
+
+    // Evaluate many points given in structure-of-arrays layout. Points are
+    // processed batchSize at a time with one SIMD kernel per instruction, so
+    // the interpreter overhead is amortized over the whole batch.
+    //
+    // Compiled for double and float. A float register holds twice as many
+    // points, but constants and arithmetic are rounded to float, which leaves
+    // an error of about 1e-6 times the coordinates' magnitude. Use float where
+    // the distances end up in float anyway (baked fields, rendering) and
+    // double where they are compared or solved with (meshing, the scalar paths).
+    template <typename T>
+    void evaluateBatch(const T* xs, const T* ys, const T* zs, T* distances, size_t count) const;
+
+    // Conservative range of the function over an axis-aligned region
+    Interval evaluateInterval(const AABB& region) const;
+
+    // Build a tape that is exact inside the given region but drops every
+    // min/max operand that interval arithmetic proves can never be selected
+    // there. Points outside the region must keep using the original tape.
+    Tape specialize(const AABB& region) const;
+
+    // Number of constants used by each opcode
+    static uint32_t constantCount(TapeOp op);
+
+    // Register files of the GPU interpreter; must match TAPE_REGISTERS and
+    // TAPE_POINTS in tape_interpreter.glsl
+    static constexpr uint32_t interpreterRegisters = 32;
+    static constexpr uint32_t interpreterPoints = 8;
+
+    // Whether tape_interpreter.glsl can run this tape: it has no external
+    // surfaces and its registers fit the interpreter's
+    bool isInterpretable() const;
+
+    // The tape as read by tape_interpreter.glsl, in RGBA texels: a header
+    // (instruction count, result register, 0, 0), then every instruction as
+    // (op, out, lhs, rhs) followed by its constants, regrouped into vectors:
+    //   Sphere, Plane: [center or normal, radius or distance]
+    //   Box: [center, smoothing], [dimensions, 0]
+    //   Cylinder: [start, radius], [axis, 1 / dot(axis, axis)]
+    //   smooth booleans: [k, 0, 0, 0]
+    //   Transform: [translation, 1 / scale], [rotation row 0, scale], [row 1, 0], [row 2, 0]
+    //   Rescale: [rotation row 0, scale], [row 1, 1 / scale], [row 2, 0]
+    // Unused operands are 0. The layout only depends on the instructions, so
+    // parameter edits change the constant texels in place.
+    std::vector<float> packInterpreter() const;
+
+    bool empty() const { return instructions.empty(); }
+    size_t size() const { return instructions.size(); }
+    const std::vector<TapeInstruction>& getInstructions() const { return instructions; }
+    const std::vector<double>& getConstants() const { return constants; }
+    uint32_t getRegisterCount() const { return registerCount; }
+    uint32_t getPointCount() const { return pointCount; }
+    uint32_t getResultRegister() const { return resultRegister; }
+};
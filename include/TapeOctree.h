@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include "Tape.h"
+#include <cstdint>
+#include <vector>
+
+// Spatial subdivision of a region where every leaf holds a tape specialized
+// to that cell. Large unions usually collapse to a handful of primitives per
+// cell, so evaluating a point only runs the instructions that can actually
+// affect the result there. Points outside the root region use the full tape.
+class TapeOctree {
+private:
+    struct Cell {
+        Vec3<double> center;
+        int32_t firstChild; // Index of 8 consecutive children, or -1 for a leaf
+        uint32_t tape;      // Index into tapes (leaves only)
+    };
+
+    AABB region;
+    std::vector<Cell> cells;
+    std::vector<Tape> tapes; // tapes[0] is the unspecialized tape
+
+    void build(uint32_t cellIndex, const AABB& cellBounds, const Tape& parent,
+               int depth, int maxDepth, size_t leafSize);
+    uint32_t findTapeIndex(const Vec3<double>& point) const;
+
+public:
+    // Subdivide until a cell's tape has at most leafSize instructions or
+    // maxDepth is reached
+    TapeOctree(const Tape& tape, const AABB& region, int maxDepth = 5, size_t leafSize = 16);
+
+    // Tape that is exact at the given point
+    const Tape& findTape(const Vec3<double>& point) const { return tapes[findTapeIndex(point)]; }
+
+    double evaluate(const Vec3<double>& point) const { return findTape(point).evaluate(point); }
+    double evaluateWithGradient(const Vec3<double>& point, Vec3<double>& gradient) const {
+        return findTape(point).evaluateWithGradient(point, gradient);
+    }
+
+    // Batched evaluation: points are grouped by leaf and each group is run
+    // through its own specialized tape with Tape::evaluateBatch
+    void evaluateBatch(const double* xs, const double* ys, const double* zs,
+                       double* distances, size_t count) const;
+
+    const AABB& getRegion() const { return region; }
+    const Tape& getFullTape() const { return tapes[0]; }
+    size_t getCellCount() const { return cells.size(); }
+    size_t getTapeCount() const { return tapes.size(); }
+};
@@ -0,0 +1,72 @@
+﻿#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of worker threads with one task deque each. Workers pop from the
+// front of their own deque and steal from the back of the others when they
+// run dry, which keeps uneven workloads (octree cells near the surface versus
+// empty ones) balanced without a central queue.
+//
+// parallelFor blocks until every chunk has run. The calling thread executes
+// chunks too, so nested parallel loops cannot deadlock.
+class ThreadPool {
+private:
+    struct Job {
+        const std::function<void(size_t, size_t)>* body;
+        std::atomic<size_t> remaining;
+    };
+
+    struct Task {
+        Job* job;
+        size_t begin, end;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Task> tasks;
+    };
+
+    std::vector<std::unique_ptr<Queue>> queues; // One per worker plus one for outside callers
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::atomic<size_t> pending;
+    bool stopping;
+
+    void workerLoop(size_t index);
+    bool popTask(size_t queue, Task& task);
+    void execute(const Task& task);
+    void run(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+
+public:
+    // threads == 0 uses one worker per hardware thread (minus the caller)
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Worker threads plus the calling thread
+    size_t getConcurrency() const { return workers.size() + 1; }
+
+    // Call body(i) for every i in [0, count), grain consecutive indices per task
+    template <typename Body>
+    void parallelFor(size_t count, Body&& body, size_t grain = 1) {
+        std::function<void(size_t, size_t)> range = [&body](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) body(i);
+        };
+        run(count, grain, range);
+    }
+
+    // Process-wide pool sized to the machine
+    static ThreadPool& shared();
+};
@@ -1,12 +1,33 @@
-﻿#include "ImplicitSurfaces.h"
+﻿#include "CpuRenderer.h"
+#include "ImplicitSurfaces.h"
+#include "MeshExtractor.h"
 #include "Renderer.h"
+#include "SceneFile.h"
+#include "SelfTest.h"
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <string>
+#include <vector>
+
+// Renders a batch of poses, ImplicitRenderer::renderFrames or CpuRenderer::renderFrames
+using BatchRenderer = std::function<bool(const std::vector<CameraPose>&, int, int, const FrameConsumer&)>;
 
 // Forward declarations
 void switchScene(ImplicitRenderer& renderer, int sceneIndex);
 std::shared_ptr<ImplicitSurface> createCustomScene();
+void exportSceneMesh(const ImplicitRenderer& renderer, const std::string& path);
+int renderTurntable(const BatchRenderer& render, int frames, int width, int height, const std::string& prefix);
+int renderCpuTurntable(const std::shared_ptr<ImplicitSurface>& scene, int frames, int width, int height,
+                       const std::string& prefix);
+bool writePPM(const std::string& path, const unsigned char* pixels, int width, int height);
+std::shared_ptr<ImplicitSurface> loadSceneFile(const std::string& path);
+bool convertSceneFile(const std::string& input, const std::string& output);
 
 // Global renderer pointer for callback access
 ImplicitRenderer* g_renderer = nullptr;
@@ -41,6 +62,82 @@ void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods
                 std::cout << "Display scene: Custom CSG Scene" << std::endl;
                 g_renderer->setScene(createCustomScene());
                 return;
+            case GLFW_KEY_B: {
+                bool baked = !g_renderer->isBakedDistanceFieldEnabled();
+                std::cout << "Baked distance field: " << (baked ? "on" : "off") << std::endl;
+                g_renderer->setBakedDistanceField(baked);
+                return;
+            }
+            case GLFW_KEY_E:
+                exportSceneMesh(*g_renderer, "scene.obj");
+                return;
+            case GLFW_KEY_M: {
+                bool relaxed = g_renderer->getMarchingStrategy() != MarchingStrategy::OverRelaxed;
+                std::cout << "Over-relaxed sphere tracing: " << (relaxed ? "on" : "off") << std::endl;
+                g_renderer->setMarchingStrategy(relaxed ? MarchingStrategy::OverRelaxed : MarchingStrategy::SphereTracing);
+                return;
+            }
+            case GLFW_KEY_S:
+                if (!g_renderer->isStillPending()) {
+                    std::cout << "Rendering 7680x4320 still (still.ppm)..." << std::endl;
+                    g_renderer->requestStill(g_renderer->getCameraPose(), 7680, 4320,
+                        [](size_t, const unsigned char* pixels, int width, int height) {
+                            if (writePPM("still.ppm", pixels, width, height)) {
+                                std::cout << "Wrote still.ppm" << std::endl;
+                            }
+                        });
+                }
+                return;
+            case GLFW_KEY_V: {
+                bool volume = !g_renderer->isShadowVolumeEnabled();
+                std::cout << "Shadow visibility volume: " << (volume ? "on" : "off") << std::endl;
+                g_renderer->setShadowVolume(volume);
+                return;
+            }
+            case GLFW_KEY_P: {
+                bool prepass = !g_renderer->isConePrepassEnabled();
+                std::cout << "Cone marching pre-pass: " << (prepass ? "on" : "off") << std::endl;
+                g_renderer->setConePrepass(prepass);
+                return;
+            }
+            case GLFW_KEY_T: {
+                // Cycle off, color reuse, depth reuse
+                TemporalMode mode = g_renderer->getTemporalReprojection();
+                mode = mode == TemporalMode::Off ? TemporalMode::ReuseColor :
+                       mode == TemporalMode::ReuseColor ? TemporalMode::ReuseDepth : TemporalMode::Off;
+                const char* names[] = { "off", "reuse color", "reuse depth" };
+                std::cout << "Temporal reprojection: " << names[static_cast<int>(mode)] << std::endl;
+                g_renderer->setTemporalReprojection(mode);
+                return;
+            }
+            case GLFW_KEY_R: {
+                bool dynamic = !g_renderer->isDynamicResolutionEnabled();
+                std::cout << "Dynamic resolution: " << (dynamic ? "on" : "off") << std::endl;
+                g_renderer->setDynamicResolution(dynamic, 14.0f, 0.5f, true);
+                return;
+            }
+            case GLFW_KEY_F: {
+                bool profiling = !g_renderer->isProfiling();
+                std::cout << "Profiling: " << (profiling ? "on (profile.jsonl)" : "off") << std::endl;
+                g_renderer->setProfiling(profiling, "profile.jsonl");
+#ifdef USE_ADVANCED_OPENGL
+                g_renderer->setStepCounters(profiling);
+#endif
+                return;
+            }
+            case GLFW_KEY_H: {
+                bool heatmap = !g_renderer->isStepHeatmapEnabled();
+                std::cout << "Step heatmap: " << (heatmap ? "on" : "off") << std::endl;
+                g_renderer->setStepHeatmap(heatmap);
+                return;
+            }
+            case GLFW_KEY_G: {
+                bool compute = g_renderer->getRenderBackend() != RenderBackend::Compute;
+                g_renderer->setRenderBackend(compute ? RenderBackend::Compute : RenderBackend::Fragment);
+                bool active = g_renderer->getRenderBackend() == RenderBackend::Compute;
+                std::cout << "Render backend: " << (active ? "compute" : "fragment") << std::endl;
+                return;
+            }
             case GLFW_KEY_ESCAPE:
                 glfwSetWindowShouldClose(window, GLFW_TRUE);
                 return;
@@ -82,6 +179,117 @@ void switchScene(ImplicitRenderer& renderer, int sceneIndex) {
     }
 }
 
+// Polygonize the displayed scene and write it as an OBJ file
+void exportSceneMesh(const ImplicitRenderer& renderer, const std::string& path) {
+    std::shared_ptr<ImplicitSurface> scene = renderer.getScene();
+    if (!scene || !scene->getBounds().isFinite()) {
+        std::cout << "Mesh export needs a bounded scene" << std::endl;
+        return;
+    }
+
+    MeshExtractor::Settings settings;
+    settings.resolution = 256;
+    Mesh mesh = MeshExtractor(settings).extract(scene);
+    if (mesh.writeOBJ(path)) {
+        std::cout << "Exported " << mesh.getTriangleCount() << " triangles to " << path << std::endl;
+    }
+}
+
+// Write an RGBA8 frame from glReadPixels (bottom row first) as a binary PPM
+bool writePPM(const std::string& path, const unsigned char* pixels, int width, int height) {
+    FILE* file = std::fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Could not write " << path << std::endl;
+        return false;
+    }
+
+    std::fprintf(file, "P6\n%d %d\n255\n", width, height);
+    std::vector<unsigned char> row(static_cast<size_t>(width) * 3);
+    for (int y = height - 1; y >= 0; --y) {
+        const unsigned char* source = pixels + static_cast<size_t>(y) * width * 4;
+        for (int x = 0; x < width; ++x) {
+            row[x * 3 + 0] = source[x * 4 + 0];
+            row[x * 3 + 1] = source[x * 4 + 1];
+            row[x * 3 + 2] = source[x * 4 + 2];
+        }
+        std::fwrite(row.data(), 1, row.size(), file);
+    }
+    return std::fclose(file) == 0;
+}
+
+// Render a full orbit around the current scene offscreen, one PPM per frame
+int renderTurntable(const BatchRenderer& render, int frames, int width, int height, const std::string& prefix) {
+    std::vector<CameraPose> path;
+    for (int i = 0; i < frames; ++i) {
+        float angle = 2.0f * 3.14159265f * static_cast<float>(i) / static_cast<float>(frames);
+        path.push_back({ Vec3<float>(std::sin(angle) * 5.0f, 0.0f, std::cos(angle) * 5.0f),
+                         Vec3<float>(0, 0, 0), Vec3<float>(0, 1, 0), 45.0f });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    bool written = true;
+    bool rendered = render(path, width, height,
+        [&](size_t frame, const unsigned char* pixels, int frameWidth, int frameHeight) {
+            char name[32];
+            std::snprintf(name, sizeof(name), "_%04zu.ppm", frame);
+            written = writePPM(prefix + name, pixels, frameWidth, frameHeight) && written;
+        });
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    if (!rendered || !written) {
+        std::cerr << "Turntable rendering failed" << std::endl;
+        return -1;
+    }
+    std::cout << "Rendered " << frames << " frames of " << width << "x" << height << " in " << seconds
+              << " s (" << frames / seconds << " frames/s)" << std::endl;
+    return 0;
+}
+
+// The turntable on the CPU renderer, for machines without a GPU, with the demo's settings
+int renderCpuTurntable(const std::shared_ptr<ImplicitSurface>& scene, int frames, int width, int height,
+                       const std::string& prefix) {
+    CpuRenderer::Settings settings;
+    settings.lightPosition = Vec3<float>(4, 4, 4);
+    settings.lightColor = Vec3<float>(1, 1, 1);
+    settings.ambientStrength = 0.2f;
+    settings.maxSteps = 100;
+    settings.maxDistance = 50.0f;
+    settings.epsilon = 0.001f;
+    settings.overRelaxation = 1.2f;
+    settings.pixelFootprintScale = 0.5f;
+
+    CpuRenderer renderer(settings);
+    renderer.setScene(scene);
+    std::cout << "Rendering on " << ThreadPool::shared().getConcurrency() << " CPU threads" << std::endl;
+    return renderTurntable([&](const std::vector<CameraPose>& path, int frameWidth, int frameHeight, const FrameConsumer& consumer) {
+        return renderer.renderFrames(path, frameWidth, frameHeight, consumer);
+    }, frames, width, height, prefix);
+}
+
+// Load a binary or JSON scene file as the renderer's surface tree
+std::shared_ptr<ImplicitSurface> loadSceneFile(const std::string& path) {
+    SceneGraph graph;
+    if (!SceneFile::load(path, graph)) {
+        return nullptr;
+    }
+    if (!graph.isValid(graph.getRoot())) {
+        std::cerr << "Error: Scene " << path << " is empty" << std::endl;
+        return nullptr;
+    }
+    std::cout << "Loaded " << graph.size() << " scene nodes from " << path << std::endl;
+    return graph.toSurface(graph.getRoot());
+}
+
+// Convert a scene file; outputs ending in .json get the text form, others the binary one
+bool convertSceneFile(const std::string& input, const std::string& output) {
+    SceneGraph graph;
+    if (!SceneFile::load(input, graph)) {
+        return false;
+    }
+    bool json = output.size() >= 5 && output.compare(output.size() - 5, 5, ".json") == 0;
+    return json ? SceneFile::saveJSON(graph, output) : SceneFile::save(graph, output);
+}
+
 // Custom scene creation function
 std::shared_ptr<ImplicitSurface> createCustomScene() {
     // Create a complex CSG scene showcasing various boolean operations
@@ -110,13 +318,61 @@ std::shared_ptr<ImplicitSurface> createCustomScene() {
 }
 
 // Main function
-int main() {
+// Usage: ImplicitBooleanCSG [--test | --convert input output |
+//                             [--scene file] [--turntable frames width height prefix [--cpu]]]
+int main(int argc, char** argv) {
+    // Self test run by CTest; exits non-zero if any check fails
+    if (argc > 1 && std::strcmp(argv[1], "--test") == 0) {
+        return SelfTest::run(std::cout) == 0 ? 0 : 1;
+    }
+    if (argc > 1 && std::strcmp(argv[1], "--convert") == 0) {
+        if (argc != 4) {
+            std::cerr << "Usage: " << argv[0] << " --convert input output" << std::endl;
+            return -1;
+        }
+        return convertSceneFile(argv[2], argv[3]) ? 0 : -1;
+    }
+
+    // A scene file replaces the default scene; the other arguments keep their positions
+    std::shared_ptr<ImplicitSurface> fileScene;
+    std::vector<char*> arguments(argv, argv + argc);
+    if (argc > 2 && std::strcmp(argv[1], "--scene") == 0) {
+        fileScene = loadSceneFile(argv[2]);
+        if (!fileScene) {
+            return -1;
+        }
+        arguments.erase(arguments.begin() + 1, arguments.begin() + 3);
+        argc = static_cast<int>(arguments.size());
+        argv = arguments.data();
+    }
+
+    // Batch mode renders an orbit of the default scene without showing a window
+    bool turntable = argc > 1 && std::strcmp(argv[1], "--turntable") == 0;
+    int turntableFrames = argc > 2 ? std::atoi(argv[2]) : 120;
+    int turntableWidth = argc > 3 ? std::atoi(argv[3]) : 1920;
+    int turntableHeight = argc > 4 ? std::atoi(argv[4]) : 1080;
+    std::string turntablePrefix = argc > 5 ? argv[5] : "frame";
+    if (turntable && (turntableFrames <= 0 || turntableWidth <= 0 || turntableHeight <= 0)) {
+        std::cerr << "Usage: " << argv[0] << " --turntable frames width height prefix [--cpu]" << std::endl;
+        return -1;
+    }
+
+    // --cpu renders the turntable without creating an OpenGL context at all
+    if (turntable && argc > 6 && std::strcmp(argv[6], "--cpu") == 0) {
+        return renderCpuTurntable(fileScene ? fileScene : ImplicitRenderer::createCSGIntersectionScene(),
+                                  turntableFrames, turntableWidth, turntableHeight, turntablePrefix);
+    }
+
     // Create renderer instance
     ImplicitRenderer renderer(800, 600);
+    renderer.setHeadless(turntable);
 
     // Set global pointer for callback use
     g_renderer = &renderer;
 
+    // Reuse linked shader programs across runs
+    renderer.setShaderCacheDirectory("shader_cache");
+
     // Initialize
     if (!renderer.initialize()) {
         std::cerr << "Renderer initialization failed!" << std::endl;
@@ -134,9 +390,21 @@ int main() {
 
     // Set ray marching parameters
     renderer.setRaymarchingParams(100, 50.0f, 0.001f);
+    renderer.setMarchingStrategy(MarchingStrategy::OverRelaxed);
+    renderer.setPixelFootprintEpsilon(0.5f);
+    renderer.setConePrepass(true);
 
     // Default scene: Complex CSG operation
-    renderer.setScene(renderer.createCSGIntersectionScene());
+    renderer.setScene(fileScene ? fileScene : renderer.createCSGIntersectionScene());
+
+    if (turntable) {
+        // Large frames are drawn in tiles to stay below driver timeouts
+        renderer.setTileSize(512);
+        g_renderer = nullptr;
+        return renderTurntable([&](const std::vector<CameraPose>& path, int frameWidth, int frameHeight, const FrameConsumer& consumer) {
+            return renderer.renderFrames(path, frameWidth, frameHeight, consumer);
+        }, turntableFrames, turntableWidth, turntableHeight, turntablePrefix);
+    }
 
     std::cout << "Implicit Boolean CSG Demonstration" << std::endl;
     std::cout << "------------------------" << std::endl;
@@ -147,6 +415,17 @@ int main() {
     std::cout << "4: CSG Difference Operation" << std::endl;
     std::cout << "5: Complex CSG Scene (Union then Difference)" << std::endl;
     std::cout << "C: Custom CSG Scene" << std::endl;
+    std::cout << "B: Toggle Baked Distance Field" << std::endl;
+    std::cout << "E: Export Scene Mesh (scene.obj)" << std::endl;
+    std::cout << "M: Toggle Over-Relaxed Sphere Tracing" << std::endl;
+    std::cout << "P: Toggle Cone Marching Pre-Pass" << std::endl;
+    std::cout << "V: Toggle Baked Shadow Volume" << std::endl;
+    std::cout << "T: Cycle Temporal Reprojection (Off / Color / Depth)" << std::endl;
+    std::cout << "R: Toggle Dynamic Resolution (14 ms GPU budget)" << std::endl;
+    std::cout << "G: Toggle Compute Shader Backend" << std::endl;
+    std::cout << "F: Toggle Profiling (profile.jsonl, timings in the title)" << std::endl;
+    std::cout << "H: Toggle Step Count Heatmap" << std::endl;
+    std::cout << "S: Render 8K Still Progressively (still.ppm)" << std::endl;
     std::cout << "ESC: Exit Program" << std::endl;
 
     // Run main loop
@@ -0,0 +1,42 @@
+﻿// Baked distance field sampling (layout documented in DistanceField.h).
+// marchSDF is what the sphere tracer steps with: the baked field far from the
+// surface, the exact sceneSDF once the baked distance drops below the band.
+// The field's bounds and sizes are members of FrameParameters (fragment.frag).
+uniform sampler3D bakedBrickIndex; // xy: atlas slot (-1 for empty bricks), conservative distance
+uniform sampler3D bakedBrickAtlas;
+
+const int bakedBrickCells = 8;
+
+float bakedSDF(vec3 p) {
+    // The surface lies at least bakedExactBand inside the baked region
+    vec3 gap = max(max(bakedBoundsMin - p, p - bakedBoundsMax), 0.0);
+    if (any(greaterThan(gap, vec3(0.0)))) {
+        return length(gap) + bakedExactBand;
+    }
+
+    vec3 cell = (p - bakedBoundsMin) / bakedVoxelSize;
+    ivec3 brick = clamp(ivec3(cell) / bakedBrickCells, ivec3(0), bakedBrickGrid - 1);
+    vec2 entry = texelFetch(bakedBrickIndex, brick, 0).xy;
+    if (entry.x < 0.0) {
+        return entry.y;
+    }
+
+    int slot = int(entry.x);
+    ivec3 atlasBrick = ivec3(slot % bakedAtlasBricks.x,
+                             (slot / bakedAtlasBricks.x) % bakedAtlasBricks.y,
+                             slot / (bakedAtlasBricks.x * bakedAtlasBricks.y));
+    vec3 local = clamp(cell - vec3(brick * bakedBrickCells), 0.0, float(bakedBrickCells));
+    vec3 texel = vec3(atlasBrick * (bakedBrickCells + 1)) + local + 0.5;
+    return texture(bakedBrickAtlas, texel / vec3(textureSize(bakedBrickAtlas, 0))).x;
+}
+
+float marchSDF(vec3 p) {
+    if (!useBakedField) {
+        return sceneSDF(p);
+    }
+
+    // Trilinear reconstruction can overestimate by up to a voxel, so keep a
+    // voxel of margin and switch to the exact scene close to the surface
+    float d = bakedSDF(p);
+    return d < bakedExactBand ? sceneSDF(p) : d - bakedVoxelSize;
+}
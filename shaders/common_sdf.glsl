@@ -9,6 +9,11 @@ float boxSDF(vec3 p, vec3 center, vec3 dimensions) {
     return length(max(d, 0.0)) + min(max(d.x, max(d.y, d.z)), 0.0);
 }
 
+// Plane distance function (normal must be normalized)
+float planeSDF(vec3 p, vec3 normal, float distance) {
+    return dot(normal, p) + distance;
+}
+
 // Cylinder distance function
 float cylinderSDF(vec3 p, vec3 start, vec3 end, float radius) {
     vec3 ba = end - start;
@@ -17,32 +22,103 @@ float cylinderSDF(vec3 p, vec3 start, vec3 end, float radius) {
     return length(pa - h * ba) - radius;
 }
 
+// Cylinder distance function with precomputed axis (end - start) and 1 / dot(axis, axis)
+float cylinderAxisSDF(vec3 p, vec3 start, vec3 axis, float invAxisLengthSq, float radius) {
+    vec3 pa = p - start;
+    float h = clamp(dot(pa, axis) * invAxisLengthSq, 0.0, 1.0);
+    return length(pa - h * axis) - radius;
+}
+
+// Instance transforms: the subtree is placed at translation + scale * rotation * local.
+// inverseRotation is the transposed rotation.
+vec3 instancePoint(vec3 p, vec3 translation, mat3 inverseRotation, float inverseScale) {
+    return inverseRotation * (p - translation) * inverseScale;
+}
+
 // CSG boolean operations
 float unionOp(float d1, float d2) { return min(d1, d2); }
 float intersectionOp(float d1, float d2) { return max(d1, d2); }
 float differenceOp(float d1, float d2) { return max(d1, -d2); }
 
-// Smooth boolean operations
+// Smooth boolean operations (cubic polynomial blend, matches ImplicitSurfaces.h)
+// k is clamped so a zero smoothing factor read from the parameter block degrades to the sharp operation
 float smoothUnionOp(float d1, float d2, float k) {
-    float h = clamp(0.5 + 0.5 * (d2 - d1) / k, 0.0, 1.0);
-    return mix(d2, d1, h) - k * h * (1.0 - h);
+    float h = max(k - abs(d1 - d2), 0.0) / max(k, 1e-6);
+    return min(d1, d2) - h * h * h * k * (1.0 / 6.0);
 }
 
 float smoothIntersectionOp(float d1, float d2, float k) {
-    float h = clamp(0.5 - 0.5 * (d2 - d1) / k, 0.0, 1.0);
-    return mix(d2, d1, h) + k * h * (1.0 - h);
+    float h = max(k - abs(d1 - d2), 0.0) / max(k, 1e-6);
+    return max(d1, d2) + h * h * h * k * (1.0 / 6.0);
 }
 
 float smoothDifferenceOp(float d1, float d2, float k) {
-    float h = clamp(0.5 - 0.5 * (d2 + d1) / k, 0.0, 1.0);
-    return mix(d1, -d2, h) + k * h * (1.0 - h);
+    float h = max(k - abs(d1 + d2), 0.0) / max(k, 1e-6);
+    return max(d1, -d2) + h * h * h * k * (1.0 / 6.0);
+}
+
+// Distance functions with analytic gradients, packed as vec4(distance, gradient)
+vec4 sphereSDFGrad(vec3 p, vec3 center, float radius) {
+    vec3 d = p - center;
+    float len = length(d);
+    return vec4(len - radius, len > 0.0 ? d / len : vec3(0.0, 1.0, 0.0));
+}
+
+vec4 boxSDFGrad(vec3 p, vec3 center, vec3 dimensions) {
+    vec3 w = p - center;
+    vec3 s = mix(vec3(-1.0), vec3(1.0), step(0.0, w));
+    vec3 d = abs(w) - dimensions;
+    float g = max(d.x, max(d.y, d.z));
+    if (g > 0.0) {
+        vec3 q = max(d, 0.0);
+        float len = length(q);
+        return vec4(len, s * q / len);
+    }
+    vec3 face = (d.x >= d.y && d.x >= d.z) ? vec3(1.0, 0.0, 0.0) : (d.y >= d.z ? vec3(0.0, 1.0, 0.0) : vec3(0.0, 0.0, 1.0));
+    return vec4(g, s * face);
+}
+
+vec4 planeSDFGrad(vec3 p, vec3 normal, float distance) {
+    return vec4(dot(normal, p) + distance, normal);
 }
 
-// Normal calculation function
+vec4 cylinderAxisSDFGrad(vec3 p, vec3 start, vec3 axis, float invAxisLengthSq, float radius) {
+    vec3 pa = p - start;
+    float h = clamp(dot(pa, axis) * invAxisLengthSq, 0.0, 1.0);
+    vec3 q = pa - h * axis;
+    float len = length(q);
+    return vec4(len - radius, len > 0.0 ? q / len : vec3(0.0, 1.0, 0.0));
+}
+
+// Bring an instance's vec4(distance, gradient) back to the parent frame (the scale cancels in the gradient)
+vec4 instanceGrad(vec4 local, mat3 inverseRotation, float scale) {
+    return vec4(local.x * scale, local.yzw * inverseRotation);
+}
+
+// Boolean operations on distance/gradient pairs (negating a vec4 negates both parts)
+vec4 unionGrad(vec4 a, vec4 b) { return a.x <= b.x ? a : b; }
+vec4 intersectionGrad(vec4 a, vec4 b) { return a.x >= b.x ? a : b; }
+vec4 differenceGrad(vec4 a, vec4 b) { return intersectionGrad(a, -b); }
+
+vec4 smoothUnionGrad(vec4 a, vec4 b, float k) {
+    float h = max(k - abs(a.x - b.x), 0.0) / max(k, 1e-6);
+    vec4 m = a.x <= b.x ? a : b;
+    vec4 o = a.x <= b.x ? b : a;
+    return vec4(m.x - h * h * h * k * (1.0 / 6.0), mix(m.yzw, o.yzw, 0.5 * h * h));
+}
+
+vec4 smoothIntersectionGrad(vec4 a, vec4 b, float k) {
+    float h = max(k - abs(a.x - b.x), 0.0) / max(k, 1e-6);
+    vec4 m = a.x >= b.x ? a : b;
+    vec4 o = a.x >= b.x ? b : a;
+    return vec4(m.x + h * h * h * k * (1.0 / 6.0), mix(m.yzw, o.yzw, 0.5 * h * h));
+}
+
+vec4 smoothDifferenceGrad(vec4 a, vec4 b, float k) {
+    return smoothIntersectionGrad(a, -b, k);
+}
+
+// Normal calculation function (single pass through the analytic gradient)
 vec3 sceneNormal(vec3 p) {
-    const float h = 0.0001;
-    float dx = sceneSDF(p + vec3(h, 0, 0)) - sceneSDF(p - vec3(h, 0, 0));
-    float dy = sceneSDF(p + vec3(0, h, 0)) - sceneSDF(p - vec3(0, h, 0));
-    float dz = sceneSDF(p + vec3(0, 0, h)) - sceneSDF(p - vec3(0, 0, h));
-    return normalize(vec3(dx, dy, dz));
-}
\ No newline at end of file
+    return normalize(sceneSDFGradient(p).yzw);
+}
@@ -1,90 +1,86 @@
 ﻿#version 330 core
 in vec2 texCoord;
-out vec4 fragColor;
-
-uniform vec3 cameraPosition;
-uniform vec3 cameraTarget;
-uniform vec3 cameraUp;
-uniform float fieldOfView;
-uniform vec2 resolution;
-
-uniform vec3 lightPosition;
-uniform vec3 lightColor;
-uniform float ambientStrength;
-
-uniform int maxSteps;
-uniform float maxDistance;
-uniform float epsilon;
-
-// Implicit scene function - will be replaced with specific scene at runtime
-float sceneSDF(vec3 p);
-vec3 sceneNormal(vec3 p);
-
-// Calculate ray direction
-vec3 getRayDir(vec2 uv, vec3 camPos, vec3 camTarget, vec3 camUp, float fov) {
-    vec3 forward = normalize(camTarget - camPos);
-    vec3 right = normalize(cross(forward, camUp));
-    vec3 up = cross(right, forward);
+layout(location = 0) out vec4 fragColor;
 
-    float aspect = resolution.x / resolution.y;
-    float tanFov = tan(radians(fov) / 2.0);
+// Marching and shading live in raymarch.glsl, inserted after the #version line
+
+// Cone pre-pass: conservative start depth and step count of each coneTileSize^2 pixel tile
+#ifndef CONE_PREPASS
+uniform sampler2D coneDepth; // Not declared while rendering into it
+
+// Temporal reprojection: color and ray depth of the previous frame
+layout(location = 1) out float fragDepth;
+uniform sampler2D historyColor;
+uniform sampler2D historyDepth;
+
+// Fraction of the reprojected depth marched again in front of it when reusing depth
+const float reprojectionMargin = 0.05;
+
+// Frames a color is reused before it is marched again. The history alpha
+// holds 1 - age / 255, so the age follows the sample through reprojection.
+const int maxSampleAge = 4;
+#endif
 
-    vec3 rayDir = normalize(forward +
-                           (2.0 * uv.x - 1.0) * tanFov * aspect * right +
-                           (2.0 * uv.y - 1.0) * tanFov * up);
+#ifdef CONE_PREPASS
+// Cone marching pre-pass, rendered at one fragment per coneTileSize^2 pixel tile
+void main() {
+    vec2 tileMin = floor(gl_FragCoord.xy) * float(coneTileSize);
+    vec3 rd;
+    float coneRatio = tileCone(tileMin, tileMin + float(coneTileSize), rd);
 
-    return rayDir;
+    int steps;
+    float depth = coneMarch(cameraPosition, rd, coneRatio, steps);
+    fragColor = vec4(depth, float(steps), 0.0, 0.0);
 }
+#else
+// Texel of the previous frame whose ray passes through p, false outside its view
+bool previousTexel(vec3 p, out ivec2 texel) {
+    vec3 forward = normalize(previousCameraTarget - previousCameraPosition);
+    vec3 right = normalize(cross(forward, previousCameraUp));
+    vec3 up = cross(right, forward);
 
-// Ray marching algorithm
-float rayMarch(vec3 ro, vec3 rd, out int steps) {
-    float depth = 0.0;
-    steps = 0;
-
-    for(int i = 0; i < maxSteps; i++) {
-        vec3 p = ro + depth * rd;
-        float dist = sceneSDF(p);
-        if(dist < epsilon) {
-            steps = i;
-            return depth;
-        }
+    // Inverse of getRayDir for the previous camera
+    vec3 v = p - previousCameraPosition;
+    float z = dot(v, forward);
+    float tanFov = tan(radians(previousFieldOfView) / 2.0);
+    float aspect = resolution.x / resolution.y;
+    vec2 uv = 0.5 + 0.5 * vec2(dot(v, right) / (z * tanFov * aspect), dot(v, up) / (z * tanFov));
+    texel = ivec2(floor(uv * resolution));
+    return z > 0.0 && all(greaterThanEqual(texel, ivec2(0))) && all(lessThan(texel, ivec2(resolution)));
+}
 
-        depth += dist;
-        if(depth >= maxDistance) {
-            steps = maxSteps;
-            return maxDistance;
+// Surface the previous frame saw along this pixel's ray. The previous depth at
+// this pixel gives a first point, which is followed to the texel that saw it;
+// that texel's sample is accepted when it lies on this ray within one pixel
+// footprint (or the hit threshold) and the scene still has a surface there.
+bool reprojectPixel(vec3 ro, vec3 rd, ivec2 pixel, out float depth, out vec4 color) {
+    float pixelAngle = 2.0 * tan(radians(fieldOfView) / 2.0) / resolution.y;
+    depth = texelFetch(historyDepth, pixel, 0).r;
+    color = vec4(0.0);
+
+    for(int i = 0; i < 2; i++) {
+        ivec2 texel;
+        if(depth <= 0.0 || depth >= maxDistance || !previousTexel(ro + rd * depth, texel)) {
+            return false;
         }
 
-        steps = i;
+        float previousDepth = texelFetch(historyDepth, texel, 0).r;
+        if(previousDepth >= maxDistance) {
+            return false;
+        }
+        vec2 texelUV = (vec2(texel) + 0.5) / resolution;
+        vec3 seen = previousCameraPosition + previousDepth *
+                    getRayDir(texelUV, previousCameraPosition, previousCameraTarget, previousCameraUp, previousFieldOfView);
+
+        depth = dot(seen - ro, rd);
+        float tolerance = max(max(epsilon, depth * pixelFootprint), depth * pixelAngle);
+        if(depth > 0.0 && length(seen - (ro + rd * depth)) < tolerance) {
+            color = texelFetch(historyColor, texel, 0);
+            return abs(marchSDF(ro + rd * depth) / lipschitzBound) < tolerance;
+        }
     }
 
-    return maxDistance;
-}
-
-// Lighting calculation
-vec3 calculateLighting(vec3 p, vec3 n, vec3 viewDir) {
-    // Ambient light
-    vec3 ambient = ambientStrength * lightColor;
-
-    // Diffuse light
-    vec3 lightDir = normalize(lightPosition - p);
-    float diff = max(dot(n, lightDir), 0.0);
-    vec3 diffuse = diff * lightColor;
-
-    // Specular reflection
-    vec3 reflectDir = reflect(-lightDir, n);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
-    vec3 specular = 0.5 * spec * lightColor;
-
-    // Shadow
-    float shadowDist = 0.1; // Offset to avoid self-shadowing
-    vec3 shadowPos = p + n * shadowDist;
-    vec3 shadowDir = normalize(lightPosition - shadowPos);
-    int shadowSteps;
-    float shadowDist2 = rayMarch(shadowPos, shadowDir, shadowSteps);
-    float shadow = (shadowDist2 < length(lightPosition - shadowPos)) ? 0.5 : 1.0;
-
-    return ambient + (diffuse + specular) * shadow;
+    return false;
 }
 
 void main() {
@@ -92,22 +88,37 @@ void main() {
     vec3 ro = cameraPosition;
     vec3 rd = getRayDir(uv, cameraPosition, cameraTarget, cameraUp, fieldOfView);
 
-    int steps;
-    float dist = rayMarch(ro, rd, steps);
-
-    if(dist < maxDistance) {
-        vec3 p = ro + rd * dist;
-        vec3 n = sceneNormal(p);
-        vec3 color = calculateLighting(p, n, -rd);
-
-        // Add details based on step count
-        float depthFactor = 1.0 - float(steps) / float(maxSteps);
-        color *= mix(0.5, 1.0, depthFactor); // Darken distant objects
-
-        fragColor = vec4(color, 1.0);
-    } else {
-        // Gradient background
-        vec3 backgroundColor = mix(vec3(0.1, 0.1, 0.2), vec3(0.2, 0.3, 0.4), uv.y);
-        fragColor = vec4(backgroundColor, 1.0);
+    // Start where the cone of this pixel's tile first came close to the scene
+    float startDepth = 0.0;
+    int coneSteps = 0;
+    if(useConeDepth) {
+        ivec2 tile = ivec2(uv * resolution) / coneTileSize;
+        vec2 cone = texelFetch(coneDepth, tile, 0).xy;
+        startDepth = cone.x;
+        coneSteps = int(cone.y);
+    }
+
+    // Pixels outside this frame's checkerboard quarter reuse the previous frame where it is still valid
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    bool refresh = ((pixel.x & 1) + 2 * (pixel.y & 1)) == temporalFrame;
+    float reprojectedDepth;
+    vec4 reprojectedColor;
+    if(temporalMode != 0 && !refresh && reprojectPixel(ro, rd, pixel, reprojectedDepth, reprojectedColor)) {
+        // Colors that moved between texels escape the checkerboard, so their own age bounds the reuse
+        int age = int(round((1.0 - reprojectedColor.a) * 255.0)) + 1;
+        if(temporalMode == 1 && age < maxSampleAge) {
+            fragColor = vec4(reprojectedColor.rgb, 1.0 - float(age) / 255.0);
+            fragDepth = reprojectedDepth;
+            return;
+        }
+        if(temporalMode == 2) {
+            startDepth = max(startDepth, reprojectedDepth * (1.0 - reprojectionMargin));
+        }
     }
-}
\ No newline at end of file
+
+    int steps;
+    float dist = rayMarch(ro, rd, startDepth, steps);
+    fragColor = shadePixel(ro, rd, uv, dist, min(steps + coneSteps, maxSteps));
+    fragDepth = dist;
+}
+#endif
@@ -0,0 +1,283 @@
+﻿// Ray marching and shading shared by the fragment and compute backends. The
+// renderer inserts this file right after the #version line of each stage;
+// the stage only supplies its entry point and outputs.
+
+// Everything the renderer sets per frame, in one uniform buffer shared by all
+// programs. Mirrored by ImplicitRenderer::FrameParameters, keep both in sync.
+layout(std140) uniform FrameParameters {
+    vec3 cameraPosition;
+    float fieldOfView;
+    vec3 cameraTarget;
+    float ambientStrength;
+    vec3 cameraUp;
+    float maxDistance;
+    vec3 lightPosition;
+    float epsilon;
+    vec3 lightColor;
+    float overRelaxation;  // Step scale of over-relaxed sphere tracing (1 disables it)
+    vec2 resolution;
+    float pixelFootprint;  // Hit threshold per unit of depth (0 keeps the fixed epsilon)
+    float lipschitzBound;  // Upper bound of the scene field's gradient length
+    int maxSteps;
+    int shadowMaxSteps;    // Shadow rays: own step budget and penumbra width
+    float shadowSoftness;
+    int coneTileSize;      // Pixels per side of a cone pre-pass tile
+
+    // Baked distance field, see baked_sdf.glsl
+    vec3 bakedBoundsMin;
+    float bakedVoxelSize;
+    vec3 bakedBoundsMax;
+    float bakedExactBand;
+    ivec3 bakedBrickGrid;
+    bool useBakedField;
+    ivec3 bakedAtlasBricks;
+
+    // Baked shadow visibility volume
+    bool useShadowVolume;
+    vec3 shadowVolumeMin;
+    float shadowVolumeOffset;
+    vec3 shadowVolumeMax;
+    bool useConeDepth;     // Main pass starts at the cone pre-pass depth
+
+    // Camera of the frame in the history textures, see fragment.frag
+    vec3 previousCameraPosition;
+    int temporalFrame;     // Checkerboard quarter re-marched this frame
+    vec3 previousCameraTarget;
+    int temporalMode;      // 0 off, 1 reuse color, 2 reuse depth (TemporalMode)
+    vec3 previousCameraUp;
+    float previousFieldOfView;
+
+    bool stepHeatmap;      // Color pixels by their march steps instead of shading them
+};
+
+#ifdef STEP_COUNTERS
+// Step statistics of the frame, read back by the renderer's profiler
+layout(std430, binding = 1) buffer StepCounters {
+    uint marchedPixels;
+    uint totalSteps;
+    uint mostSteps;
+    uint stepHistogram[16]; // Pixels per sixteenth of maxSteps
+};
+#endif
+
+uniform sampler3D shadowVolume;
+
+// Implicit scene function - will be replaced with specific scene at runtime
+float sceneSDF(vec3 p);
+vec4 sceneSDFGradient(vec3 p); // vec4(distance, gradient)
+vec3 sceneNormal(vec3 p);
+float marchSDF(vec3 p); // sceneSDF, or the baked field when enabled
+
+// Calculate ray direction
+vec3 getRayDir(vec2 uv, vec3 camPos, vec3 camTarget, vec3 camUp, float fov) {
+    vec3 forward = normalize(camTarget - camPos);
+    vec3 right = normalize(cross(forward, camUp));
+    vec3 up = cross(right, forward);
+
+    float aspect = resolution.x / resolution.y;
+    float tanFov = tan(radians(fov) / 2.0);
+
+    vec3 rayDir = normalize(forward +
+                           (2.0 * uv.x - 1.0) * tanFov * aspect * right +
+                           (2.0 * uv.y - 1.0) * tanFov * up);
+
+    return rayDir;
+}
+
+// Ray marching algorithm: sphere tracing, optionally over-relaxed. An
+// over-relaxed step is only kept while the unbounding spheres of consecutive
+// samples overlap and the ray stays outside; otherwise it steps back into the
+// last safe sphere and continues with plain steps. A hit is accepted below
+// epsilon or the pixel footprint at the current depth, whichever is larger.
+//
+// Marches at most budget steps and returns the hit depth, maxDistance once
+// the ray leaves the scene, or -1 when the budget runs out first. resumeDepth
+// is then a depth known to be outside the surface to continue from (the
+// last over-relaxed step is not validated yet, so it is not used).
+float traceSegment(vec3 ro, vec3 rd, float startDepth, int budget, out int steps, out float resumeDepth) {
+    float depth = startDepth;
+    float omega = overRelaxation;
+    float previousRadius = 0.0;
+    float stepLength = 0.0;
+    float inverseLipschitz = 1.0 / lipschitzBound;
+    steps = 0;
+    resumeDepth = startDepth;
+
+    for(int i = 0; i < budget; i++) {
+        vec3 p = ro + depth * rd;
+        float dist = marchSDF(p) * inverseLipschitz;
+        float radius = abs(dist);
+
+        bool relaxationFailed = omega > 1.0 && (dist < 0.0 || radius + previousRadius < stepLength);
+        if(relaxationFailed) {
+            stepLength -= omega * stepLength;
+            omega = 1.0;
+        } else {
+            stepLength = dist * omega;
+        }
+        previousRadius = radius;
+
+        if(!relaxationFailed && dist < max(epsilon, depth * pixelFootprint)) {
+            steps = i;
+            return depth;
+        }
+
+        resumeDepth = relaxationFailed ? depth + stepLength : depth + dist;
+        depth += stepLength;
+        if(depth >= maxDistance) {
+            steps = budget;
+            return maxDistance;
+        }
+
+        steps = i;
+    }
+
+    return -1.0;
+}
+
+float rayMarch(vec3 ro, vec3 rd, float startDepth, out int steps) {
+    float resumeDepth;
+    float depth = traceSegment(ro, rd, startDepth, maxSteps, steps, resumeDepth);
+    return depth < 0.0 ? maxDistance : depth;
+}
+
+// Soft shadow towards the light with its own step budget. Stops at the first
+// occluder and otherwise keeps the narrowest penumbra cone seen along the ray,
+// using the previous sample to locate the closest approach between steps.
+float softShadow(vec3 ro, vec3 rd, float maxT) {
+    float result = 1.0;
+    float t = 0.0;
+    float previous = 1e20;
+    float inverseLipschitz = 1.0 / lipschitzBound;
+
+    for(int i = 0; i < shadowMaxSteps && t < maxT; i++) {
+        float h = marchSDF(ro + rd * t) * inverseLipschitz;
+        if(h < epsilon) {
+            return 0.0;
+        }
+
+        float y = h * h / (2.0 * previous);
+        float d = sqrt(max(h * h - y * y, 0.0));
+        result = min(result, shadowSoftness * d / max(t - y, 1e-4));
+        previous = h;
+        t += h;
+
+        // Anything darker is indistinguishable from full shadow
+        if(result < 0.01) {
+            return 0.0;
+        }
+    }
+
+    return clamp(result, 0.0, 1.0);
+}
+
+// Visibility of the light from a surface point, from the baked volume where it
+// covers the point and by marching a shadow ray elsewhere
+float lightVisibility(vec3 p, vec3 n) {
+    if(useShadowVolume) {
+        vec3 uvw = (p + n * shadowVolumeOffset - shadowVolumeMin) / (shadowVolumeMax - shadowVolumeMin);
+        if(all(greaterThanEqual(uvw, vec3(0.0))) && all(lessThanEqual(uvw, vec3(1.0)))) {
+            return texture(shadowVolume, uvw).r;
+        }
+    }
+
+    vec3 shadowPos = p + n * 0.1; // Offset to avoid self-shadowing
+    vec3 toLight = lightPosition - shadowPos;
+    float lightDistance = length(toLight);
+    return softShadow(shadowPos, toLight / lightDistance, lightDistance);
+}
+
+// Lighting calculation
+vec3 calculateLighting(vec3 p, vec3 n, vec3 viewDir) {
+    // Ambient light
+    vec3 ambient = ambientStrength * lightColor;
+
+    // Diffuse light
+    vec3 lightDir = normalize(lightPosition - p);
+    float diff = max(dot(n, lightDir), 0.0);
+    vec3 diffuse = diff * lightColor;
+
+    // Specular reflection
+    vec3 reflectDir = reflect(-lightDir, n);
+    float spec = pow(max(dot(viewDir, reflectDir), 0.0), 32.0);
+    vec3 specular = 0.5 * spec * lightColor;
+
+    // Shadow
+    float shadow = mix(0.5, 1.0, lightVisibility(p, n));
+
+    return ambient + (diffuse + specular) * shadow;
+}
+
+// Cone marching for one tile of pixels. A cone around the tile's center ray
+// contains every pixel ray of the tile: at depth t they are at most
+// t * coneRatio from the center ray. Steps are shortened so the unbounding
+// sphere of each sample covers the cone's cross sections up to the next one,
+// which makes the returned depth free of surfaces for all of the tile's rays.
+float coneMarch(vec3 ro, vec3 rd, float coneRatio, out int steps) {
+    float depth = 0.0;
+    float inverseLipschitz = 1.0 / lipschitzBound;
+    steps = 0;
+
+    for(int i = 0; i < maxSteps; i++) {
+        float dist = marchSDF(ro + depth * rd) * inverseLipschitz;
+        float clearance = dist - depth * coneRatio;
+        if(clearance < epsilon) {
+            break;
+        }
+
+        depth += clearance / (1.0 + coneRatio);
+        steps = i + 1;
+        if(depth >= maxDistance) {
+            return maxDistance;
+        }
+    }
+
+    return depth;
+}
+
+// Center ray and cone ratio of the pixel rectangle [pixelMin, pixelMax)
+float tileCone(vec2 pixelMin, vec2 pixelMax, out vec3 rd) {
+    vec2 uvMin = pixelMin / resolution;
+    vec2 uvMax = min(pixelMax, resolution) / resolution;
+    rd = getRayDir(0.5 * (uvMin + uvMax), cameraPosition, cameraTarget, cameraUp, fieldOfView);
+
+    // Pixel rays lie between the corner rays, so the farthest corner bounds the cone
+    float coneRatio = 0.0;
+    coneRatio = max(coneRatio, length(getRayDir(uvMin, cameraPosition, cameraTarget, cameraUp, fieldOfView) - rd));
+    coneRatio = max(coneRatio, length(getRayDir(uvMax, cameraPosition, cameraTarget, cameraUp, fieldOfView) - rd));
+    coneRatio = max(coneRatio, length(getRayDir(vec2(uvMin.x, uvMax.y), cameraPosition, cameraTarget, cameraUp, fieldOfView) - rd));
+    coneRatio = max(coneRatio, length(getRayDir(vec2(uvMax.x, uvMin.y), cameraPosition, cameraTarget, cameraUp, fieldOfView) - rd));
+    return coneRatio;
+}
+
+// Final color of a pixel whose ray stopped at dist after steps steps
+vec4 shadePixel(vec3 ro, vec3 rd, vec2 uv, float dist, int steps) {
+#ifdef STEP_COUNTERS
+    atomicAdd(marchedPixels, 1u);
+    atomicAdd(totalSteps, uint(steps));
+    atomicMax(mostSteps, uint(steps));
+    atomicAdd(stepHistogram[min(steps * 16 / max(maxSteps, 1), 15)], 1u);
+#endif
+
+    if(stepHeatmap) {
+        // Blue for rays that stopped early, through green, to red for the whole budget
+        float load = clamp(float(steps) / float(maxSteps), 0.0, 1.0);
+        return vec4(smoothstep(0.5, 1.0, load), 1.0 - abs(2.0 * load - 1.0), 1.0 - smoothstep(0.0, 0.5, load), 1.0);
+    }
+
+    if(dist < maxDistance) {
+        vec3 p = ro + rd * dist;
+        vec3 n = sceneNormal(p);
+        vec3 color = calculateLighting(p, n, -rd);
+
+        // Add details based on step count
+        float depthFactor = 1.0 - float(steps) / float(maxSteps);
+        color *= mix(0.5, 1.0, depthFactor); // Darken distant objects
+
+        return vec4(color, 1.0);
+    }
+
+    // Gradient background
+    vec3 backgroundColor = mix(vec3(0.1, 0.1, 0.2), vec3(0.2, 0.3, 0.4), uv.y);
+    return vec4(backgroundColor, 1.0);
+}
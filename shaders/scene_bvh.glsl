@@ -0,0 +1,108 @@
+﻿// Scene evaluation through a bounding volume hierarchy over the top-level
+// union items (layout documented in SceneBVH.h). Appended after the generated
+// sceneItemSDF / sceneUnboundedSDF functions.
+uniform samplerBuffer sceneBVHNodes;
+uniform samplerBuffer sceneBVHItems;
+
+// Distance from a point to an axis-aligned box (0 inside)
+float aabbDistance(vec3 p, vec3 boxMin, vec3 boxMax) {
+    return length(max(max(boxMin - p, p - boxMax), 0.0));
+}
+
+float bvhItemSDF(int item, vec3 p) {
+    vec4 a = texelFetch(sceneBVHItems, item * 3);
+    vec4 b = texelFetch(sceneBVHItems, item * 3 + 1);
+    int type = int(a.x);
+    if (type == 0) return sphereSDF(p, a.yzw, b.x);
+    if (type == 1) return boxSDF(p, a.yzw, b.xyz) - b.w;
+    if (type == 2) return cylinderAxisSDF(p, a.yzw, b.xyz, b.w, texelFetch(sceneBVHItems, item * 3 + 2).x);
+    return sceneItemSDF(int(a.y), p);
+}
+
+vec4 bvhItemSDFGradient(int item, vec3 p) {
+    vec4 a = texelFetch(sceneBVHItems, item * 3);
+    vec4 b = texelFetch(sceneBVHItems, item * 3 + 1);
+    int type = int(a.x);
+    if (type == 0) return sphereSDFGrad(p, a.yzw, b.x);
+    if (type == 1) return boxSDFGrad(p, a.yzw, b.xyz) - vec4(b.w, 0.0, 0.0, 0.0);
+    if (type == 2) return cylinderAxisSDFGrad(p, a.yzw, b.xyz, b.w, texelFetch(sceneBVHItems, item * 3 + 2).x);
+    return sceneItemSDFGradient(int(a.y), p);
+}
+
+// Union of all items. Every item is at least as far as its bounding box, so
+// subtrees whose box is farther than the closest distance found so far are
+// skipped; children are visited nearest first to find a close item early.
+// bestItem receives the closest hierarchy item, or -1 if an unbounded item won.
+float bvhSceneSDF(vec3 p, out int bestItem) {
+    float best = sceneUnboundedSDF(p);
+    bestItem = -1;
+
+    // Depth is limited to SceneBVH::maxDepth, so the stack never holds more than 25 entries
+    int stack[32];
+    float stackGap[32];
+    int top = 0;
+    stack[top] = 0;
+    stackGap[top] = 0.0;
+    top++;
+
+    while (top > 0) {
+        top--;
+        if (stackGap[top] > 0.0 && stackGap[top] >= best) {
+            continue;
+        }
+
+        int node = stack[top];
+        vec4 lo = texelFetch(sceneBVHNodes, node * 2);
+        vec4 hi = texelFetch(sceneBVHNodes, node * 2 + 1);
+        int count = int(hi.w);
+
+        if (count > 0) {
+            int first = int(lo.w);
+            for (int i = first; i < first + count; i++) {
+                float d = bvhItemSDF(i, p);
+                if (d < best) {
+                    best = d;
+                    bestItem = i;
+                }
+            }
+            continue;
+        }
+
+        int left = node + 1;
+        int right = int(lo.w);
+        float leftGap = aabbDistance(p, texelFetch(sceneBVHNodes, left * 2).xyz, texelFetch(sceneBVHNodes, left * 2 + 1).xyz);
+        float rightGap = aabbDistance(p, texelFetch(sceneBVHNodes, right * 2).xyz, texelFetch(sceneBVHNodes, right * 2 + 1).xyz);
+
+        // Push the farther child first so the nearer one is popped next
+        bool leftNear = leftGap <= rightGap;
+        int nearNode = leftNear ? left : right;
+        int farNode = leftNear ? right : left;
+        float nearGap = min(leftGap, rightGap);
+        float farGap = max(leftGap, rightGap);
+
+        if (farGap <= 0.0 || farGap < best) {
+            stack[top] = farNode;
+            stackGap[top] = farGap;
+            top++;
+        }
+        if (nearGap <= 0.0 || nearGap < best) {
+            stack[top] = nearNode;
+            stackGap[top] = nearGap;
+            top++;
+        }
+    }
+
+    return best;
+}
+
+float sceneSDF(vec3 p) {
+    int bestItem;
+    return bvhSceneSDF(p, bestItem);
+}
+
+// The gradient of a union is the gradient of its closest operand
+vec4 sceneSDFGradient(vec3 p) {
+    int bestItem;
+    bvhSceneSDF(p, bestItem);
+    return bestItem >= 0 ? bvhItemSDFGradient(bestItem, p) : sceneUnboundedSDFGradient(p);
+}
@@ -1,4 +0,0 @@
-﻿// Main scene function - Sphere
-float sceneSDF(vec3 p) {
-    return sphereSDF(p, vec3(0.0, 0.0, 0.0), 1.0);
-}
\ No newline at end of file
@@ -0,0 +1,137 @@
+﻿// Scene evaluation by interpreting the scene's tape (layout documented at
+// Tape::packInterpreter) instead of generated code, so that every scene runs
+// on the same programs. Used in place of the generated scene functions.
+uniform samplerBuffer sceneTape;
+
+// Must match Tape::interpreterRegisters and Tape::interpreterPoints
+#define TAPE_REGISTERS 32
+#define TAPE_POINTS 8
+
+// TapeOp values
+const int TAPE_SPHERE = 0;
+const int TAPE_BOX = 1;
+const int TAPE_PLANE = 2;
+const int TAPE_CYLINDER = 3;
+const int TAPE_UNION = 4;
+const int TAPE_INTERSECTION = 5;
+const int TAPE_DIFFERENCE = 6;
+const int TAPE_SMOOTH_UNION = 7;
+const int TAPE_SMOOTH_INTERSECTION = 8;
+const int TAPE_NEGATE = 11;
+const int TAPE_TRANSFORM = 12;
+const int TAPE_RESCALE = 13;
+
+// Rotation rows at texel, as the transposed rotation instancePoint expects
+mat3 tapeInverseRotation(int texel) {
+    return mat3(texelFetch(sceneTape, texel).xyz, texelFetch(sceneTape, texel + 1).xyz, texelFetch(sceneTape, texel + 2).xyz);
+}
+
+float sceneSDF(vec3 p) {
+    float regs[TAPE_REGISTERS];
+    vec3 points[TAPE_POINTS];
+    points[0] = p;
+
+    vec4 header = texelFetch(sceneTape, 0);
+    int count = int(header.x);
+    int texel = 1;
+    for (int i = 0; i < count; i++) {
+        vec4 ins = texelFetch(sceneTape, texel++);
+        int op = int(ins.x);
+        float result;
+
+        if (op <= TAPE_CYLINDER) {
+            vec3 q = points[int(ins.z)];
+            vec4 a = texelFetch(sceneTape, texel++);
+            if (op == TAPE_SPHERE) {
+                result = sphereSDF(q, a.xyz, a.w);
+            } else if (op == TAPE_PLANE) {
+                result = planeSDF(q, a.xyz, a.w);
+            } else {
+                vec4 b = texelFetch(sceneTape, texel++);
+                result = op == TAPE_BOX ? boxSDF(q, a.xyz, b.xyz) - a.w : cylinderAxisSDF(q, a.xyz, b.xyz, b.w, a.w);
+            }
+        } else if (op == TAPE_TRANSFORM) {
+            vec4 a = texelFetch(sceneTape, texel);
+            points[int(ins.y)] = instancePoint(points[int(ins.z)], a.xyz, tapeInverseRotation(texel + 1), a.w);
+            texel += 4;
+            continue;
+        } else if (op == TAPE_RESCALE) {
+            result = regs[int(ins.z)] * texelFetch(sceneTape, texel).w;
+            texel += 3;
+        } else {
+            float a = regs[int(ins.z)];
+            float b = regs[int(ins.w)];
+            if (op == TAPE_UNION) {
+                result = unionOp(a, b);
+            } else if (op == TAPE_INTERSECTION) {
+                result = intersectionOp(a, b);
+            } else if (op == TAPE_DIFFERENCE) {
+                result = differenceOp(a, b);
+            } else if (op == TAPE_NEGATE) {
+                result = -a;
+            } else {
+                float k = texelFetch(sceneTape, texel++).x;
+                result = op == TAPE_SMOOTH_UNION ? smoothUnionOp(a, b, k)
+                       : (op == TAPE_SMOOTH_INTERSECTION ? smoothIntersectionOp(a, b, k) : smoothDifferenceOp(a, b, k));
+            }
+        }
+        regs[int(ins.y)] = result;
+    }
+    return regs[int(header.y)];
+}
+
+// The same program on vec4(distance, gradient) registers
+vec4 sceneSDFGradient(vec3 p) {
+    vec4 regs[TAPE_REGISTERS];
+    vec3 points[TAPE_POINTS];
+    points[0] = p;
+
+    vec4 header = texelFetch(sceneTape, 0);
+    int count = int(header.x);
+    int texel = 1;
+    for (int i = 0; i < count; i++) {
+        vec4 ins = texelFetch(sceneTape, texel++);
+        int op = int(ins.x);
+        vec4 result;
+
+        if (op <= TAPE_CYLINDER) {
+            vec3 q = points[int(ins.z)];
+            vec4 a = texelFetch(sceneTape, texel++);
+            if (op == TAPE_SPHERE) {
+                result = sphereSDFGrad(q, a.xyz, a.w);
+            } else if (op == TAPE_PLANE) {
+                result = planeSDFGrad(q, a.xyz, a.w);
+            } else {
+                vec4 b = texelFetch(sceneTape, texel++);
+                result = op == TAPE_BOX ? boxSDFGrad(q, a.xyz, b.xyz) - vec4(a.w, 0.0, 0.0, 0.0)
+                                        : cylinderAxisSDFGrad(q, a.xyz, b.xyz, b.w, a.w);
+            }
+        } else if (op == TAPE_TRANSFORM) {
+            vec4 a = texelFetch(sceneTape, texel);
+            points[int(ins.y)] = instancePoint(points[int(ins.z)], a.xyz, tapeInverseRotation(texel + 1), a.w);
+            texel += 4;
+            continue;
+        } else if (op == TAPE_RESCALE) {
+            result = instanceGrad(regs[int(ins.z)], tapeInverseRotation(texel), texelFetch(sceneTape, texel).w);
+            texel += 3;
+        } else {
+            vec4 a = regs[int(ins.z)];
+            vec4 b = regs[int(ins.w)];
+            if (op == TAPE_UNION) {
+                result = unionGrad(a, b);
+            } else if (op == TAPE_INTERSECTION) {
+                result = intersectionGrad(a, b);
+            } else if (op == TAPE_DIFFERENCE) {
+                result = differenceGrad(a, b);
+            } else if (op == TAPE_NEGATE) {
+                result = -a;
+            } else {
+                float k = texelFetch(sceneTape, texel++).x;
+                result = op == TAPE_SMOOTH_UNION ? smoothUnionGrad(a, b, k)
+                       : (op == TAPE_SMOOTH_INTERSECTION ? smoothIntersectionGrad(a, b, k) : smoothDifferenceGrad(a, b, k));
+            }
+        }
+        regs[int(ins.y)] = result;
+    }
+    return regs[int(header.y)];
+}
@@ -0,0 +1,121 @@
+﻿#include "ComputeMarcher.h"
+#include <algorithm>
+#include <iostream>
+
+ComputeMarcher::ComputeMarcher()
+    : outputTexture(0), readFramebuffer(0), rayQueueBuffer(0), imageWidth(0), imageHeight(0),
+    rayQueueCapacity(0), primarySteps(32), persistentGroups(256),
+    passLocation(-1), primaryStepsLocation(-1), capacityLocation(-1)
+{
+}
+
+ComputeMarcher::~ComputeMarcher() {
+    // GL objects must be released with a current context, see release()
+    if (outputTexture || rayQueueBuffer) {
+        std::cerr << "Warning: ComputeMarcher destroyed with live GL objects" << std::endl;
+    }
+}
+
+bool ComputeMarcher::supported() {
+    return (GLEW_VERSION_4_3 || (GLEW_ARB_compute_shader && GLEW_ARB_shader_storage_buffer_object &&
+                                 GLEW_ARB_shader_image_load_store)) != 0;
+}
+
+void ComputeMarcher::configure(GLuint program) {
+    passLocation = glGetUniformLocation(program, "computePass");
+    primaryStepsLocation = glGetUniformLocation(program, "primarySteps");
+    capacityLocation = glGetUniformLocation(program, "rayQueueCapacity");
+
+    // Enough workgroups to fill the device a few times over, each looping until the queue is empty
+    GLint maxGroups = 0;
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
+    persistentGroups = static_cast<GLuint>(std::clamp(maxGroups, 1, 256));
+}
+
+// Size the output image and the ray queue to the frame
+bool ComputeMarcher::resize(int width, int height) {
+    if (outputTexture && width == imageWidth && height == imageHeight) {
+        return true;
+    }
+
+    if (!readFramebuffer) {
+        glGenFramebuffers(1, &readFramebuffer);
+        glGenBuffers(1, &rayQueueBuffer);
+    }
+
+    // Immutable storage cannot be resized, so every size gets a new texture
+    if (outputTexture) glDeleteTextures(1, &outputTexture);
+    glGenTextures(1, &outputTexture);
+    glBindTexture(GL_TEXTURE_2D, outputTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    GLint previousRead = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glFramebufferTexture2D(GL_READ_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, outputTexture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_READ_FRAMEBUFFER);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previousRead));
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Error: Compute output of " << width << "x" << height << " is incomplete" << std::endl;
+        imageWidth = imageHeight = 0;
+        return false;
+    }
+
+    // Only rays near silhouettes and grazing surfaces outlast the primary
+    // budget; rays beyond the capacity are finished in the primary pass
+    size_t pixels = static_cast<size_t>(width) * height;
+    rayQueueCapacity = static_cast<GLuint>(std::max<size_t>(pixels / 4, 1));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rayQueueBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, (2 + static_cast<GLsizeiptr>(rayQueueCapacity) * rayWords) * sizeof(GLuint),
+                 nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    imageWidth = width;
+    imageHeight = height;
+    return true;
+}
+
+void ComputeMarcher::render(GLuint program, int width, int height) {
+    if (!resize(width, height)) {
+        return;
+    }
+
+    // Empty the queue: both counters live at the start of the buffer
+    const GLuint counters[2] = { 0, 0 };
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, rayQueueBinding, rayQueueBuffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+    glBindImageTexture(outputImageUnit, outputTexture, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA8);
+
+    glUseProgram(program);
+    glUniform1i(primaryStepsLocation, primarySteps);
+    glUniform1ui(capacityLocation, rayQueueCapacity);
+
+    glUniform1i(passLocation, 0);
+    glDispatchCompute((width + groupSize - 1) / groupSize, (height + groupSize - 1) / groupSize, 1);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+    glUniform1i(passLocation, 1);
+    glDispatchCompute(persistentGroups, 1, 1);
+    glMemoryBarrier(GL_FRAMEBUFFER_BARRIER_BIT);
+
+    // Copy into the viewport of whatever draw framebuffer is bound
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint previousRead = 0;
+    glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &previousRead);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, readFramebuffer);
+    glBlitFramebuffer(0, 0, width, height, viewport[0], viewport[1], viewport[0] + viewport[2],
+                      viewport[1] + viewport[3], GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, static_cast<GLuint>(previousRead));
+}
+
+void ComputeMarcher::release() {
+    if (outputTexture) glDeleteTextures(1, &outputTexture);
+    if (readFramebuffer) glDeleteFramebuffers(1, &readFramebuffer);
+    if (rayQueueBuffer) glDeleteBuffers(1, &rayQueueBuffer);
+    outputTexture = readFramebuffer = rayQueueBuffer = 0;
+    imageWidth = imageHeight = 0;
+}
@@ -0,0 +1,287 @@
+﻿#include "CpuRenderer.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// Camera and derived march parameters shared by every tile of a frame
+struct CpuRenderer::Frame {
+    Vec3<double> origin;
+    Vec3<double> forward, right, up; // up and right already scaled by the field of view
+    int width, height;
+    double pixelFootprint;           // Hit threshold per unit of depth
+    double inverseLipschitz;
+};
+
+namespace {
+    // State of one primary ray of traceSegment in raymarch.glsl
+    struct Ray {
+        Vec3<double> direction;
+        double depth;
+        double omega;
+        double previousRadius;
+        double stepLength;
+        int steps;
+    };
+
+    // State of one shadow ray of softShadow
+    struct ShadowRay {
+        Vec3<double> origin, direction;
+        double maxT;
+        double t;
+        double previous;
+        double result;
+    };
+
+    // Buffers of one tile, reused by every tile a thread renders
+    struct TileScratch {
+        std::vector<Ray> rays;
+        std::vector<ShadowRay> shadows;
+        std::vector<uint32_t> active;
+        std::vector<uint32_t> hits;
+        std::vector<Vec3<double>> normals; // Of each hit
+        std::vector<float> xs, ys, zs, distances; // Evaluated in float, like the GPU
+
+        void reserve(size_t count) {
+            xs.resize(count);
+            ys.resize(count);
+            zs.resize(count);
+            distances.resize(count);
+        }
+    };
+
+    Vec3<double> reflect(const Vec3<double>& incident, const Vec3<double>& normal) {
+        return incident - normal * (2.0 * normal.dot(incident));
+    }
+
+    double mix(double a, double b, double t) {
+        return a + (b - a) * t;
+    }
+
+    // Float to unsigned normalized byte, as the GPU writes RGBA8 targets
+    unsigned char toByte(double value) {
+        return static_cast<unsigned char>(std::lround(std::clamp(value, 0.0, 1.0) * 255.0));
+    }
+}
+
+CpuRenderer::CpuRenderer()
+    : CpuRenderer(Settings()) {}
+
+CpuRenderer::CpuRenderer(const Settings& settings)
+    : settings(settings), pool(&ThreadPool::shared()) {}
+
+void CpuRenderer::setScene(const std::shared_ptr<const ImplicitSurface>& surface) {
+    tape = surface ? Tape::compile(surface) : Tape();
+}
+
+bool CpuRenderer::renderFrame(const CameraPose& pose, int width, int height, std::vector<unsigned char>& pixels) const {
+    if (tape.empty() || width <= 0 || height <= 0) {
+        std::cerr << "Warning: CPU rendering needs a scene and a positive frame size" << std::endl;
+        return false;
+    }
+
+    // Camera basis of getRayDir
+    Frame frame;
+    frame.origin = Vec3<double>(pose.position);
+    frame.forward = (Vec3<double>(pose.target) - frame.origin).normalize();
+    frame.right = frame.forward.cross(Vec3<double>(pose.up)).normalize();
+    frame.up = frame.right.cross(frame.forward);
+    double tanFov = std::tan(pose.fieldOfView * 3.14159265358979 / 360.0);
+    double aspect = static_cast<double>(width) / height;
+    frame.right = frame.right * (tanFov * aspect);
+    frame.up = frame.up * tanFov;
+    frame.width = width;
+    frame.height = height;
+    frame.pixelFootprint = settings.pixelFootprintScale * 2.0 * tanFov / height;
+    frame.inverseLipschitz = 1.0 / std::max(settings.lipschitzBound, 1e-6f);
+
+    pixels.resize(static_cast<size_t>(width) * height * 4);
+    int tileSize = std::max(settings.tileSize, 1);
+    int tilesX = (width + tileSize - 1) / tileSize;
+    int tilesY = (height + tileSize - 1) / tileSize;
+    pool->parallelFor(static_cast<size_t>(tilesX) * tilesY, [&](size_t index) {
+        int x0 = static_cast<int>(index % tilesX) * tileSize;
+        int y0 = static_cast<int>(index / tilesX) * tileSize;
+        renderTile(frame, x0, y0, std::min(x0 + tileSize, width), std::min(y0 + tileSize, height), pixels.data());
+    });
+    return true;
+}
+
+bool CpuRenderer::renderFrames(const std::vector<CameraPose>& path, int width, int height,
+                               const FrameConsumer& consumer) const {
+    std::vector<unsigned char> pixels;
+    for (size_t frame = 0; frame < path.size(); ++frame) {
+        if (!renderFrame(path[frame], width, height, pixels)) {
+            return false;
+        }
+        consumer(frame, pixels.data(), width, height);
+    }
+    return true;
+}
+
+void CpuRenderer::renderTile(const Frame& frame, int x0, int y0, int x1, int y1, unsigned char* pixels) const {
+    static thread_local TileScratch scratch;
+    const int tileWidth = x1 - x0;
+    const size_t count = static_cast<size_t>(tileWidth) * (y1 - y0);
+    const int maxSteps = std::max(settings.maxSteps, 1);
+    const double maxDistance = settings.maxDistance;
+    const double epsilon = settings.epsilon;
+    scratch.reserve(count);
+
+    // Primary rays, marched together one step at a time
+    std::vector<Ray>& rays = scratch.rays;
+    std::vector<uint32_t>& active = scratch.active;
+    rays.resize(count);
+    active.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        double u = (x0 + static_cast<int>(i % tileWidth) + 0.5) / frame.width;
+        double v = (y0 + static_cast<int>(i / tileWidth) + 0.5) / frame.height;
+        Vec3<double> direction = (frame.forward + frame.right * (2.0 * u - 1.0) + frame.up * (2.0 * v - 1.0)).normalize();
+        rays[i] = { direction, 0.0, std::max<double>(settings.overRelaxation, 1.0), 0.0, 0.0, maxSteps - 1 };
+        active[i] = static_cast<uint32_t>(i);
+    }
+
+    for (int step = 0; step < maxSteps && !active.empty(); ++step) {
+        for (size_t k = 0; k < active.size(); ++k) {
+            const Ray& ray = rays[active[k]];
+            scratch.xs[k] = static_cast<float>(frame.origin.x + ray.depth * ray.direction.x);
+            scratch.ys[k] = static_cast<float>(frame.origin.y + ray.depth * ray.direction.y);
+            scratch.zs[k] = static_cast<float>(frame.origin.z + ray.depth * ray.direction.z);
+        }
+        tape.evaluateBatch(scratch.xs.data(), scratch.ys.data(), scratch.zs.data(), scratch.distances.data(), active.size());
+
+        size_t kept = 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            Ray& ray = rays[active[k]];
+            double dist = scratch.distances[k] * frame.inverseLipschitz;
+            double radius = std::abs(dist);
+
+            bool relaxationFailed = ray.omega > 1.0 && (dist < 0.0 || radius + ray.previousRadius < ray.stepLength);
+            if (relaxationFailed) {
+                ray.stepLength -= ray.omega * ray.stepLength;
+                ray.omega = 1.0;
+            }
+            else {
+                ray.stepLength = dist * ray.omega;
+            }
+            ray.previousRadius = radius;
+
+            if (!relaxationFailed && dist < std::max(epsilon, ray.depth * frame.pixelFootprint)) {
+                ray.steps = step;
+                continue;
+            }
+            ray.depth += ray.stepLength;
+            if (ray.depth >= maxDistance) {
+                ray.depth = maxDistance;
+                ray.steps = maxSteps;
+                continue;
+            }
+            ray.steps = step;
+            active[kept++] = active[k];
+        }
+        active.resize(kept);
+    }
+    // Rays that ran out of steps count as misses, like rayMarch
+    for (uint32_t index : active) {
+        rays[index].depth = maxDistance;
+    }
+
+    // Shadow rays of the hits, from the offset point lightVisibility marches from
+    std::vector<uint32_t>& hits = scratch.hits;
+    std::vector<Vec3<double>>& normals = scratch.normals;
+    std::vector<ShadowRay>& shadows = scratch.shadows;
+    Vec3<double> lightPosition(settings.lightPosition);
+    hits.clear();
+    normals.clear();
+    shadows.clear();
+    for (size_t i = 0; i < count; ++i) {
+        const Ray& ray = rays[i];
+        if (ray.depth >= maxDistance) {
+            continue;
+        }
+        Vec3<double> p = frame.origin + ray.direction * ray.depth;
+        Vec3<double> gradient;
+        tape.evaluateWithGradient(p, gradient);
+        Vec3<double> normal = gradient.normalize();
+
+        Vec3<double> shadowPosition = p + normal * 0.1; // Offset to avoid self-shadowing
+        Vec3<double> toLight = lightPosition - shadowPosition;
+        double lightDistance = toLight.length();
+        hits.push_back(static_cast<uint32_t>(i));
+        normals.push_back(normal);
+        shadows.push_back({ shadowPosition, toLight * (1.0 / lightDistance), lightDistance, 0.0, 1e20, 1.0 });
+    }
+
+    active.resize(shadows.size());
+    for (size_t k = 0; k < shadows.size(); ++k) {
+        active[k] = static_cast<uint32_t>(k);
+    }
+    for (int step = 0; step < settings.shadowMaxSteps && !active.empty(); ++step) {
+        for (size_t k = 0; k < active.size(); ++k) {
+            const ShadowRay& shadow = shadows[active[k]];
+            scratch.xs[k] = static_cast<float>(shadow.origin.x + shadow.t * shadow.direction.x);
+            scratch.ys[k] = static_cast<float>(shadow.origin.y + shadow.t * shadow.direction.y);
+            scratch.zs[k] = static_cast<float>(shadow.origin.z + shadow.t * shadow.direction.z);
+        }
+        tape.evaluateBatch(scratch.xs.data(), scratch.ys.data(), scratch.zs.data(), scratch.distances.data(), active.size());
+
+        size_t kept = 0;
+        for (size_t k = 0; k < active.size(); ++k) {
+            ShadowRay& shadow = shadows[active[k]];
+            double h = scratch.distances[k] * frame.inverseLipschitz;
+            if (h < epsilon) {
+                shadow.result = 0.0;
+                continue;
+            }
+
+            double y = h * h / (2.0 * shadow.previous);
+            double d = std::sqrt(std::max(h * h - y * y, 0.0));
+            shadow.result = std::min(shadow.result, settings.shadowSoftness * d / std::max(shadow.t - y, 1e-4));
+            shadow.previous = h;
+            shadow.t += h;
+
+            // Anything darker is indistinguishable from full shadow
+            if (shadow.result < 0.01) {
+                shadow.result = 0.0;
+                continue;
+            }
+            if (shadow.t < shadow.maxT) {
+                active[kept++] = active[k];
+            }
+        }
+        active.resize(kept);
+    }
+
+    // Background of shadePixel, then calculateLighting over the hits
+    Vec3<double> lightColor(settings.lightColor);
+    for (size_t i = 0; i < count; ++i) {
+        int x = x0 + static_cast<int>(i % tileWidth);
+        int y = y0 + static_cast<int>(i / tileWidth);
+        double v = (y + 0.5) / frame.height;
+        unsigned char* pixel = pixels + (static_cast<size_t>(y) * frame.width + x) * 4;
+        pixel[0] = toByte(mix(0.1, 0.2, v));
+        pixel[1] = toByte(mix(0.1, 0.3, v));
+        pixel[2] = toByte(mix(0.2, 0.4, v));
+        pixel[3] = 255;
+    }
+    for (size_t k = 0; k < hits.size(); ++k) {
+        const Ray& ray = rays[hits[k]];
+        const Vec3<double>& normal = normals[k];
+        Vec3<double> p = frame.origin + ray.direction * ray.depth;
+        Vec3<double> viewDirection = ray.direction * -1.0;
+
+        Vec3<double> lightDirection = (lightPosition - p).normalize();
+        double diffuse = std::max(normal.dot(lightDirection), 0.0);
+        Vec3<double> reflectDirection = reflect(lightDirection * -1.0, normal);
+        double specular = 0.5 * std::pow(std::max(viewDirection.dot(reflectDirection), 0.0), 32.0);
+        double shadowFactor = mix(0.5, 1.0, std::clamp(shadows[k].result, 0.0, 1.0));
+        double darken = mix(0.5, 1.0, 1.0 - static_cast<double>(ray.steps) / maxSteps);
+        Vec3<double> color = (lightColor * settings.ambientStrength + lightColor * ((diffuse + specular) * shadowFactor)) * darken;
+
+        int x = x0 + static_cast<int>(hits[k] % tileWidth);
+        int y = y0 + static_cast<int>(hits[k] / tileWidth);
+        unsigned char* pixel = pixels + (static_cast<size_t>(y) * frame.width + x) * 4;
+        pixel[0] = toByte(color.x);
+        pixel[1] = toByte(color.y);
+        pixel[2] = toByte(color.z);
+    }
+}
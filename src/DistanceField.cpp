@@ -0,0 +1,254 @@
+﻿#include "DistanceField.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+bool DistanceField::bake(const Tape& tape, const AABB& sceneBounds, int resolution, int maxTextureSize) {
+    brickIndex.clear();
+    atlas.clear();
+    brickReach.clear();
+    freeSlots.clear();
+    updatedBricks.clear();
+    updatedSlots.clear();
+    nearBricks = 0;
+
+    if (!sceneBounds.isFinite() || tape.empty() || resolution <= 0) {
+        return false;
+    }
+
+    // Keep the surface at least exactBand inside the baked region so that
+    // distances outside it can be bounded by the distance to the region
+    Vec3<double> extent = sceneBounds.max - sceneBounds.min;
+    double longest = std::max(extent.x, std::max(extent.y, extent.z));
+    voxelSize = std::max(longest, 1e-6) / resolution;
+    Vec3<double> origin = sceneBounds.min - Vec3<double>(getExactBand(), getExactBand(), getExactBand());
+    Vec3<double> padded = extent + Vec3<double>(2.0, 2.0, 2.0) * getExactBand();
+
+    double brickSize = voxelSize * brickCells;
+    brickGrid[0] = std::max(1, static_cast<int>(std::ceil(padded.x / brickSize)));
+    brickGrid[1] = std::max(1, static_cast<int>(std::ceil(padded.y / brickSize)));
+    brickGrid[2] = std::max(1, static_cast<int>(std::ceil(padded.z / brickSize)));
+    bounds = AABB(origin, origin + Vec3<double>(brickGrid[0], brickGrid[1], brickGrid[2]) * brickSize);
+
+    // Classify bricks first so the atlas can be allocated in one go
+    size_t brickCount = static_cast<size_t>(brickGrid[0]) * brickGrid[1] * brickGrid[2];
+    brickIndex.assign(brickCount * 2, 0.0f);
+    brickReach.assign(brickCount, 0.0);
+    std::vector<size_t> near;
+    for (size_t index = 0; index < brickCount; ++index) {
+        if (classifyBrick(tape, index)) {
+            brickIndex[index * 2] = static_cast<float>(near.size());
+            near.push_back(index);
+        }
+    }
+    nearBricks = near.size();
+
+    // Pack the sampled bricks into a roughly cubic atlas, with an eighth more
+    // slots than needed (when that still fits) so edits can add bricks in place
+    int perAxis = std::max(1, maxTextureSize / brickSamples);
+    auto layout = [&](size_t slots) {
+        int side = std::max(1, static_cast<int>(std::ceil(std::cbrt(static_cast<double>(std::max<size_t>(slots, 1))))));
+        atlasBricks[0] = std::min(side, perAxis);
+        atlasBricks[1] = std::min(side, perAxis);
+        atlasBricks[2] = static_cast<int>((std::max<size_t>(slots, 1) + atlasBricks[0] * atlasBricks[1] - 1) /
+                                          (atlasBricks[0] * atlasBricks[1]));
+        return atlasBricks[2] <= perAxis;
+    };
+    if (!layout(nearBricks + nearBricks / 8 + 1) && !layout(nearBricks)) {
+        std::cerr << "Warning: Distance field needs " << nearBricks << " bricks, which exceeds the 3D texture limit" << std::endl;
+        brickIndex.clear();
+        brickReach.clear();
+        nearBricks = 0;
+        return false;
+    }
+
+    int atlasSize[3];
+    getAtlasSize(atlasSize);
+    atlas.assign(static_cast<size_t>(atlasSize[0]) * atlasSize[1] * atlasSize[2], 0.0f);
+    for (size_t slot = getSlotCapacity(); slot-- > nearBricks;) {
+        freeSlots.push_back(slot);
+    }
+
+    for (size_t slot = 0; slot < near.size(); ++slot) {
+        sampleBrick(tape, near[slot], slot);
+    }
+
+    return true;
+}
+
+bool DistanceField::update(const Tape& tape, const AABB& sceneBounds, const AABB& region, double margin) {
+    updatedBricks.clear();
+    updatedSlots.clear();
+
+    // The baked region must still keep the surface exactBand inside it
+    AABB interior = bounds.expand(-getExactBand());
+    bool inside = sceneBounds.min.x >= interior.min.x && sceneBounds.min.y >= interior.min.y &&
+                  sceneBounds.min.z >= interior.min.z && sceneBounds.max.x <= interior.max.x &&
+                  sceneBounds.max.y <= interior.max.y && sceneBounds.max.z <= interior.max.z;
+    if (empty() || tape.empty() || !sceneBounds.isFinite() || !region.isFinite() || !inside) {
+        return false;
+    }
+
+    // Classify the reachable bricks again, freeing the slots of those that became far
+    std::vector<size_t> sampled;
+    for (size_t index = 0; index < brickReach.size(); ++index) {
+        if (brickReach[index] < brickRegion(index).distance(region) - margin) {
+            continue;
+        }
+
+        float previousSlot = brickIndex[index * 2];
+        updatedBricks.push_back(index);
+        if (!classifyBrick(tape, index)) {
+            if (previousSlot >= 0.0f) {
+                freeSlots.push_back(static_cast<size_t>(previousSlot));
+                --nearBricks;
+            }
+            continue;
+        }
+
+        if (previousSlot >= 0.0f) {
+            brickIndex[index * 2] = previousSlot;
+        }
+        else if (freeSlots.empty()) {
+            return false;
+        }
+        else {
+            brickIndex[index * 2] = static_cast<float>(freeSlots.back());
+            freeSlots.pop_back();
+            ++nearBricks;
+        }
+        sampled.push_back(index);
+    }
+
+    for (size_t index : sampled) {
+        size_t slot = static_cast<size_t>(brickIndex[index * 2]);
+        sampleBrick(tape, index, slot);
+        updatedSlots.push_back(slot);
+    }
+    return true;
+}
+
+AABB DistanceField::brickRegion(size_t index) const {
+    int bx = static_cast<int>(index % brickGrid[0]);
+    int by = static_cast<int>((index / brickGrid[0]) % brickGrid[1]);
+    int bz = static_cast<int>(index / (static_cast<size_t>(brickGrid[0]) * brickGrid[1]));
+    double brickSize = voxelSize * brickCells;
+    Vec3<double> brickMin = bounds.min + Vec3<double>(bx, by, bz) * brickSize;
+    return AABB(brickMin, brickMin + Vec3<double>(brickSize, brickSize, brickSize));
+}
+
+bool DistanceField::classifyBrick(const Tape& tape, size_t index) {
+    Interval range = tape.evaluateInterval(brickRegion(index));
+    brickReach[index] = std::max(std::abs(range.lower), std::abs(range.upper));
+
+    double band = getExactBand();
+    if (range.lower > band || range.upper < -band) {
+        brickIndex[index * 2] = -1.0f;
+        brickIndex[index * 2 + 1] = static_cast<float>(range.lower > band ? range.lower : range.upper);
+        return false;
+    }
+    brickIndex[index * 2 + 1] = 0.0f;
+    return true;
+}
+
+void DistanceField::sampleBrick(const Tape& tape, size_t index, size_t slot) {
+    const size_t samples = static_cast<size_t>(brickSamples) * brickSamples * brickSamples;
+    // Sampled in float, the precision the atlas stores anyway
+    thread_local std::vector<float> xs, ys, zs, distances;
+    xs.resize(samples);
+    ys.resize(samples);
+    zs.resize(samples);
+    distances.resize(samples);
+
+    AABB region = brickRegion(index);
+    size_t n = 0;
+    for (int z = 0; z < brickSamples; ++z) {
+        for (int y = 0; y < brickSamples; ++y) {
+            for (int x = 0; x < brickSamples; ++x, ++n) {
+                xs[n] = static_cast<float>(region.min.x + x * voxelSize);
+                ys[n] = static_cast<float>(region.min.y + y * voxelSize);
+                zs[n] = static_cast<float>(region.min.z + z * voxelSize);
+            }
+        }
+    }
+
+    // Only the instructions that matter inside this brick are evaluated
+    Tape brickTape = tape.specialize(region);
+    brickTape.evaluateBatch(xs.data(), ys.data(), zs.data(), distances.data(), samples);
+
+    int atlasSize[3];
+    getAtlasSize(atlasSize);
+    int ax = static_cast<int>(slot % atlasBricks[0]) * brickSamples;
+    int ay = static_cast<int>((slot / atlasBricks[0]) % atlasBricks[1]) * brickSamples;
+    int az = static_cast<int>(slot / (static_cast<size_t>(atlasBricks[0]) * atlasBricks[1])) * brickSamples;
+    n = 0;
+    for (int z = 0; z < brickSamples; ++z) {
+        for (int y = 0; y < brickSamples; ++y) {
+            size_t row = (static_cast<size_t>(az + z) * atlasSize[1] + ay + y) * atlasSize[0] + ax;
+            for (int x = 0; x < brickSamples; ++x, ++n) {
+                atlas[row + x] = distances[n];
+            }
+        }
+    }
+}
+
+void DistanceField::getAtlasSize(int size[3]) const {
+    for (int axis = 0; axis < 3; ++axis) {
+        size[axis] = atlasBricks[axis] * brickSamples;
+    }
+}
+
+double DistanceField::sample(const Vec3<double>& point) const {
+    if (brickIndex.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    // The surface lies at least exactBand inside the baked region
+    double gap = bounds.distance(point);
+    if (gap > 0.0) {
+        return gap + getExactBand();
+    }
+
+    Vec3<double> cell = (point - bounds.min) * (1.0 / voxelSize);
+    int brick[3];
+    double local[3];
+    const double coordinates[3] = { cell.x, cell.y, cell.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        brick[axis] = std::min(std::max(static_cast<int>(coordinates[axis]) / brickCells, 0), brickGrid[axis] - 1);
+        local[axis] = std::min(std::max(coordinates[axis] - brick[axis] * brickCells, 0.0), static_cast<double>(brickCells));
+    }
+
+    size_t index = (static_cast<size_t>(brick[2]) * brickGrid[1] + brick[1]) * brickGrid[0] + brick[0];
+    if (brickIndex[index * 2] < 0.0f) {
+        return brickIndex[index * 2 + 1];
+    }
+
+    size_t slot = static_cast<size_t>(brickIndex[index * 2]);
+    int atlasSize[3];
+    getAtlasSize(atlasSize);
+    int origin[3] = {
+        static_cast<int>(slot % atlasBricks[0]) * brickSamples,
+        static_cast<int>((slot / atlasBricks[0]) % atlasBricks[1]) * brickSamples,
+        static_cast<int>(slot / (static_cast<size_t>(atlasBricks[0]) * atlasBricks[1])) * brickSamples
+    };
+
+    // Trilinear interpolation between the eight surrounding samples
+    int base[3];
+    double t[3];
+    for (int axis = 0; axis < 3; ++axis) {
+        base[axis] = std::min(static_cast<int>(local[axis]), brickCells - 1);
+        t[axis] = local[axis] - base[axis];
+    }
+    auto at = [&](int x, int y, int z) {
+        size_t offset = (static_cast<size_t>(origin[2] + base[2] + z) * atlasSize[1] + origin[1] + base[1] + y) * atlasSize[0] +
+                        origin[0] + base[0] + x;
+        return static_cast<double>(atlas[offset]);
+    };
+    double value = 0.0;
+    for (int corner = 0; corner < 8; ++corner) {
+        int x = corner & 1, y = (corner >> 1) & 1, z = (corner >> 2) & 1;
+        double weight = (x ? t[0] : 1.0 - t[0]) * (y ? t[1] : 1.0 - t[1]) * (z ? t[2] : 1.0 - t[2]);
+        value += weight * at(x, y, z);
+    }
+    return value;
+}
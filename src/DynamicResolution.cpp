@@ -0,0 +1,139 @@
+﻿#include "DynamicResolution.h"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+namespace {
+    // Scales are kept on a coarse grid so render targets are not reallocated for tiny changes
+    const float scaleGrid = 20.0f;
+    // No change while the smoothed time stays within this band around the budget
+    const float overBudget = 1.05f;
+    const float underBudget = 0.85f;
+    // Weight of a new measurement in the smoothed frame time
+    const float smoothing = 0.2f;
+}
+
+DynamicResolution::DynamicResolution()
+    : queries(), pending(), nextQuery(0), timing(false), enabled(false), budgetMs(14.0f), minScale(0.5f),
+    scaleSteps(false), scale(1.0f), stepScale(1.0f), frameTimeMs(0.0f), settleFrames(0)
+{
+}
+
+DynamicResolution::~DynamicResolution() {
+    // Queries must be released with a current context, see release()
+    if (queries[0]) {
+        std::cerr << "Warning: DynamicResolution destroyed with live queries" << std::endl;
+    }
+}
+
+void DynamicResolution::configure(bool enable, float budget, float minimumScale, bool adaptSteps) {
+    enabled = enable;
+    budgetMs = std::max(budget, 0.1f);
+    minScale = std::clamp(minimumScale, 0.05f, 1.0f);
+    scaleSteps = adaptSteps;
+    scale = 1.0f;
+    stepScale = 1.0f;
+    frameTimeMs = 0.0f;
+    settleFrames = 0;
+}
+
+void DynamicResolution::beginFrame() {
+    if (!enabled) {
+        return;
+    }
+    if (!queries[0]) {
+        glGenQueries(queryRingSize, queries);
+    }
+
+    // Every query in the ring is still in flight; skip timing this frame rather than wait
+    if (pending[nextQuery]) {
+        return;
+    }
+    glBeginQuery(GL_TIME_ELAPSED, queries[nextQuery]);
+    timing = true;
+}
+
+void DynamicResolution::endFrame() {
+    if (!timing) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    pending[nextQuery] = true;
+    nextQuery = (nextQuery + 1) % queryRingSize;
+    timing = false;
+}
+
+void DynamicResolution::update() {
+    if (!queries[0]) {
+        return;
+    }
+
+    // Oldest first, stopping at the first query the GPU has not finished
+    for (int i = 0; i < queryRingSize; ++i) {
+        int slot = (nextQuery + i) % queryRingSize;
+        if (!pending[slot]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(queries[slot], GL_QUERY_RESULT, &elapsed);
+        pending[slot] = false;
+        if (enabled) {
+            adapt(static_cast<float>(elapsed) * 1e-6f);
+        }
+    }
+}
+
+void DynamicResolution::adapt(float gpuMs) {
+    // Frames queued before the last change still ran at the old scale
+    if (settleFrames > 0) {
+        --settleFrames;
+        return;
+    }
+
+    frameTimeMs = frameTimeMs > 0.0f ? frameTimeMs + smoothing * (gpuMs - frameTimeMs) : gpuMs;
+    if (frameTimeMs <= budgetMs * overBudget && frameTimeMs >= budgetMs * underBudget) {
+        return;
+    }
+
+    float newScale = scale;
+    float newStepScale = stepScale;
+    bool over = frameTimeMs > budgetMs;
+    if (scaleSteps && (over ? scale <= minScale : stepScale < 1.0f)) {
+        // Steps go first when recovering and last when cutting back
+        newStepScale = std::clamp(stepScale * (over ? 0.9f : 1.1f), minStepScale, 1.0f);
+    }
+    else {
+        // Cost follows the pixel count, the square of the scale; move halfway there
+        float target = scale * std::sqrt(budgetMs / frameTimeMs);
+        newScale = std::clamp(scale + 0.5f * (target - scale), minScale, 1.0f);
+        float snapped = std::round(newScale * scaleGrid) / scaleGrid;
+        if (snapped == scale) {
+            // Still outside the dead band, so take at least one grid step
+            snapped += (over ? -1.0f : 1.0f) / scaleGrid;
+        }
+        newScale = std::clamp(snapped, minScale, 1.0f);
+    }
+
+    if (newScale != scale || newStepScale != stepScale) {
+        scale = newScale;
+        stepScale = newStepScale;
+        frameTimeMs = 0.0f;
+        settleFrames = queryRingSize;
+    }
+}
+
+void DynamicResolution::release() {
+    if (queries[0]) {
+        glDeleteQueries(queryRingSize, queries);
+    }
+    for (int i = 0; i < queryRingSize; ++i) {
+        queries[i] = 0;
+        pending[i] = false;
+    }
+    timing = false;
+}
@@ -0,0 +1,65 @@
+﻿#include "Mesh.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+bool Mesh::writeOBJ(const std::string& path) const {
+    // stdio is much faster than iostreams for millions of formatted numbers
+    FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        std::cerr << "Error: Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    std::fprintf(file, "# %zu vertices, %zu triangles\n", vertices.size(), getTriangleCount());
+    for (const Vec3<float>& v : vertices) {
+        std::fprintf(file, "v %.7g %.7g %.7g\n", v.x, v.y, v.z);
+    }
+    for (const Vec3<float>& n : normals) {
+        std::fprintf(file, "vn %.5g %.5g %.5g\n", n.x, n.y, n.z);
+    }
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        // OBJ indices are 1-based
+        uint32_t a = indices[i] + 1, b = indices[i + 1] + 1, c = indices[i + 2] + 1;
+        std::fprintf(file, "f %u//%u %u//%u %u//%u\n", a, a, b, b, c, c);
+    }
+
+    bool ok = std::ferror(file) == 0;
+    ok = std::fclose(file) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Error: Failed writing " << path << std::endl;
+    }
+    return ok;
+}
+
+bool Mesh::writeSTL(const std::string& path) const {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error: Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+
+    char header[80] = "ImplicitBooleanCSG binary STL";
+    uint32_t triangles = static_cast<uint32_t>(getTriangleCount());
+    file.write(header, sizeof(header));
+    file.write(reinterpret_cast<const char*>(&triangles), sizeof(triangles));
+
+    // STL is little-endian; every supported target is too
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const Vec3<float>& a = vertices[indices[i]];
+        const Vec3<float>& b = vertices[indices[i + 1]];
+        const Vec3<float>& c = vertices[indices[i + 2]];
+        Vec3<float> normal = (b - a).cross(c - a).normalize();
+
+        float record[12] = { normal.x, normal.y, normal.z, a.x, a.y, a.z, b.x, b.y, b.z, c.x, c.y, c.z };
+        uint16_t attributes = 0;
+        file.write(reinterpret_cast<const char*>(record), sizeof(record));
+        file.write(reinterpret_cast<const char*>(&attributes), sizeof(attributes));
+    }
+
+    if (!file) {
+        std::cerr << "Error: Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,325 @@
+﻿#include "MeshExtractor.h"
+#include <algorithm>
+#include <array>
+#include <cmath>
+
+namespace {
+    // Corner offsets of a cell, bit 0 = x, bit 1 = y, bit 2 = z
+    const int cellEdges[12][2] = {
+        { 0, 1 }, { 2, 3 }, { 4, 5 }, { 6, 7 }, // x
+        { 0, 2 }, { 1, 3 }, { 4, 6 }, { 5, 7 }, // y
+        { 0, 4 }, { 1, 5 }, { 2, 6 }, { 3, 7 }  // z
+    };
+
+    const int samplesPerAxis = MeshExtractor::brickCells + 1;
+    const int samplesPerBrick = samplesPerAxis * samplesPerAxis * samplesPerAxis;
+    const int cellsPerBrick = MeshExtractor::brickCells * MeshExtractor::brickCells * MeshExtractor::brickCells;
+
+    struct Grid {
+        Vec3<double> origin;
+        double cellSize;
+        int bricks[3];
+
+        size_t brickIndex(int x, int y, int z) const {
+            return (static_cast<size_t>(z) * bricks[1] + y) * bricks[0] + x;
+        }
+        // Point of a brick's local grid index, computed from the global index
+        // so bricks sharing a face sample it at identical coordinates
+        Vec3<double> point(const int brick[3], int x, int y, int z) const {
+            const int n = MeshExtractor::brickCells;
+            return origin + Vec3<double>(brick[0] * n + x, brick[1] * n + y, brick[2] * n + z) * cellSize;
+        }
+        AABB brickBounds(int x, int y, int z) const {
+            const int brick[3] = { x, y, z };
+            const int n = MeshExtractor::brickCells;
+            return AABB(point(brick, 0, 0, 0), point(brick, n, n, n));
+        }
+    };
+
+    struct Brick {
+        int coordinate[3];
+        std::vector<double> samples;   // samplesPerAxis^3, x fastest
+        std::vector<int32_t> cellVertex; // Local vertex of each cell or -1
+        std::vector<Vec3<float>> vertices;
+        std::vector<Vec3<float>> normals;
+        std::vector<uint32_t> indices;
+        uint32_t firstVertex = 0;
+    };
+
+    int sampleIndex(int x, int y, int z) {
+        return (z * samplesPerAxis + y) * samplesPerAxis + x;
+    }
+
+    // Solve the 3x3 symmetric system a * x = b by Cramer's rule
+    bool solve3(const double a[3][3], const double b[3], double x[3]) {
+        double det = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1]) -
+                     a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0]) +
+                     a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+        if (std::abs(det) < 1e-12) {
+            return false;
+        }
+        for (int column = 0; column < 3; ++column) {
+            double m[3][3];
+            for (int r = 0; r < 3; ++r) {
+                for (int c = 0; c < 3; ++c) {
+                    m[r][c] = c == column ? b[r] : a[r][c];
+                }
+            }
+            x[column] = (m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                         m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                         m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0])) / det;
+        }
+        return true;
+    }
+
+    // Octree over the brick grid: collect bricks the surface may cross
+    void collectBricks(const Tape& tape, const Grid& grid, const int lo[3], const int hi[3],
+                       std::vector<std::array<int, 3>>& bricks) {
+        AABB bounds(grid.brickBounds(lo[0], lo[1], lo[2]).min, grid.brickBounds(hi[0] - 1, hi[1] - 1, hi[2] - 1).max);
+        Interval range = tape.evaluateInterval(bounds);
+        if (range.lower > 0.0 || range.upper < 0.0) {
+            return;
+        }
+
+        int axis = 0;
+        for (int a = 1; a < 3; ++a) {
+            if (hi[a] - lo[a] > hi[axis] - lo[axis]) axis = a;
+        }
+        if (hi[axis] - lo[axis] == 1) {
+            bricks.push_back({ lo[0], lo[1], lo[2] });
+            return;
+        }
+
+        int middle = (lo[axis] + hi[axis]) / 2;
+        int leftHi[3] = { hi[0], hi[1], hi[2] };
+        int rightLo[3] = { lo[0], lo[1], lo[2] };
+        leftHi[axis] = middle;
+        rightLo[axis] = middle;
+        collectBricks(tape, grid, lo, leftHi, bricks);
+        collectBricks(tape, grid, rightLo, hi, bricks);
+    }
+}
+
+MeshExtractor::MeshExtractor()
+    : MeshExtractor(Settings()) {}
+
+MeshExtractor::MeshExtractor(const Settings& settings)
+    : settings(settings), pool(&ThreadPool::shared()) {}
+
+Mesh MeshExtractor::extract(const std::shared_ptr<const ImplicitSurface>& surface) const {
+    if (!surface || !surface->getBounds().isFinite()) {
+        return Mesh();
+    }
+
+    // Pad by two cells so the surface closes inside the sampled region
+    const AABB& bounds = surface->getBounds();
+    Vec3<double> extent = bounds.max - bounds.min;
+    double cellSize = std::max(std::max(extent.x, std::max(extent.y, extent.z)), 1e-6) / settings.resolution;
+    return extract(Tape::compile(surface), bounds.expand(2.0 * cellSize));
+}
+
+Mesh MeshExtractor::extract(const Tape& tape, const AABB& region) const {
+    Mesh mesh;
+    if (tape.empty() || !region.isFinite() || settings.resolution <= 0) {
+        return mesh;
+    }
+
+    Grid grid;
+    Vec3<double> extent = region.max - region.min;
+    grid.origin = region.min;
+    grid.cellSize = std::max(std::max(extent.x, std::max(extent.y, extent.z)), 1e-6) / settings.resolution;
+    const double extents[3] = { extent.x, extent.y, extent.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        grid.bricks[axis] = std::max(1, static_cast<int>(std::ceil(extents[axis] / (grid.cellSize * brickCells))));
+    }
+
+    std::vector<std::array<int, 3>> candidates;
+    const int lo[3] = { 0, 0, 0 };
+    collectBricks(tape, grid, lo, grid.bricks, candidates);
+    if (candidates.empty()) {
+        return mesh;
+    }
+
+    std::vector<Brick> bricks(candidates.size());
+    std::vector<int32_t> brickSlot(static_cast<size_t>(grid.bricks[0]) * grid.bricks[1] * grid.bricks[2], -1);
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        std::copy(candidates[i].begin(), candidates[i].end(), bricks[i].coordinate);
+        brickSlot[grid.brickIndex(candidates[i][0], candidates[i][1], candidates[i][2])] = static_cast<int32_t>(i);
+    }
+
+    const double regularization = settings.regularization;
+
+    // Pass 1: sample every brick and place one vertex per cell with a sign change
+    pool->parallelFor(bricks.size(), [&](size_t index) {
+        Brick& brick = bricks[index];
+        AABB bounds = grid.brickBounds(brick.coordinate[0], brick.coordinate[1], brick.coordinate[2]);
+        Tape local = tape.specialize(bounds);
+
+        std::vector<double> xs(samplesPerBrick), ys(samplesPerBrick), zs(samplesPerBrick);
+        for (int z = 0, n = 0; z < samplesPerAxis; ++z) {
+            for (int y = 0; y < samplesPerAxis; ++y) {
+                for (int x = 0; x < samplesPerAxis; ++x, ++n) {
+                    Vec3<double> p = grid.point(brick.coordinate, x, y, z);
+                    xs[n] = p.x;
+                    ys[n] = p.y;
+                    zs[n] = p.z;
+                }
+            }
+        }
+        brick.samples.resize(samplesPerBrick);
+        local.evaluateBatch(xs.data(), ys.data(), zs.data(), brick.samples.data(), samplesPerBrick);
+
+        brick.cellVertex.assign(cellsPerBrick, -1);
+        for (int z = 0; z < brickCells; ++z) {
+            for (int y = 0; y < brickCells; ++y) {
+                for (int x = 0; x < brickCells; ++x) {
+                    double corner[8];
+                    int inside = 0;
+                    for (int c = 0; c < 8; ++c) {
+                        corner[c] = brick.samples[sampleIndex(x + (c & 1), y + ((c >> 1) & 1), z + ((c >> 2) & 1))];
+                        inside += corner[c] < 0.0 ? 1 : 0;
+                    }
+                    if (inside == 0 || inside == 8) {
+                        continue;
+                    }
+
+                    // Accumulate the QEF normal equations from every crossing edge
+                    Vec3<double> cellMin = grid.point(brick.coordinate, x, y, z);
+                    double ata[3][3] = {};
+                    double atb[3] = {};
+                    Vec3<double> massPoint;
+                    int crossings = 0;
+                    for (const auto& edge : cellEdges) {
+                        double a = corner[edge[0]], b = corner[edge[1]];
+                        if ((a < 0.0) == (b < 0.0)) {
+                            continue;
+                        }
+                        double t = a / (a - b);
+                        Vec3<double> pa((edge[0] & 1), ((edge[0] >> 1) & 1), ((edge[0] >> 2) & 1));
+                        Vec3<double> pb((edge[1] & 1), ((edge[1] >> 1) & 1), ((edge[1] >> 2) & 1));
+                        Vec3<double> point = cellMin + (pa + (pb - pa) * t) * grid.cellSize;
+
+                        Vec3<double> normal;
+                        local.evaluateWithGradient(point, normal);
+                        normal = normal.normalize();
+                        const double n[3] = { normal.x, normal.y, normal.z };
+                        double d = normal.dot(point);
+                        for (int r = 0; r < 3; ++r) {
+                            for (int c = 0; c < 3; ++c) ata[r][c] += n[r] * n[c];
+                            atb[r] += n[r] * d;
+                        }
+                        massPoint = massPoint + point;
+                        ++crossings;
+                    }
+                    massPoint = massPoint * (1.0 / crossings);
+
+                    // Regularize towards the mass point so flat and edge-only cells stay well posed
+                    const double m[3] = { massPoint.x, massPoint.y, massPoint.z };
+                    for (int r = 0; r < 3; ++r) {
+                        ata[r][r] += regularization;
+                        atb[r] += regularization * m[r];
+                    }
+                    double solution[3];
+                    Vec3<double> vertex = massPoint;
+                    if (solve3(ata, atb, solution)) {
+                        Vec3<double> candidate(solution[0], solution[1], solution[2]);
+                        // Vertices leaving their cell fold the mesh; fall back to the mass point
+                        AABB cell(cellMin, cellMin + Vec3<double>(grid.cellSize, grid.cellSize, grid.cellSize));
+                        if (cell.contains(candidate)) vertex = candidate;
+                    }
+
+                    Vec3<double> normal;
+                    local.evaluateWithGradient(vertex, normal);
+                    brick.cellVertex[(z * brickCells + y) * brickCells + x] = static_cast<int32_t>(brick.vertices.size());
+                    brick.vertices.push_back(Vec3<float>(vertex));
+                    brick.normals.push_back(Vec3<float>(normal.normalize()));
+                }
+            }
+        }
+    });
+
+    // Global vertex numbering in brick order
+    uint32_t vertexCount = 0;
+    for (Brick& brick : bricks) {
+        brick.firstVertex = vertexCount;
+        vertexCount += static_cast<uint32_t>(brick.vertices.size());
+    }
+
+    auto cellVertex = [&](int cx, int cy, int cz) -> int64_t {
+        int b[3] = { cx / brickCells, cy / brickCells, cz / brickCells };
+        if (cx < 0 || cy < 0 || cz < 0 || b[0] >= grid.bricks[0] || b[1] >= grid.bricks[1] || b[2] >= grid.bricks[2]) {
+            return -1;
+        }
+        int32_t slot = brickSlot[grid.brickIndex(b[0], b[1], b[2])];
+        if (slot < 0) {
+            return -1;
+        }
+        const Brick& brick = bricks[slot];
+        int local = ((cz % brickCells) * brickCells + cy % brickCells) * brickCells + cx % brickCells;
+        int32_t vertex = brick.cellVertex[local];
+        return vertex < 0 ? -1 : static_cast<int64_t>(brick.firstVertex) + vertex;
+    };
+
+    // Pass 2: one quad per crossing edge. A brick owns the edges starting at
+    // its samples 0..brickCells-1; neighbours across a shared face own the rest.
+    pool->parallelFor(bricks.size(), [&](size_t index) {
+        Brick& brick = bricks[index];
+        int base[3] = { brick.coordinate[0] * brickCells, brick.coordinate[1] * brickCells, brick.coordinate[2] * brickCells };
+
+        for (int z = 0; z < brickCells; ++z) {
+            for (int y = 0; y < brickCells; ++y) {
+                for (int x = 0; x < brickCells; ++x) {
+                    const int local[3] = { x, y, z };
+                    const bool inside = brick.samples[sampleIndex(x, y, z)] < 0.0;
+
+                    for (int axis = 0; axis < 3; ++axis) {
+                        int end[3] = { x, y, z };
+                        ++end[axis];
+                        if ((brick.samples[sampleIndex(end[0], end[1], end[2])] < 0.0) == inside) {
+                            continue;
+                        }
+
+                        // The four cells around the edge, counter-clockwise around +axis
+                        int u = (axis + 1) % 3, v = (axis + 2) % 3;
+                        static const int around[4][2] = { { -1, -1 }, { 0, -1 }, { 0, 0 }, { -1, 0 } };
+                        int64_t quad[4];
+                        bool complete = true;
+                        for (int k = 0; k < 4 && complete; ++k) {
+                            int cell[3] = { base[0] + local[0], base[1] + local[1], base[2] + local[2] };
+                            cell[u] += around[k][0];
+                            cell[v] += around[k][1];
+                            quad[k] = cellVertex(cell[0], cell[1], cell[2]);
+                            complete = quad[k] >= 0;
+                        }
+                        if (!complete) {
+                            continue; // Edge on the region boundary
+                        }
+
+                        // Outward normal points from inside to outside along the edge
+                        if (!inside) {
+                            std::swap(quad[1], quad[3]);
+                        }
+                        const uint32_t a = static_cast<uint32_t>(quad[0]), b = static_cast<uint32_t>(quad[1]);
+                        const uint32_t c = static_cast<uint32_t>(quad[2]), d = static_cast<uint32_t>(quad[3]);
+                        brick.indices.insert(brick.indices.end(), { a, b, c, a, c, d });
+                    }
+                }
+            }
+        }
+    });
+
+    // Concatenate the per-brick outputs
+    size_t indexCount = 0;
+    for (const Brick& brick : bricks) {
+        indexCount += brick.indices.size();
+    }
+    mesh.vertices.reserve(vertexCount);
+    mesh.normals.reserve(vertexCount);
+    mesh.indices.reserve(indexCount);
+    for (const Brick& brick : bricks) {
+        mesh.vertices.insert(mesh.vertices.end(), brick.vertices.begin(), brick.vertices.end());
+        mesh.normals.insert(mesh.normals.end(), brick.normals.begin(), brick.normals.end());
+        mesh.indices.insert(mesh.indices.end(), brick.indices.begin(), brick.indices.end());
+    }
+    return mesh;
+}
@@ -0,0 +1,270 @@
+﻿#include "Profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <iostream>
+
+double Profiler::FrameReport::cpuTime(const std::string& name) const {
+    double total = 0.0;
+    for (const Stage& stage : cpu) {
+        if (stage.name == name) total += stage.milliseconds;
+    }
+    return total;
+}
+
+double Profiler::FrameReport::gpuTime(const std::string& name) const {
+    double total = 0.0;
+    for (const Stage& stage : gpu) {
+        if (stage.name == name) total += stage.milliseconds;
+    }
+    return total;
+}
+
+Profiler::CpuScope::CpuScope(Profiler& profiler, const char* name)
+    : profiler(profiler), name(name), start(std::chrono::steady_clock::now()), active(profiler.isEnabled())
+{
+}
+
+Profiler::CpuScope::~CpuScope() {
+    if (active) {
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        profiler.addCpuTime(name, elapsed.count());
+    }
+}
+
+Profiler::GpuScope::GpuScope(Profiler& profiler, const char* name)
+    : profiler(profiler), stage(profiler.beginGpu(name))
+{
+}
+
+Profiler::GpuScope::~GpuScope() {
+    profiler.endGpu(stage);
+}
+
+Profiler::Profiler()
+    : enabled(false), stepCounters(false), current(0), frameCount(0)
+{
+}
+
+Profiler::~Profiler() {
+    // Queries must be released with a current context, see release()
+    for (const Frame& frame : frames) {
+        if (!frame.queries.empty()) {
+            std::cerr << "Warning: Profiler destroyed with live queries" << std::endl;
+            break;
+        }
+    }
+}
+
+void Profiler::setEnabled(bool enable) {
+    enabled = enable;
+    earlyCpu.clear();
+}
+
+bool Profiler::setOutputFile(const std::string& path) {
+    output.close();
+    if (path.empty()) {
+        return true;
+    }
+    output.open(path, std::ios::trunc);
+    if (!output) {
+        std::cerr << "Warning: Could not open profile output " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool Profiler::setStepCounters(bool enable) {
+#ifdef USE_ADVANCED_OPENGL
+    if (enable && !GLEW_VERSION_4_3 && !GLEW_ARB_shader_storage_buffer_object) {
+        std::cerr << "Warning: Step counters need shader storage buffers" << std::endl;
+        return false;
+    }
+    stepCounters = enable;
+    return true;
+#else
+    if (enable) {
+        std::cerr << "Warning: Step counters require building with USE_ADVANCED_OPENGL" << std::endl;
+    }
+    stepCounters = false;
+    return !enable;
+#endif
+}
+
+void Profiler::beginFrame() {
+    if (!enabled) {
+        return;
+    }
+
+    Frame& frame = frames[current];
+    // The GPU is a whole ring behind; wait for its oldest frame
+    if (frame.pending) {
+        resolve(frame, true);
+    }
+
+    frame.open = true;
+    frame.index = frameCount++;
+    frame.cpu.swap(earlyCpu);
+    earlyCpu.clear();
+    frame.gpu.clear();
+    frame.usedQueries = 0;
+
+#ifdef USE_ADVANCED_OPENGL
+    if (stepCounters) {
+        const GLuint zeros[3 + stepHistogramBins] = {};
+        if (!frame.stepBuffer) {
+            glGenBuffers(1, &frame.stepBuffer);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame.stepBuffer);
+            glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(zeros), nullptr, GL_DYNAMIC_READ);
+        }
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, stepCounterBinding, frame.stepBuffer);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    }
+#endif
+}
+
+void Profiler::endFrame() {
+    Frame& frame = frames[current];
+    if (!frame.open) {
+        return;
+    }
+    frame.open = false;
+    frame.pending = true;
+    current = (current + 1) % frameRingSize;
+
+#ifdef USE_ADVANCED_OPENGL
+    // Shader writes to the step counters must be visible to glGetBufferSubData in resolve
+    if (stepCounters && frame.stepBuffer) {
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    }
+#endif
+
+    // Report every frame the GPU has finished, oldest first
+    for (int i = 0; i < frameRingSize; ++i) {
+        Frame& candidate = frames[(current + i) % frameRingSize];
+        if (candidate.pending) {
+            resolve(candidate, false);
+            if (candidate.pending) {
+                break;
+            }
+        }
+    }
+}
+
+void Profiler::finish() {
+    for (int i = 0; i < frameRingSize; ++i) {
+        Frame& frame = frames[(current + i) % frameRingSize];
+        if (frame.pending) {
+            resolve(frame, true);
+        }
+    }
+}
+
+void Profiler::addCpuTime(const char* name, double milliseconds) {
+    Frame& frame = frames[current];
+    (frame.open ? frame.cpu : earlyCpu).push_back({ name, milliseconds });
+}
+
+int Profiler::beginGpu(const char* name) {
+    Frame& frame = frames[current];
+    if (!enabled || !frame.open) {
+        return -1;
+    }
+
+    if (frame.usedQueries + 2 > frame.queries.size()) {
+        size_t added = std::max<size_t>(frame.queries.size(), 8);
+        frame.queries.resize(frame.queries.size() + added);
+        glGenQueries(static_cast<GLsizei>(added), frame.queries.data() + frame.queries.size() - added);
+    }
+
+    frame.gpu.push_back({ name, frame.usedQueries });
+    glQueryCounter(frame.queries[frame.usedQueries], GL_TIMESTAMP);
+    frame.usedQueries += 2;
+    return static_cast<int>(frame.gpu.size()) - 1;
+}
+
+void Profiler::endGpu(int stage) {
+    Frame& frame = frames[current];
+    if (stage < 0 || !frame.open) {
+        return;
+    }
+    glQueryCounter(frame.queries[frame.gpu[stage].query + 1], GL_TIMESTAMP);
+}
+
+// Turn a finished frame into the last report; without wait, frames whose
+// last query is not available yet stay pending
+void Profiler::resolve(Frame& frame, bool wait) {
+    if (frame.usedQueries > 0 && !wait) {
+        GLint available = 0;
+        glGetQueryObjectiv(frame.queries[frame.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            return;
+        }
+    }
+
+    FrameReport report;
+    report.frame = frame.index;
+    report.cpu = frame.cpu;
+    for (const GpuStage& stage : frame.gpu) {
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(frame.queries[stage.query], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(frame.queries[stage.query + 1], GL_QUERY_RESULT, &end);
+        report.gpu.push_back({ stage.name, end > begin ? (end - begin) * 1e-6 : 0.0 });
+    }
+
+#ifdef USE_ADVANCED_OPENGL
+    if (stepCounters && frame.stepBuffer) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, frame.stepBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(StepStatistics), &report.steps);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        report.hasSteps = true;
+    }
+#endif
+
+    frame.pending = false;
+    lastReport = std::move(report);
+    if (output.is_open()) {
+        output << toJSON(lastReport) << '\n';
+    }
+    if (listener) {
+        listener(lastReport);
+    }
+}
+
+std::string Profiler::toJSON(const FrameReport& report) {
+    auto stages = [](const std::vector<Stage>& list) {
+        std::string text = "{";
+        char value[32];
+        for (size_t i = 0; i < list.size(); ++i) {
+            std::snprintf(value, sizeof(value), "%.4f", list[i].milliseconds);
+            text += (i ? ",\"" : "\"") + list[i].name + "\":" + value;
+        }
+        return text + "}";
+    };
+
+    std::string json = "{\"frame\":" + std::to_string(report.frame);
+    json += ",\"cpuMs\":" + stages(report.cpu);
+    json += ",\"gpuMs\":" + stages(report.gpu);
+    if (report.hasSteps) {
+        char mean[32];
+        std::snprintf(mean, sizeof(mean), "%.3f", report.meanSteps());
+        json += ",\"steps\":{\"pixels\":" + std::to_string(report.steps.pixels) +
+                ",\"mean\":" + mean + ",\"max\":" + std::to_string(report.steps.maxSteps) + ",\"histogram\":[";
+        for (int i = 0; i < stepHistogramBins; ++i) {
+            json += (i ? "," : "") + std::to_string(report.steps.histogram[i]);
+        }
+        json += "]}";
+    }
+    return json + "}";
+}
+
+void Profiler::release() {
+    for (Frame& frame : frames) {
+        if (!frame.queries.empty()) {
+            glDeleteQueries(static_cast<GLsizei>(frame.queries.size()), frame.queries.data());
+        }
+        if (frame.stepBuffer) {
+            glDeleteBuffers(1, &frame.stepBuffer);
+        }
+        frame = Frame();
+    }
+}
@@ -1,4 +1,10 @@
 ﻿#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+static const char* const windowTitle = "Implicit Boolean CSG Renderer";
 
 // Add a function to get the correct shader directory path
 std::string ImplicitRenderer::getShaderPath(const std::string& shaderFile) {
@@ -27,19 +33,71 @@ std::string ImplicitRenderer::getShaderPath(const std::string& shaderFile) {
 }
 
 ImplicitRenderer::ImplicitRenderer(int width, int height)
-    : width(width), height(height), window(nullptr), programID(0),
-    vao(0), vbo(0), framebufferTexture(0), scene(nullptr),
+    : width(width), height(height), windowWidth(width), windowHeight(height), window(nullptr), programID(0),
+    vao(0), vbo(0), framebufferTexture(0), frameParameterBuffer(0), uploadedFrameParameters(),
+    frameParametersUploaded(false), sceneParameterBuffer(0), sceneParameterBufferSize(0),
+    maxSceneParameterVec4s(0), bvhNodeBuffer(0), bvhNodeTexture(0), bvhItemBuffer(0), bvhItemTexture(0),
+    interpreterMode(InterpreterMode::Fallback), sceneInterpreted(false), tapeBuffer(0), tapeTexture(0),
+    bakedFieldEnabled(false), bakedFieldResolution(128), bakedIndexTexture(0), bakedAtlasTexture(0),
+    shadowMaxSteps(48), shadowSoftness(16.0f), shadowVolumeEnabled(false), shadowVolumeResolution(64),
+    shadowVolumeTexture(0), conePrepassEnabled(false), coneTileSize(8), coneProgramID(0), coneFramebuffer(0), coneDepthTexture(0),
+    coneTargetWidth(0), coneTargetHeight(0), headless(false), offscreenFramebuffer(0),
+    offscreenWidth(0), offscreenHeight(0), readbackFrameSize(0), readbackBuffers(), readbackFences(), tileSize(0),
+    temporalMode(TemporalMode::Off), historyFramebuffers(), historyColorTextures(), historyDepthTextures(),
+    historyWidth(0), historyHeight(0), historyIndex(0), historyValid(false), historyPose(), temporalFrame(0),
+    upscaleFramebuffer(0), upscaleTexture(0), upscaleWidth(0), upscaleHeight(0), frameStepScale(1.0f),
+    stepHeatmap(false), overlayTime(0.0),
+    renderBackend(RenderBackend::Fragment),
+    scene(nullptr), asyncShaderCompile(true),
     cameraPosition(0.0f, 0.0f, 5.0f), cameraTarget(0.0f, 0.0f, 0.0f), cameraUp(0.0f, 1.0f, 0.0f),
     fieldOfView(45.0f), lightPosition(3.0f, 5.0f, 5.0f), lightColor(1.0f, 1.0f, 1.0f),
-    ambientStrength(0.1f), maxSteps(100), maxDistance(100.0f), epsilon(0.001f)
+    ambientStrength(0.1f), maxSteps(100), maxDistance(100.0f), epsilon(0.001f),
+    marchingStrategy(MarchingStrategy::SphereTracing), overRelaxation(1.2f), pixelFootprintScale(0.0f),
+    lipschitzBound(1.0f)
 {
+#ifdef USE_ADVANCED_OPENGL
+    computeProgramID = 0;
+#endif
 }
 
 ImplicitRenderer::~ImplicitRenderer() {
-    if (programID) glDeleteProgram(programID);
+    // Linked programs are owned by the cache and need the context to be released
+    if (window) cancelPendingScene();
+    if (window) cancelGeneratedBuilds();
+    if (window) programCache.clear();
+#ifdef USE_ADVANCED_OPENGL
+    if (window) computeMarcher.release();
+#endif
+    if (window) dynamicResolution.release();
+    if (window) profiler.release();
     if (vao) glDeleteVertexArrays(1, &vao);
     if (vbo) glDeleteBuffers(1, &vbo);
+    if (frameParameterBuffer) glDeleteBuffers(1, &frameParameterBuffer);
+    if (sceneParameterBuffer) glDeleteBuffers(1, &sceneParameterBuffer);
+    if (bvhNodeTexture) glDeleteTextures(1, &bvhNodeTexture);
+    if (bvhNodeBuffer) glDeleteBuffers(1, &bvhNodeBuffer);
+    if (bvhItemTexture) glDeleteTextures(1, &bvhItemTexture);
+    if (bvhItemBuffer) glDeleteBuffers(1, &bvhItemBuffer);
+    if (tapeTexture) glDeleteTextures(1, &tapeTexture);
+    if (tapeBuffer) glDeleteBuffers(1, &tapeBuffer);
+    if (bakedIndexTexture) glDeleteTextures(1, &bakedIndexTexture);
+    if (bakedAtlasTexture) glDeleteTextures(1, &bakedAtlasTexture);
+    if (shadowVolumeTexture) glDeleteTextures(1, &shadowVolumeTexture);
+    if (coneFramebuffer) glDeleteFramebuffers(1, &coneFramebuffer);
+    if (coneDepthTexture) glDeleteTextures(1, &coneDepthTexture);
     if (framebufferTexture) glDeleteTextures(1, &framebufferTexture);
+    if (upscaleFramebuffer) glDeleteFramebuffers(1, &upscaleFramebuffer);
+    if (upscaleTexture) glDeleteTextures(1, &upscaleTexture);
+    if (historyFramebuffers[0]) {
+        glDeleteFramebuffers(2, historyFramebuffers);
+        glDeleteTextures(2, historyColorTextures);
+        glDeleteTextures(2, historyDepthTextures);
+    }
+    if (offscreenFramebuffer) glDeleteFramebuffers(1, &offscreenFramebuffer);
+    if (readbackBuffers[0]) glDeleteBuffers(readbackRingSize, readbackBuffers);
+    for (GLsync fence : readbackFences) {
+        if (fence) glDeleteSync(fence);
+    }
 
     if (window) glfwDestroyWindow(window);
     glfwTerminate();
@@ -66,6 +124,11 @@ std::string ImplicitRenderer::loadShaderFile(const std::string& filePath) {
 
         // Convert stream into string
         shaderCode = shaderStream.str();
+
+        // Strip the UTF-8 byte order mark, sources are concatenated before compiling
+        if (shaderCode.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+            shaderCode.erase(0, 3);
+        }
     }
     catch (std::ifstream::failure& e) {
         std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << filePath << std::endl;
@@ -81,11 +144,22 @@ bool ImplicitRenderer::initialize() {
         return false;
     }
 
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    // Headless batches still need a context, which GLFW only creates with a window
+    glfwWindowHint(GLFW_VISIBLE, headless ? GLFW_FALSE : GLFW_TRUE);
 
-    window = glfwCreateWindow(width, height, "Implicit Boolean CSG Renderer", nullptr, nullptr);
+    window = nullptr;
+#ifdef USE_ADVANCED_OPENGL
+    // The compute backend needs OpenGL 4.3, everything else runs on 3.3
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    window = glfwCreateWindow(width, height, windowTitle, nullptr, nullptr);
+#endif
+    if (!window) {
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+        window = glfwCreateWindow(width, height, windowTitle, nullptr, nullptr);
+    }
     if (!window) {
         std::cerr << "Failed to create GLFW window" << std::endl;
         glfwTerminate();
@@ -99,100 +173,353 @@ bool ImplicitRenderer::initialize() {
         return false;
     }
 
+    // Largest parameter block the driver accepts, in vec4 slots
+    GLint maxBlockSize = 0;
+    glGetIntegerv(GL_MAX_UNIFORM_BLOCK_SIZE, &maxBlockSize);
+    maxSceneParameterVec4s = static_cast<size_t>(maxBlockSize) / (4 * sizeof(float));
+
+    // Let the driver pick how many threads compile programs in the background
+    if (GLEW_KHR_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+    } else if (GLEW_ARB_parallel_shader_compile) {
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+    }
+
+    GeneratedScene generated = generateScene(scene, sceneEditor);
+    sceneCode = generated.code;
+    sceneParameters = std::move(generated.parameters);
+    sceneParameterBindings = std::move(generated.bindings);
+    sceneBVH = std::move(generated.bvh);
+    prepareInterpreterPrograms();
     if (!setupShaders() || !setupBuffers()) {
         return false;
     }
+    uploadSceneParameters({});
+    uploadSceneBVH({}, {});
+    bakeSceneField();
+    bakeShadowVolume();
 
-    glfwSwapInterval(1); // Enable vsync
+    glfwSwapInterval(headless ? 0 : 1); // Enable vsync for interactive windows
 
     return true;
 }
 
 bool ImplicitRenderer::setupShaders() {
+    Profiler::CpuScope scope(profiler, "compileShaders");
+    ProgramSources sources = composePrograms(sceneInterpreted ? loadShaderFile(getShaderPath("tape_interpreter.glsl")) : sceneCode);
+
+#ifdef USE_ADVANCED_OPENGL
+    computeProgramID = 0;
+    if (renderBackend == RenderBackend::Compute) {
+        if (!sources.compute.empty()) {
+            computeProgramID = buildComputeProgram(sources.compute);
+        }
+        if (computeProgramID) {
+            computeMarcher.configure(computeProgramID);
+        } else {
+            std::cerr << "Warning: Compute backend disabled, using the fragment backend" << std::endl;
+            renderBackend = RenderBackend::Fragment;
+        }
+    }
+#endif
+
+    // The cone pre-pass is the same source with its own entry point selected
+    coneProgramID = 0;
+    if (!sources.cone.empty()) {
+        coneProgramID = buildProgram(sources.vertex, sources.cone);
+        if (!coneProgramID) {
+            std::cerr << "Warning: Cone pre-pass disabled" << std::endl;
+        }
+    }
+
+    // Frames of the previous program may have been shaded differently
+    historyValid = false;
+
+    // Built last so it is the most recently used program and never evicted;
+    // the other programs are next in line and survive while capacity allows
+    GLuint program = buildProgram(sources.vertex, sources.fragment);
+    if (!program) {
+        return false;
+    }
+    programID = program;
+    return true;
+}
+
+// Link the tape interpreter's programs for the current settings up front and
+// pin them in the cache, so falling back to the interpreter on a scene switch
+// never waits for the driver
+void ImplicitRenderer::prepareInterpreterPrograms() {
+    if (interpreterMode == InterpreterMode::Off) {
+        programCache.setPinned({});
+        return;
+    }
+    Profiler::CpuScope scope(profiler, "compileInterpreter");
+    ProgramSources sources = composePrograms(loadShaderFile(getShaderPath("tape_interpreter.glsl")));
+    std::vector<GLuint> programs = { buildProgram(sources.vertex, sources.fragment) };
+    if (!sources.cone.empty()) {
+        programs.push_back(buildProgram(sources.vertex, sources.cone));
+    }
+#ifdef USE_ADVANCED_OPENGL
+    if (!sources.compute.empty()) {
+        programs.push_back(buildComputeProgram(sources.compute));
+    }
+#endif
+    programCache.setPinned(programs);
+}
+
+// Sources of the programs setupShaders would build for the given scene code
+ImplicitRenderer::ProgramSources ImplicitRenderer::composePrograms(const std::string& code) {
     // Load shader source code with the correct path finder
     std::string vertexShaderCode = loadShaderFile(getShaderPath("vertex.vert"));
     std::string fragmentShaderCode = loadShaderFile(getShaderPath("fragment.frag"));
+    std::string marchingCode = loadShaderFile(getShaderPath("raymarch.glsl"));
     std::string commonSDFCode = loadShaderFile(getShaderPath("common_sdf.glsl"));
+    std::string bakedSDFCode = loadShaderFile(getShaderPath("baked_sdf.glsl"));
+
+    // Every marching stage starts with its own #version line, followed by the
+    // shared marching code; the generated scene function goes at the end.
+    // Step counters are shader storage buffers, which need GLSL 4.30 in every stage.
+    std::string sceneLibrary = "\n" + commonSDFCode + "\n" + bakedSDFCode + "\n" + code;
+    bool stepCounters = profiler.hasStepCounters();
+    auto composeStage = [&](const std::string& stageCode, const std::string& defines) {
+        size_t versionEnd = stageCode.find('\n') + 1;
+        std::string version = stepCounters ? "#version 430 core\n#define STEP_COUNTERS\n" : stageCode.substr(0, versionEnd);
+        return version + defines + marchingCode + "\n" + stageCode.substr(versionEnd) + sceneLibrary;
+    };
 
-    // Get scene-specific code based on scene type
-    std::string sceneSpecificCode;
-
-    // If no scene is set, use default empty scene
-    if (!scene) {
-        sceneSpecificCode = "float sceneSDF(vec3 p) { return 1000.0; }"; // Default empty scene
+    ProgramSources sources;
+    sources.vertex = vertexShaderCode;
+    sources.fragment = composeStage(fragmentShaderCode, "");
+    if (conePrepassEnabled) {
+        sources.cone = composeStage(fragmentShaderCode, "#define CONE_PREPASS\n");
     }
-    else if (dynamic_cast<Sphere*>(scene.get())) {
-        sceneSpecificCode = loadShaderFile(getShaderPath("scene_sphere.frag"));
+#ifdef USE_ADVANCED_OPENGL
+    if (renderBackend == RenderBackend::Compute && ComputeMarcher::supported()) {
+        sources.compute = composeStage(loadShaderFile(getShaderPath("compute_march.comp")), "");
     }
-    else if (dynamic_cast<UnionOp*>(scene.get())) {
-        sceneSpecificCode = loadShaderFile(getShaderPath("scene_union.frag"));
+#endif
+    return sources;
+}
+
+bool ImplicitRenderer::parallelShaderCompileSupported() {
+    return GLEW_KHR_parallel_shader_compile || GLEW_ARB_parallel_shader_compile;
+}
+
+// Start compiling one shader stage. Errors are reported by finishProgram, so
+// that with parallel compilation nothing waits for the driver here.
+GLuint ImplicitRenderer::startShader(GLenum type, const std::string& shaderCode) {
+    const char* source = shaderCode.c_str();
+    GLuint shader = glCreateShader(type);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+    return shader;
+}
+
+// Attach the started stages and start linking
+ImplicitRenderer::ProgramBuild ImplicitRenderer::startProgram(uint64_t programKey, const std::vector<GLuint>& shaders) {
+    ProgramBuild build = { programKey, glCreateProgram(), shaders };
+    for (GLuint shader : shaders) {
+        glAttachShader(build.program, shader);
     }
-    else if (dynamic_cast<IntersectionOp*>(scene.get())) {
-        sceneSpecificCode = loadShaderFile(getShaderPath("scene_intersection.frag"));
+    if (ShaderCache::binariesSupported()) {
+        glProgramParameteri(build.program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
     }
-    else if (dynamic_cast<DifferenceOp*>(scene.get())) {
-        DifferenceOp* diffOp = dynamic_cast<DifferenceOp*>(scene.get());
-        auto spherePtr = dynamic_cast<Sphere*>(diffOp->getLeft().get());
-        auto boxPtr = dynamic_cast<Box*>(diffOp->getRight().get());
+    glLinkProgram(build.program);
+    return build;
+}
 
-        if (spherePtr && boxPtr) {
-            // Standard difference operation (sphere - box)
-            sceneSpecificCode = loadShaderFile(getShaderPath("scene_difference.frag"));
-        }
-        else {
-            // Complex difference operation (possibly union of shapes - box)
-            sceneSpecificCode = loadShaderFile(getShaderPath("scene_complex.frag"));
+// Whether the driver finished linking, polled without blocking (parallel compilation only)
+bool ImplicitRenderer::isBuildComplete(const ProgramBuild& build) {
+    GLint complete = GL_TRUE;
+    glGetProgramiv(build.program, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+// Check a started build, waiting for the driver if it is still busy, and hand
+// the program to the cache. Returns 0 and logs the errors on failure; the
+// stages are deleted either way.
+GLuint ImplicitRenderer::finishProgram(const ProgramBuild& build) {
+    for (GLuint shader : build.shaders) {
+        int success;
+        glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+        if (!success) {
+            GLint type = 0;
+            glGetShaderiv(shader, GL_SHADER_TYPE, &type);
+            const char* stageName = type == GL_VERTEX_SHADER ? "vertex" : type == GL_FRAGMENT_SHADER ? "fragment" : "compute";
+            char infoLog[512];
+            glGetShaderInfoLog(shader, 512, nullptr, infoLog);
+            std::cerr << "Error compiling " << stageName << " shader: " << infoLog << std::endl;
         }
-    }
-    else {
-        // Custom scene
-        sceneSpecificCode = loadShaderFile(getShaderPath("scene_custom.frag"));
+        glDeleteShader(shader);
     }
 
-    const char* vertexSource = vertexShaderCode.c_str();
-    GLuint vertexShader = glCreateShader(GL_VERTEX_SHADER);
-    glShaderSource(vertexShader, 1, &vertexSource, nullptr);
-    glCompileShader(vertexShader);
-
     int success;
-    char infoLog[512];
-    glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &success);
+    glGetProgramiv(build.program, GL_LINK_STATUS, &success);
     if (!success) {
-        glGetShaderInfoLog(vertexShader, 512, nullptr, infoLog);
-        std::cerr << "Error compiling vertex shader: " << infoLog << std::endl;
-        return false;
+        char infoLog[512];
+        glGetProgramInfoLog(build.program, 512, nullptr, infoLog);
+        std::cerr << "Error linking shader program: " << infoLog << std::endl;
+        glDeleteProgram(build.program);
+        return 0;
     }
 
-    std::string fullFragmentCode = fragmentShaderCode + "\n" + commonSDFCode + "\n" + sceneSpecificCode;
-    const char* fragmentSource = fullFragmentCode.c_str();
+    // The cache takes ownership; the previous program stays cached for reuse
+    programCache.insert(build.key, build.program);
+    configureProgram(build.program);
 
-    GLuint fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
-    glShaderSource(fragmentShader, 1, &fragmentSource, nullptr);
-    glCompileShader(fragmentShader);
+    return build.program;
+}
 
-    glGetShaderiv(fragmentShader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        glGetShaderInfoLog(fragmentShader, 512, nullptr, infoLog);
-        std::cerr << "Error compiling fragment shader: " << infoLog << std::endl;
-        return false;
+void ImplicitRenderer::cancelProgram(const ProgramBuild& build) {
+    for (GLuint shader : build.shaders) {
+        glDeleteShader(shader);
     }
+    glDeleteProgram(build.program);
+}
 
-    programID = glCreateProgram();
-    glAttachShader(programID, vertexShader);
-    glAttachShader(programID, fragmentShader);
-    glLinkProgram(programID);
+// Compile and link a program, or reuse a previously linked one for identical
+// sources. With background, a program that is not cached is only started and
+// appended to it, and 0 is returned.
+GLuint ImplicitRenderer::buildProgram(const std::string& vertexShaderCode, const std::string& fragmentShaderCode,
+                                      std::vector<ProgramBuild>* background) {
+    // Reuse a previously linked program for identical sources, from memory or disk
+    uint64_t programKey = ShaderCache::hashSources(vertexShaderCode, fragmentShaderCode);
+    if (GLuint cached = programCache.find(programKey)) {
+        configureProgram(cached);
+        return cached;
+    }
 
-    glGetProgramiv(programID, GL_LINK_STATUS, &success);
-    if (!success) {
-        glGetProgramInfoLog(programID, 512, nullptr, infoLog);
-        std::cerr << "Error linking shader program: " << infoLog << std::endl;
-        return false;
+    ProgramBuild build = startProgram(programKey, { startShader(GL_VERTEX_SHADER, vertexShaderCode),
+                                                    startShader(GL_FRAGMENT_SHADER, fragmentShaderCode) });
+    if (background) {
+        background->push_back(build);
+        return 0;
     }
+    return finishProgram(build);
+}
 
-    glDeleteShader(vertexShader);
-    glDeleteShader(fragmentShader);
+#ifdef USE_ADVANCED_OPENGL
+// Same as buildProgram for a single compute stage; the empty first source keeps
+// its cache keys apart from every graphics program
+GLuint ImplicitRenderer::buildComputeProgram(const std::string& computeShaderCode, std::vector<ProgramBuild>* background) {
+    uint64_t programKey = ShaderCache::hashSources("", computeShaderCode);
+    if (GLuint cached = programCache.find(programKey)) {
+        configureProgram(cached);
+        return cached;
+    }
 
-    return true;
+    ProgramBuild build = startProgram(programKey, { startShader(GL_COMPUTE_SHADER, computeShaderCode) });
+    if (background) {
+        background->push_back(build);
+        return 0;
+    }
+    return finishProgram(build);
+}
+#endif
+
+// Per-program state that is not guaranteed to survive a program binary round trip.
+// Samplers are the only plain uniforms left and their units never change, so
+// they are resolved here once per link or cache hit instead of every frame.
+void ImplicitRenderer::configureProgram(GLuint program) {
+    // Scene and frame parameters are always bound at the same uniform buffer binding points
+    GLuint blockIndex = glGetUniformBlockIndex(program, ShaderGenerator::parameterBlockName);
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, blockIndex, sceneParameterBinding);
+    }
+    GLuint frameBlockIndex = glGetUniformBlockIndex(program, "FrameParameters");
+    if (frameBlockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, frameBlockIndex, frameParameterBinding);
+    }
+
+    // Hierarchy buffers use fixed texture units
+    GLint nodesLocation = glGetUniformLocation(program, "sceneBVHNodes");
+    GLint itemsLocation = glGetUniformLocation(program, "sceneBVHItems");
+    glUseProgram(program);
+    glUniform1i(nodesLocation, bvhNodeTextureUnit);
+    glUniform1i(itemsLocation, bvhItemTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "sceneTape"), tapeTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "bakedBrickIndex"), bakedIndexTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "bakedBrickAtlas"), bakedAtlasTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "shadowVolume"), shadowVolumeTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "coneDepth"), coneDepthTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "historyColor"), historyColorTextureUnit);
+    glUniform1i(glGetUniformLocation(program, "historyDepth"), historyDepthTextureUnit);
+}
+
+void ImplicitRenderer::setConePrepass(bool enabled, int tileSize) {
+    conePrepassEnabled = enabled;
+    coneTileSize = std::max(tileSize, 1);
+    // The pre-pass program is only built while enabled
+    if (window && enabled && !coneProgramID) {
+        prepareInterpreterPrograms();
+        setupShaders();
+    }
+}
+
+void ImplicitRenderer::setRenderBackend(RenderBackend backend) {
+    if (backend == RenderBackend::Compute) {
+#ifdef USE_ADVANCED_OPENGL
+        if (window && !ComputeMarcher::supported()) {
+            std::cerr << "Warning: Compute shaders are not supported by this context" << std::endl;
+            return;
+        }
+#else
+        std::cerr << "Warning: Compute backend requires building with USE_ADVANCED_OPENGL" << std::endl;
+        return;
+#endif
+    }
+
+    RenderBackend previous = renderBackend;
+    renderBackend = backend;
+#ifdef USE_ADVANCED_OPENGL
+    // The compute program is only built while selected
+    if (window && backend != previous && backend == RenderBackend::Compute) {
+        prepareInterpreterPrograms();
+        setupShaders();
+    }
+#else
+    (void)previous;
+#endif
+}
+
+void ImplicitRenderer::setTemporalReprojection(TemporalMode mode) {
+    temporalMode = mode;
+    historyValid = false;
+}
+
+void ImplicitRenderer::setDynamicResolution(bool enabled, float budgetMs, float minScale, bool scaleSteps) {
+    dynamicResolution.configure(enabled, budgetMs, minScale, scaleSteps);
+}
+
+void ImplicitRenderer::setProfiling(bool enabled, const std::string& outputPath) {
+    if (!enabled) {
+        setStepCounters(false);
+    }
+    profiler.setEnabled(enabled);
+    profiler.setOutputFile(enabled ? outputPath : "");
+    if (window && !enabled) {
+        glfwSetWindowTitle(window, windowTitle);
+    }
+}
+
+void ImplicitRenderer::setStepCounters(bool enabled) {
+    if (enabled == profiler.hasStepCounters()) {
+        return;
+    }
+    // Each profiled frame binds its own counter buffer, which shaders must never miss
+    if (enabled && !profiler.isEnabled()) {
+        std::cerr << "Warning: Step counters need profiling to be enabled" << std::endl;
+        return;
+    }
+    // The counters are compiled into the programs
+    if (profiler.setStepCounters(enabled) && window) {
+        prepareInterpreterPrograms();
+        setupShaders();
+    }
+}
+
+void ImplicitRenderer::setShaderCacheDirectory(const std::string& directory) {
+    programCache.setCacheDirectory(directory);
 }
 
 bool ImplicitRenderer::setupBuffers() {
@@ -219,24 +546,535 @@ bool ImplicitRenderer::setupBuffers() {
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
 
+    glGenBuffers(1, &frameParameterBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, frameParameterBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameParameters), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, frameParameterBinding, frameParameterBuffer);
+    frameParametersUploaded = false;
+
     return true;
 }
 
-// This function can be simplified or removed since we're now loading shader code from files
-std::string ImplicitRenderer::generateSceneSDFCode() {
-    // Return empty string since we're now loading shader code from files
-    return "";
+// Range [first, last) of data that differs from previous, false if none does
+static bool changedRange(const std::vector<float>& data, const std::vector<float>& previous, size_t& first, size_t& last) {
+    first = 0;
+    last = data.size();
+    if (previous.size() != data.size()) {
+        return true;
+    }
+    while (first < last && data[first] == previous[first]) ++first;
+    while (last > first && data[last - 1] == previous[last - 1]) --last;
+    return first < last;
+}
+
+// Write RGBA32F data into a buffer texture (created on first use), only the
+// range that differs from previous (the buffer's contents) unless the size changed
+static void uploadBufferTexture(GLuint& buffer, GLuint& texture, const std::vector<float>& data, const std::vector<float>& previous) {
+    size_t first, last;
+    if (buffer && !changedRange(data, previous, first, last)) {
+        return;
+    }
+    if (buffer && previous.size() == data.size()) {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferSubData(GL_TEXTURE_BUFFER, static_cast<GLintptr>(first * sizeof(float)),
+                        static_cast<GLsizeiptr>((last - first) * sizeof(float)), data.data() + first);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        return;
+    }
+    if (!buffer) {
+        glGenBuffers(1, &buffer);
+        glGenTextures(1, &texture);
+    }
+    glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+    glBufferData(GL_TEXTURE_BUFFER, static_cast<GLsizeiptr>(data.size() * sizeof(float)), data.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_BUFFER, texture);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+    glBindTexture(GL_TEXTURE_BUFFER, 0);
+}
+
+// Replace the texels between min and max (inclusive) of a 3D texture with
+// the matching part of data, which holds the whole texture, x fastest
+static void uploadTextureBox(GLuint texture, GLenum format, int components, const int size[3],
+                             const int min[3], const int max[3], const float* data) {
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, size[0]);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, size[1]);
+    size_t offset = (static_cast<size_t>(min[2]) * size[1] + min[1]) * size[0] + min[0];
+    glTexSubImage3D(GL_TEXTURE_3D, 0, min[0], min[1], min[2], max[0] - min[0] + 1, max[1] - min[1] + 1,
+                    max[2] - min[2] + 1, format, GL_FLOAT, data + offset * components);
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glPixelStorei(GL_UNPACK_IMAGE_HEIGHT, 0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+// Generate the scene functions of surface, whose graph editor holds. With
+// refit, the hierarchy is refitted from that one when the items still match.
+ImplicitRenderer::GeneratedScene ImplicitRenderer::generateScene(const std::shared_ptr<const ImplicitSurface>& surface,
+                                                                 const SceneEditor& editor, const SceneBVH* refit) {
+    Profiler::CpuScope scope(profiler, "generateScene");
+    GeneratedScene generated;
+
+    // If no scene is set, use default empty scene
+    if (!surface) {
+        generated.code = "float sceneSDF(vec3 p) { return 1000.0; }\n"
+                         "vec4 sceneSDFGradient(vec3 p) { return vec4(1000.0, 0.0, 1.0, 0.0); }\n";
+        return generated;
+    }
+
+    // Scenes with many top-level union items are traversed through a BVH
+    // instead of evaluating every item at every step
+    if (refit) {
+        generated.bvh = *refit;
+    }
+    bool useBVH = (refit && generated.bvh.refit(surface)) || generated.bvh.build(surface);
+    auto generate = [&](ShaderGenerator& generator) {
+        if (!useBVH) {
+            return generator.generateSceneSDF(editor.getGraph(), editor.getRoot());
+        }
+        return generator.generateSceneBVHFunctions(generated.bvh) + "\n" +
+               loadShaderFile(getShaderPath("scene_bvh.glsl"));
+    };
+
+    ShaderGenerator generator;
+    generator.setUseParameterBlock(true);
+    generated.code = generate(generator);
+
+    // Scenes too large for a uniform block fall back to literal constants
+    if (generator.getParameterVec4Count() > maxSceneParameterVec4s) {
+        generator.setUseParameterBlock(false);
+        generated.code = generate(generator);
+        return generated;
+    }
+
+    generated.parameters = generator.getParameters();
+    if (!useBVH) {
+        generated.bindings = generator.getParameterBindings();
+    }
+    return generated;
+}
+
+// Make generated the current scene functions, relinking only when the source
+// changed (in the background if allowed), and upload what differs from the
+// previous scene's buffers. generated is left holding the previous
+// parameters and hierarchy.
+void ImplicitRenderer::installScene(GeneratedScene& generated, bool background) {
+    std::swap(sceneParameters, generated.parameters);
+    std::swap(sceneBVH, generated.bvh);
+    sceneParameterBindings = std::move(generated.bindings);
+    if (!programID || generated.code != sceneCode) {
+        sceneCode = std::move(generated.code);
+        setupScenePrograms(background);
+    }
+    uploadSceneParameters(generated.parameters);
+    uploadSceneBVH(generated.bvh.getNodeData(), generated.bvh.getItemData());
+}
+
+// Upload sceneParameters, writing only the range that differs from previous
+// (the buffer's contents) unless the size changed
+void ImplicitRenderer::uploadSceneParameters(const std::vector<float>& previous) {
+    if (sceneParameters.empty()) {
+        return;
+    }
+
+    if (!sceneParameterBuffer) {
+        glGenBuffers(1, &sceneParameterBuffer);
+    }
+
+    GLsizeiptr size = static_cast<GLsizeiptr>(sceneParameters.size() * sizeof(float));
+    glBindBuffer(GL_UNIFORM_BUFFER, sceneParameterBuffer);
+    size_t first, last;
+    if (size != sceneParameterBufferSize) {
+        glBufferData(GL_UNIFORM_BUFFER, size, sceneParameters.data(), GL_DYNAMIC_DRAW);
+        sceneParameterBufferSize = size;
+    }
+    else if (changedRange(sceneParameters, previous, first, last)) {
+        glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(first * sizeof(float)),
+                        static_cast<GLsizeiptr>((last - first) * sizeof(float)), sceneParameters.data() + first);
+    }
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, sceneParameterBinding, sceneParameterBuffer);
+}
+
+// Write the block values of nodes edited in place at their bindings and
+// upload the range they span. False when the block cannot be patched (no
+// bindings, or literal constants) and the scene has to be generated again.
+bool ImplicitRenderer::patchSceneParameters(const std::vector<NodeHandle>& nodes) {
+    if (!sceneBVH.empty() || sceneParameters.empty() || sceneParameterBindings.empty() || !sceneParameterBuffer) {
+        return false;
+    }
+
+    std::vector<char> edited(sceneEditor.getGraph().size(), 0);
+    for (NodeHandle node : nodes) edited[node] = 1;
+
+    size_t first = sceneParameters.size(), last = 0;
+    float values[ShaderGenerator::maxPackedParameters];
+    for (const ShaderGenerator::ParameterBinding& binding : sceneParameterBindings) {
+        if (!edited[binding.node]) continue;
+        size_t count = ShaderGenerator::packParameters(sceneEditor.getGraph(), binding.node, values);
+        std::copy(values, values + count, sceneParameters.begin() + binding.offset);
+        first = std::min<size_t>(first, binding.offset);
+        last = std::max<size_t>(last, binding.offset + count);
+    }
+
+    if (first < last) {
+        glBindBuffer(GL_UNIFORM_BUFFER, sceneParameterBuffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(first * sizeof(float)),
+                        static_cast<GLsizeiptr>((last - first) * sizeof(float)), sceneParameters.data() + first);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    }
+    return true;
+}
+
+// Upload the hierarchy built by generateScene into its buffer textures,
+// writing only what differs from the previous node and item data
+void ImplicitRenderer::uploadSceneBVH(const std::vector<float>& previousNodes, const std::vector<float>& previousItems) {
+    Profiler::CpuScope scope(profiler, "sceneBVH");
+    if (sceneBVH.empty()) {
+        return;
+    }
+
+    uploadBufferTexture(bvhNodeBuffer, bvhNodeTexture, sceneBVH.getNodeData(), previousNodes);
+    uploadBufferTexture(bvhItemBuffer, bvhItemTexture, sceneBVH.getItemData(), previousItems);
+}
+
+// Upload the interpreter form of sceneTape, writing only what differs from the uploaded one
+void ImplicitRenderer::uploadSceneTape() {
+    std::vector<float> texels = sceneTape.packInterpreter();
+    uploadBufferTexture(tapeBuffer, tapeTexture, texels, uploadedTape);
+    uploadedTape = std::move(texels);
+}
+
+void ImplicitRenderer::setBakedDistanceField(bool enabled, int resolution) {
+    bakedFieldEnabled = enabled;
+    bakedFieldResolution = resolution;
+    if (window) {
+        bakeSceneField();
+    }
+}
+
+// Bake the current scene on the CPU and upload the brick index and atlas
+void ImplicitRenderer::bakeSceneField() {
+    Profiler::CpuScope scope(profiler, "bakeField");
+    if (!bakedFieldEnabled || !scene) {
+        bakedField = DistanceField();
+        return;
+    }
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize);
+
+    if (!bakedField.bake(sceneTape, scene->getBounds(), bakedFieldResolution, maxTextureSize)) {
+        // Unbounded scenes (planes) have no finite region to bake
+        std::cerr << "Warning: Scene cannot be baked, using exact evaluation" << std::endl;
+        return;
+    }
+
+    auto upload = [](GLuint& texture, GLenum internalFormat, GLenum format, GLint filter,
+                     const int size[3], const std::vector<float>& data) {
+        if (!texture) {
+            glGenTextures(1, &texture);
+        }
+        glBindTexture(GL_TEXTURE_3D, texture);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexImage3D(GL_TEXTURE_3D, 0, internalFormat, size[0], size[1], size[2], 0, format, GL_FLOAT, data.data());
+        glBindTexture(GL_TEXTURE_3D, 0);
+    };
+
+    int atlasSize[3];
+    bakedField.getAtlasSize(atlasSize);
+    upload(bakedIndexTexture, GL_RG32F, GL_RG, GL_NEAREST, bakedField.getBrickGrid(), bakedField.getBrickIndex());
+    upload(bakedAtlasTexture, GL_R32F, GL_RED, GL_LINEAR, atlasSize, bakedField.getAtlas());
+
+    std::cout << "Baked distance field: " << bakedField.getNearBrickCount() << " of "
+              << bakedField.getBrickIndex().size() / 2 << " bricks sampled" << std::endl;
+}
+
+// Rebake and upload only the bricks an edit can have changed
+void ImplicitRenderer::updateSceneField(const SceneEditor::Changes& changes) {
+    if (!bakedFieldEnabled) {
+        return;
+    }
+    Profiler::CpuScope scope(profiler, "updateField");
+    if (bakedField.empty() || !bakedField.update(sceneTape, scene->getBounds(), changes.region, changes.margin)) {
+        bakeSceneField();
+        return;
+    }
+
+    const std::vector<size_t>& bricks = bakedField.getUpdatedBricks();
+    if (bricks.empty()) {
+        return;
+    }
+    const int* grid = bakedField.getBrickGrid();
+    int low[3] = { grid[0], grid[1], grid[2] }, high[3] = { -1, -1, -1 };
+    for (size_t index : bricks) {
+        int coordinates[3] = { static_cast<int>(index % grid[0]), static_cast<int>((index / grid[0]) % grid[1]),
+                               static_cast<int>(index / (static_cast<size_t>(grid[0]) * grid[1])) };
+        for (int axis = 0; axis < 3; ++axis) {
+            low[axis] = std::min(low[axis], coordinates[axis]);
+            high[axis] = std::max(high[axis], coordinates[axis]);
+        }
+    }
+    uploadTextureBox(bakedIndexTexture, GL_RG, 2, grid, low, high, bakedField.getBrickIndex().data());
+
+    int atlasSize[3];
+    bakedField.getAtlasSize(atlasSize);
+    const int* atlasBricks = bakedField.getAtlasBricks();
+    for (size_t slot : bakedField.getUpdatedSlots()) {
+        int origin[3] = {
+            static_cast<int>(slot % atlasBricks[0]) * DistanceField::brickSamples,
+            static_cast<int>((slot / atlasBricks[0]) % atlasBricks[1]) * DistanceField::brickSamples,
+            static_cast<int>(slot / (static_cast<size_t>(atlasBricks[0]) * atlasBricks[1])) * DistanceField::brickSamples
+        };
+        int corner[3] = { origin[0] + DistanceField::brickCells, origin[1] + DistanceField::brickCells,
+                          origin[2] + DistanceField::brickCells };
+        uploadTextureBox(bakedAtlasTexture, GL_RED, 1, atlasSize, origin, corner, bakedField.getAtlas().data());
+    }
+}
+
+void ImplicitRenderer::setShadowVolume(bool enabled, int resolution) {
+    shadowVolumeEnabled = enabled;
+    shadowVolumeResolution = resolution;
+    if (window) {
+        bakeShadowVolume();
+    }
+}
+
+// Trace the light's visibility on the CPU and upload it as a filtered 3D texture
+void ImplicitRenderer::bakeShadowVolume() {
+    Profiler::CpuScope scope(profiler, "bakeShadowVolume");
+    if (!shadowVolumeEnabled || !scene) {
+        shadowVolume = ShadowVolume();
+        return;
+    }
+
+    GLint maxTextureSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxTextureSize);
+
+    Vec3<double> light(lightPosition.x, lightPosition.y, lightPosition.z);
+    if (!shadowVolume.bake(sceneTape, scene->getBounds(), light, shadowVolumeResolution,
+                           shadowMaxSteps, shadowSoftness, epsilon, lipschitzBound, maxTextureSize)) {
+        std::cerr << "Warning: Scene cannot be covered by a shadow volume, marching shadow rays" << std::endl;
+        return;
+    }
+
+    if (!shadowVolumeTexture) {
+        glGenTextures(1, &shadowVolumeTexture);
+    }
+    const int* size = shadowVolume.getSize();
+    glBindTexture(GL_TEXTURE_3D, shadowVolumeTexture);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R32F, size[0], size[1], size[2], 0, GL_RED, GL_FLOAT,
+                 shadowVolume.getVisibility().data());
+    glBindTexture(GL_TEXTURE_3D, 0);
+}
+
+// Trace again and upload only the cells whose shadow rays pass near an edit
+void ImplicitRenderer::updateShadowVolume(const SceneEditor::Changes& changes) {
+    if (!shadowVolumeEnabled) {
+        return;
+    }
+    Profiler::CpuScope scope(profiler, "updateShadowVolume");
+    if (shadowVolume.empty() || !shadowVolume.update(sceneTape, scene->getBounds(), changes.region, changes.margin)) {
+        bakeShadowVolume();
+        return;
+    }
+
+    if (shadowVolume.getUpdatedMax()[0] >= 0) {
+        uploadTextureBox(shadowVolumeTexture, GL_RED, 1, shadowVolume.getSize(), shadowVolume.getUpdatedMin(),
+                         shadowVolume.getUpdatedMax(), shadowVolume.getVisibility().data());
+    }
 }
 
 void ImplicitRenderer::setScene(std::shared_ptr<ImplicitSurface> newScene) {
-    scene = newScene;
-    // Recompile shaders to update scene
-    setupShaders();
+    cancelPendingScene();
+    std::unique_ptr<PendingScene> pending(new PendingScene());
+    pending->surface = newScene;
+    pending->editor.reset(newScene);
+    pending->tape = Tape::compile(pending->editor.getGraph(), pending->editor.getRoot());
+    pending->generated = generateScene(newScene, pending->editor);
+
+    // Only recompile when the tree topology changed; parameter edits just
+    // produce identical source and are applied through the uniform buffer.
+    // New programs are built in the background if the driver can, while the
+    // tape interpreter draws the new scene or else the current one is kept.
+    bool changed = pending->generated.code != sceneCode;
+    if (changed && interpreterMode != InterpreterMode::Off && pending->tape.isInterpretable()) {
+        pending->interpret = true;
+    } else if (changed && backgroundCompileAvailable()) {
+        startProgramBuilds(composePrograms(pending->generated.code), pending->builds);
+    }
+    pendingScene = std::move(pending);
+    if (pendingScene->builds.empty()) {
+        applyPendingScene(true);
+    }
 
     // Immediately trigger a render to update the scene right away
     render();
 }
 
+bool ImplicitRenderer::backgroundCompileAvailable() const {
+    return asyncShaderCompile && window && !headless && programID && parallelShaderCompileSupported();
+}
+
+// Start building every program of sources that is not cached yet
+void ImplicitRenderer::startProgramBuilds(const ProgramSources& sources, std::vector<ProgramBuild>& builds) {
+    buildProgram(sources.vertex, sources.fragment, &builds);
+    if (!sources.cone.empty()) {
+        buildProgram(sources.vertex, sources.cone, &builds);
+    }
+#ifdef USE_ADVANCED_OPENGL
+    if (!sources.compute.empty()) {
+        buildComputeProgram(sources.compute, &builds);
+    }
+#endif
+}
+
+// Link the programs for sceneCode. The tape interpreter stands in while they
+// build in the background, and for good when they fail to build.
+void ImplicitRenderer::setupScenePrograms(bool background) {
+    cancelGeneratedBuilds();
+    bool interpretable = interpreterMode != InterpreterMode::Off && sceneTape.isInterpretable();
+    bool interpret = interpretable && interpreterMode == InterpreterMode::Always;
+    if (interpretable && !interpret && background && backgroundCompileAvailable()) {
+        startProgramBuilds(composePrograms(sceneCode), generatedBuilds);
+        interpret = !generatedBuilds.empty();
+    }
+
+    if (!interpret) {
+        sceneInterpreted = false;
+        if (setupShaders() || !interpretable) {
+            return;
+        }
+        std::cerr << "Warning: Scene program failed to build, interpreting the scene tape" << std::endl;
+    }
+    sceneInterpreted = true;
+    setupShaders();
+}
+
+// Swap the generated programs in for the interpreter once they are built,
+// or right away (waiting for the driver) with wait
+void ImplicitRenderer::finishGeneratedBuilds(bool wait) {
+    if (generatedBuilds.empty()) {
+        return;
+    }
+    if (!wait) {
+        for (const ProgramBuild& build : generatedBuilds) {
+            if (!isBuildComplete(build)) return;
+        }
+    }
+
+    bool linked = true;
+    for (const ProgramBuild& build : generatedBuilds) {
+        linked = finishProgram(build) != 0 && linked;
+    }
+    generatedBuilds.clear();
+    if (!linked) {
+        std::cerr << "Warning: Scene program failed to build, interpreting the scene tape" << std::endl;
+        return;
+    }
+    sceneInterpreted = false;
+    setupShaders();
+}
+
+void ImplicitRenderer::cancelGeneratedBuilds() {
+    for (const ProgramBuild& build : generatedBuilds) {
+        cancelProgram(build);
+    }
+    generatedBuilds.clear();
+}
+
+void ImplicitRenderer::setTapeInterpreter(InterpreterMode mode) {
+    if (mode == interpreterMode) {
+        return;
+    }
+    interpreterMode = mode;
+    if (window && programID) {
+        prepareInterpreterPrograms();
+        setupScenePrograms(true);
+        if (sceneInterpreted) uploadSceneTape();
+    }
+}
+
+// Switch to the pending scene once its programs are linked, or right away
+// (waiting for the driver) with wait
+void ImplicitRenderer::applyPendingScene(bool wait) {
+    if (!pendingScene) {
+        return;
+    }
+    if (!wait) {
+        for (const ProgramBuild& build : pendingScene->builds) {
+            if (!isBuildComplete(build)) return;
+        }
+    }
+
+    Profiler::CpuScope scope(profiler, "applyScene");
+    std::unique_ptr<PendingScene> pending = std::move(pendingScene);
+
+    // Linked programs go into the cache, where setupShaders finds them
+    for (const ProgramBuild& build : pending->builds) {
+        finishProgram(build);
+    }
+
+    scene = pending->surface;
+    sceneEditor = std::move(pending->editor);
+    sceneTape = std::move(pending->tape);
+    installScene(pending->generated, pending->interpret);
+    if (sceneInterpreted) uploadSceneTape();
+    bakeSceneField();
+    bakeShadowVolume();
+    historyValid = false;
+}
+
+void ImplicitRenderer::cancelPendingScene() {
+    if (!pendingScene) {
+        return;
+    }
+    for (const ProgramBuild& build : pendingScene->builds) {
+        cancelProgram(build);
+    }
+    pendingScene.reset();
+}
+
+void ImplicitRenderer::commitSceneEdits() {
+    if (!sceneEditor.hasChanges()) {
+        return;
+    }
+    Profiler::CpuScope scope(profiler, "commitEdits");
+    SceneEditor::Changes changes = sceneEditor.takeChanges();
+    scene = sceneEditor.getSurface();
+
+    // Parameter edits keep the tape's instructions and, with a parameter
+    // block, the generated source as well
+    const SceneGraph& graph = sceneEditor.getGraph();
+    bool inPlace = !changes.structure && sceneTape.updateConstants(graph, changes.parameterNodes);
+    if (!inPlace) {
+        sceneTape = Tape::compile(graph, sceneEditor.getRoot());
+    }
+
+    if (!inPlace || !patchSceneParameters(changes.parameterNodes)) {
+        GeneratedScene generated = generateScene(scene, sceneEditor, inPlace ? &sceneBVH : nullptr);
+        installScene(generated, true);
+    }
+    if (sceneInterpreted) uploadSceneTape();
+
+    updateSceneField(changes);
+    updateShadowVolume(changes);
+    historyValid = false;
+}
+
 void ImplicitRenderer::setCamera(const Vec3<float>& position, const Vec3<float>& target, const Vec3<float>& up, float fov) {
     cameraPosition = position;
     cameraTarget = target;
@@ -245,9 +1083,25 @@ void ImplicitRenderer::setCamera(const Vec3<float>& position, const Vec3<float>&
 }
 
 void ImplicitRenderer::setLight(const Vec3<float>& position, const Vec3<float>& color, float ambient) {
+    bool moved = position.x != lightPosition.x || position.y != lightPosition.y || position.z != lightPosition.z;
     lightPosition = position;
     lightColor = color;
     ambientStrength = ambient;
+
+    // The visibility volume is only valid for the light it was traced from
+    if (moved && shadowVolumeEnabled && window) {
+        bakeShadowVolume();
+    }
+    // Reprojected colors were lit by the previous light
+    historyValid = false;
+}
+
+void ImplicitRenderer::setShadowParams(int maxSteps, float softness) {
+    shadowMaxSteps = std::max(maxSteps, 1);
+    shadowSoftness = std::max(softness, 1e-3f);
+    if (shadowVolumeEnabled && window) {
+        bakeShadowVolume();
+    }
 }
 
 void ImplicitRenderer::setRaymarchingParams(int steps, float distance, float eps) {
@@ -256,48 +1110,711 @@ void ImplicitRenderer::setRaymarchingParams(int steps, float distance, float eps
     epsilon = eps;
 }
 
+void ImplicitRenderer::setMarchingStrategy(MarchingStrategy strategy, float relaxation) {
+    marchingStrategy = strategy;
+    // Relaxation of 2 or more can step over thin features in any field
+    overRelaxation = std::min(std::max(relaxation, 1.0f), 1.95f);
+}
+
+void ImplicitRenderer::setPixelFootprintEpsilon(float pixels) {
+    pixelFootprintScale = std::max(pixels, 0.0f);
+}
+
+void ImplicitRenderer::setLipschitzBound(float bound) {
+    if (!(bound > 0.0f)) {
+        std::cerr << "Warning: Lipschitz bound must be positive, keeping " << lipschitzBound << std::endl;
+        return;
+    }
+    bool changed = bound != lipschitzBound;
+    lipschitzBound = bound;
+
+    // Shadow rays of the volume were marched with the previous bound
+    if (changed && shadowVolumeEnabled && window) {
+        bakeShadowVolume();
+    }
+}
+
+// Fill the FrameParameters block and upload the range that changed since the
+// last frame; a static camera costs no buffer update at all
+void ImplicitRenderer::updateFrameParameters(bool useConeDepth, bool useHistory) {
+    FrameParameters frame = {};
+    auto copy3 = [](float* out, const Vec3<float>& v) {
+        out[0] = v.x;
+        out[1] = v.y;
+        out[2] = v.z;
+    };
+    auto copyBounds = [](float* outMin, float* outMax, const AABB& bounds) {
+        outMin[0] = static_cast<float>(bounds.min.x);
+        outMin[1] = static_cast<float>(bounds.min.y);
+        outMin[2] = static_cast<float>(bounds.min.z);
+        outMax[0] = static_cast<float>(bounds.max.x);
+        outMax[1] = static_cast<float>(bounds.max.y);
+        outMax[2] = static_cast<float>(bounds.max.z);
+    };
+
+    copy3(frame.cameraPosition, cameraPosition);
+    copy3(frame.cameraTarget, cameraTarget);
+    copy3(frame.cameraUp, cameraUp);
+    frame.fieldOfView = fieldOfView;
+    frame.resolution[0] = static_cast<float>(width);
+    frame.resolution[1] = static_cast<float>(height);
+
+    copy3(frame.lightPosition, lightPosition);
+    copy3(frame.lightColor, lightColor);
+    frame.ambientStrength = ambientStrength;
+
+    frame.maxSteps = std::max(1, static_cast<int>(std::lround(maxSteps * frameStepScale)));
+    frame.maxDistance = maxDistance;
+    frame.epsilon = epsilon;
+
+    // Size of one pixel per unit of depth along the view axis
+    float pixelAngle = 2.0f * std::tan(fieldOfView * 3.14159265f / 360.0f) / static_cast<float>(height);
+    frame.overRelaxation = marchingStrategy == MarchingStrategy::OverRelaxed ? overRelaxation : 1.0f;
+    frame.pixelFootprint = pixelFootprintScale * pixelAngle;
+    frame.lipschitzBound = lipschitzBound;
+
+    frame.shadowMaxSteps = shadowMaxSteps;
+    frame.shadowSoftness = shadowSoftness;
+    frame.coneTileSize = coneTileSize;
+    frame.useConeDepth = useConeDepth ? 1 : 0;
+
+    if (bakedFieldEnabled && !bakedField.empty()) {
+        frame.useBakedField = 1;
+        copyBounds(frame.bakedBoundsMin, frame.bakedBoundsMax, bakedField.getBounds());
+        frame.bakedVoxelSize = static_cast<float>(bakedField.getVoxelSize());
+        frame.bakedExactBand = static_cast<float>(bakedField.getExactBand());
+        std::copy(bakedField.getBrickGrid(), bakedField.getBrickGrid() + 3, frame.bakedBrickGrid);
+        std::copy(bakedField.getAtlasBricks(), bakedField.getAtlasBricks() + 3, frame.bakedAtlasBricks);
+    }
+
+    if (useHistory) {
+        copy3(frame.previousCameraPosition, historyPose.position);
+        copy3(frame.previousCameraTarget, historyPose.target);
+        copy3(frame.previousCameraUp, historyPose.up);
+        frame.previousFieldOfView = historyPose.fieldOfView;
+        frame.temporalMode = static_cast<int32_t>(temporalMode);
+    }
+    frame.temporalFrame = temporalFrame;
+    frame.stepHeatmap = stepHeatmap ? 1 : 0;
+
+    if (shadowVolumeEnabled && !shadowVolume.empty()) {
+        frame.useShadowVolume = 1;
+        copyBounds(frame.shadowVolumeMin, frame.shadowVolumeMax, shadowVolume.getBounds());
+        frame.shadowVolumeOffset = static_cast<float>(shadowVolume.getLookupOffset());
+    }
+
+    // Smallest run of 16 byte rows that differs from the buffer contents
+    const size_t rowSize = 16;
+    const size_t rows = sizeof(FrameParameters) / rowSize;
+    const unsigned char* current = reinterpret_cast<const unsigned char*>(&frame);
+    const unsigned char* uploaded = reinterpret_cast<const unsigned char*>(&uploadedFrameParameters);
+    size_t first = 0, last = rows;
+    if (frameParametersUploaded) {
+        while (first < rows && std::memcmp(current + first * rowSize, uploaded + first * rowSize, rowSize) == 0) {
+            ++first;
+        }
+        while (last > first && std::memcmp(current + (last - 1) * rowSize, uploaded + (last - 1) * rowSize, rowSize) == 0) {
+            --last;
+        }
+    }
+    if (first == last) {
+        return;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, frameParameterBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, static_cast<GLintptr>(first * rowSize),
+                    static_cast<GLsizeiptr>((last - first) * rowSize), current + first * rowSize);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    uploadedFrameParameters = frame;
+    frameParametersUploaded = true;
+}
+
+// Size the pre-pass depth target to the window. Returns false when the
+// pre-pass is disabled, leaving the main pass to march from the camera.
+bool ImplicitRenderer::prepareConeTarget() {
+    if (!conePrepassEnabled || !coneProgramID) {
+        return false;
+    }
+
+    // Only grown, so alternating window frames and larger offscreen frames
+    // do not reallocate it every time
+    int tilesX = std::max((width + coneTileSize - 1) / coneTileSize, coneTargetWidth);
+    int tilesY = std::max((height + coneTileSize - 1) / coneTileSize, coneTargetHeight);
+    if (!coneFramebuffer || tilesX != coneTargetWidth || tilesY != coneTargetHeight) {
+        if (!coneFramebuffer) {
+            glGenFramebuffers(1, &coneFramebuffer);
+            glGenTextures(1, &coneDepthTexture);
+        }
+        // Depth and cone step count per tile, fetched without filtering
+        glBindTexture(GL_TEXTURE_2D, coneDepthTexture);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RG32F, tilesX, tilesY, 0, GL_RG, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, coneFramebuffer);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, coneDepthTexture, 0);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Warning: Cone pre-pass target incomplete, pre-pass disabled" << std::endl;
+            conePrepassEnabled = false;
+            return false;
+        }
+        coneTargetWidth = tilesX;
+        coneTargetHeight = tilesY;
+    }
+    return true;
+}
+
+// Render the cone pre-pass into the low resolution depth target, over the
+// whole frame or the cone tiles under the given tiles
+void ImplicitRenderer::renderConePrepass(const Tile* tiles, size_t tileCount) {
+    // The main pass may target the window or an offscreen batch framebuffer
+    GLint viewport[4], framebuffer = 0;
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, coneFramebuffer);
+    glViewport(0, 0, (width + coneTileSize - 1) / coneTileSize, (height + coneTileSize - 1) / coneTileSize);
+
+    {
+        Profiler::GpuScope scope(profiler, "conePrepass");
+        glUseProgram(coneProgramID);
+        glBindVertexArray(vao);
+        if (!tiles) {
+            glDrawArrays(GL_TRIANGLES, 0, 6);
+        }
+        else {
+            glEnable(GL_SCISSOR_TEST);
+            for (size_t i = 0; i < tileCount; ++i) {
+                const Tile& tile = tiles[i];
+                int x0 = tile.x / coneTileSize, y0 = tile.y / coneTileSize;
+                int x1 = (tile.x + tile.width + coneTileSize - 1) / coneTileSize;
+                int y1 = (tile.y + tile.height + coneTileSize - 1) / coneTileSize;
+                glScissor(x0, y0, x1 - x0, y1 - y0);
+                glDrawArrays(GL_TRIANGLES, 0, 6);
+            }
+            glDisable(GL_SCISSOR_TEST);
+        }
+        glBindVertexArray(0);
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, static_cast<GLuint>(framebuffer));
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+    glActiveTexture(GL_TEXTURE0 + coneDepthTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, coneDepthTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
 void ImplicitRenderer::render() {
+    applyPendingScene(false);
+    finishGeneratedBuilds(false);
+    commitSceneEdits();
+
+    // Window frames follow the framebuffer, which may have been resized, at the dynamic resolution scale
+    glfwGetFramebufferSize(window, &windowWidth, &windowHeight);
+    if (windowWidth <= 0 || windowHeight <= 0) {
+        return; // Minimized
+    }
+    float scale = dynamicResolution.getScale();
+    width = std::max(1, static_cast<int>(std::lround(windowWidth * scale)));
+    height = std::max(1, static_cast<int>(std::lround(windowHeight * scale)));
+    frameStepScale = dynamicResolution.getStepScale();
+    glViewport(0, 0, width, height);
+
+    profiler.beginFrame();
+    {
+        Profiler::CpuScope drawScope(profiler, "draw");
+        Profiler::GpuScope frameScope(profiler, "frame");
+        dynamicResolution.beginFrame();
+        bool tiled = tileSize > 0 && (width > tileSize || height > tileSize);
+        if (temporalMode != TemporalMode::Off && renderBackend == RenderBackend::Fragment && !tiled) {
+            drawTemporalFrame();
+        }
+        else {
+            historyValid = false;
+            bool scaled = width != windowWidth || height != windowHeight;
+            if (scaled && prepareUpscaleTarget()) {
+                glBindFramebuffer(GL_FRAMEBUFFER, upscaleFramebuffer);
+                drawFrame();
+                presentFrame(upscaleFramebuffer);
+            }
+            else {
+                drawFrame();
+            }
+        }
+        dynamicResolution.endFrame();
+    }
+    frameStepScale = 1.0f;
+
+    // Events are polled by run(); render() is also called from key callbacks,
+    // where polling again is not allowed
+    {
+        Profiler::CpuScope swapScope(profiler, "swap");
+        glfwSwapBuffers(window);
+    }
+    profiler.endFrame();
+    dynamicResolution.update();
+}
+
+// Draw one frame into the currently bound framebuffer
+void ImplicitRenderer::drawFrame() {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    bool tiled = tileSize > 0 && (width > tileSize || height > tileSize);
+
+#ifdef USE_ADVANCED_OPENGL
+    if (renderBackend == RenderBackend::Compute && computeProgramID && !tiled) {
+        // The compute shader marches its own tile cones, the pre-pass is not needed
+        updateFrameParameters(false, false);
+        bindSceneTextures();
+        Profiler::GpuScope scope(profiler, "march");
+        computeMarcher.render(computeProgramID, width, height);
+        return;
+    }
+#endif
 
-    glUseProgram(programID);
+    beginFrame();
+    Profiler::GpuScope scope(profiler, "march");
 
-    // Set uniform variables without explicit casts since we're using float types
-    glUniform3f(glGetUniformLocation(programID, "cameraPosition"),
-                cameraPosition.x,
-                cameraPosition.y,
-                cameraPosition.z);
-    glUniform3f(glGetUniformLocation(programID, "cameraTarget"),
-                cameraTarget.x,
-                cameraTarget.y,
-                cameraTarget.z);
-    glUniform3f(glGetUniformLocation(programID, "cameraUp"),
-                cameraUp.x,
-                cameraUp.y,
-                cameraUp.z);
-    glUniform1f(glGetUniformLocation(programID, "fieldOfView"), fieldOfView);
-    glUniform2f(glGetUniformLocation(programID, "resolution"), width, height);
-
-    glUniform3f(glGetUniformLocation(programID, "lightPosition"),
-                lightPosition.x,
-                lightPosition.y,
-                lightPosition.z);
-    glUniform3f(glGetUniformLocation(programID, "lightColor"),
-                lightColor.x,
-                lightColor.y,
-                lightColor.z);
-    glUniform1f(glGetUniformLocation(programID, "ambientStrength"), ambientStrength);
-
-    glUniform1i(glGetUniformLocation(programID, "maxSteps"), maxSteps);
-    glUniform1f(glGetUniformLocation(programID, "maxDistance"), maxDistance);
-    glUniform1f(glGetUniformLocation(programID, "epsilon"), epsilon);
-
-    // Draw fullscreen rectangle
+    // Frames larger than one tile are split so no single draw runs long
+    // enough to trip the driver's watchdog
+    if (!tiled) {
+        drawTile(0, 0, width, height);
+    }
+    else {
+        for (const Tile& tile : frameTiles(width, height, tileSize)) {
+            drawTile(tile.x, tile.y, tile.width, tile.height);
+            glFlush();
+        }
+    }
+    glBindVertexArray(0);
+}
+
+// Upload the frame parameters, bind the scene textures and run the cone
+// pre-pass, leaving the main program ready for drawTile. useHistory enables
+// reprojection of the history textures bound by drawTemporalFrame. Given
+// tiles, the pre-pass only covers those, as only they are drawn.
+void ImplicitRenderer::beginFrame(bool useHistory, const Tile* tiles, size_t tileCount) {
+    bool useConeDepth = prepareConeTarget();
+    updateFrameParameters(useConeDepth, useHistory);
+    bindSceneTextures();
+
+    if (useConeDepth) {
+        renderConePrepass(tiles, tileCount);
+    }
+
+    glUseProgram(programID);
     glBindVertexArray(vao);
+}
+
+// Bind the baked field, shadow volume and hierarchy textures to their fixed units
+void ImplicitRenderer::bindSceneTextures() {
+    if (bakedFieldEnabled && !bakedField.empty()) {
+        glActiveTexture(GL_TEXTURE0 + bakedIndexTextureUnit);
+        glBindTexture(GL_TEXTURE_3D, bakedIndexTexture);
+        glActiveTexture(GL_TEXTURE0 + bakedAtlasTextureUnit);
+        glBindTexture(GL_TEXTURE_3D, bakedAtlasTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    if (shadowVolumeEnabled && !shadowVolume.empty()) {
+        glActiveTexture(GL_TEXTURE0 + shadowVolumeTextureUnit);
+        glBindTexture(GL_TEXTURE_3D, shadowVolumeTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    if (sceneInterpreted) {
+        glActiveTexture(GL_TEXTURE0 + tapeTextureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, tapeTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+
+    if (!sceneBVH.empty()) {
+        glActiveTexture(GL_TEXTURE0 + bvhNodeTextureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, bvhNodeTexture);
+        glActiveTexture(GL_TEXTURE0 + bvhItemTextureUnit);
+        glBindTexture(GL_TEXTURE_BUFFER, bvhItemTexture);
+        glActiveTexture(GL_TEXTURE0);
+    }
+}
+
+// Draw the fullscreen rectangle restricted to one rectangle of pixels
+void ImplicitRenderer::drawTile(int x, int y, int tileWidth, int tileHeight) {
+    bool partial = x > 0 || y > 0 || tileWidth < width || tileHeight < height;
+    if (partial) {
+        glEnable(GL_SCISSOR_TEST);
+        glScissor(x, y, tileWidth, tileHeight);
+    }
     glDrawArrays(GL_TRIANGLES, 0, 6);
+    if (partial) {
+        glDisable(GL_SCISSOR_TEST);
+    }
+}
+
+// Size both history targets to the window, color in the first attachment and
+// ray depth in the second
+bool ImplicitRenderer::prepareHistoryTargets() {
+    if (historyFramebuffers[0] && width == historyWidth && height == historyHeight) {
+        return true;
+    }
+
+    if (!historyFramebuffers[0]) {
+        glGenFramebuffers(2, historyFramebuffers);
+        glGenTextures(2, historyColorTextures);
+        glGenTextures(2, historyDepthTextures);
+    }
+
+    historyValid = false;
+    historyWidth = historyHeight = 0;
+    for (int i = 0; i < 2; ++i) {
+        glBindTexture(GL_TEXTURE_2D, historyColorTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, historyDepthTextures[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, width, height, 0, GL_RED, GL_FLOAT, nullptr);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, historyFramebuffers[i]);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, historyColorTextures[i], 0);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, historyDepthTextures[i], 0);
+        const GLenum drawBuffers[2] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+        glDrawBuffers(2, drawBuffers);
+        GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (status != GL_FRAMEBUFFER_COMPLETE) {
+            std::cerr << "Error: History framebuffer of " << width << "x" << height << " is incomplete" << std::endl;
+            return false;
+        }
+    }
+
+    historyWidth = width;
+    historyHeight = height;
+    return true;
+}
+
+// Size the color target of scaled window frames to the frame
+bool ImplicitRenderer::prepareUpscaleTarget() {
+    if (upscaleFramebuffer && width == upscaleWidth && height == upscaleHeight) {
+        return true;
+    }
+
+    if (!upscaleFramebuffer) {
+        glGenFramebuffers(1, &upscaleFramebuffer);
+        glGenTextures(1, &upscaleTexture);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, upscaleTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, upscaleFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, upscaleTexture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Error: Upscale framebuffer of " << width << "x" << height << " is incomplete" << std::endl;
+        upscaleWidth = upscaleHeight = 0;
+        return false;
+    }
+
+    upscaleWidth = width;
+    upscaleHeight = height;
+    return true;
+}
+
+// Copy the frame from a framebuffer to the window, stretched to its size
+void ImplicitRenderer::presentFrame(GLuint framebuffer) {
+    Profiler::GpuScope scope(profiler, "present");
+    bool scaled = width != windowWidth || height != windowHeight;
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+    glBlitFramebuffer(0, 0, width, height, 0, 0, windowWidth, windowHeight, GL_COLOR_BUFFER_BIT,
+                      scaled ? GL_LINEAR : GL_NEAREST);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Draw a window frame into the next history target, reprojecting the previous
+// one where it is valid, and copy it to the window
+void ImplicitRenderer::drawTemporalFrame() {
+    if (!prepareHistoryTargets()) {
+        drawFrame();
+        return;
+    }
+
+    GLuint target = historyFramebuffers[historyIndex];
+    int previous = 1 - historyIndex;
+    glBindFramebuffer(GL_FRAMEBUFFER, target);
+    glClear(GL_COLOR_BUFFER_BIT);
+
+    glActiveTexture(GL_TEXTURE0 + historyColorTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, historyColorTextures[previous]);
+    glActiveTexture(GL_TEXTURE0 + historyDepthTextureUnit);
+    glBindTexture(GL_TEXTURE_2D, historyDepthTextures[previous]);
+    glActiveTexture(GL_TEXTURE0);
+
+    beginFrame(historyValid);
+    {
+        Profiler::GpuScope scope(profiler, "march");
+        drawTile(0, 0, width, height);
+        glBindVertexArray(0);
+    }
+    presentFrame(target);
+
+    historyPose = getCameraPose();
+    historyValid = true;
+    historyIndex = previous;
+    temporalFrame = (temporalFrame + 1) & 3;
+}
+
+// Tiles covering a frame, nearest to the view center first so the region the
+// viewer looks at is finished before the borders
+std::vector<ImplicitRenderer::Tile> ImplicitRenderer::frameTiles(int frameWidth, int frameHeight, int size) {
+    std::vector<Tile> tiles;
+    for (int y = 0; y < frameHeight; y += size) {
+        for (int x = 0; x < frameWidth; x += size) {
+            tiles.push_back({ x, y, std::min(size, frameWidth - x), std::min(size, frameHeight - y) });
+        }
+    }
+
+    auto centerDistance = [&](const Tile& tile) {
+        double dx = tile.x + 0.5 * tile.width - 0.5 * frameWidth;
+        double dy = tile.y + 0.5 * tile.height - 0.5 * frameHeight;
+        return dx * dx + dy * dy;
+    };
+    std::stable_sort(tiles.begin(), tiles.end(), [&](const Tile& a, const Tile& b) {
+        return centerDistance(a) < centerDistance(b);
+    });
+    return tiles;
+}
+
+// Size the offscreen color target to a batch or still resolution
+bool ImplicitRenderer::prepareOffscreenTarget(int targetWidth, int targetHeight) {
+    if (offscreenFramebuffer && targetWidth == offscreenWidth && targetHeight == offscreenHeight) {
+        return true;
+    }
+
+    if (!offscreenFramebuffer) {
+        glGenFramebuffers(1, &offscreenFramebuffer);
+        glGenTextures(1, &framebufferTexture);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, framebufferTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, targetWidth, targetHeight, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, framebufferTexture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Error: Offscreen framebuffer of " << targetWidth << "x" << targetHeight << " is incomplete" << std::endl;
+        offscreenWidth = offscreenHeight = 0;
+        return false;
+    }
+
+    offscreenWidth = targetWidth;
+    offscreenHeight = targetHeight;
+    return true;
+}
+
+bool ImplicitRenderer::renderFrames(const std::vector<CameraPose>& path, int frameWidth, int frameHeight,
+                                    const FrameConsumer& consumer) {
+    if (!window || frameWidth <= 0 || frameHeight <= 0) {
+        return false;
+    }
+    // Batches draw the scene last set, with its pending edits, on its own programs even while they are compiling
+    applyPendingScene(true);
+    commitSceneEdits();
+    finishGeneratedBuilds(true);
+    // A pending still shares the offscreen target
+    progressStill(0);
+    if (!prepareOffscreenTarget(frameWidth, frameHeight)) {
+        return false;
+    }
+
+    // Pixel buffers receive glReadPixels asynchronously and are mapped frames later
+    GLsizeiptr frameSize = static_cast<GLsizeiptr>(frameWidth) * frameHeight * 4;
+    if (frameSize != readbackFrameSize) {
+        if (!readbackBuffers[0]) {
+            glGenBuffers(readbackRingSize, readbackBuffers);
+        }
+        for (GLuint buffer : readbackBuffers) {
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, buffer);
+            glBufferData(GL_PIXEL_PACK_BUFFER, frameSize, nullptr, GL_STREAM_READ);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readbackFrameSize = frameSize;
+    }
+
+    // Frame parameters and the cone target follow width and height
+    int savedWidth = width, savedHeight = height;
+    Vec3<float> savedPosition = cameraPosition, savedTarget = cameraTarget, savedUp = cameraUp;
+    float savedFieldOfView = fieldOfView;
+    width = frameWidth;
+    height = frameHeight;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glViewport(0, 0, frameWidth, frameHeight);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    // Map a frame once its fence signals, hand it to the consumer and free its slot
+    auto deliver = [&](size_t frame) {
+        size_t slot = frame % readbackRingSize;
+        while (glClientWaitSync(readbackFences[slot], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ull) == GL_TIMEOUT_EXPIRED) {
+        }
+        glDeleteSync(readbackFences[slot]);
+        readbackFences[slot] = nullptr;
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+        GLsizeiptr frameSize = static_cast<GLsizeiptr>(frameWidth) * frameHeight * 4;
+        const void* pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, frameSize, GL_MAP_READ_BIT);
+        if (pixels) {
+            consumer(frame, static_cast<const unsigned char*>(pixels), frameWidth, frameHeight);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        else {
+            std::cerr << "Warning: Could not map frame " << frame << " for readback" << std::endl;
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    };
+
+    // The consumer works on frame i - readbackRingSize while the GPU still
+    // renders the frames after it
+    for (size_t frame = 0; frame < path.size(); ++frame) {
+        if (frame >= readbackRingSize) {
+            deliver(frame - readbackRingSize);
+        }
+
+        const CameraPose& pose = path[frame];
+        cameraPosition = pose.position;
+        cameraTarget = pose.target;
+        cameraUp = pose.up;
+        fieldOfView = pose.fieldOfView;
+        profiler.beginFrame();
+        {
+            Profiler::CpuScope drawScope(profiler, "draw");
+            Profiler::GpuScope frameScope(profiler, "frame");
+            drawFrame();
+        }
+
+        size_t slot = frame % readbackRingSize;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readbackBuffers[slot]);
+        glReadPixels(0, 0, frameWidth, frameHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        readbackFences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        profiler.endFrame();
+    }
+    size_t pending = std::min(path.size(), static_cast<size_t>(readbackRingSize));
+    for (size_t frame = path.size() - pending; frame < path.size(); ++frame) {
+        deliver(frame);
+    }
+    profiler.finish();
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    width = savedWidth;
+    height = savedHeight;
+    cameraPosition = savedPosition;
+    cameraTarget = savedTarget;
+    cameraUp = savedUp;
+    fieldOfView = savedFieldOfView;
+    return true;
+}
+
+void ImplicitRenderer::setTileSize(int size) {
+    tileSize = std::max(size, 0);
+}
+
+CameraPose ImplicitRenderer::getCameraPose() const {
+    return { cameraPosition, cameraTarget, cameraUp, fieldOfView };
+}
+
+void ImplicitRenderer::requestStill(const CameraPose& pose, int stillWidth, int stillHeight,
+                                    const FrameConsumer& consumer, int stillTileSize, int tilesPerFrame) {
+    if (stillWidth <= 0 || stillHeight <= 0) {
+        return;
+    }
+    still.active = true;
+    still.pose = pose;
+    still.width = stillWidth;
+    still.height = stillHeight;
+    still.tilesPerFrame = std::max(tilesPerFrame, 1);
+    still.consumer = consumer;
+    still.tiles = frameTiles(stillWidth, stillHeight, std::max(stillTileSize, 1));
+    still.nextTile = 0;
+}
+
+// Render the next tiles of the pending still into the offscreen target and
+// deliver it once the last tile is done. maxTiles of 0 finishes it.
+void ImplicitRenderer::progressStill(size_t maxTiles) {
+    if (!still.active) {
+        return;
+    }
+    if (!prepareOffscreenTarget(still.width, still.height)) {
+        still = StillJob();
+        return;
+    }
+
+    int savedWidth = width, savedHeight = height;
+    CameraPose windowPose = getCameraPose();
+    width = still.width;
+    height = still.height;
+    cameraPosition = still.pose.position;
+    cameraTarget = still.pose.target;
+    cameraUp = still.pose.up;
+    fieldOfView = still.pose.fieldOfView;
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, offscreenFramebuffer);
+    glViewport(0, 0, still.width, still.height);
+    if (still.nextTile == 0) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    }
+
+    // The cone target is shared with window frames, so it is refilled under this call's tiles only
+    size_t end = maxTiles == 0 ? still.tiles.size() : std::min(still.tiles.size(), still.nextTile + maxTiles);
+    beginFrame(false, still.tiles.data() + still.nextTile, end - still.nextTile);
+    for (; still.nextTile < end; ++still.nextTile) {
+        const Tile& tile = still.tiles[still.nextTile];
+        drawTile(tile.x, tile.y, tile.width, tile.height);
+        glFlush();
+    }
     glBindVertexArray(0);
 
-    glfwSwapBuffers(window);
-    glfwPollEvents();
+    if (still.nextTile == still.tiles.size()) {
+        // A single still does not need the readback ring
+        std::vector<unsigned char> pixels(static_cast<size_t>(still.width) * still.height * 4);
+        glPixelStorei(GL_PACK_ALIGNMENT, 1);
+        glReadPixels(0, 0, still.width, still.height, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        FrameConsumer consumer = still.consumer;
+        int stillWidth = still.width, stillHeight = still.height;
+        still = StillJob();
+        if (consumer) {
+            consumer(0, pixels.data(), stillWidth, stillHeight);
+        }
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    width = savedWidth;
+    height = savedHeight;
+    cameraPosition = windowPose.position;
+    cameraTarget = windowPose.target;
+    cameraUp = windowPose.up;
+    fieldOfView = windowPose.fieldOfView;
 }
 
 void ImplicitRenderer::run() {
@@ -313,6 +1830,9 @@ void ImplicitRenderer::run() {
 
         // Process input events - this line is crucial to ensure key callbacks are executed
         glfwPollEvents();
+        if (glfwWindowShouldClose(window)) {
+            break;
+        }
 
         // Camera rotation logic
         angle += 0.5f * static_cast<float>(deltaTime); // Control rotation speed
@@ -321,16 +1841,31 @@ void ImplicitRenderer::run() {
         cameraPosition.z = cos(angle) * radius;
         cameraTarget = Vec3<float>(0.0f, 0.0f, 0.0f);
 
-        // Update camera position uniform variable
-        glUseProgram(programID);
-        glUniform3f(glGetUniformLocation(programID, "cameraPosition"),
-                    cameraPosition.x,
-                    cameraPosition.y,
-                    cameraPosition.z);
+        // A few tiles of a pending still per frame keep the window responsive
+        progressStill(still.tilesPerFrame);
 
-        // Render scene
+        // Render scene, uploading the moved camera with the frame parameters
         render();
+
+        if (profiler.isEnabled() && currentTime - overlayTime >= 0.5) {
+            overlayTime = currentTime;
+            glfwSetWindowTitle(window, profileOverlay().c_str());
+        }
+    }
+}
+
+// Window title summarizing the latest profiled frame
+std::string ImplicitRenderer::profileOverlay() const {
+    const Profiler::FrameReport& report = profiler.getLastReport();
+    char text[256];
+    int length = std::snprintf(text, sizeof(text), "%s | GPU %.2f ms (march %.2f) | CPU %.2f ms | %dx%d",
+                               windowTitle, report.gpuTime("frame"), report.gpuTime("march"),
+                               report.cpuTime("draw"), width, height);
+    if (report.hasSteps && length > 0 && static_cast<size_t>(length) < sizeof(text)) {
+        std::snprintf(text + length, sizeof(text) - length, " | %.1f steps/px (max %u)",
+                      report.meanSteps(), report.steps.maxSteps);
     }
+    return text;
 }
 
 // Predefined scene creation functions
@@ -0,0 +1,314 @@
+﻿#include "SceneBVH.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+    const size_t maxLeafItems = 4;
+    const int sahBins = 12;
+
+    double surfaceArea(const AABB& box) {
+        Vec3<double> e = box.max - box.min;
+        return 2.0 * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    double axisValue(const Vec3<double>& v, int axis) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    // Float bounds rounded outwards so the shader never culls a box too tightly
+    void pushBounds(std::vector<float>& data, const Vec3<double>& v, bool upper, float w) {
+        const float direction = upper ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity();
+        data.push_back(std::nextafter(static_cast<float>(v.x), direction));
+        data.push_back(std::nextafter(static_cast<float>(v.y), direction));
+        data.push_back(std::nextafter(static_cast<float>(v.z), direction));
+        data.push_back(w);
+    }
+}
+
+void SceneBVH::collectUnionItems(const std::shared_ptr<const ImplicitSurface>& node,
+                                 std::vector<std::shared_ptr<const ImplicitSurface>>& items) {
+    // Explicit stack: folded scenes produce union chains thousands of nodes deep
+    std::vector<std::shared_ptr<const ImplicitSurface>> pending = { node };
+    while (!pending.empty()) {
+        std::shared_ptr<const ImplicitSurface> current = std::move(pending.back());
+        pending.pop_back();
+
+        auto unionOp = dynamic_cast<const UnionOp*>(current.get());
+        if (unionOp && unionOp->getLeft() && unionOp->getRight()) {
+            pending.push_back(unionOp->getRight());
+            pending.push_back(unionOp->getLeft());
+        }
+        else {
+            items.push_back(std::move(current));
+        }
+    }
+}
+
+bool SceneBVH::build(const std::shared_ptr<const ImplicitSurface>& root) {
+    nodeCount = 0;
+    nodeData.clear();
+    itemData.clear();
+    generatedItems.clear();
+    unboundedItems.clear();
+    itemSceneIndices.clear();
+    sceneItemCount = 0;
+
+    if (!root) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<const ImplicitSurface>> surfaces;
+    collectUnionItems(root, surfaces);
+
+    std::vector<BuildItem> items;
+    std::vector<std::shared_ptr<const ImplicitSurface>> unbounded;
+    for (const std::shared_ptr<const ImplicitSurface>& surface : surfaces) {
+        const AABB& bounds = surface->getBounds();
+        if (bounds.isFinite()) {
+            // Function indices follow scene order so the generated code does not
+            // depend on the order the hierarchy is built in
+            int function = -1;
+            if (!dynamic_cast<const Sphere*>(surface.get()) && !dynamic_cast<const Box*>(surface.get()) &&
+                !dynamic_cast<const Cylinder*>(surface.get())) {
+                function = static_cast<int>(generatedItems.size());
+                generatedItems.push_back(surface);
+            }
+            items.push_back({ surface.get(), function, bounds, bounds.center(), static_cast<uint32_t>(items.size() + unbounded.size()) });
+        }
+        else {
+            unbounded.push_back(surface);
+        }
+    }
+
+    if (items.size() < minimumItems) {
+        generatedItems.clear();
+        return false;
+    }
+
+    unboundedItems = std::move(unbounded);
+    sceneItemCount = surfaces.size();
+    buildNode(items, 0, items.size(), 0);
+    return true;
+}
+
+bool SceneBVH::refit(const std::shared_ptr<const ImplicitSurface>& root) {
+    if (empty() || !root) {
+        return false;
+    }
+
+    std::vector<std::shared_ptr<const ImplicitSurface>> surfaces;
+    collectUnionItems(root, surfaces);
+    if (surfaces.size() != sceneItemCount) {
+        return false;
+    }
+
+    // Every slot must still hold a bounded item of the same kind
+    std::vector<char> inHierarchy(surfaces.size(), 0);
+    for (size_t slot = 0; slot < itemSceneIndices.size(); ++slot) {
+        const ImplicitSurface* surface = surfaces[itemSceneIndices[slot]].get();
+        float texels[texelsPerItem * 4] = {};
+        writeItem(surface, 0, texels);
+        if (!surface->getBounds().isFinite() || texels[0] != itemData[slot * texelsPerItem * 4]) {
+            return false;
+        }
+        inHierarchy[itemSceneIndices[slot]] = 1;
+    }
+
+    // Generated function indices follow scene order, so they are unchanged
+    std::vector<std::shared_ptr<const ImplicitSurface>> generated(generatedItems.size()), unbounded;
+    for (size_t slot = 0; slot < itemSceneIndices.size(); ++slot) {
+        float* texels = itemData.data() + slot * texelsPerItem * 4;
+        int function = texels[0] == GeneratedItem ? static_cast<int>(texels[1]) : -1;
+        const std::shared_ptr<const ImplicitSurface>& surface = surfaces[itemSceneIndices[slot]];
+        std::fill(texels, texels + texelsPerItem * 4, 0.0f);
+        writeItem(surface.get(), function, texels);
+        if (function >= 0) {
+            generated[function] = surface;
+        }
+    }
+    for (size_t i = 0; i < surfaces.size(); ++i) {
+        if (!inHierarchy[i]) {
+            unbounded.push_back(surfaces[i]);
+        }
+    }
+    generatedItems = std::move(generated);
+    unboundedItems = std::move(unbounded);
+
+    refitNode(0, surfaces);
+    return true;
+}
+
+AABB SceneBVH::refitNode(size_t nodeIndex, const std::vector<std::shared_ptr<const ImplicitSurface>>& surfaces) {
+    float* texels = nodeData.data() + nodeIndex * texelsPerNode * 4;
+    size_t count = static_cast<size_t>(texels[7]);
+    AABB bounds;
+    if (count > 0) {
+        size_t first = static_cast<size_t>(texels[3]);
+        bounds = surfaces[itemSceneIndices[first]]->getBounds();
+        for (size_t i = first + 1; i < first + count; ++i) {
+            bounds = bounds.unite(surfaces[itemSceneIndices[i]]->getBounds());
+        }
+    }
+    else {
+        // The left child follows its parent
+        bounds = refitNode(nodeIndex + 1, surfaces).unite(refitNode(static_cast<size_t>(texels[3]), surfaces));
+    }
+
+    std::vector<float> node;
+    pushBounds(node, bounds.min, false, texels[3]);
+    pushBounds(node, bounds.max, true, texels[7]);
+    std::copy(node.begin(), node.end(), texels);
+    return bounds;
+}
+
+void SceneBVH::buildNode(std::vector<BuildItem>& items, size_t begin, size_t end, int depth) {
+    AABB bounds = items[begin].bounds;
+    AABB centroidBounds(items[begin].centroid, items[begin].centroid);
+    for (size_t i = begin + 1; i < end; ++i) {
+        bounds = bounds.unite(items[i].bounds);
+        centroidBounds = centroidBounds.unite(AABB(items[i].centroid, items[i].centroid));
+    }
+
+    size_t nodeIndex = nodeCount++;
+    nodeData.resize(nodeCount * texelsPerNode * 4);
+
+    auto makeLeaf = [&]() {
+        float firstItem = static_cast<float>(getItemCount());
+        for (size_t i = begin; i < end; ++i) {
+            appendItem(items[i]);
+        }
+        std::vector<float> node;
+        pushBounds(node, bounds.min, false, firstItem);
+        pushBounds(node, bounds.max, true, static_cast<float>(end - begin));
+        std::copy(node.begin(), node.end(), nodeData.begin() + nodeIndex * texelsPerNode * 4);
+    };
+
+    size_t count = end - begin;
+    if (count <= maxLeafItems || depth >= maxDepth) {
+        makeLeaf();
+        return;
+    }
+
+    // Binned surface area heuristic over item centroids
+    int bestAxis = -1;
+    int bestSplit = 0;
+    double bestCost = static_cast<double>(count) * surfaceArea(bounds);
+    for (int axis = 0; axis < 3; ++axis) {
+        double low = axisValue(centroidBounds.min, axis);
+        double extent = axisValue(centroidBounds.max, axis) - low;
+        if (extent <= 0.0) {
+            continue;
+        }
+
+        AABB binBounds[sahBins];
+        size_t binCounts[sahBins] = {};
+        for (size_t i = begin; i < end; ++i) {
+            int bin = std::min(sahBins - 1, static_cast<int>((axisValue(items[i].centroid, axis) - low) / extent * sahBins));
+            binBounds[bin] = binCounts[bin] ? binBounds[bin].unite(items[i].bounds) : items[i].bounds;
+            ++binCounts[bin];
+        }
+
+        // Sweep from the right to get the cost of every split plane in one pass
+        double rightArea[sahBins];
+        size_t rightCount[sahBins];
+        AABB accumulated;
+        size_t accumulatedCount = 0;
+        for (int bin = sahBins - 1; bin > 0; --bin) {
+            if (binCounts[bin]) {
+                accumulated = accumulatedCount ? accumulated.unite(binBounds[bin]) : binBounds[bin];
+                accumulatedCount += binCounts[bin];
+            }
+            rightArea[bin] = accumulatedCount ? surfaceArea(accumulated) : 0.0;
+            rightCount[bin] = accumulatedCount;
+        }
+
+        accumulatedCount = 0;
+        for (int bin = 0; bin < sahBins - 1; ++bin) {
+            if (binCounts[bin]) {
+                accumulated = accumulatedCount ? accumulated.unite(binBounds[bin]) : binBounds[bin];
+                accumulatedCount += binCounts[bin];
+            }
+            if (!accumulatedCount || !rightCount[bin + 1]) {
+                continue;
+            }
+            double cost = accumulatedCount * surfaceArea(accumulated) + rightCount[bin + 1] * rightArea[bin + 1];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = bin;
+            }
+        }
+    }
+
+    size_t middle;
+    if (bestAxis >= 0) {
+        double low = axisValue(centroidBounds.min, bestAxis);
+        double extent = axisValue(centroidBounds.max, bestAxis) - low;
+        auto it = std::partition(items.begin() + begin, items.begin() + end, [&](const BuildItem& item) {
+            int bin = std::min(sahBins - 1, static_cast<int>((axisValue(item.centroid, bestAxis) - low) / extent * sahBins));
+            return bin <= bestSplit;
+        });
+        middle = static_cast<size_t>(it - items.begin());
+    }
+    else {
+        // Splitting does not pay off by area, but large leaves are slow to
+        // evaluate in the shader: fall back to a median split on the widest axis
+        Vec3<double> extent = centroidBounds.max - centroidBounds.min;
+        int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+        middle = begin + count / 2;
+        std::nth_element(items.begin() + begin, items.begin() + middle, items.begin() + end,
+                         [axis](const BuildItem& a, const BuildItem& b) {
+                             return axisValue(a.centroid, axis) < axisValue(b.centroid, axis);
+                         });
+    }
+
+    buildNode(items, begin, middle, depth + 1);
+    float rightChild = static_cast<float>(nodeCount);
+    buildNode(items, middle, end, depth + 1);
+
+    std::vector<float> node;
+    pushBounds(node, bounds.min, false, rightChild);
+    pushBounds(node, bounds.max, true, 0.0f);
+    std::copy(node.begin(), node.end(), nodeData.begin() + nodeIndex * texelsPerNode * 4);
+}
+
+void SceneBVH::appendItem(const BuildItem& item) {
+    float texels[texelsPerItem * 4] = {};
+    writeItem(item.surface, item.function, texels);
+    itemData.insert(itemData.end(), texels, texels + texelsPerItem * 4);
+    itemSceneIndices.push_back(item.sceneIndex);
+}
+
+void SceneBVH::writeItem(const ImplicitSurface* surface, int function, float* texels) {
+    auto setVec3 = [&texels](int texel, int component, const Vec3<double>& v) {
+        texels[texel * 4 + component] = static_cast<float>(v.x);
+        texels[texel * 4 + component + 1] = static_cast<float>(v.y);
+        texels[texel * 4 + component + 2] = static_cast<float>(v.z);
+    };
+
+    if (auto sphere = dynamic_cast<const Sphere*>(surface)) {
+        texels[0] = SphereItem;
+        setVec3(0, 1, sphere->getCenter());
+        texels[4] = static_cast<float>(sphere->getRadius());
+    }
+    else if (auto box = dynamic_cast<const Box*>(surface)) {
+        texels[0] = BoxItem;
+        setVec3(0, 1, box->getCenter());
+        setVec3(1, 0, box->getDimensions());
+        texels[7] = static_cast<float>(box->getSmoothing());
+    }
+    else if (auto cylinder = dynamic_cast<const Cylinder*>(surface)) {
+        Vec3<double> axis = cylinder->getEnd() - cylinder->getStart();
+        double lengthSquared = axis.dot(axis);
+        texels[0] = CylinderItem;
+        setVec3(0, 1, cylinder->getStart());
+        setVec3(1, 0, axis);
+        texels[7] = static_cast<float>(lengthSquared > 0.0 ? 1.0 / lengthSquared : 0.0);
+        texels[8] = static_cast<float>(cylinder->getRadius());
+    }
+    else {
+        texels[0] = GeneratedItem;
+        texels[1] = static_cast<float>(function);
+    }
+}
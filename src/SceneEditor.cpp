@@ -0,0 +1,205 @@
+﻿#include "SceneEditor.h"
+#include <algorithm>
+#include <iostream>
+
+void SceneEditor::reset(const std::shared_ptr<const ImplicitSurface>& surface) {
+    SceneGraph imported;
+    imported.setRoot(imported.import(surface));
+    reset(std::move(imported));
+}
+
+void SceneEditor::reset(SceneGraph source) {
+    graph = std::move(source);
+    if (!graph.isValid(graph.getRoot()) && !graph.empty()) {
+        graph.setRoot(static_cast<NodeHandle>(graph.size() - 1));
+    }
+    surfaces.clear();
+    forwarding.clear();
+    changes = Changes();
+}
+
+void SceneEditor::ensureSurfaces() {
+    if (graph.isValid(graph.getRoot())) {
+        graph.toSurface(graph.getRoot(), surfaces);
+    }
+}
+
+std::shared_ptr<ImplicitSurface> SceneEditor::getSurface() {
+    ensureSurfaces();
+    return graph.isValid(graph.getRoot()) ? surfaces[graph.getRoot()] : nullptr;
+}
+
+NodeHandle SceneEditor::current(NodeHandle handle) const {
+    while (handle < forwarding.size() && forwarding[handle] != invalidNode) {
+        handle = forwarding[handle];
+    }
+    return handle;
+}
+
+SceneEditor::Changes SceneEditor::takeChanges() {
+    Changes taken = std::move(changes);
+    changes = Changes();
+    return taken;
+}
+
+bool SceneEditor::noteEdit(NodeHandle seed, const AABB& before) {
+    NodeHandle root = graph.getRoot();
+    if (!graph.isValid(root) || seed > root) {
+        return false;
+    }
+
+    // Everything above seed is rebuilt; handles are bottom-up, so one ascending pass finds it
+    std::vector<NodeHandle> edited = { seed };
+    std::vector<size_t> position(root - seed + 1, SIZE_MAX);
+    position[0] = 0;
+    auto isEdited = [&](NodeHandle child) {
+        return child != invalidNode && child >= seed && position[child - seed] != SIZE_MAX;
+    };
+    for (NodeHandle h = seed + 1; h <= root; ++h) {
+        const SceneNode& node = graph.getNode(h);
+        if (isEdited(node.left) || isEdited(node.right)) {
+            position[h - seed] = edited.size();
+            edited.push_back(h);
+        }
+    }
+    if (edited.back() != root) {
+        return false;
+    }
+    for (NodeHandle h : edited) {
+        if (h < surfaces.size()) surfaces[h].reset();
+    }
+    ensureSurfaces();
+
+    // Carry the region of the edit up into world space
+    std::vector<AABB> regions(edited.size());
+    std::vector<double> margins(edited.size(), 0.0);
+    regions[0] = before.unite(surfaces[seed]->getBounds());
+    for (size_t i = 1; i < edited.size(); ++i) {
+        const SceneNode& node = graph.getNode(edited[i]);
+        bool left = isEdited(node.left), right = isEdited(node.right);
+        size_t a = left ? position[node.left - seed] : position[node.right - seed];
+        size_t b = right ? position[node.right - seed] : a;
+
+        if (node.type == SceneNodeType::Transform) {
+            Transform transform = graph.getTransform(edited[i]);
+            regions[i] = transform.toParent(regions[a]);
+            margins[i] = margins[a] * transform.scale;
+            continue;
+        }
+        regions[i] = regions[a].unite(regions[b]);
+        margins[i] = std::max(margins[a], margins[b]);
+        if (SceneGraph::isSmooth(node.type)) {
+            margins[i] += std::max(graph.getParameters(edited[i])[0], 0.0) * (7.0 / 6.0);
+        }
+    }
+
+    changes.region = changes.region.unite(regions.back());
+    changes.margin = std::max(changes.margin, margins.back());
+    return true;
+}
+
+bool SceneEditor::setParameters(NodeHandle node, const std::vector<double>& values) {
+    node = current(node);
+    if (!graph.isValid(node) || graph.getNode(node).type == SceneNodeType::External ||
+        values.size() != SceneGraph::parameterCount(graph.getNode(node).type)) {
+        std::cerr << "Warning: Scene edit with an invalid node or parameter count" << std::endl;
+        return false;
+    }
+
+    // Nodes the scene does not use can change without invalidating anything
+    ensureSurfaces();
+    std::shared_ptr<ImplicitSurface> previous = node < surfaces.size() ? surfaces[node] : nullptr;
+    if (!graph.setParameters(node, values.data())) {
+        return false;
+    }
+    if (previous && noteEdit(node, previous->getBounds())) {
+        changes.parameterNodes.push_back(node);
+    }
+    return true;
+}
+
+bool SceneEditor::setParameter(NodeHandle node, uint32_t index, double value) {
+    node = current(node);
+    if (!graph.isValid(node) || index >= SceneGraph::parameterCount(graph.getNode(node).type)) {
+        std::cerr << "Warning: Scene edit with an invalid node or parameter index" << std::endl;
+        return false;
+    }
+    const double* p = graph.getParameters(node);
+    std::vector<double> values(p, p + SceneGraph::parameterCount(graph.getNode(node).type));
+    values[index] = value;
+    return setParameters(node, values);
+}
+
+bool SceneEditor::replace(NodeHandle node, NodeHandle replacement) {
+    node = current(node);
+    replacement = current(replacement);
+    NodeHandle root = graph.getRoot();
+    if (!graph.isValid(node) || !graph.isValid(replacement) || !graph.isValid(root) || node > root) {
+        std::cerr << "Warning: Scene replace with an invalid node" << std::endl;
+        return false;
+    }
+    if (node == replacement) {
+        return true;
+    }
+
+    std::vector<char> reachable(root + 1, 0);
+    reachable[root] = 1;
+    for (NodeHandle h = root + 1; h-- > 0;) {
+        if (!reachable[h]) continue;
+        const SceneNode& n = graph.getNode(h);
+        if (n.left != invalidNode) reachable[n.left] = 1;
+        if (n.right != invalidNode) reachable[n.right] = 1;
+    }
+    if (!reachable[node]) {
+        std::cerr << "Warning: Scene replace of a node the scene does not use" << std::endl;
+        return false;
+    }
+
+    ensureSurfaces();
+    AABB before = surfaces[node]->getBounds();
+
+    // Copy every ancestor, children first, pointing at the copies below it
+    std::vector<NodeHandle> copies(root + 1, invalidNode);
+    copies[node] = replacement;
+    auto mapped = [&](NodeHandle child) {
+        return child != invalidNode && child <= root && copies[child] != invalidNode ? copies[child] : child;
+    };
+    for (NodeHandle h = node + 1; h <= root; ++h) {
+        if (!reachable[h]) continue;
+        SceneNode n = graph.getNode(h);
+        NodeHandle left = mapped(n.left), right = mapped(n.right);
+        if (left == n.left && right == n.right) continue;
+
+        copies[h] = graph.addCopy(h, left, right);
+        forwarding.resize(graph.size(), invalidNode);
+        forwarding[h] = copies[h];
+    }
+    graph.setRoot(node == root ? replacement : copies[root]);
+
+    changes.structure = true;
+    noteEdit(replacement, before);
+    return true;
+}
+
+NodeHandle SceneEditor::insertBoolean(NodeHandle node, SceneNodeType type, NodeHandle operand, double k) {
+    node = current(node);
+    operand = current(operand);
+    if (!SceneGraph::isBoolean(type)) {
+        std::cerr << "Warning: Scene insert of a node that is not a boolean" << std::endl;
+        return invalidNode;
+    }
+
+    NodeHandle inserted;
+    switch (type) {
+        case SceneNodeType::Intersection: inserted = graph.addIntersection(node, operand); break;
+        case SceneNodeType::Difference: inserted = graph.addDifference(node, operand); break;
+        case SceneNodeType::SmoothUnion: inserted = graph.addSmoothUnion(node, operand, k); break;
+        case SceneNodeType::SmoothIntersection: inserted = graph.addSmoothIntersection(node, operand, k); break;
+        case SceneNodeType::SmoothDifference: inserted = graph.addSmoothDifference(node, operand, k); break;
+        default: inserted = graph.addUnion(node, operand); break;
+    }
+    if (inserted == invalidNode || !replace(node, inserted)) {
+        return invalidNode;
+    }
+    return inserted;
+}
@@ -0,0 +1,803 @@
+﻿#include "SceneFile.h"
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <sstream>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(SceneNode) == 16, "SceneNode records are stored as is");
+static_assert(sizeof(SceneFileHeader) == 48, "SceneFileHeader is stored as is");
+
+namespace {
+    const char sceneMagic[8] = { 'I', 'C', 'S', 'G', 'S', 'C', 'N', '1' };
+    const uint32_t byteOrderMark = 0x01020304u;
+
+    // Read-only view of a whole file; mapped where possible, read otherwise
+    class MappedFile {
+    public:
+        static std::shared_ptr<MappedFile> open(const std::string& path);
+        ~MappedFile();
+
+        const unsigned char* data() const { return bytes; }
+        size_t size() const { return length; }
+
+    private:
+        const unsigned char* bytes = nullptr;
+        size_t length = 0;
+        std::vector<unsigned char> buffer;
+#ifdef _WIN32
+        HANDLE mapping = nullptr;
+        const void* view = nullptr;
+#else
+        void* address = nullptr;
+#endif
+    };
+
+    std::shared_ptr<MappedFile> MappedFile::open(const std::string& path) {
+        std::shared_ptr<MappedFile> file(new MappedFile());
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                    FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (handle == INVALID_HANDLE_VALUE) {
+            return nullptr;
+        }
+        LARGE_INTEGER fileSize;
+        if (GetFileSizeEx(handle, &fileSize) && fileSize.QuadPart > 0) {
+            file->mapping = CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            if (file->mapping) {
+                file->view = MapViewOfFile(file->mapping, FILE_MAP_READ, 0, 0, 0);
+                if (file->view) {
+                    file->bytes = static_cast<const unsigned char*>(file->view);
+                    file->length = static_cast<size_t>(fileSize.QuadPart);
+                }
+            }
+        }
+        CloseHandle(handle);
+#else
+        int descriptor = ::open(path.c_str(), O_RDONLY);
+        if (descriptor < 0) {
+            return nullptr;
+        }
+        struct stat info;
+        if (fstat(descriptor, &info) == 0 && info.st_size > 0) {
+            size_t fileSize = static_cast<size_t>(info.st_size);
+            void* view = mmap(nullptr, fileSize, PROT_READ, MAP_PRIVATE, descriptor, 0);
+            if (view != MAP_FAILED) {
+                file->address = view;
+                file->bytes = static_cast<const unsigned char*>(view);
+                file->length = fileSize;
+            }
+        }
+        close(descriptor);
+#endif
+
+        if (!file->bytes) {
+            // Empty files and file systems without mapping support
+            std::ifstream stream(path, std::ios::binary);
+            if (!stream) {
+                return nullptr;
+            }
+            file->buffer.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+            file->bytes = file->buffer.data();
+            file->length = file->buffer.size();
+        }
+        return file;
+    }
+
+    MappedFile::~MappedFile() {
+#ifdef _WIN32
+        if (view) {
+            UnmapViewOfFile(view);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+#else
+        if (address) {
+            munmap(address, length);
+        }
+#endif
+    }
+
+    // Types, handles, parameter ranges and plane normals of untrusted nodes.
+    // Every child must precede its parent, which keeps all passes over the
+    // graph in bounds.
+    bool validateNodes(const SceneNode* nodes, size_t nodeCount, const double* parameters, uint64_t parameterCount,
+                       std::string& error) {
+        for (size_t h = 0; h < nodeCount; ++h) {
+            const SceneNode& node = nodes[h];
+            if (node.type > SceneNodeType::Transform) {
+                error = "node " + std::to_string(h) + " has an unsupported type";
+                return false;
+            }
+            bool twoChildren = SceneGraph::isBoolean(node.type);
+            bool oneChild = node.type == SceneNodeType::Transform;
+            bool leftValid = (twoChildren || oneChild) ? node.left < h : node.left == invalidNode;
+            bool rightValid = twoChildren ? node.right < h : node.right == invalidNode;
+            if (!leftValid || !rightValid) {
+                error = "node " + std::to_string(h) + " has invalid child handles";
+                return false;
+            }
+            if (static_cast<uint64_t>(node.parameters) + SceneGraph::parameterCount(node.type) > parameterCount) {
+                error = "node " + std::to_string(h) + " has parameters outside the pool";
+                return false;
+            }
+            if (node.type == SceneNodeType::Plane) {
+                const double* normal = parameters + node.parameters;
+                if (!(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2] > 0.0)) {
+                    error = "node " + std::to_string(h) + " is a plane with a zero normal";
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    NodeHandle storedRoot(const SceneGraph& graph) {
+        if (graph.isValid(graph.getRoot())) {
+            return graph.getRoot();
+        }
+        return graph.empty() ? invalidNode : static_cast<NodeHandle>(graph.size() - 1);
+    }
+
+    // Shortest text that reads back as the same double
+    std::string formatNumber(double value) {
+        if (std::isnan(value)) {
+            return "null";
+        }
+        if (std::isinf(value)) {
+            return value > 0 ? "1e999" : "-1e999";
+        }
+        char text[32];
+        std::snprintf(text, sizeof(text), "%.15g", value);
+        if (std::strtod(text, nullptr) != value) {
+            std::snprintf(text, sizeof(text), "%.17g", value);
+        }
+        return text;
+    }
+
+    std::string formatVector(const double* p) {
+        return "[" + formatNumber(p[0]) + ", " + formatNumber(p[1]) + ", " + formatNumber(p[2]) + "]";
+    }
+
+    const char* typeName(SceneNodeType type) {
+        switch (type) {
+            case SceneNodeType::Sphere: return "sphere";
+            case SceneNodeType::Box: return "box";
+            case SceneNodeType::Plane: return "plane";
+            case SceneNodeType::Cylinder: return "cylinder";
+            case SceneNodeType::Union: return "union";
+            case SceneNodeType::Intersection: return "intersection";
+            case SceneNodeType::Difference: return "difference";
+            case SceneNodeType::SmoothUnion: return "smoothUnion";
+            case SceneNodeType::SmoothIntersection: return "smoothIntersection";
+            case SceneNodeType::SmoothDifference: return "smoothDifference";
+            case SceneNodeType::Transform: return "transform";
+            default: return "external";
+        }
+    }
+
+    struct JsonValue {
+        enum class Kind { Null, Boolean, Number, String, Array, Object };
+
+        Kind kind = Kind::Null;
+        bool boolean = false;
+        double number = 0.0;
+        std::string text;
+        std::vector<JsonValue> items;
+        std::vector<std::pair<std::string, JsonValue>> members;
+
+        const JsonValue* find(const char* key) const {
+            for (const auto& member : members) {
+                if (member.first == key) return &member.second;
+            }
+            return nullptr;
+        }
+    };
+
+    // Recursive descent parser for RFC 8259 JSON
+    class JsonParser {
+    public:
+        explicit JsonParser(const std::string& text) : text(text), position(0) {}
+
+        bool parse(JsonValue& value) {
+            // Editors on Windows like to start files with a byte order mark
+            if (text.compare(0, 3, "\xEF\xBB\xBF") == 0) {
+                position = 3;
+            }
+            skipWhitespace();
+            if (!parseValue(value, 0)) {
+                return false;
+            }
+            skipWhitespace();
+            return position == text.size() || fail("unexpected text after the document");
+        }
+
+        // Message of the first error with its line
+        std::string getError() const {
+            size_t line = 1;
+            for (size_t i = 0; i < position && i < text.size(); ++i) {
+                if (text[i] == '\n') ++line;
+            }
+            return "line " + std::to_string(line) + ": " + message;
+        }
+
+    private:
+        static constexpr int maxDepth = 64;
+
+        const std::string& text;
+        size_t position;
+        std::string message;
+
+        bool fail(const std::string& what) {
+            if (message.empty()) message = what;
+            return false;
+        }
+
+        void skipWhitespace() {
+            while (position < text.size() && std::strchr(" \t\r\n", text[position]) && text[position] != '\0') {
+                ++position;
+            }
+        }
+
+        bool consume(char c) {
+            skipWhitespace();
+            if (position < text.size() && text[position] == c) {
+                ++position;
+                return true;
+            }
+            return false;
+        }
+
+        bool parseValue(JsonValue& value, int depth) {
+            if (depth > maxDepth) {
+                return fail("nesting too deep");
+            }
+            skipWhitespace();
+            if (position >= text.size()) {
+                return fail("unexpected end of input");
+            }
+
+            char c = text[position];
+            if (c == '{') {
+                ++position;
+                value.kind = JsonValue::Kind::Object;
+                if (consume('}')) return true;
+                do {
+                    skipWhitespace();
+                    std::string key;
+                    if (!parseString(key)) return false;
+                    if (!consume(':')) return fail("expected ':' after \"" + key + "\"");
+                    value.members.emplace_back(std::move(key), JsonValue());
+                    if (!parseValue(value.members.back().second, depth + 1)) return false;
+                } while (consume(','));
+                return consume('}') || fail("expected ',' or '}'");
+            }
+            if (c == '[') {
+                ++position;
+                value.kind = JsonValue::Kind::Array;
+                if (consume(']')) return true;
+                do {
+                    value.items.emplace_back();
+                    if (!parseValue(value.items.back(), depth + 1)) return false;
+                } while (consume(','));
+                return consume(']') || fail("expected ',' or ']'");
+            }
+            if (c == '"') {
+                value.kind = JsonValue::Kind::String;
+                return parseString(value.text);
+            }
+            if (c == '-' || (c >= '0' && c <= '9')) {
+                value.kind = JsonValue::Kind::Number;
+                return parseNumber(value.number);
+            }
+            if (parseLiteral("true")) {
+                value.kind = JsonValue::Kind::Boolean;
+                value.boolean = true;
+                return true;
+            }
+            if (parseLiteral("false")) {
+                value.kind = JsonValue::Kind::Boolean;
+                return true;
+            }
+            if (parseLiteral("null")) {
+                return true;
+            }
+            return fail(std::string("unexpected character '") + c + "'");
+        }
+
+        bool parseLiteral(const char* word) {
+            size_t length = std::strlen(word);
+            if (text.compare(position, length, word) == 0) {
+                position += length;
+                return true;
+            }
+            return false;
+        }
+
+        bool parseNumber(double& number) {
+            size_t start = position;
+            while (position < text.size() && std::strchr("+-0123456789.eE", text[position]) && text[position] != '\0') {
+                ++position;
+            }
+            std::string token = text.substr(start, position - start);
+            char* end = nullptr;
+            number = std::strtod(token.c_str(), &end);
+            if (token.empty() || end != token.c_str() + token.size()) {
+                position = start;
+                return fail("invalid number");
+            }
+            return true;
+        }
+
+        // Appends a code point as UTF-8
+        static void appendUTF8(std::string& out, uint32_t code) {
+            if (code < 0x80) {
+                out += static_cast<char>(code);
+            }
+            else if (code < 0x800) {
+                out += static_cast<char>(0xC0 | (code >> 6));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else if (code < 0x10000) {
+                out += static_cast<char>(0xE0 | (code >> 12));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+            else {
+                out += static_cast<char>(0xF0 | (code >> 18));
+                out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+                out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+                out += static_cast<char>(0x80 | (code & 0x3F));
+            }
+        }
+
+        bool parseHex(uint32_t& code) {
+            if (position + 4 > text.size()) return fail("truncated \\u escape");
+            code = 0;
+            for (int i = 0; i < 4; ++i) {
+                char c = text[position++];
+                code <<= 4;
+                if (c >= '0' && c <= '9') code |= c - '0';
+                else if (c >= 'a' && c <= 'f') code |= c - 'a' + 10;
+                else if (c >= 'A' && c <= 'F') code |= c - 'A' + 10;
+                else return fail("invalid \\u escape");
+            }
+            return true;
+        }
+
+        bool parseString(std::string& out) {
+            if (position >= text.size() || text[position] != '"') {
+                return fail("expected a string");
+            }
+            ++position;
+            while (position < text.size()) {
+                char c = text[position++];
+                if (c == '"') {
+                    return true;
+                }
+                if (c != '\\') {
+                    out += c;
+                    continue;
+                }
+                if (position >= text.size()) break;
+                char escape = text[position++];
+                switch (escape) {
+                    case '"': out += '"'; break;
+                    case '\\': out += '\\'; break;
+                    case '/': out += '/'; break;
+                    case 'b': out += '\b'; break;
+                    case 'f': out += '\f'; break;
+                    case 'n': out += '\n'; break;
+                    case 'r': out += '\r'; break;
+                    case 't': out += '\t'; break;
+                    case 'u': {
+                        uint32_t code;
+                        if (!parseHex(code)) return false;
+                        // Surrogate pair
+                        if (code >= 0xD800 && code < 0xDC00 && text.compare(position, 2, "\\u") == 0) {
+                            position += 2;
+                            uint32_t low;
+                            if (!parseHex(low)) return false;
+                            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                        }
+                        appendUTF8(out, code);
+                        break;
+                    }
+                    default:
+                        return fail("invalid escape sequence");
+                }
+            }
+            return fail("unterminated string");
+        }
+    };
+
+    // Fill graph from the JSON authoring form
+    bool buildGraph(const JsonValue& document, SceneGraph& graph, std::string& error) {
+        const JsonValue* nodes = document.find("nodes");
+        if (document.kind != JsonValue::Kind::Object || !nodes || nodes->kind != JsonValue::Kind::Array) {
+            error = "expected an object with a \"nodes\" array";
+            return false;
+        }
+
+        graph.clear();
+        graph.reserve(nodes->items.size(), nodes->items.size() * 4);
+        for (size_t index = 0; index < nodes->items.size(); ++index) {
+            const JsonValue& node = nodes->items[index];
+            const JsonValue* type = node.find("type");
+            std::string prefix = "node " + std::to_string(index);
+            if (node.kind != JsonValue::Kind::Object || !type || type->kind != JsonValue::Kind::String) {
+                error = prefix + " needs a \"type\"";
+                return false;
+            }
+            prefix += " (" + type->text + ")";
+
+            auto number = [&](const char* key, double& out, bool required) {
+                const JsonValue* value = node.find(key);
+                if (!value) {
+                    if (required) error = prefix + " needs \"" + key + "\"";
+                    return !required;
+                }
+                if (value->kind != JsonValue::Kind::Number) {
+                    error = prefix + ": \"" + key + "\" must be a number";
+                    return false;
+                }
+                out = value->number;
+                return true;
+            };
+            auto vector = [&](const JsonValue* value, const char* key, Vec3<double>& out) {
+                if (!value || value->kind != JsonValue::Kind::Array || value->items.size() != 3 ||
+                    value->items[0].kind != JsonValue::Kind::Number || value->items[1].kind != JsonValue::Kind::Number ||
+                    value->items[2].kind != JsonValue::Kind::Number) {
+                    error = prefix + ": \"" + key + "\" must be an array of three numbers";
+                    return false;
+                }
+                out = Vec3<double>(value->items[0].number, value->items[1].number, value->items[2].number);
+                return true;
+            };
+            auto vectorField = [&](const char* key, Vec3<double>& out, bool required) {
+                const JsonValue* value = node.find(key);
+                if (!value && !required) return true;
+                return vector(value, key, out);
+            };
+            // Children reference earlier nodes only
+            auto child = [&](const char* key, NodeHandle& out) {
+                double value = -1.0;
+                if (!number(key, value, true)) return false;
+                if (value < 0.0 || value >= static_cast<double>(index) || value != std::floor(value)) {
+                    error = prefix + ": \"" + key + "\" must be the index of an earlier node";
+                    return false;
+                }
+                out = static_cast<NodeHandle>(value);
+                return true;
+            };
+
+            const std::string& name = type->text;
+            Vec3<double> a, b;
+            double r = 0.0, k = 0.0;
+            NodeHandle left = invalidNode, right = invalidNode;
+            NodeHandle handle = invalidNode;
+            if (name == "sphere") {
+                if (!vectorField("center", a, true) || !number("radius", r, true)) return false;
+                handle = graph.addSphere(a, r);
+            }
+            else if (name == "box") {
+                double smoothing = 0.1;
+                if (!vectorField("center", a, true) || !vectorField("dimensions", b, true) ||
+                    !number("smoothing", smoothing, false)) {
+                    return false;
+                }
+                handle = graph.addBox(a, b, smoothing);
+            }
+            else if (name == "plane") {
+                if (!vectorField("normal", a, true) || !number("distance", r, true)) return false;
+                if (!(a.length() > 0.0)) {
+                    error = prefix + ": \"normal\" must not be zero";
+                    return false;
+                }
+                handle = graph.addPlane(a, r);
+            }
+            else if (name == "cylinder") {
+                if (!vectorField("start", a, true) || !vectorField("end", b, true) || !number("radius", r, true)) return false;
+                handle = graph.addCylinder(a, b, r);
+            }
+            else if (name == "union" || name == "intersection" || name == "difference") {
+                if (!child("left", left) || !child("right", right)) return false;
+                if (name == "union") handle = graph.addUnion(left, right);
+                else if (name == "intersection") handle = graph.addIntersection(left, right);
+                else handle = graph.addDifference(left, right);
+            }
+            else if (name == "smoothUnion" || name == "smoothIntersection" || name == "smoothDifference") {
+                if (!child("left", left) || !child("right", right) || !number("k", k, true)) return false;
+                if (name == "smoothUnion") handle = graph.addSmoothUnion(left, right, k);
+                else if (name == "smoothIntersection") handle = graph.addSmoothIntersection(left, right, k);
+                else handle = graph.addSmoothDifference(left, right, k);
+            }
+            else if (name == "transform") {
+                Transform transform;
+                if (!child("child", left) || !vectorField("translation", transform.translation, false) ||
+                    !number("scale", transform.scale, false)) {
+                    return false;
+                }
+                const JsonValue* rotation = node.find("rotation");
+                if (rotation) {
+                    if (rotation->kind != JsonValue::Kind::Array || rotation->items.size() != 3) {
+                        error = prefix + ": \"rotation\" must be three rows of three numbers";
+                        return false;
+                    }
+                    for (int row = 0; row < 3; ++row) {
+                        if (!vector(&rotation->items[row], "rotation", transform.rotation[row])) return false;
+                    }
+                }
+                else if (node.find("axis")) {
+                    double angle = 0.0;
+                    if (!vectorField("axis", a, true) || !number("angle", angle, true)) return false;
+                    if (a.length() == 0.0) {
+                        error = prefix + ": \"axis\" must not be zero";
+                        return false;
+                    }
+                    Transform rotated = Transform::rotate(a, angle);
+                    for (int row = 0; row < 3; ++row) transform.rotation[row] = rotated.rotation[row];
+                }
+                handle = graph.addTransform(left, transform);
+            }
+            else {
+                error = prefix + " is not a known node type";
+                return false;
+            }
+            if (handle == invalidNode) {
+                error = prefix + " could not be added";
+                return false;
+            }
+        }
+
+        const JsonValue* root = document.find("root");
+        if (root) {
+            double value = root->kind == JsonValue::Kind::Number ? root->number : -1.0;
+            if (value < 0.0 || value >= static_cast<double>(graph.size()) || value != std::floor(value)) {
+                error = "\"root\" must be the index of a node";
+                return false;
+            }
+            graph.setRoot(static_cast<NodeHandle>(value));
+        }
+        else if (!graph.empty()) {
+            graph.setRoot(static_cast<NodeHandle>(graph.size() - 1));
+        }
+        return true;
+    }
+
+    bool parseScene(const std::string& text, SceneGraph& graph, std::string& error) {
+        JsonValue document;
+        JsonParser parser(text);
+        if (!parser.parse(document)) {
+            error = parser.getError();
+            graph.clear();
+            return false;
+        }
+        if (!buildGraph(document, graph, error)) {
+            graph.clear();
+            return false;
+        }
+        return true;
+    }
+}
+
+bool SceneFile::save(const SceneGraph& graph, const std::string& path) {
+    if (graph.getExternalCount() > 0) {
+        std::cerr << "Error: Scenes with External nodes cannot be saved to " << path << std::endl;
+        return false;
+    }
+
+    SceneFileHeader header = {};
+    std::memcpy(header.magic, sceneMagic, sizeof(sceneMagic));
+    header.byteOrder = byteOrderMark;
+    header.version = version;
+    header.nodeCount = static_cast<uint32_t>(graph.size());
+    header.root = storedRoot(graph);
+    header.parameterCount = graph.getParameterPoolSize();
+    header.nodeOffset = sizeof(SceneFileHeader);
+    header.parameterOffset = header.nodeOffset + static_cast<uint64_t>(header.nodeCount) * sizeof(SceneNode);
+
+    // Write to a temporary file first: the old file may still be mapped by a loaded graph
+    std::string temporaryPath = path + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Error: Could not open " << temporaryPath << " for writing" << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(graph.getNodeData()),
+                   static_cast<std::streamsize>(graph.size() * sizeof(SceneNode)));
+        file.write(reinterpret_cast<const char*>(graph.getParameterData()),
+                   static_cast<std::streamsize>(graph.getParameterPoolSize() * sizeof(double)));
+        if (!file) {
+            std::cerr << "Error: Failed writing " << temporaryPath << std::endl;
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return false;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::cerr << "Error: Could not replace " << path << ": " << error.message() << std::endl;
+        std::filesystem::remove(temporaryPath, error);
+        return false;
+    }
+    return true;
+}
+
+std::string SceneFile::toJSON(const SceneGraph& graph) {
+    std::ostringstream json;
+    NodeHandle root = storedRoot(graph);
+    json << "{\n";
+    if (root != invalidNode) {
+        json << "  \"root\": " << root << ",\n";
+    }
+    json << "  \"nodes\": [";
+    for (NodeHandle h = 0; h < graph.size(); ++h) {
+        const SceneNode& node = graph.getNode(h);
+        const double* p = node.type == SceneNodeType::External ? nullptr : graph.getParameters(h);
+        json << (h ? ",\n" : "\n") << "    { \"type\": \"" << typeName(node.type) << "\"";
+        switch (node.type) {
+            case SceneNodeType::Sphere:
+                json << ", \"center\": " << formatVector(p) << ", \"radius\": " << formatNumber(p[3]);
+                break;
+            case SceneNodeType::Box:
+                json << ", \"center\": " << formatVector(p) << ", \"dimensions\": " << formatVector(p + 3)
+                     << ", \"smoothing\": " << formatNumber(p[6]);
+                break;
+            case SceneNodeType::Plane:
+                json << ", \"normal\": " << formatVector(p) << ", \"distance\": " << formatNumber(p[3]);
+                break;
+            case SceneNodeType::Cylinder:
+                json << ", \"start\": " << formatVector(p) << ", \"end\": " << formatVector(p + 3)
+                     << ", \"radius\": " << formatNumber(p[6]);
+                break;
+            case SceneNodeType::Transform:
+                json << ", \"child\": " << node.left << ", \"translation\": " << formatVector(p)
+                     << ", \"rotation\": [" << formatVector(p + 3) << ", " << formatVector(p + 6) << ", "
+                     << formatVector(p + 9) << "], \"scale\": " << formatNumber(p[12]);
+                break;
+            case SceneNodeType::External:
+                break;
+            default:
+                json << ", \"left\": " << node.left << ", \"right\": " << node.right;
+                if (SceneGraph::isSmooth(node.type)) {
+                    json << ", \"k\": " << formatNumber(p[0]);
+                }
+                break;
+        }
+        json << " }";
+    }
+    json << (graph.empty() ? "]\n" : "\n  ]\n") << "}\n";
+    return json.str();
+}
+
+bool SceneFile::saveJSON(const SceneGraph& graph, const std::string& path) {
+    if (graph.getExternalCount() > 0) {
+        std::cerr << "Error: Scenes with External nodes cannot be saved to " << path << std::endl;
+        return false;
+    }
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        std::cerr << "Error: Could not open " << path << " for writing" << std::endl;
+        return false;
+    }
+    file << toJSON(graph);
+    if (!file) {
+        std::cerr << "Error: Failed writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::parseJSON(const std::string& text, SceneGraph& graph) {
+    std::string error;
+    if (!parseScene(text, graph, error)) {
+        std::cerr << "Error: Invalid scene, " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::load(const std::string& path, SceneGraph& graph) {
+    graph.clear();
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        std::cerr << "Error: Could not open scene " << path << std::endl;
+        return false;
+    }
+    char magic[sizeof(sceneMagic)] = {};
+    file.read(magic, sizeof(magic));
+    if (file && std::memcmp(magic, sceneMagic, sizeof(sceneMagic)) == 0) {
+        file.close();
+        return loadBinary(path, graph);
+    }
+
+    file.clear();
+    file.seekg(0);
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    std::string error;
+    if (!parseScene(text, graph, error)) {
+        std::cerr << "Error: " << path << ", " << error << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool SceneFile::loadBinary(const std::string& path, SceneGraph& graph) {
+    std::shared_ptr<MappedFile> file = MappedFile::open(path);
+    if (!file) {
+        std::cerr << "Error: Could not open scene " << path << std::endl;
+        return false;
+    }
+
+    auto reject = [&](const std::string& reason) {
+        std::cerr << "Error: " << path << ", " << reason << std::endl;
+        return false;
+    };
+    if (file->size() < sizeof(SceneFileHeader)) {
+        return reject("truncated header");
+    }
+    SceneFileHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, sceneMagic, sizeof(sceneMagic)) != 0) {
+        return reject("not a scene file");
+    }
+    if (header.byteOrder != byteOrderMark) {
+        return reject("written with a different byte order");
+    }
+    if (header.version != version) {
+        return reject("unsupported version " + std::to_string(header.version));
+    }
+
+    // Ranges are checked without overflow before any pointer is formed
+    uint64_t size = file->size();
+    bool nodesInside = header.nodeOffset <= size &&
+                       header.nodeCount <= (size - header.nodeOffset) / sizeof(SceneNode);
+    bool parametersInside = header.parameterOffset <= size &&
+                            header.parameterCount <= (size - header.parameterOffset) / sizeof(double);
+    if (!nodesInside || !parametersInside) {
+        return reject("node table or parameters outside the file");
+    }
+    if (header.nodeOffset % alignof(SceneNode) != 0 || header.parameterOffset % alignof(double) != 0) {
+        return reject("misaligned node table or parameters");
+    }
+    if (header.nodeCount == 0 ? header.root != invalidNode : header.root >= header.nodeCount) {
+        return reject("invalid root");
+    }
+
+    const SceneNode* nodes = reinterpret_cast<const SceneNode*>(file->data() + header.nodeOffset);
+    const double* parameters = reinterpret_cast<const double*>(file->data() + header.parameterOffset);
+    std::string error;
+    if (!validateNodes(nodes, header.nodeCount, parameters, header.parameterCount, error)) {
+        return reject(error);
+    }
+
+    graph.view(file, nodes, header.nodeCount, parameters, static_cast<size_t>(header.parameterCount), header.root);
+    return true;
+}
@@ -0,0 +1,350 @@
+﻿#include "SceneGraph.h"
+#include <algorithm>
+#include <iostream>
+
+uint32_t SceneGraph::parameterCount(SceneNodeType type) {
+    switch (type) {
+        case SceneNodeType::Sphere: return 4;
+        case SceneNodeType::Box: return 7;
+        case SceneNodeType::Plane: return 4;
+        case SceneNodeType::Cylinder: return 7;
+        case SceneNodeType::SmoothUnion:
+        case SceneNodeType::SmoothIntersection:
+        case SceneNodeType::SmoothDifference: return 1;
+        case SceneNodeType::Transform: return 13;
+        default: return 0;
+    }
+}
+
+void SceneGraph::reserve(size_t nodeCount, size_t parameterCount) {
+    detach();
+    nodes.reserve(nodeCount);
+    parameters.reserve(parameterCount);
+}
+
+void SceneGraph::clear() {
+    nodes.clear();
+    parameters.clear();
+    externals.clear();
+    root = invalidNode;
+    storage.reset();
+    viewNodes = nullptr;
+    viewParameters = nullptr;
+    viewNodeCount = 0;
+    viewParameterCount = 0;
+}
+
+void SceneGraph::view(std::shared_ptr<const void> viewStorage, const SceneNode* nodeData, size_t nodeCount,
+                      const double* parameterData, size_t parameterCount, NodeHandle rootHandle) {
+    clear();
+    storage = viewStorage ? std::move(viewStorage) : std::make_shared<int>(0);
+    viewNodes = nodeData;
+    viewParameters = parameterData;
+    viewNodeCount = nodeCount;
+    viewParameterCount = parameterCount;
+    root = rootHandle;
+}
+
+void SceneGraph::detach() {
+    if (!storage) {
+        return;
+    }
+    nodes.assign(viewNodes, viewNodes + viewNodeCount);
+    parameters.assign(viewParameters, viewParameters + viewParameterCount);
+    storage.reset();
+    viewNodes = nullptr;
+    viewParameters = nullptr;
+    viewNodeCount = 0;
+    viewParameterCount = 0;
+}
+
+NodeHandle SceneGraph::addNode(SceneNodeType type, std::initializer_list<double> values) {
+    detach();
+    NodeHandle handle = static_cast<NodeHandle>(nodes.size());
+    nodes.push_back({ type, static_cast<uint32_t>(parameters.size()), invalidNode, invalidNode });
+    parameters.insert(parameters.end(), values);
+    return handle;
+}
+
+NodeHandle SceneGraph::addBoolean(SceneNodeType type, NodeHandle a, NodeHandle b, std::initializer_list<double> values) {
+    // Children must already exist, which keeps handle order bottom-up
+    if (!isValid(a) || !isValid(b)) {
+        std::cerr << "Warning: Boolean scene node with invalid operand handle" << std::endl;
+        return invalidNode;
+    }
+    NodeHandle handle = addNode(type, values);
+    nodes[handle].left = a;
+    nodes[handle].right = b;
+    return handle;
+}
+
+NodeHandle SceneGraph::addSphere(const Vec3<double>& center, double radius) {
+    return addNode(SceneNodeType::Sphere, { center.x, center.y, center.z, radius });
+}
+
+NodeHandle SceneGraph::addBox(const Vec3<double>& center, const Vec3<double>& dimensions, double smoothing) {
+    return addNode(SceneNodeType::Box, { center.x, center.y, center.z, dimensions.x, dimensions.y, dimensions.z, smoothing });
+}
+
+NodeHandle SceneGraph::addPlane(const Vec3<double>& normal, double distance) {
+    // Normalized like the Plane constructor, so the field stays a distance bound
+    double length = normal.length();
+    if (!(length > 0.0)) {
+        std::cerr << "Warning: Plane scene node with a zero normal" << std::endl;
+        return invalidNode;
+    }
+    Vec3<double> unit = normal * (1.0 / length);
+    return addNode(SceneNodeType::Plane, { unit.x, unit.y, unit.z, distance });
+}
+
+NodeHandle SceneGraph::addCylinder(const Vec3<double>& start, const Vec3<double>& end, double radius) {
+    return addNode(SceneNodeType::Cylinder, { start.x, start.y, start.z, end.x, end.y, end.z, radius });
+}
+
+NodeHandle SceneGraph::addUnion(NodeHandle a, NodeHandle b) {
+    return addBoolean(SceneNodeType::Union, a, b, {});
+}
+
+NodeHandle SceneGraph::addIntersection(NodeHandle a, NodeHandle b) {
+    return addBoolean(SceneNodeType::Intersection, a, b, {});
+}
+
+NodeHandle SceneGraph::addDifference(NodeHandle a, NodeHandle b) {
+    return addBoolean(SceneNodeType::Difference, a, b, {});
+}
+
+NodeHandle SceneGraph::addSmoothUnion(NodeHandle a, NodeHandle b, double k) {
+    return addBoolean(SceneNodeType::SmoothUnion, a, b, { k });
+}
+
+NodeHandle SceneGraph::addSmoothIntersection(NodeHandle a, NodeHandle b, double k) {
+    return addBoolean(SceneNodeType::SmoothIntersection, a, b, { k });
+}
+
+NodeHandle SceneGraph::addSmoothDifference(NodeHandle a, NodeHandle b, double k) {
+    return addBoolean(SceneNodeType::SmoothDifference, a, b, { k });
+}
+
+NodeHandle SceneGraph::addTransform(NodeHandle child, const Transform& transform) {
+    if (!isValid(child)) {
+        std::cerr << "Warning: Transform scene node with invalid child handle" << std::endl;
+        return invalidNode;
+    }
+    const Vec3<double>& t = transform.translation;
+    const Vec3<double>* r = transform.rotation;
+    NodeHandle handle = addNode(SceneNodeType::Transform, { t.x, t.y, t.z,
+                                                            r[0].x, r[0].y, r[0].z,
+                                                            r[1].x, r[1].y, r[1].z,
+                                                            r[2].x, r[2].y, r[2].z, transform.scale });
+    nodes[handle].left = child;
+    return handle;
+}
+
+Transform SceneGraph::getTransform(NodeHandle handle) const {
+    const double* p = getParameters(handle);
+    Transform transform;
+    transform.translation = Vec3<double>(p[0], p[1], p[2]);
+    for (int i = 0; i < 3; ++i) {
+        transform.rotation[i] = Vec3<double>(p[3 + 3 * i], p[4 + 3 * i], p[5 + 3 * i]);
+    }
+    transform.scale = p[12];
+    return transform;
+}
+
+bool SceneGraph::setParameters(NodeHandle handle, const double* values) {
+    if (!isValid(handle)) {
+        return false;
+    }
+    // Normalized like addPlane, so edited planes stay distance bounds
+    double planeLength = 1.0;
+    if (getNode(handle).type == SceneNodeType::Plane) {
+        planeLength = Vec3<double>(values[0], values[1], values[2]).length();
+        if (!(planeLength > 0.0)) {
+            std::cerr << "Warning: Plane scene node with a zero normal" << std::endl;
+            return false;
+        }
+    }
+    detach();
+    const SceneNode& node = nodes[handle];
+    std::copy(values, values + parameterCount(node.type), parameters.begin() + node.parameters);
+    if (node.type == SceneNodeType::Plane) {
+        for (int i = 0; i < 3; ++i) {
+            parameters[node.parameters + i] /= planeLength;
+        }
+    }
+    return true;
+}
+
+NodeHandle SceneGraph::addCopy(NodeHandle handle, NodeHandle left, NodeHandle right) {
+    NodeHandle next = static_cast<NodeHandle>(size());
+    bool childrenValid = (left == invalidNode || left < next) && (right == invalidNode || right < next);
+    if (!isValid(handle) || !childrenValid) {
+        std::cerr << "Warning: Copied scene node with invalid handle" << std::endl;
+        return invalidNode;
+    }
+    detach();
+
+    // Parameters are copied, so editing the copy leaves the source alone; externals are shared
+    SceneNode node = nodes[handle];
+    node.left = left;
+    node.right = right;
+    if (node.type != SceneNodeType::External) {
+        std::vector<double> values(parameters.begin() + node.parameters,
+                                   parameters.begin() + node.parameters + parameterCount(node.type));
+        node.parameters = static_cast<uint32_t>(parameters.size());
+        parameters.insert(parameters.end(), values.begin(), values.end());
+    }
+    nodes.push_back(node);
+    return next;
+}
+
+NodeHandle SceneGraph::addExternal(const std::shared_ptr<const ImplicitSurface>& surface) {
+    detach();
+    NodeHandle handle = static_cast<NodeHandle>(nodes.size());
+    nodes.push_back({ SceneNodeType::External, static_cast<uint32_t>(externals.size()), invalidNode, invalidNode });
+    externals.push_back(surface);
+    return handle;
+}
+
+NodeHandle SceneGraph::import(const std::shared_ptr<const ImplicitSurface>& surface) {
+    ImportMap imported;
+    return import(surface, imported);
+}
+
+NodeHandle SceneGraph::import(const std::shared_ptr<const ImplicitSurface>& surface, ImportMap& imported) {
+    if (!surface) {
+        return invalidNode;
+    }
+
+    // Post-order walk with an explicit stack: union chains of large scenes are
+    // far deeper than the call stack allows
+    struct Pending {
+        std::shared_ptr<const ImplicitSurface> node;
+        bool childrenDone;
+    };
+    std::vector<Pending> stack = { { surface, false } };
+
+    while (!stack.empty()) {
+        Pending current = stack.back();
+        const ImplicitSurface* node = current.node.get();
+        if (imported.count(node)) {
+            stack.pop_back();
+            continue;
+        }
+
+        auto booleanOp = dynamic_cast<const BooleanOperation*>(node);
+        auto transformOp = dynamic_cast<const TransformOp*>(node);
+        bool hasChildren = booleanOp && booleanOp->getLeft() && booleanOp->getRight();
+        bool hasChild = transformOp && transformOp->getChild();
+        if ((hasChildren || hasChild) && !current.childrenDone) {
+            stack.back().childrenDone = true;
+            if (hasChild) {
+                stack.push_back({ transformOp->getChild(), false });
+            }
+            else {
+                stack.push_back({ booleanOp->getRight(), false });
+                stack.push_back({ booleanOp->getLeft(), false });
+            }
+            continue;
+        }
+        stack.pop_back();
+
+        NodeHandle handle;
+        if (hasChild) {
+            handle = addTransform(imported[transformOp->getChild().get()], transformOp->getTransform());
+        }
+        else if (hasChildren) {
+            NodeHandle a = imported[booleanOp->getLeft().get()];
+            NodeHandle b = imported[booleanOp->getRight().get()];
+            if (dynamic_cast<const UnionOp*>(node)) handle = addUnion(a, b);
+            else if (dynamic_cast<const IntersectionOp*>(node)) handle = addIntersection(a, b);
+            else if (dynamic_cast<const DifferenceOp*>(node)) handle = addDifference(a, b);
+            else if (auto smooth = dynamic_cast<const SmoothUnionOp*>(node)) handle = addSmoothUnion(a, b, smooth->getSmoothFactor());
+            else if (auto smooth = dynamic_cast<const SmoothIntersectionOp*>(node)) handle = addSmoothIntersection(a, b, smooth->getSmoothFactor());
+            else if (auto smooth = dynamic_cast<const SmoothDifferenceOp*>(node)) handle = addSmoothDifference(a, b, smooth->getSmoothFactor());
+            else handle = addExternal(current.node);
+        }
+        else if (auto sphere = dynamic_cast<const Sphere*>(node)) {
+            handle = addSphere(sphere->getCenter(), sphere->getRadius());
+        }
+        else if (auto box = dynamic_cast<const Box*>(node)) {
+            handle = addBox(box->getCenter(), box->getDimensions(), box->getSmoothing());
+        }
+        else if (auto plane = dynamic_cast<const Plane*>(node); plane && plane->getNormal().length() > 0.0) {
+            handle = addPlane(plane->getNormal(), plane->getDistance());
+        }
+        else if (auto cylinder = dynamic_cast<const Cylinder*>(node)) {
+            handle = addCylinder(cylinder->getStart(), cylinder->getEnd(), cylinder->getRadius());
+        }
+        else {
+            // Unknown types, booleans with missing operands and zero-normal planes
+            // (constant fields that addPlane refuses) keep their own evaluate()
+            handle = addExternal(current.node);
+        }
+        imported[node] = handle;
+    }
+
+    return imported[surface.get()];
+}
+
+std::shared_ptr<ImplicitSurface> SceneGraph::toSurface(NodeHandle handle) const {
+    std::vector<std::shared_ptr<ImplicitSurface>> built;
+    return toSurface(handle, built);
+}
+
+std::shared_ptr<ImplicitSurface> SceneGraph::toSurface(NodeHandle handle, std::vector<std::shared_ptr<ImplicitSurface>>& built) const {
+    if (!isValid(handle)) {
+        return nullptr;
+    }
+    if (built.size() < size()) {
+        built.resize(size());
+    }
+
+    // Children precede their parents, so one ascending pass over the reachable
+    // nodes suffices. Subtrees below nodes that are already built are skipped.
+    std::vector<char> reachable(handle + 1, 0);
+    reachable[handle] = 1;
+    for (NodeHandle h = handle + 1; h-- > 0;) {
+        if (!reachable[h] || built[h]) continue;
+        const SceneNode& node = getNode(h);
+        if (node.left != invalidNode) reachable[node.left] = 1;
+        if (node.right != invalidNode) reachable[node.right] = 1;
+    }
+
+    for (NodeHandle h = 0; h <= handle; ++h) {
+        if (!reachable[h] || built[h]) {
+            continue;
+        }
+
+        const SceneNode& node = getNode(h);
+        const double* p = getParameters(h);
+        const std::shared_ptr<ImplicitSurface>& a = node.left != invalidNode ? built[node.left] : built[h];
+        const std::shared_ptr<ImplicitSurface>& b = node.right != invalidNode ? built[node.right] : built[h];
+        switch (node.type) {
+            case SceneNodeType::Sphere:
+                built[h] = std::make_shared<Sphere>(Vec3<double>(p[0], p[1], p[2]), p[3]);
+                break;
+            case SceneNodeType::Box:
+                built[h] = std::make_shared<Box>(Vec3<double>(p[0], p[1], p[2]), Vec3<double>(p[3], p[4], p[5]), p[6]);
+                break;
+            case SceneNodeType::Plane:
+                built[h] = std::make_shared<Plane>(Vec3<double>(p[0], p[1], p[2]), p[3]);
+                break;
+            case SceneNodeType::Cylinder:
+                built[h] = std::make_shared<Cylinder>(Vec3<double>(p[0], p[1], p[2]), Vec3<double>(p[3], p[4], p[5]), p[6]);
+                break;
+            case SceneNodeType::Union: built[h] = std::make_shared<UnionOp>(a, b); break;
+            case SceneNodeType::Intersection: built[h] = std::make_shared<IntersectionOp>(a, b); break;
+            case SceneNodeType::Difference: built[h] = std::make_shared<DifferenceOp>(a, b); break;
+            case SceneNodeType::SmoothUnion: built[h] = std::make_shared<SmoothUnionOp>(a, b, p[0]); break;
+            case SceneNodeType::SmoothIntersection: built[h] = std::make_shared<SmoothIntersectionOp>(a, b, p[0]); break;
+            case SceneNodeType::SmoothDifference: built[h] = std::make_shared<SmoothDifferenceOp>(a, b, p[0]); break;
+            case SceneNodeType::Transform: built[h] = std::make_shared<TransformOp>(a, getTransform(h)); break;
+            case SceneNodeType::External:
+                // The classes hold mutable children, but surfaces are never modified through them
+                built[h] = std::const_pointer_cast<ImplicitSurface>(externals[node.parameters]);
+                break;
+        }
+    }
+    return built[handle];
+}
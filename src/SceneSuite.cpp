@@ -0,0 +1,102 @@
+﻿#include "SceneSuite.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+    // SplitMix64; std::uniform_real_distribution differs between standard libraries
+    class Random {
+    public:
+        explicit Random(uint64_t seed) : state(seed) {}
+
+        double uniform(double low, double high) {
+            state += 0x9e3779b97f4a7c15ull;
+            uint64_t z = state;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            z ^= z >> 31;
+            return low + (high - low) * static_cast<double>(z >> 11) * (1.0 / 9007199254740992.0);
+        }
+
+    private:
+        uint64_t state;
+    };
+
+    // Balanced union of items[begin, end); every fourth operation, in creation order, is smooth
+    std::shared_ptr<ImplicitSurface> unionTree(const std::vector<std::shared_ptr<ImplicitSurface>>& items,
+                                               size_t begin, size_t end, size_t& operations) {
+        if (end - begin == 1) {
+            return items[begin];
+        }
+        size_t middle = begin + (end - begin) / 2;
+        auto left = unionTree(items, begin, middle, operations);
+        auto right = unionTree(items, middle, end, operations);
+        if (operations++ % 4 == 0) {
+            return std::make_shared<SmoothUnionOp>(left, right, 0.1);
+        }
+        return std::make_shared<UnionOp>(left, right);
+    }
+}
+
+std::vector<SceneSuite::Scene> SceneSuite::standardScenes() {
+    return {
+        { "sphere", ImplicitRenderer::createSphereScene() },
+        { "union", ImplicitRenderer::createCSGUnionScene() },
+        { "intersection", ImplicitRenderer::createCSGIntersectionScene() },
+        { "difference", ImplicitRenderer::createCSGDifferenceScene() },
+        { "complex", ImplicitRenderer::createComplexCSGScene() },
+        { "synthetic16", syntheticScene(16) },
+        { "synthetic64", syntheticScene(64) },
+        { "synthetic256", syntheticScene(256) },
+    };
+}
+
+std::shared_ptr<ImplicitSurface> SceneSuite::syntheticScene(size_t count, uint32_t seed) {
+    Random random(seed);
+    // Primitive size shrinks with the count so the scene keeps a similar silhouette
+    double size = 0.9 / std::cbrt(static_cast<double>(std::max<size_t>(count, 1)));
+
+    std::vector<std::shared_ptr<ImplicitSurface>> items;
+    for (size_t i = 0; i < std::max<size_t>(count, 1); ++i) {
+        Vec3<double> center(random.uniform(-1.5, 1.5), random.uniform(-1.5, 1.5), random.uniform(-1.5, 1.5));
+        double scale = size * random.uniform(0.6, 1.2);
+        switch (i % 3) {
+            case 0:
+                items.push_back(std::make_shared<Sphere>(center, scale));
+                break;
+            case 1:
+                items.push_back(std::make_shared<Box>(center, Vec3<double>(scale, 0.7 * scale, 0.5 * scale), 0.1 * scale));
+                break;
+            default: {
+                Vec3<double> axis(random.uniform(-1.0, 1.0), random.uniform(-1.0, 1.0), random.uniform(-1.0, 1.0));
+                if (axis.length() < 1e-3) axis = Vec3<double>(0.0, 1.0, 0.0);
+                axis = axis.normalize() * scale;
+                items.push_back(std::make_shared<Cylinder>(center - axis, center + axis, 0.4 * scale));
+                break;
+            }
+        }
+    }
+    size_t operations = 0;
+    return unionTree(items, 0, items.size(), operations);
+}
+
+std::vector<CameraPose> SceneSuite::orbitPath(size_t frames, float radius) {
+    std::vector<CameraPose> path;
+    for (size_t i = 0; i < frames; ++i) {
+        float angle = 2.0f * 3.14159265f * static_cast<float>(i) / static_cast<float>(std::max<size_t>(frames, 1));
+        path.push_back({ Vec3<float>(std::sin(angle) * radius, 0.2f * radius, std::cos(angle) * radius),
+                         Vec3<float>(0.0f, 0.0f, 0.0f), Vec3<float>(0.0f, 1.0f, 0.0f), 45.0f });
+    }
+    return path;
+}
+
+std::vector<Vec3<double>> SceneSuite::samplePoints(const AABB& region, size_t count, uint32_t seed) {
+    Random random(seed);
+    std::vector<Vec3<double>> points;
+    points.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        points.emplace_back(random.uniform(region.min.x, region.max.x),
+                            random.uniform(region.min.y, region.max.y),
+                            random.uniform(region.min.z, region.max.z));
+    }
+    return points;
+}
@@ -0,0 +1,612 @@
+﻿#include "SelfTest.h"
+#include "CpuRenderer.h"
+#include "DistanceField.h"
+#include "MeshExtractor.h"
+#include "SceneEditor.h"
+#include "SceneFile.h"
+#include "SceneSuite.h"
+#include "ShadowVolume.h"
+#include "Tape.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+
+namespace {
+    const double tolerance = 1e-9;
+
+    bool close(double a, double b) {
+        return std::abs(a - b) <= tolerance * std::max(1.0, std::abs(b));
+    }
+
+    // Finite region to sample a scene in, with some empty space around it
+    AABB sampleRegion(const ImplicitSurface& surface) {
+        const AABB& bounds = surface.getBounds();
+        if (!bounds.isFinite()) {
+            return AABB::around(Vec3<double>(0.0, 0.0, 0.0), Vec3<double>(3.0, 3.0, 3.0));
+        }
+        return bounds.expand(0.5);
+    }
+
+    class Checker {
+    public:
+        explicit Checker(std::ostream& log) : log(log), failures(0) {}
+
+        void report(const std::string& name, bool passed, const std::string& detail = "") {
+            log << (passed ? "[  OK  ] " : "[ FAIL ] ") << name;
+            if (!passed && !detail.empty()) {
+                log << ": " << detail;
+            }
+            log << std::endl;
+            if (!passed) {
+                ++failures;
+            }
+        }
+
+        void skip(const std::string& name, const std::string& reason) {
+            log << "[ SKIP ] " << name << ": " << reason << std::endl;
+        }
+
+        int getFailures() const { return failures; }
+
+    private:
+        std::ostream& log;
+        int failures;
+    };
+
+    std::string mismatch(const Vec3<double>& p, double value, double expected) {
+        std::ostringstream text;
+        text.precision(17);
+        text << "at (" << p.x << ", " << p.y << ", " << p.z << ") got " << value << ", expected " << expected;
+        return text.str();
+    }
+
+    // Value of a tape in the interpreter layout (Tape::packInterpreter), read
+    // the way tape_interpreter.glsl reads it
+    double interpretPacked(const std::vector<float>& t, const Vec3<double>& input) {
+        double regs[Tape::interpreterRegisters] = {};
+        Vec3<double> points[Tape::interpreterPoints];
+        points[0] = input;
+        auto xyz = [&](size_t texel) { return Vec3<double>(t[texel * 4], t[texel * 4 + 1], t[texel * 4 + 2]); };
+        auto w = [&](size_t texel) { return static_cast<double>(t[texel * 4 + 3]); };
+
+        size_t texel = 1;
+        for (size_t i = 0; i < static_cast<size_t>(t[0]); ++i, ++texel) {
+            TapeOp op = static_cast<TapeOp>(static_cast<uint32_t>(t[texel * 4]));
+            size_t out = static_cast<size_t>(t[texel * 4 + 1]);
+            size_t lhs = static_cast<size_t>(t[texel * 4 + 2]), rhs = static_cast<size_t>(t[texel * 4 + 3]);
+            double a = regs[lhs], b = regs[rhs], result;
+
+            switch (op) {
+                case TapeOp::Sphere:
+                    result = (points[lhs] - xyz(texel + 1)).length() - w(texel + 1);
+                    texel += 1;
+                    break;
+                case TapeOp::Plane:
+                    result = xyz(texel + 1).dot(points[lhs]) + w(texel + 1);
+                    texel += 1;
+                    break;
+                case TapeOp::Box: {
+                    Vec3<double> d = points[lhs] - xyz(texel + 1), size = xyz(texel + 2);
+                    double dx = std::abs(d.x) - size.x, dy = std::abs(d.y) - size.y, dz = std::abs(d.z) - size.z;
+                    result = Vec3<double>(std::max(dx, 0.0), std::max(dy, 0.0), std::max(dz, 0.0)).length() +
+                             std::min(std::max(dx, std::max(dy, dz)), 0.0) - w(texel + 1);
+                    texel += 2;
+                    break;
+                }
+                case TapeOp::Cylinder: {
+                    Vec3<double> pa = points[lhs] - xyz(texel + 1), axis = xyz(texel + 2);
+                    double h = std::min(std::max(pa.dot(axis) * w(texel + 2), 0.0), 1.0);
+                    result = (pa - axis * h).length() - w(texel + 1);
+                    texel += 2;
+                    break;
+                }
+                case TapeOp::Transform: {
+                    // The rotation rows are the columns of the inverse rotation
+                    Vec3<double> d = points[lhs] - xyz(texel + 1);
+                    points[out] = (xyz(texel + 2) * d.x + xyz(texel + 3) * d.y + xyz(texel + 4) * d.z) * w(texel + 1);
+                    texel += 4;
+                    continue;
+                }
+                case TapeOp::Rescale:
+                    result = a * w(texel + 1);
+                    texel += 3;
+                    break;
+                case TapeOp::Union: result = std::min(a, b); break;
+                case TapeOp::Intersection: result = std::max(a, b); break;
+                case TapeOp::Difference: result = std::max(a, -b); break;
+                case TapeOp::Negate: result = -a; break;
+                case TapeOp::SmoothUnion:
+                case TapeOp::SmoothIntersection:
+                case TapeOp::SmoothDifference: {
+                    double k = t[(texel + 1) * 4];
+                    if (op == TapeOp::SmoothDifference) b = -b;
+                    double h = std::max(k - std::abs(a - b), 0.0) / k;
+                    double correction = h * h * h * k * (1.0 / 6.0);
+                    result = op == TapeOp::SmoothUnion ? std::min(a, b) - correction : std::max(a, b) + correction;
+                    texel += 1;
+                    break;
+                }
+                default:
+                    return std::numeric_limits<double>::quiet_NaN();
+            }
+            regs[out] = result;
+        }
+        return regs[static_cast<size_t>(t[1])];
+    }
+
+    void checkScene(Checker& checker, const SceneSuite::Scene& scene) {
+        const ImplicitSurface& tree = *scene.surface;
+        Tape tape = Tape::compile(scene.surface);
+        AABB region = sampleRegion(tree);
+        std::vector<Vec3<double>> points = SceneSuite::samplePoints(region, 1024);
+
+        // Scalar tape and gradient pass against the tree
+        std::string failure;
+        for (const Vec3<double>& p : points) {
+            double expected = tree.evaluate(p);
+            double value = tape.evaluate(p);
+            Vec3<double> gradient;
+            double gradientValue = tape.evaluateWithGradient(p, gradient);
+            if (!close(value, expected) || !close(gradientValue, expected)) {
+                failure = mismatch(p, close(value, expected) ? gradientValue : value, expected);
+                break;
+            }
+        }
+        checker.report("tape/" + scene.name, failure.empty(), failure);
+
+        // SIMD batches against the scalar interpreter, including a partial batch
+        std::vector<double> xs, ys, zs;
+        for (size_t i = 0; i + 3 < points.size(); ++i) {
+            xs.push_back(points[i].x);
+            ys.push_back(points[i].y);
+            zs.push_back(points[i].z);
+        }
+        std::vector<double> distances(xs.size());
+        tape.evaluateBatch(xs.data(), ys.data(), zs.data(), distances.data(), xs.size());
+        failure.clear();
+        for (size_t i = 0; i < xs.size(); ++i) {
+            double expected = tape.evaluate(points[i]);
+            if (!close(distances[i], expected)) {
+                failure = mismatch(points[i], distances[i], expected);
+                break;
+            }
+        }
+        checker.report("batch/" + scene.name, failure.empty(), failure);
+
+        // Float batches against the double ones, within float rounding of the coordinates
+        std::vector<float> fx(xs.begin(), xs.end()), fy(ys.begin(), ys.end()), fz(zs.begin(), zs.end());
+        std::vector<float> floatDistances(fx.size());
+        tape.evaluateBatch(fx.data(), fy.data(), fz.data(), floatDistances.data(), fx.size());
+        failure.clear();
+        for (size_t i = 0; i < fx.size(); ++i) {
+            double magnitude = std::max({ 1.0, points[i].length(), std::abs(distances[i]) });
+            if (!(std::abs(floatDistances[i] - distances[i]) <= 1e-5 * magnitude)) {
+                failure = mismatch(points[i], floatDistances[i], distances[i]);
+                break;
+            }
+        }
+        checker.report("batchFloat/" + scene.name, failure.empty(), failure);
+
+        // Interval bounds and specialized tapes over random sub-regions
+        std::vector<Vec3<double>> corners = SceneSuite::samplePoints(region, 64, 2);
+        std::vector<Vec3<double>> sizes = SceneSuite::samplePoints(
+            AABB(Vec3<double>(0.01, 0.01, 0.01), region.halfExtent() * 0.5), 64, 3);
+        std::string intervalFailure, specializeFailure;
+        for (size_t i = 0; i < corners.size(); ++i) {
+            AABB box(corners[i], corners[i] + sizes[i]);
+            Interval range = tape.evaluateInterval(box);
+            Tape specialized = tape.specialize(box);
+            for (const Vec3<double>& p : SceneSuite::samplePoints(box, 16, static_cast<uint32_t>(4 + i))) {
+                double value = tape.evaluate(p);
+                if (intervalFailure.empty() && (value < range.lower - tolerance || value > range.upper + tolerance)) {
+                    std::ostringstream text;
+                    text << mismatch(p, value, value) << " outside [" << range.lower << ", " << range.upper << "]";
+                    intervalFailure = text.str();
+                }
+                double specializedValue = specialized.evaluate(p);
+                if (specializeFailure.empty() && !close(specializedValue, value)) {
+                    specializeFailure = mismatch(p, specializedValue, value);
+                }
+            }
+        }
+        checker.report("interval/" + scene.name, intervalFailure.empty(), intervalFailure);
+        checker.report("specialize/" + scene.name, specializeFailure.empty(), specializeFailure);
+
+        // The tape as the GPU interpreter reads it, in single precision
+        if (!tape.isInterpretable()) {
+            checker.skip("interpreter/" + scene.name, "tape cannot be interpreted");
+            return;
+        }
+        std::vector<float> texels = tape.packInterpreter();
+        failure.clear();
+        for (const Vec3<double>& p : points) {
+            double value = interpretPacked(texels, p), expected = tape.evaluate(p);
+            if (!(std::abs(value - expected) <= 1e-4 * std::max(1.0, std::abs(expected)))) {
+                failure = mismatch(p, value, expected);
+                break;
+            }
+        }
+        checker.report("interpreter/" + scene.name, failure.empty(), failure);
+    }
+
+    // Tapes compiled from two graphs agree at every sample point
+    std::string compareGraphs(const SceneGraph& expected, const SceneGraph& actual, const AABB& region) {
+        if (!actual.isValid(actual.getRoot())) {
+            return "no root";
+        }
+        Tape expectedTape = Tape::compile(expected, expected.getRoot());
+        Tape actualTape = Tape::compile(actual, actual.getRoot());
+        for (const Vec3<double>& p : SceneSuite::samplePoints(region, 256)) {
+            double value = actualTape.evaluate(p), reference = expectedTape.evaluate(p);
+            if (value != reference) {
+                return mismatch(p, value, reference);
+            }
+        }
+        return "";
+    }
+
+    // A field updated after an edit against a fresh bake: near samples must
+    // agree, far ones may differ but must stay conservative
+    std::string compareFields(const DistanceField& updated, const DistanceField& baked, const Tape& tape) {
+        for (const Vec3<double>& p : SceneSuite::samplePoints(baked.getBounds(), 4096, 5)) {
+            double value = updated.sample(p), reference = baked.sample(p), exact = tape.evaluate(p);
+            bool conservative = (value < 0.0) == (exact < 0.0) && std::abs(value) <= std::abs(exact) + baked.getVoxelSize();
+            if (std::abs(value - reference) > 1e-5 * std::max(1.0, std::abs(reference)) && !conservative) {
+                return mismatch(p, value, reference);
+            }
+        }
+        return "";
+    }
+
+    std::string compareShadows(const ShadowVolume& updated, const ShadowVolume& baked) {
+        const std::vector<float>& value = updated.getVisibility();
+        const std::vector<float>& reference = baked.getVisibility();
+        if (value.size() != reference.size()) {
+            return "volume size changed";
+        }
+        for (size_t i = 0; i < value.size(); ++i) {
+            if (std::abs(value[i] - reference[i]) > 1e-6f) {
+                std::ostringstream text;
+                text << "cell " << i << ": " << value[i] << ", expected " << reference[i];
+                return text.str();
+            }
+        }
+        return "";
+    }
+
+    // Scene edits: rebuilt surfaces, patched tapes, parameter blocks and BVHs
+    // and partially rebaked fields must match what a full rebuild produces
+    void checkEditing(Checker& checker) {
+        SceneEditor editor;
+        editor.reset(SceneSuite::syntheticScene(64));
+        const SceneGraph& graph = editor.getGraph();
+        AABB region = sampleRegion(*editor.getSurface());
+        const Vec3<double> light(4.0, 6.0, 5.0);
+
+        Tape tape = Tape::compile(graph, editor.getRoot());
+        ShaderGenerator generator;
+        generator.setUseParameterBlock(true);
+        generator.generateSceneSDF(graph, editor.getRoot());
+        std::vector<float> parameters = generator.getParameters();
+        std::vector<ShaderGenerator::ParameterBinding> bindings = generator.getParameterBindings();
+        SceneBVH bvh;
+        bvh.build(editor.getSurface());
+        DistanceField field;
+        ShadowVolume shadows;
+        field.bake(tape, editor.getSurface()->getBounds(), 48);
+        shadows.bake(tape, editor.getSurface()->getBounds(), light, 24, 64, 16.0, 1e-3, 1.0);
+
+        NodeHandle sphere = invalidNode;
+        for (NodeHandle h = 0; h < graph.size() && sphere == invalidNode; ++h) {
+            if (graph.getNode(h).type == SceneNodeType::Sphere) sphere = h;
+        }
+
+        // Updated structures after the pending edits, against ones built from scratch
+        auto verify = [&](const std::string& name) {
+            SceneEditor::Changes changes = editor.takeChanges();
+            std::shared_ptr<ImplicitSurface> surface = editor.getSurface();
+            std::shared_ptr<ImplicitSurface> rebuilt = graph.toSurface(graph.getRoot());
+            Tape fresh = Tape::compile(graph, graph.getRoot());
+            std::string failure;
+            for (const Vec3<double>& p : SceneSuite::samplePoints(region, 256, 6)) {
+                if (surface->evaluate(p) != rebuilt->evaluate(p)) {
+                    failure = mismatch(p, surface->evaluate(p), rebuilt->evaluate(p));
+                    break;
+                }
+            }
+            checker.report("edit/" + name + "/surface", failure.empty(), failure);
+
+            if (changes.structure || !tape.updateConstants(graph, changes.parameterNodes)) {
+                tape = fresh;
+            }
+            checker.report("edit/" + name + "/tape", tape.getConstants() == fresh.getConstants(), "patched constants differ");
+
+            DistanceField baked;
+            ShadowVolume bakedShadows;
+            baked.bake(tape, surface->getBounds(), 48);
+            bakedShadows.bake(tape, surface->getBounds(), light, 24, 64, 16.0, 1e-3, 1.0);
+            bool updated = field.update(tape, surface->getBounds(), changes.region, changes.margin);
+            failure = updated ? compareFields(field, baked, tape) : "update refused";
+            checker.report("edit/" + name + "/field", failure.empty(), failure);
+            if (!updated) field = baked;
+
+            updated = shadows.update(tape, surface->getBounds(), changes.region, changes.margin);
+            failure = updated ? compareShadows(shadows, bakedShadows) : "update refused";
+            checker.report("edit/" + name + "/shadow", failure.empty(), failure);
+            if (!updated) shadows = bakedShadows;
+        };
+
+        // A moved and shrunk sphere: the parameter block patched at its
+        // bindings and the BVH refitted in place
+        const double* p = graph.getParameters(sphere);
+        editor.setParameters(sphere, { p[0] + 0.05, p[1] - 0.03, p[2], p[3] * 0.8 });
+        float values[ShaderGenerator::maxPackedParameters];
+        for (const ShaderGenerator::ParameterBinding& binding : bindings) {
+            if (binding.node != sphere) continue;
+            size_t count = ShaderGenerator::packParameters(graph, binding.node, values);
+            std::copy(values, values + count, parameters.begin() + binding.offset);
+        }
+        generator.generateSceneSDF(graph, editor.getRoot());
+        checker.report("edit/parameters/block", parameters == generator.getParameters(), "patched parameters differ");
+
+        SceneBVH built;
+        built.build(editor.getSurface());
+        bool refitted = bvh.refit(editor.getSurface());
+        const std::vector<float>& nodes = bvh.getNodeData();
+        const std::vector<float>& reference = built.getNodeData();
+        bool sameRoot = nodes.size() >= 8 && reference.size() >= 8 &&
+                        std::equal(nodes.begin(), nodes.begin() + 3, reference.begin()) &&
+                        std::equal(nodes.begin() + 4, nodes.begin() + 7, reference.begin() + 4);
+        checker.report("edit/parameters/bvh", refitted && sameRoot, refitted ? "root bounds differ" : "refit refused");
+        verify("parameters");
+
+        // A smooth hole cut into the sphere, then a union swapped for an intersection
+        NodeHandle hole = editor.builder().addSphere(Vec3<double>(p[0], p[1] + 0.1, p[2]), 0.1);
+        editor.insertBoolean(sphere, SceneNodeType::SmoothDifference, hole, 0.05);
+        verify("insert");
+
+        NodeHandle merge = invalidNode;
+        for (NodeHandle h = 0; h < hole && merge == invalidNode; ++h) {
+            if (graph.getNode(h).type == SceneNodeType::Union) merge = editor.current(h);
+        }
+        NodeHandle intersection = editor.builder().addIntersection(graph.getNode(merge).left, graph.getNode(merge).right);
+        editor.replace(merge, intersection);
+        verify("replace");
+    }
+
+    // Surface type the tape cannot lower, kept as an external instruction
+    class ExternalSphere : public ImplicitSurface {
+    private:
+        Vec3<double> center;
+
+    public:
+        explicit ExternalSphere(const Vec3<double>& center) : center(center) {}
+
+        double evaluate(const Vec3<double>& point) const override {
+            return (point - center).length() - 1.0;
+        }
+    };
+
+    // A tape of external surfaces only has no constants at all; interval
+    // evaluation and specialization must still work and stay exact
+    void checkExternalTape(Checker& checker) {
+        auto tree = std::make_shared<UnionOp>(std::make_shared<ExternalSphere>(Vec3<double>(-0.5, 0.0, 0.0)),
+                                              std::make_shared<ExternalSphere>(Vec3<double>(0.5, 0.0, 0.0)));
+        Tape tape = Tape::compile(tree);
+        AABB region = AABB::around(Vec3<double>(0.0, 0.0, 0.0), Vec3<double>(2.0, 2.0, 2.0));
+        Tape specialized = tape.specialize(region);
+        Interval range = tape.evaluateInterval(region);
+
+        std::string failure;
+        for (const Vec3<double>& p : SceneSuite::samplePoints(region, 256, 7)) {
+            double expected = tree->evaluate(p);
+            if (!close(specialized.evaluate(p), expected) || !range.contains(expected)) {
+                failure = mismatch(p, specialized.evaluate(p), expected);
+                break;
+            }
+        }
+        checker.report("specialize/external", failure.empty(), failure);
+    }
+
+    // Planes added with a non-unit normal must evaluate like the Plane class,
+    // through the tape and the rebuilt surface; a zero normal is rejected
+    void checkGraphPlanes(Checker& checker) {
+        SceneGraph graph;
+        NodeHandle plane = graph.addPlane(Vec3<double>(0.0, 2.0, 0.0), 1.0);
+        Plane reference(Vec3<double>(0.0, 2.0, 0.0), 1.0);
+        Vec3<double> p(0.3, 3.0, -0.2);
+        bool matches = graph.isValid(plane) && close(Tape::compile(graph, plane).evaluate(p), reference.evaluate(p)) &&
+                       close(graph.toSurface(plane)->evaluate(p), reference.evaluate(p));
+        checker.report("graph/plane", matches, "non-unit plane normal is not normalized");
+        checker.report("graph/plane/zero", graph.addPlane(Vec3<double>(), 1.0) == invalidNode, "zero plane normal accepted");
+
+        // Edits go through the same normalization
+        const double edited[4] = { 0.0, 2.0, 0.0, 1.0 };
+        const double zero[4] = { 0.0, 0.0, 0.0, 1.0 };
+        NodeHandle editedPlane = graph.addPlane(Vec3<double>(1.0, 0.0, 0.0), 0.0);
+        bool normalized = graph.setParameters(editedPlane, edited) &&
+                          close(Tape::compile(graph, editedPlane).evaluate(p), reference.evaluate(p));
+        checker.report("graph/plane/edit", normalized && !graph.setParameters(editedPlane, zero) &&
+                       close(graph.getParameters(editedPlane)[1], 1.0), "edited plane normal is not normalized, or zero accepted");
+
+        // Imported zero-normal planes are constant fields kept as externals
+        auto flat = std::make_shared<UnionOp>(std::make_shared<Plane>(Vec3<double>(), 0.5), std::make_shared<Sphere>(Vec3<double>(), 1.0));
+        NodeHandle imported = graph.import(flat);
+        checker.report("graph/plane/zeroImport", graph.isValid(imported) && close(Tape::compile(graph, imported).evaluate(p), flat->evaluate(p)),
+                       "zero-normal plane was not imported");
+    }
+
+    // Binary and JSON round trips, and rejection of damaged binaries
+    void checkSceneFiles(Checker& checker) {
+        std::error_code error;
+        std::filesystem::path directory = std::filesystem::temp_directory_path(error);
+        std::string path = (directory / "implicit_csg_selftest.icsg").string();
+
+        for (const SceneSuite::Scene& scene : SceneSuite::standardScenes()) {
+            SceneGraph graph;
+            graph.setRoot(graph.import(scene.surface));
+            AABB region = sampleRegion(*scene.surface);
+
+            SceneGraph loaded;
+            std::string failure = "could not save or load " + path;
+            if (SceneFile::save(graph, path) && SceneFile::load(path, loaded)) {
+                failure = loaded.isView() ? compareGraphs(graph, loaded, region) : "binary scene was copied";
+            }
+            checker.report("sceneFile/" + scene.name, failure.empty(), failure);
+
+            SceneGraph parsed;
+            failure = SceneFile::parseJSON(SceneFile::toJSON(graph), parsed) ? compareGraphs(graph, parsed, region) : "parse failed";
+            checker.report("sceneJSON/" + scene.name, failure.empty(), failure);
+        }
+
+        // A truncated file and a forward child reference must both be refused
+        SceneGraph graph;
+        graph.setRoot(graph.import(ImplicitRenderer::createComplexCSGScene()));
+        bool rejected = false;
+        if (SceneFile::save(graph, path)) {
+            std::vector<char> bytes;
+            {
+                std::ifstream file(path, std::ios::binary);
+                bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+            }
+            SceneGraph loaded;
+            std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size() / 2);
+            rejected = !SceneFile::load(path, loaded) && loaded.empty();
+
+            SceneNode* nodes = reinterpret_cast<SceneNode*>(bytes.data() + sizeof(SceneFileHeader));
+            nodes[graph.getRoot()].left = graph.getRoot();
+            std::ofstream(path, std::ios::binary | std::ios::trunc).write(bytes.data(), bytes.size());
+            rejected = rejected && !SceneFile::load(path, loaded) && loaded.empty();
+        }
+        checker.report("sceneFile/damaged", rejected, "a damaged scene file was accepted");
+
+        SceneGraph plane;
+        bool zeroNormal = SceneFile::parseJSON(R"({ "nodes": [ { "type": "plane", "normal": [0, 0, 0], "distance": 1 } ] })", plane);
+        checker.report("sceneFile/zeroNormal", !zeroNormal && plane.empty(), "a plane with a zero normal was accepted");
+        std::filesystem::remove(path, error);
+    }
+
+    void checkMesh(Checker& checker) {
+        MeshExtractor::Settings settings;
+        settings.resolution = 64;
+        Mesh mesh = MeshExtractor(settings).extract(ImplicitRenderer::createSphereScene());
+
+        double worst = 0.0;
+        for (const Vec3<float>& v : mesh.vertices) {
+            worst = std::max(worst, std::abs(std::sqrt(double(v.x) * v.x + double(v.y) * v.y + double(v.z) * v.z) - 1.0));
+        }
+        std::ostringstream detail;
+        detail << mesh.getTriangleCount() << " triangles, worst radius error " << worst;
+        checker.report("mesh/sphere", !mesh.empty() && worst < 0.02, detail.str());
+    }
+
+    // The unit sphere straight ahead on the CPU renderer: the center must be lit
+    // and the corner the background, and neither the tiling nor the thread
+    // count may change a single pixel
+    void checkCpuRender(Checker& checker) {
+        const int size = 64;
+        CpuRenderer renderer;
+        renderer.setScene(ImplicitRenderer::createSphereScene());
+        CameraPose pose = { Vec3<float>(0.0f, 0.0f, 5.0f), Vec3<float>(0.0f, 0.0f, 0.0f), Vec3<float>(0.0f, 1.0f, 0.0f), 45.0f };
+
+        std::vector<unsigned char> frame;
+        if (!renderer.renderFrame(pose, size, size, frame)) {
+            checker.report("cpu/sphere", false, "no frame rendered");
+            return;
+        }
+        const unsigned char* center = &frame[(static_cast<size_t>(size / 2) * size + size / 2) * 4];
+        const unsigned char* corner = &frame[0];
+        int difference = std::abs(center[0] - corner[0]) + std::abs(center[1] - corner[1]) + std::abs(center[2] - corner[2]);
+        double v = 0.5 / size;
+        bool background = corner[0] == std::lround((0.1 + 0.1 * v) * 255.0) && corner[1] == std::lround((0.1 + 0.2 * v) * 255.0) &&
+                          corner[2] == std::lround((0.2 + 0.2 * v) * 255.0) && corner[3] == 255;
+        checker.report("cpu/sphere", difference > 30 && background, "center and corner pixels look alike");
+
+        CpuRenderer::Settings settings = renderer.getSettings();
+        settings.tileSize = 5;
+        renderer.setSettings(settings);
+        ThreadPool pool(1);
+        renderer.setThreadPool(&pool);
+        std::vector<unsigned char> tiled;
+        bool rendered = renderer.renderFrame(pose, size, size, tiled);
+        checker.report("cpu/tiles", rendered && tiled == frame, "the tiling changed the frame");
+    }
+
+    // One frame of the unit sphere straight ahead: the center must be lit and the corner background
+    void checkRender(Checker& checker) {
+        const int size = 64;
+        ImplicitRenderer renderer(size, size);
+        renderer.setHeadless(true);
+        if (!renderer.initialize()) {
+            checker.skip("render/sphere", "no OpenGL context");
+            return;
+        }
+        renderer.setScene(ImplicitRenderer::createSphereScene());
+
+        std::vector<unsigned char> frame;
+        CameraPose pose = { Vec3<float>(0.0f, 0.0f, 5.0f), Vec3<float>(0.0f, 0.0f, 0.0f), Vec3<float>(0.0f, 1.0f, 0.0f), 45.0f };
+        bool rendered = renderer.renderFrames({ pose }, size, size,
+            [&](size_t, const unsigned char* pixels, int width, int height) {
+                frame.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+            });
+        if (!rendered || frame.empty()) {
+            checker.report("render/sphere", false, "no frame delivered");
+            return;
+        }
+
+        const unsigned char* center = &frame[(static_cast<size_t>(size / 2) * size + size / 2) * 4];
+        const unsigned char* corner = &frame[0];
+        int difference = std::abs(center[0] - corner[0]) + std::abs(center[1] - corner[1]) + std::abs(center[2] - corner[2]);
+        checker.report("render/sphere", difference > 30, "center and corner pixels look alike");
+
+        // The CPU renderer has the same defaults; only silhouette pixels may differ beyond rounding
+        CpuRenderer cpuRenderer;
+        cpuRenderer.setScene(ImplicitRenderer::createSphereScene());
+        std::vector<unsigned char> software;
+        size_t differing = 0;
+        if (cpuRenderer.renderFrame(pose, size, size, software)) {
+            for (size_t i = 0; i < software.size() && i < frame.size(); ++i) {
+                differing += std::abs(software[i] - frame[i]) > 8 ? 1 : 0;
+            }
+        }
+        checker.report("render/cpu", software.size() == frame.size() && differing * 100 <= frame.size(),
+                       "CPU frame differs from the GPU one");
+
+        // The tape interpreter draws the same frame up to rounding
+        renderer.setTapeInterpreter(InterpreterMode::Always);
+        std::vector<unsigned char> interpreted;
+        rendered = renderer.renderFrames({ pose }, size, size,
+            [&](size_t, const unsigned char* pixels, int width, int height) {
+                interpreted.assign(pixels, pixels + static_cast<size_t>(width) * height * 4);
+            });
+        int worst = 0;
+        for (size_t i = 0; rendered && i < interpreted.size() && i < frame.size(); ++i) {
+            worst = std::max(worst, std::abs(interpreted[i] - frame[i]));
+        }
+        checker.report("render/interpreter", rendered && renderer.isSceneInterpreted() && interpreted.size() == frame.size() && worst <= 8,
+                       "interpreted frame differs from the generated one");
+    }
+}
+
+int SelfTest::run(std::ostream& log) {
+    Checker checker(log);
+    for (const SceneSuite::Scene& scene : SceneSuite::standardScenes()) {
+        checkScene(checker, scene);
+    }
+    checkExternalTape(checker);
+    checkGraphPlanes(checker);
+    checkSceneFiles(checker);
+    checkEditing(checker);
+    checkMesh(checker);
+    checkCpuRender(checker);
+    checkRender(checker);
+
+    log << (checker.getFailures() == 0 ? "All checks passed" : "Some checks failed")
+        << " (" << checker.getFailures() << " failures)" << std::endl;
+    return checker.getFailures();
+}
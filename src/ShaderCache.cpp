@@ -0,0 +1,248 @@
+﻿#include "ShaderCache.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+namespace {
+    // Header written in front of every persisted program binary
+    const char binaryMagic[8] = { 'I', 'C', 'S', 'G', 'P', 'R', 'G', '1' };
+
+    uint64_t fnv1a(uint64_t hash, const void* data, size_t length) {
+        const unsigned char* bytes = static_cast<const unsigned char*>(data);
+        for (size_t i = 0; i < length; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    uint64_t fnv1a(uint64_t hash, const char* text) {
+        return text ? fnv1a(hash, text, std::char_traits<char>::length(text)) : hash;
+    }
+}
+
+ShaderCache::ShaderCache(size_t capacity)
+    : capacity(capacity > 0 ? capacity : 1)
+{
+}
+
+ShaderCache::~ShaderCache() {
+    // Programs must be released with a current context, see clear()
+    if (!entries.empty()) {
+        std::cerr << "Warning: ShaderCache destroyed with " << entries.size() << " live programs" << std::endl;
+    }
+}
+
+void ShaderCache::setCacheDirectory(const std::string& directory) {
+    cacheDirectory = directory;
+    if (cacheDirectory.empty()) {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(cacheDirectory, error);
+    if (error) {
+        std::cerr << "Warning: Could not create shader cache directory " << cacheDirectory
+                  << ": " << error.message() << std::endl;
+        cacheDirectory.clear();
+    }
+}
+
+void ShaderCache::setCapacity(size_t newCapacity) {
+    capacity = newCapacity > 0 ? newCapacity : 1;
+    evict();
+}
+
+bool ShaderCache::binariesSupported() {
+    if (!GLEW_ARB_get_program_binary) {
+        return false;
+    }
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    return formats > 0;
+}
+
+uint64_t ShaderCache::hashSources(const std::string& vertexSource, const std::string& fragmentSource) {
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash = fnv1a(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    hash = fnv1a(hash, vertexSource.data(), vertexSource.size());
+    // Separator so moving text between the two stages changes the hash
+    hash = fnv1a(hash, "\0", 1);
+    hash = fnv1a(hash, fragmentSource.data(), fragmentSource.size());
+    return hash;
+}
+
+std::string ShaderCache::binaryPath(uint64_t key) const {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return (std::filesystem::path(cacheDirectory) / name).string();
+}
+
+GLuint ShaderCache::find(uint64_t key) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        // Move to the front of the LRU list
+        entries.splice(entries.begin(), entries, it->second);
+        return it->second->program;
+    }
+
+    GLuint program = loadBinary(key);
+    if (program) {
+        entries.push_front({ key, program, false });
+        index[key] = entries.begin();
+        evict();
+    }
+    return program;
+}
+
+void ShaderCache::insert(uint64_t key, GLuint program) {
+    auto it = index.find(key);
+    if (it != index.end()) {
+        if (it->second->program != program) {
+            glDeleteProgram(it->second->program);
+            it->second->program = program;
+        }
+        entries.splice(entries.begin(), entries, it->second);
+        return;
+    }
+
+    entries.push_front({ key, program, false });
+    index[key] = entries.begin();
+    storeBinary(key, program);
+    evict();
+}
+
+void ShaderCache::setPinned(const std::vector<GLuint>& programs) {
+    for (Entry& entry : entries) {
+        entry.pinned = std::find(programs.begin(), programs.end(), entry.program) != programs.end();
+    }
+    evict();
+}
+
+void ShaderCache::evict() {
+    size_t pinned = std::count_if(entries.begin(), entries.end(), [](const Entry& entry) { return entry.pinned; });
+
+    // Never evict the front entry, it is the program currently handed out
+    auto it = entries.end();
+    while (entries.size() - pinned > capacity && it != std::next(entries.begin())) {
+        --it;
+        if (!it->pinned) {
+            glDeleteProgram(it->program);
+            index.erase(it->key);
+            it = entries.erase(it);
+        }
+    }
+}
+
+void ShaderCache::clear() {
+    for (const Entry& entry : entries) {
+        glDeleteProgram(entry.program);
+    }
+    entries.clear();
+    index.clear();
+}
+
+GLuint ShaderCache::loadBinary(uint64_t key) {
+    if (cacheDirectory.empty() || !binariesSupported()) {
+        return 0;
+    }
+
+    std::string path = binaryPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        return 0;
+    }
+
+    char magic[sizeof(binaryMagic)];
+    uint32_t format = 0, length = 0;
+    file.read(magic, sizeof(magic));
+    file.read(reinterpret_cast<char*>(&format), sizeof(format));
+    file.read(reinterpret_cast<char*>(&length), sizeof(length));
+
+    // Reject lengths that cannot belong to this file before allocating
+    std::error_code sizeError;
+    uintmax_t fileSize = std::filesystem::file_size(path, sizeError);
+    if (sizeError || length > fileSize) {
+        file.setstate(std::ios::failbit);
+        length = 0;
+    }
+
+    std::vector<char> binary(length);
+    if (file) {
+        file.read(binary.data(), length);
+    }
+
+    bool valid = file && std::equal(magic, magic + sizeof(magic), binaryMagic);
+    file.close();
+
+    GLuint program = 0;
+    if (valid) {
+        program = glCreateProgram();
+        glProgramBinary(program, format, binary.data(), static_cast<GLsizei>(length));
+
+        GLint success = 0;
+        glGetProgramiv(program, GL_LINK_STATUS, &success);
+        if (!success) {
+            // Usually a driver update; the binary is stale and will be rebuilt
+            glDeleteProgram(program);
+            program = 0;
+        }
+    }
+
+    if (!program) {
+        std::error_code error;
+        std::filesystem::remove(path, error);
+    }
+    return program;
+}
+
+void ShaderCache::storeBinary(uint64_t key, GLuint program) {
+    if (cacheDirectory.empty() || !binariesSupported()) {
+        return;
+    }
+
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    GLsizei written = 0;
+    glGetProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0) {
+        return;
+    }
+
+    // Write to a temporary file first so a crash never leaves a truncated binary
+    std::string path = binaryPath(key);
+    std::string temporaryPath = path + ".tmp";
+    std::error_code error;
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        uint32_t format32 = static_cast<uint32_t>(format);
+        uint32_t length32 = static_cast<uint32_t>(written);
+        file.write(binaryMagic, sizeof(binaryMagic));
+        file.write(reinterpret_cast<const char*>(&format32), sizeof(format32));
+        file.write(reinterpret_cast<const char*>(&length32), sizeof(length32));
+        file.write(binary.data(), written);
+        if (!file) {
+            std::cerr << "Warning: Could not write shader cache file " << temporaryPath << std::endl;
+            file.close();
+            std::filesystem::remove(temporaryPath, error);
+            return;
+        }
+    }
+
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        std::filesystem::remove(temporaryPath, error);
+    }
+}
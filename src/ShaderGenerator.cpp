@@ -0,0 +1,392 @@
+﻿#include "ShaderGenerator.h"
+#include <iostream>
+#include <locale>
+
+ShaderGenerator::ShaderGenerator()
+    : source(nullptr), nextVariable(0), useParameterBlock(false), scalarSlot(-1), scalarComponent(4) {}
+
+std::string ShaderGenerator::formatFloat(double value) {
+    std::ostringstream out;
+    out.imbue(std::locale::classic());
+    out.precision(9);
+    out << value;
+
+    // GLSL needs a decimal point or exponent to treat the literal as a float
+    std::string literal = out.str();
+    if (literal.find_first_of(".e") == std::string::npos) {
+        literal += ".0";
+    }
+    return literal;
+}
+
+std::string ShaderGenerator::formatVec3(const Vec3<double>& value) {
+    return "vec3(" + formatFloat(value.x) + ", " + formatFloat(value.y) + ", " + formatFloat(value.z) + ")";
+}
+
+int ShaderGenerator::declare(const std::string& valueExpression, const std::string& gradientExpression) {
+    int id = nextVariable++;
+    body << "    float " << valueName(id) << " = " << valueExpression << ";\n";
+    gradientBody << "    vec4 " << gradientName(id) << " = " << gradientExpression << ";\n";
+    return id;
+}
+
+int ShaderGenerator::declareCall(const std::string& function, const std::string& arguments) {
+    return declare(function + "SDF(p, " + arguments + ")", function + "SDFGrad(p, " + arguments + ")");
+}
+
+void ShaderGenerator::bindVec4(const Vec3<double>& xyz, double w, std::string& xyzExpr, std::string& wExpr) {
+    if (!useParameterBlock) {
+        xyzExpr = formatVec3(xyz);
+        wExpr = formatFloat(w);
+        return;
+    }
+
+    std::string slot = "sceneParams[" + std::to_string(parameters.size() / 4) + "]";
+    parameters.push_back(static_cast<float>(xyz.x));
+    parameters.push_back(static_cast<float>(xyz.y));
+    parameters.push_back(static_cast<float>(xyz.z));
+    parameters.push_back(static_cast<float>(w));
+    xyzExpr = slot + ".xyz";
+    wExpr = slot + ".w";
+}
+
+std::string ShaderGenerator::bindScalar(double value) {
+    if (!useParameterBlock) {
+        return formatFloat(value);
+    }
+
+    // Pack scalars four to a slot
+    if (scalarComponent == 4) {
+        scalarSlot = static_cast<int>(parameters.size() / 4);
+        parameters.insert(parameters.end(), 4, 0.0f);
+        scalarComponent = 0;
+    }
+    parameters[scalarSlot * 4 + scalarComponent] = static_cast<float>(value);
+    static const char* swizzle[] = { "x", "y", "z", "w" };
+    return "sceneParams[" + std::to_string(scalarSlot) + "]." + swizzle[scalarComponent++];
+}
+
+void ShaderGenerator::recordBinding(NodeHandle handle, size_t offset) {
+    if (useParameterBlock) {
+        bindings.push_back({ handle, static_cast<uint32_t>(offset) });
+    }
+}
+
+size_t ShaderGenerator::packParameters(const SceneGraph& graph, NodeHandle handle, float* values) {
+    // Must follow the bind calls of emitPrimitive, emitBoolean and emitTransform
+    const double* p = graph.getParameters(handle);
+    auto pack = [values](std::initializer_list<double> list) {
+        size_t count = 0;
+        for (double value : list) values[count++] = static_cast<float>(value);
+        return count;
+    };
+
+    switch (graph.getNode(handle).type) {
+        case SceneNodeType::Sphere:
+        case SceneNodeType::Plane:
+            return pack({ p[0], p[1], p[2], p[3] });
+        case SceneNodeType::Box:
+            return pack({ p[0], p[1], p[2], p[6], p[3], p[4], p[5], 0.0 });
+        case SceneNodeType::Cylinder: {
+            Vec3<double> axis = Vec3<double>(p[3], p[4], p[5]) - Vec3<double>(p[0], p[1], p[2]);
+            double lengthSquared = axis.dot(axis);
+            return pack({ p[0], p[1], p[2], p[6], axis.x, axis.y, axis.z, lengthSquared > 0.0 ? 1.0 / lengthSquared : 0.0 });
+        }
+        case SceneNodeType::SmoothUnion:
+        case SceneNodeType::SmoothIntersection:
+        case SceneNodeType::SmoothDifference:
+            return pack({ p[0] });
+        case SceneNodeType::Transform:
+            return pack({ p[0], p[1], p[2], p[12], p[3], p[4], p[5], 1.0 / p[12],
+                          p[6], p[7], p[8], 0.0, p[9], p[10], p[11], 0.0 });
+        default:
+            return 0;
+    }
+}
+
+void ShaderGenerator::reset() {
+    bindings.clear();
+    parameters.clear();
+    scalarSlot = -1;
+    scalarComponent = 4;
+}
+
+void ShaderGenerator::beginFunction() {
+    body.str("");
+    body.clear();
+    gradientBody.str("");
+    gradientBody.clear();
+    nextVariable = 0;
+    emitted.assign(source ? source->size() : 0, -1);
+}
+
+void ShaderGenerator::writeFunctionPair(std::ostringstream& code, const std::string& name,
+                                        const std::string& signature, int result) const {
+    code << "float " << name << "SDF(" << signature << ") {\n";
+    code << body.str();
+    code << "    return " << valueName(result) << ";\n";
+    code << "}\n\n";
+    code << "vec4 " << name << "SDFGradient(" << signature << ") {\n";
+    code << gradientBody.str();
+    code << "    return " << gradientName(result) << ";\n";
+    code << "}\n";
+}
+
+std::string ShaderGenerator::parameterBlockCode() const {
+    if (!useParameterBlock) {
+        return "";
+    }
+
+    // GLSL does not allow zero-sized arrays
+    std::ostringstream code;
+    size_t slots = std::max<size_t>(getParameterVec4Count(), 1);
+    code << "layout(std140) uniform " << parameterBlockName << " {\n";
+    code << "    vec4 sceneParams[" << slots << "];\n";
+    code << "};\n\n";
+    return code.str();
+}
+
+std::string ShaderGenerator::generateInstanceFunctions(const std::vector<NodeHandle>& roots) {
+    NodeHandle last = 0;
+    for (NodeHandle root : roots) last = std::max(last, root);
+    std::vector<char> reachable(roots.empty() ? 0 : last + 1, 0), instanced(reachable.size(), 0);
+    for (NodeHandle root : roots) reachable[root] = 1;
+    for (NodeHandle h = static_cast<NodeHandle>(reachable.size()); h-- > 0;) {
+        if (!reachable[h]) continue;
+        const SceneNode& node = source->getNode(h);
+        if (node.left != invalidNode) reachable[node.left] = 1;
+        if (node.right != invalidNode) reachable[node.right] = 1;
+        if (node.type == SceneNodeType::Transform) instanced[node.left] = 1;
+    }
+
+    // Nested instances have smaller handles, so ascending order defines every
+    // function before its first call
+    std::ostringstream code;
+    for (NodeHandle h = 0; h < instanced.size(); ++h) {
+        if (!instanced[h]) continue;
+        beginFunction();
+        int result = emitNode(h);
+        code << "// Generated instanced subtree " << h << "\n";
+        writeFunctionPair(code, instanceName(h), "vec3 p", result);
+        code << "\n";
+    }
+    return code.str();
+}
+
+std::string ShaderGenerator::generateSceneSDF(const std::shared_ptr<const ImplicitSurface>& root) {
+    imported.clear();
+    NodeHandle handle = imported.import(root);
+    return generateSceneSDF(imported, handle);
+}
+
+std::string ShaderGenerator::generateSceneSDF(const SceneGraph& graph, NodeHandle root) {
+    reset();
+    source = &graph;
+    std::ostringstream code;
+    if (graph.isValid(root)) {
+        code << generateInstanceFunctions({ root });
+    }
+
+    beginFunction();
+    int result = graph.isValid(root) ? emitNode(root) : declare("1000.0", "vec4(1000.0, 0.0, 1.0, 0.0)");
+
+    code << "// Generated scene function and its analytic gradient, vec4(distance, gradient)\n";
+    writeFunctionPair(code, "scene", "vec3 p", result);
+    return parameterBlockCode() + code.str();
+}
+
+std::string ShaderGenerator::generateSceneBVHFunctions(const SceneBVH& bvh) {
+    reset();
+    std::ostringstream code;
+
+    // Import every item into one graph so subtrees shared between items are stored once
+    const std::vector<std::shared_ptr<const ImplicitSurface>>& items = bvh.getGeneratedItems();
+    const std::vector<std::shared_ptr<const ImplicitSurface>>& unbounded = bvh.getUnboundedItems();
+    imported.clear();
+    SceneGraph::ImportMap importMap;
+    std::vector<NodeHandle> itemHandles, unboundedHandles;
+    for (const auto& item : items) itemHandles.push_back(imported.import(item, importMap));
+    for (const auto& item : unbounded) unboundedHandles.push_back(imported.import(item, importMap));
+    source = &imported;
+
+    std::vector<NodeHandle> roots = itemHandles;
+    roots.insert(roots.end(), unboundedHandles.begin(), unboundedHandles.end());
+    code << generateInstanceFunctions(roots);
+
+    // One function pair per generated item, dispatched by index from scene_bvh.glsl
+    for (size_t i = 0; i < items.size(); ++i) {
+        beginFunction();
+        int result = emitNode(itemHandles[i]);
+        code << "// Generated scene item " << i << "\n";
+        writeFunctionPair(code, "sceneItem" + std::to_string(i), "vec3 p", result);
+        code << "\n";
+    }
+
+    code << "float sceneItemSDF(int item, vec3 p) {\n";
+    if (!items.empty()) {
+        code << "    switch (item) {\n";
+        for (size_t i = 0; i < items.size(); ++i) {
+            code << "    case " << i << ": return sceneItem" << i << "SDF(p);\n";
+        }
+        code << "    }\n";
+    }
+    code << "    return 1000.0;\n";
+    code << "}\n\n";
+    code << "vec4 sceneItemSDFGradient(int item, vec3 p) {\n";
+    if (!items.empty()) {
+        code << "    switch (item) {\n";
+        for (size_t i = 0; i < items.size(); ++i) {
+            code << "    case " << i << ": return sceneItem" << i << "SDFGradient(p);\n";
+        }
+        code << "    }\n";
+    }
+    code << "    return vec4(1000.0, 0.0, 1.0, 0.0);\n";
+    code << "}\n\n";
+
+    // Items without finite bounds are evaluated for every sample
+    beginFunction();
+    int result = declare("1000.0", "vec4(1000.0, 0.0, 1.0, 0.0)");
+    for (NodeHandle item : unboundedHandles) {
+        int id = emitNode(item);
+        result = declare("min(" + valueName(result) + ", " + valueName(id) + ")",
+                         "unionGrad(" + gradientName(result) + ", " + gradientName(id) + ")");
+    }
+    code << "// Generated union of the unbounded scene items\n";
+    writeFunctionPair(code, "sceneUnbounded", "vec3 p", result);
+
+    return parameterBlockCode() + code.str();
+}
+
+int ShaderGenerator::emitNode(NodeHandle handle) {
+    if (emitted[handle] >= 0) {
+        return emitted[handle];
+    }
+
+    const SceneNode& node = source->getNode(handle);
+    int id;
+    if (SceneGraph::isBoolean(node.type)) id = emitBoolean(handle);
+    else if (node.type == SceneNodeType::Transform) id = emitTransform(handle);
+    else id = emitPrimitive(handle);
+    emitted[handle] = id;
+    return id;
+}
+
+int ShaderGenerator::emitPrimitive(NodeHandle handle) {
+    const SceneNode& node = source->getNode(handle);
+    const double* p = source->getParameters(handle);
+    std::string xyz, w;
+    recordBinding(handle, parameters.size());
+
+    switch (node.type) {
+        case SceneNodeType::Sphere:
+            bindVec4(Vec3<double>(p[0], p[1], p[2]), p[3], xyz, w);
+            return declareCall("sphere", xyz + ", " + w);
+
+        case SceneNodeType::Box: {
+            std::string dimensions, unused;
+            bindVec4(Vec3<double>(p[0], p[1], p[2]), p[6], xyz, w);
+            bindVec4(Vec3<double>(p[3], p[4], p[5]), 0.0, dimensions, unused);
+            std::string arguments = xyz + ", " + dimensions;
+            if (useParameterBlock || p[6] != 0.0) {
+                return declare("boxSDF(p, " + arguments + ") - " + w,
+                               "boxSDFGrad(p, " + arguments + ") - vec4(" + w + ", 0.0, 0.0, 0.0)");
+            }
+            return declareCall("box", arguments);
+        }
+
+        case SceneNodeType::Plane:
+            bindVec4(Vec3<double>(p[0], p[1], p[2]), p[3], xyz, w);
+            return declareCall("plane", xyz + ", " + w);
+
+        case SceneNodeType::Cylinder: {
+            // Fold the segment axis and its inverse squared length into constants
+            Vec3<double> start(p[0], p[1], p[2]);
+            Vec3<double> axis = Vec3<double>(p[3], p[4], p[5]) - start;
+            double lengthSquared = axis.dot(axis);
+            if (lengthSquared == 0.0 && !useParameterBlock) {
+                // A zero-length cylinder degenerates into a sphere around its start point
+                bindVec4(start, p[6], xyz, w);
+                return declareCall("sphere", xyz + ", " + w);
+            }
+
+            // With a zero inverse length the axis term vanishes, giving the same sphere
+            std::string axisExpr, inverseLength;
+            bindVec4(start, p[6], xyz, w);
+            bindVec4(axis, lengthSquared > 0.0 ? 1.0 / lengthSquared : 0.0, axisExpr, inverseLength);
+            return declareCall("cylinderAxis", xyz + ", " + axisExpr + ", " + inverseLength + ", " + w);
+        }
+
+        default:
+            std::cerr << "Warning: Unsupported implicit surface type in shader generation" << std::endl;
+            return declare("1000.0", "vec4(1000.0, 0.0, 1.0, 0.0)");
+    }
+}
+
+int ShaderGenerator::emitBoolean(NodeHandle handle) {
+    const SceneNode& node = source->getNode(handle);
+    int left = emitNode(node.left);
+    int right = emitNode(node.right);
+    std::string a = valueName(left), b = valueName(right);
+    std::string ga = gradientName(left), gb = gradientName(right);
+
+    auto sharp = [&](const std::string& value, const std::string& gradientFunction) {
+        return declare(value, gradientFunction + "(" + ga + ", " + gb + ")");
+    };
+    auto smooth = [&](const std::string& function, double k) {
+        std::string factor = bindScalar(k);
+        recordBinding(handle, static_cast<size_t>(scalarSlot) * 4 + scalarComponent - 1);
+        return declare(function + "Op(" + a + ", " + b + ", " + factor + ")",
+                       function + "Grad(" + ga + ", " + gb + ", " + factor + ")");
+    };
+
+    // Smooth operations collapse to their sharp counterparts when k is not positive.
+    // With a parameter block k may change later, so the smooth form is always kept.
+    double k = SceneGraph::isSmooth(node.type) ? source->getParameters(handle)[0] : 0.0;
+    bool folded = k <= 0.0 && !useParameterBlock;
+
+    switch (node.type) {
+        case SceneNodeType::Intersection:
+            return sharp("max(" + a + ", " + b + ")", "intersectionGrad");
+        case SceneNodeType::Difference:
+            return sharp("max(" + a + ", -" + b + ")", "differenceGrad");
+        case SceneNodeType::SmoothUnion:
+            if (folded) return sharp("min(" + a + ", " + b + ")", "unionGrad");
+            return smooth("smoothUnion", k);
+        case SceneNodeType::SmoothIntersection:
+            if (folded) return sharp("max(" + a + ", " + b + ")", "intersectionGrad");
+            return smooth("smoothIntersection", k);
+        case SceneNodeType::SmoothDifference:
+            if (folded) return sharp("max(" + a + ", -" + b + ")", "differenceGrad");
+            return smooth("smoothDifference", k);
+        default:
+            return sharp("min(" + a + ", " + b + ")", "unionGrad");
+    }
+}
+
+int ShaderGenerator::emitTransform(NodeHandle handle) {
+    const SceneNode& node = source->getNode(handle);
+    Transform transform = source->getTransform(handle);
+    std::string function = instanceName(node.left);
+
+    // Pure translations only offset the point (and leave the gradient alone)
+    const Vec3<double>* r = transform.rotation;
+    bool translationOnly = transform.scale == 1.0 && r[0].x == 1.0 && r[0].y == 0.0 && r[0].z == 0.0 &&
+                           r[1].x == 0.0 && r[1].y == 1.0 && r[1].z == 0.0 && r[2].x == 0.0 && r[2].y == 0.0 && r[2].z == 1.0;
+    if (translationOnly && !useParameterBlock) {
+        std::string point = "p - " + formatVec3(transform.translation);
+        return declare(function + "SDF(" + point + ")", function + "SDFGradient(" + point + ")");
+    }
+
+    // The columns of the inverse rotation are the rows of the rotation
+    std::string translation, scale, inverseScale, columns[3], unused;
+    recordBinding(handle, parameters.size());
+    bindVec4(transform.translation, transform.scale, translation, scale);
+    bindVec4(transform.rotation[0], 1.0 / transform.scale, columns[0], inverseScale);
+    bindVec4(transform.rotation[1], 0.0, columns[1], unused);
+    bindVec4(transform.rotation[2], 0.0, columns[2], unused);
+    std::string inverseRotation = "mat3(" + columns[0] + ", " + columns[1] + ", " + columns[2] + ")";
+    std::string point = "instancePoint(p, " + translation + ", " + inverseRotation + ", " + inverseScale + ")";
+
+    return declare(scale + " * " + function + "SDF(" + point + ")",
+                   "instanceGrad(" + function + "SDFGradient(" + point + "), " + inverseRotation + ", " + scale + ")");
+}
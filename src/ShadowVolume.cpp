@@ -0,0 +1,167 @@
+﻿#include "ShadowVolume.h"
+#include "ThreadPool.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+double ShadowVolume::softShadow(const Tape& tape, const Vec3<double>& origin, const Vec3<double>& direction,
+                                double maxDistance, int maxSteps, double softness, double epsilon,
+                                double lipschitzBound, AABB* sweep) {
+    // Penumbra estimate that uses the previous sample to find the closest
+    // approach between two steps instead of taking each distance at face value
+    double result = 1.0;
+    double t = 0.0;
+    double previous = 1e20;
+    double inverseLipschitz = 1.0 / lipschitzBound;
+    for (int i = 0; i < maxSteps && t < maxDistance; ++i) {
+        Vec3<double> point = origin + direction * t;
+        double value = tape.evaluate(point);
+        double h = value * inverseLipschitz;
+        if (sweep) {
+            // Covers both the field value and the step taken from it
+            double radius = std::max(std::abs(value), std::abs(h));
+            *sweep = sweep->unite(AABB::around(point, Vec3<double>(radius, radius, radius)));
+        }
+        if (h < epsilon) {
+            return 0.0;
+        }
+
+        double y = h * h / (2.0 * previous);
+        double d = std::sqrt(std::max(h * h - y * y, 0.0));
+        result = std::min(result, softness * d / std::max(t - y, 1e-4));
+        previous = h;
+        t += h;
+
+        // Anything darker is indistinguishable from full shadow
+        if (result < 0.01) {
+            return 0.0;
+        }
+    }
+    return std::min(std::max(result, 0.0), 1.0);
+}
+
+bool ShadowVolume::bake(const Tape& tape, const AABB& sceneBounds, const Vec3<double>& light, int resolution,
+                        int steps, double penumbraSoftness, double hitEpsilon, double bound, int maxTextureSize) {
+    visibility.clear();
+    sweeps.clear();
+    lightPosition = light;
+    maxSteps = steps;
+    softness = penumbraSoftness;
+    epsilon = hitEpsilon;
+    lipschitzBound = bound;
+    updatedMin[0] = updatedMin[1] = updatedMin[2] = 0;
+    updatedMax[0] = updatedMax[1] = updatedMax[2] = -1;
+
+    if (!sceneBounds.isFinite() || tape.empty() || resolution <= 0 || !(bound > 0.0)) {
+        return false;
+    }
+
+    // Pad by two cells so offset lookups from surface points stay inside
+    Vec3<double> extent = sceneBounds.max - sceneBounds.min;
+    double longest = std::max(extent.x, std::max(extent.y, extent.z));
+    voxelSize = std::max(longest, 1e-6) / resolution;
+    double padding = 2.0 * voxelSize;
+    Vec3<double> origin = sceneBounds.min - Vec3<double>(padding, padding, padding);
+
+    const double extents[3] = { extent.x, extent.y, extent.z };
+    for (int axis = 0; axis < 3; ++axis) {
+        size[axis] = std::max(1, static_cast<int>(std::ceil((extents[axis] + 2.0 * padding) / voxelSize)));
+        if (size[axis] > maxTextureSize) {
+            return false;
+        }
+    }
+    bounds = AABB(origin, origin + Vec3<double>(size[0], size[1], size[2]) * voxelSize);
+    visibility.assign(static_cast<size_t>(size[0]) * size[1] * size[2], 0.0f);
+    sweeps.assign(visibility.size() * 6, 0.0f);
+
+    // Rays are independent; one task per row of cells
+    size_t rows = static_cast<size_t>(size[1]) * size[2];
+    ThreadPool::shared().parallelFor(rows, [&](size_t row) {
+        for (int x = 0; x < size[0]; ++x) {
+            traceCell(tape, x, static_cast<int>(row % size[1]), static_cast<int>(row / size[1]));
+        }
+    });
+
+    return true;
+}
+
+bool ShadowVolume::update(const Tape& tape, const AABB& sceneBounds, const AABB& region, double margin) {
+    updatedMin[0] = updatedMin[1] = updatedMin[2] = 0;
+    updatedMax[0] = updatedMax[1] = updatedMax[2] = -1;
+
+    // The padding must still cover the scene, up to the rounding of the bake
+    AABB interior = bounds.expand((1e-6 - 2.0) * voxelSize);
+    bool inside = sceneBounds.min.x >= interior.min.x && sceneBounds.min.y >= interior.min.y &&
+                  sceneBounds.min.z >= interior.min.z && sceneBounds.max.x <= interior.max.x &&
+                  sceneBounds.max.y <= interior.max.y && sceneBounds.max.z <= interior.max.z;
+    if (empty() || tape.empty() || !sceneBounds.isFinite() || !region.isFinite() || !inside) {
+        return false;
+    }
+
+    // Rows record the range of cells they traced again
+    size_t rows = static_cast<size_t>(size[1]) * size[2];
+    std::vector<int> first(rows, size[0]), last(rows, -1);
+    ThreadPool::shared().parallelFor(rows, [&](size_t row) {
+        for (int x = 0; x < size[0]; ++x) {
+            const float* s = sweeps.data() + (row * size[0] + x) * 6;
+            AABB sweep(Vec3<double>(s[0], s[1], s[2]), Vec3<double>(s[3], s[4], s[5]));
+            if (s[0] > s[3] || sweep.distance(region) > margin) {
+                continue;
+            }
+            traceCell(tape, x, static_cast<int>(row % size[1]), static_cast<int>(row / size[1]));
+            first[row] = std::min(first[row], x);
+            last[row] = std::max(last[row], x);
+        }
+    });
+
+    for (size_t row = 0; row < rows; ++row) {
+        if (last[row] < 0) continue;
+        int y = static_cast<int>(row % size[1]), z = static_cast<int>(row / size[1]);
+        if (updatedMax[0] < 0) {
+            updatedMin[0] = first[row];
+            updatedMin[1] = y;
+            updatedMin[2] = z;
+            updatedMax[0] = last[row];
+            updatedMax[1] = y;
+            updatedMax[2] = z;
+            continue;
+        }
+        updatedMin[0] = std::min(updatedMin[0], first[row]);
+        updatedMin[1] = std::min(updatedMin[1], y);
+        updatedMax[0] = std::max(updatedMax[0], last[row]);
+        updatedMax[1] = std::max(updatedMax[1], y);
+        updatedMax[2] = z;
+    }
+    return true;
+}
+
+void ShadowVolume::traceCell(const Tape& tape, int x, int y, int z) {
+    Vec3<double> center = bounds.min + Vec3<double>(x + 0.5, y + 0.5, z + 0.5) * voxelSize;
+    Vec3<double> toLight = lightPosition - center;
+    double distance = toLight.length();
+
+    // Cells at the light never march, so no edit can change them
+    const double inf = std::numeric_limits<double>::infinity();
+    AABB sweep(Vec3<double>(inf, inf, inf), Vec3<double>(-inf, -inf, -inf));
+    double value = 1.0;
+    if (distance > 0.0) {
+        double h = tape.evaluate(center);
+        sweep = AABB::around(center, Vec3<double>(std::abs(h), std::abs(h), std::abs(h)));
+        value = h >= 0.0 ? softShadow(tape, center, toLight * (1.0 / distance), distance, maxSteps, softness, epsilon,
+                                      lipschitzBound, &sweep)
+                         : 0.0;
+    }
+
+    size_t cell = (static_cast<size_t>(z) * size[1] + y) * size[0] + x;
+    visibility[cell] = static_cast<float>(value);
+
+    // Rounded outwards, so the stored box still contains every sphere
+    float* s = sweeps.data() + cell * 6;
+    const float up = std::numeric_limits<float>::infinity();
+    s[0] = std::nextafter(static_cast<float>(sweep.min.x), -up);
+    s[1] = std::nextafter(static_cast<float>(sweep.min.y), -up);
+    s[2] = std::nextafter(static_cast<float>(sweep.min.z), -up);
+    s[3] = std::nextafter(static_cast<float>(sweep.max.x), up);
+    s[4] = std::nextafter(static_cast<float>(sweep.max.y), up);
+    s[5] = std::nextafter(static_cast<float>(sweep.max.z), up);
+}
@@ -0,0 +1,1161 @@
+﻿#include "Tape.h"
+#include "Simd.h"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+
+namespace {
+    const uint32_t maxNodeConstants = 14;
+
+    // Constants of the instruction lowered from a node with these parameters
+    // (see TapeOp), returning their count
+    uint32_t lowerConstants(SceneNodeType type, const double* p, double* out) {
+        switch (type) {
+            case SceneNodeType::Sphere:
+            case SceneNodeType::Plane:
+                std::copy(p, p + 4, out);
+                return 4;
+            case SceneNodeType::Box:
+                std::copy(p, p + 7, out);
+                return 7;
+            case SceneNodeType::Cylinder: {
+                Vec3<double> axis(p[3] - p[0], p[4] - p[1], p[5] - p[2]);
+                double lengthSquared = axis.dot(axis);
+                // A zero inverse length turns the segment into its start point, as in Cylinder::evaluate
+                double values[8] = { p[0], p[1], p[2], axis.x, axis.y, axis.z,
+                                     lengthSquared > 0.0 ? 1.0 / lengthSquared : 0.0, p[6] };
+                std::copy(values, values + 8, out);
+                return 8;
+            }
+            case SceneNodeType::SmoothUnion:
+            case SceneNodeType::SmoothIntersection:
+            case SceneNodeType::SmoothDifference:
+                out[0] = p[0];
+                return 1;
+            case SceneNodeType::Transform:
+                std::copy(p, p + 12, out);
+                out[12] = 1.0 / p[12];
+                out[13] = p[12];
+                return 14;
+            default:
+                return 0;
+        }
+    }
+}
+
+// Lowers a SceneGraph node (tree or DAG) into a Tape
+class TapeCompiler {
+private:
+    Tape& tape;
+    const SceneGraph& graph;
+
+    // Per-handle state, indexed by NodeHandle. Every instance transform opens a
+    // frame evaluated at its own point; a node reachable from several frames
+    // is emitted once per frame, so this state is saved and restored around them.
+    std::vector<int> remainingUses;       // Parents still waiting for the node's register
+    std::vector<uint32_t> emitted;        // Register holding the node's value, or unemitted
+    std::vector<uint32_t> registerNeed;   // Registers needed by the subtree (Sethi-Ullman number)
+    std::vector<uint32_t> visitedFrame;   // Last frame that collected the node
+
+    std::vector<uint32_t> freeRegisters;
+    std::vector<uint32_t> freePoints;
+    uint32_t currentPoint = 0;
+    uint32_t frameCount = 0;
+
+    struct SavedNode {
+        NodeHandle handle;
+        int remainingUses;
+        uint32_t emitted;
+    };
+
+    static constexpr uint32_t unemitted = 0xffffffffu;
+
+public:
+    TapeCompiler(Tape& tape, const SceneGraph& graph) : tape(tape), graph(graph) {}
+
+    // Register needs for everything reachable from root, then the use counts
+    // of the top-level frame. Handles are bottom-up, so needs take a single
+    // linear pass without recursion.
+    void analyze(NodeHandle root) {
+        remainingUses.assign(root + 1, 0);
+        emitted.assign(root + 1, unemitted);
+        registerNeed.assign(root + 1, 1);
+        visitedFrame.assign(root + 1, 0);
+
+        std::vector<char> reachable(root + 1, 0);
+        reachable[root] = 1;
+        for (NodeHandle h = root + 1; h-- > 0;) {
+            const SceneNode& node = graph.getNode(h);
+            if (!reachable[h]) continue;
+            if (node.left != invalidNode) reachable[node.left] = 1;
+            if (node.right != invalidNode) reachable[node.right] = 1;
+        }
+
+        for (NodeHandle h = 0; h <= root; ++h) {
+            const SceneNode& node = graph.getNode(h);
+            if (reachable[h] && SceneGraph::isBoolean(node.type)) {
+                uint32_t left = registerNeed[node.left];
+                uint32_t right = registerNeed[node.right];
+                registerNeed[h] = left == right ? left + 1 : std::max(left, right);
+            }
+            else if (reachable[h] && node.type == SceneNodeType::Transform) {
+                registerNeed[h] = registerNeed[node.left];
+            }
+        }
+
+        beginFrame(root, 0);
+    }
+
+    // Reset the state of the nodes evaluated in a frame (everything reachable
+    // from frameRoot without entering nested instances) and count their uses
+    // inside it. rootUses are the consumers of frameRoot outside the frame.
+    std::vector<SavedNode> beginFrame(NodeHandle frameRoot, int rootUses) {
+        uint32_t frame = ++frameCount;
+        std::vector<SavedNode> saved;
+        std::vector<NodeHandle> stack;
+
+        auto visit = [&](NodeHandle h) {
+            if (visitedFrame[h] == frame) return;
+            visitedFrame[h] = frame;
+            saved.push_back({ h, remainingUses[h], emitted[h] });
+            remainingUses[h] = 0;
+            emitted[h] = unemitted;
+            stack.push_back(h);
+        };
+
+        visit(frameRoot);
+        while (!stack.empty()) {
+            const SceneNode& node = graph.getNode(stack.back());
+            stack.pop_back();
+            if (SceneGraph::isBoolean(node.type)) {
+                visit(node.left);
+                visit(node.right);
+                ++remainingUses[node.left];
+                ++remainingUses[node.right];
+            }
+        }
+        remainingUses[frameRoot] += rootUses;
+        return saved;
+    }
+
+    void endFrame(const std::vector<SavedNode>& saved) {
+        for (const SavedNode& node : saved) {
+            remainingUses[node.handle] = node.remainingUses;
+            emitted[node.handle] = node.emitted;
+        }
+    }
+
+    uint32_t allocate() {
+        if (!freeRegisters.empty()) {
+            uint32_t reg = freeRegisters.back();
+            freeRegisters.pop_back();
+            return reg;
+        }
+        return tape.registerCount++;
+    }
+
+    // Called by each consumer once it has read a node's register
+    void release(NodeHandle handle) {
+        if (--remainingUses[handle] == 0) {
+            freeRegisters.push_back(emitted[handle]);
+        }
+    }
+
+    // Lower the parameters of a node into the constant pool, remembering where
+    // they went so that parameter edits can be patched in (see updateConstants)
+    uint32_t pushConstants(NodeHandle handle) {
+        double values[maxNodeConstants];
+        uint32_t count = lowerConstants(graph.getNode(handle).type, graph.getParameters(handle), values);
+        uint32_t offset = static_cast<uint32_t>(tape.constants.size());
+        tape.constants.insert(tape.constants.end(), values, values + count);
+        tape.sources.push_back({ handle, offset });
+        return offset;
+    }
+
+    uint32_t emitInstruction(TapeOp op, uint32_t lhs, uint32_t rhs, uint32_t constants) {
+        uint32_t out = allocate();
+        tape.instructions.push_back({ op, out, lhs, rhs, constants });
+        return out;
+    }
+
+    uint32_t emit(NodeHandle handle) {
+        if (emitted[handle] != unemitted) {
+            return emitted[handle];
+        }
+
+        const SceneNode& node = graph.getNode(handle);
+        uint32_t reg;
+        if (SceneGraph::isBoolean(node.type)) reg = emitBoolean(handle);
+        else if (node.type == SceneNodeType::Transform) reg = emitTransform(handle);
+        else reg = emitPrimitive(handle);
+        emitted[handle] = reg;
+        return reg;
+    }
+
+    uint32_t emitPrimitive(NodeHandle handle) {
+        const SceneNode& node = graph.getNode(handle);
+        uint32_t point = currentPoint;
+
+        switch (node.type) {
+            case SceneNodeType::Sphere:
+                return emitInstruction(TapeOp::Sphere, point, 0, pushConstants(handle));
+            case SceneNodeType::Box:
+                return emitInstruction(TapeOp::Box, point, 0, pushConstants(handle));
+            case SceneNodeType::Plane:
+                return emitInstruction(TapeOp::Plane, point, 0, pushConstants(handle));
+            case SceneNodeType::Cylinder:
+                return emitInstruction(TapeOp::Cylinder, point, 0, pushConstants(handle));
+            default: {
+                // Unknown node types are still supported through a virtual call
+                uint32_t external = static_cast<uint32_t>(tape.externals.size());
+                tape.externals.push_back(graph.getExternal(handle));
+                return emitInstruction(TapeOp::Surface, point, 0, external);
+            }
+        }
+    }
+
+    uint32_t emitTransform(NodeHandle handle) {
+        const SceneNode& node = graph.getNode(handle);
+        uint32_t constants = pushConstants(handle);
+
+        // The instance's point register lives until its subtree is complete
+        uint32_t point;
+        if (!freePoints.empty()) {
+            point = freePoints.back();
+            freePoints.pop_back();
+        }
+        else {
+            point = tape.pointCount++;
+        }
+        tape.instructions.push_back({ TapeOp::Transform, point, currentPoint, 0, constants });
+
+        uint32_t parentPoint = currentPoint;
+        currentPoint = point;
+        std::vector<SavedNode> saved = beginFrame(node.left, 1);
+        uint32_t child = emit(node.left);
+        release(node.left);
+        endFrame(saved);
+        currentPoint = parentPoint;
+        freePoints.push_back(point);
+
+        return emitInstruction(TapeOp::Rescale, child, 0, constants + 3);
+    }
+
+    uint32_t emitBoolean(NodeHandle handle) {
+        const SceneNode& node = graph.getNode(handle);
+        TapeOp op;
+        switch (node.type) {
+            case SceneNodeType::Intersection: op = TapeOp::Intersection; break;
+            case SceneNodeType::Difference: op = TapeOp::Difference; break;
+            case SceneNodeType::SmoothUnion: op = TapeOp::SmoothUnion; break;
+            case SceneNodeType::SmoothIntersection: op = TapeOp::SmoothIntersection; break;
+            case SceneNodeType::SmoothDifference: op = TapeOp::SmoothDifference; break;
+            default: op = TapeOp::Union; break;
+        }
+
+        // Evaluate the more register-hungry operand first to keep the register file small
+        uint32_t lhs, rhs;
+        if (registerNeed[node.right] > registerNeed[node.left]) {
+            rhs = emit(node.right);
+            lhs = emit(node.left);
+        }
+        else {
+            lhs = emit(node.left);
+            rhs = emit(node.right);
+        }
+
+        // Operands are consumed by this instruction, so their registers can be reused for the result
+        release(node.left);
+        release(node.right);
+
+        uint32_t constants = SceneGraph::isSmooth(node.type) ? pushConstants(handle) : 0;
+        return emitInstruction(op, lhs, rhs, constants);
+    }
+};
+
+Tape::Tape() : registerCount(0), pointCount(1), resultRegister(0) {}
+
+Tape Tape::compile(const std::shared_ptr<const ImplicitSurface>& root) {
+    SceneGraph graph;
+    NodeHandle handle = graph.import(root);
+    return compile(graph, handle);
+}
+
+Tape Tape::compile(const SceneGraph& graph, NodeHandle root) {
+    Tape tape;
+    if (!graph.isValid(root)) {
+        return tape;
+    }
+
+    TapeCompiler compiler(tape, graph);
+    compiler.analyze(root);
+    tape.resultRegister = compiler.emit(root);
+    return tape;
+}
+
+bool Tape::updateConstants(const SceneGraph& graph, const std::vector<NodeHandle>& nodes) {
+    if (sources.empty()) {
+        return false;
+    }
+
+    std::vector<char> edited;
+    for (NodeHandle handle : nodes) {
+        if (handle >= edited.size()) edited.resize(handle + 1, 0);
+        edited[handle] = 1;
+    }
+    for (const ConstantSource& source : sources) {
+        if (source.node < edited.size() && edited[source.node] && graph.isValid(source.node)) {
+            lowerConstants(graph.getNode(source.node).type, graph.getParameters(source.node),
+                           constants.data() + source.constants);
+        }
+    }
+    return true;
+}
+
+namespace {
+    // Point in the local frame of a Transform instruction
+    Vec3<double> transformPoint(const double* c, const Vec3<double>& point) {
+        double dx = point.x - c[0], dy = point.y - c[1], dz = point.z - c[2];
+        return Vec3<double>((c[3] * dx + c[6] * dy + c[9] * dz) * c[12],
+                            (c[4] * dx + c[7] * dy + c[10] * dz) * c[12],
+                            (c[5] * dx + c[8] * dy + c[11] * dz) * c[12]);
+    }
+
+    // The transform of a Transform instruction's constants
+    Transform instructionTransform(const double* c) {
+        Transform transform;
+        transform.translation = Vec3<double>(c[0], c[1], c[2]);
+        for (int i = 0; i < 3; ++i) {
+            transform.rotation[i] = Vec3<double>(c[3 + 3 * i], c[4 + 3 * i], c[5 + 3 * i]);
+        }
+        transform.scale = c[13];
+        return transform;
+    }
+}
+
+double Tape::evaluate(const Vec3<double>& input) const {
+    if (instructions.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+
+    // Small register files live on the stack, large ones in a per-thread buffer
+    double localRegisters[64];
+    double* regs = localRegisters;
+    if (registerCount > 64) {
+        thread_local std::vector<double> heapRegisters;
+        heapRegisters.resize(registerCount);
+        regs = heapRegisters.data();
+    }
+
+    Vec3<double> localPoints[16];
+    Vec3<double>* points = localPoints;
+    if (pointCount > 16) {
+        thread_local std::vector<Vec3<double>> heapPoints;
+        heapPoints.resize(pointCount);
+        points = heapPoints.data();
+    }
+    points[0] = input;
+
+    const double* constantPool = constants.data();
+    for (const TapeInstruction& ins : instructions) {
+        const double* c = constantPool + ins.constants;
+        double result;
+
+        switch (ins.op) {
+            case TapeOp::Sphere: {
+                const Vec3<double>& point = points[ins.lhs];
+                double dx = point.x - c[0], dy = point.y - c[1], dz = point.z - c[2];
+                result = std::sqrt(dx * dx + dy * dy + dz * dz) - c[3];
+                break;
+            }
+            case TapeOp::Box: {
+                const Vec3<double>& point = points[ins.lhs];
+                double dx = std::abs(point.x - c[0]) - c[3];
+                double dy = std::abs(point.y - c[1]) - c[4];
+                double dz = std::abs(point.z - c[2]) - c[5];
+                double ox = std::max(dx, 0.0), oy = std::max(dy, 0.0), oz = std::max(dz, 0.0);
+                result = std::sqrt(ox * ox + oy * oy + oz * oz) +
+                         std::min(std::max(dx, std::max(dy, dz)), 0.0) - c[6];
+                break;
+            }
+            case TapeOp::Plane: {
+                const Vec3<double>& point = points[ins.lhs];
+                result = c[0] * point.x + c[1] * point.y + c[2] * point.z + c[3];
+                break;
+            }
+            case TapeOp::Cylinder: {
+                const Vec3<double>& point = points[ins.lhs];
+                double px = point.x - c[0], py = point.y - c[1], pz = point.z - c[2];
+                double h = (px * c[3] + py * c[4] + pz * c[5]) * c[6];
+                h = std::max(0.0, std::min(1.0, h));
+                double qx = px - c[3] * h, qy = py - c[4] * h, qz = pz - c[5] * h;
+                result = std::sqrt(qx * qx + qy * qy + qz * qz) - c[7];
+                break;
+            }
+            case TapeOp::Union:
+                result = std::min(regs[ins.lhs], regs[ins.rhs]);
+                break;
+            case TapeOp::Intersection:
+                result = std::max(regs[ins.lhs], regs[ins.rhs]);
+                break;
+            case TapeOp::Difference:
+                result = std::max(regs[ins.lhs], -regs[ins.rhs]);
+                break;
+            case TapeOp::SmoothUnion: {
+                double a = regs[ins.lhs], b = regs[ins.rhs], k = c[0];
+                double h = std::max(k - std::abs(a - b), 0.0) / k;
+                result = std::min(a, b) - h * h * h * k * (1.0 / 6.0);
+                break;
+            }
+            case TapeOp::SmoothIntersection: {
+                double a = regs[ins.lhs], b = regs[ins.rhs], k = c[0];
+                double h = std::max(k - std::abs(a - b), 0.0) / k;
+                result = std::max(a, b) + h * h * h * k * (1.0 / 6.0);
+                break;
+            }
+            case TapeOp::SmoothDifference: {
+                double a = regs[ins.lhs], b = -regs[ins.rhs], k = c[0];
+                double h = std::max(k - std::abs(a - b), 0.0) / k;
+                result = std::max(a, b) + h * h * h * k * (1.0 / 6.0);
+                break;
+            }
+            case TapeOp::Negate:
+                result = -regs[ins.lhs];
+                break;
+            case TapeOp::Transform:
+                points[ins.out] = transformPoint(c, points[ins.lhs]);
+                continue;
+            case TapeOp::Rescale:
+                result = regs[ins.lhs] * c[10];
+                break;
+            case TapeOp::Surface:
+            default:
+                result = externals[ins.constants]->evaluate(points[ins.lhs]);
+                break;
+        }
+
+        regs[ins.out] = result;
+    }
+
+    return regs[resultRegister];
+}
+
+namespace {
+    // Value and gradient of one register during forward-mode evaluation
+    struct Dual {
+        double value;
+        Vec3<double> grad;
+    };
+
+    Dual selectDual(const Dual& a, const Dual& b, bool maximum) {
+        return (maximum ? a.value >= b.value : a.value <= b.value) ? a : b;
+    }
+
+    Dual negateDual(const Dual& a) {
+        return { -a.value, a.grad * -1.0 };
+    }
+
+    // Cubic smooth minimum/maximum, gradient blended by h^2 / 2 (see BooleanOperation::smoothCombine)
+    Dual smoothDual(const Dual& a, const Dual& b, double k, bool maximum) {
+        bool selectA = maximum ? a.value >= b.value : a.value <= b.value;
+        const Dual& selected = selectA ? a : b;
+        const Dual& other = selectA ? b : a;
+        double h = std::max(k - std::abs(a.value - b.value), 0.0) / k;
+        double w = 0.5 * h * h;
+        double correction = h * h * h * k * (1.0 / 6.0);
+        return { maximum ? selected.value + correction : selected.value - correction,
+                 selected.grad * (1.0 - w) + other.grad * w };
+    }
+
+    Dual radialDual(double x, double y, double z, double radius) {
+        double length = std::sqrt(x * x + y * y + z * z);
+        Vec3<double> grad = length > 0.0 ? Vec3<double>(x / length, y / length, z / length)
+                                         : Vec3<double>(0.0, 1.0, 0.0);
+        return { length - radius, grad };
+    }
+}
+
+double Tape::evaluateWithGradient(const Vec3<double>& input, Vec3<double>& gradient) const {
+    if (instructions.empty()) {
+        gradient = Vec3<double>();
+        return std::numeric_limits<double>::infinity();
+    }
+
+    Dual localRegisters[32];
+    Dual* regs = localRegisters;
+    if (registerCount > 32) {
+        thread_local std::vector<Dual> heapRegisters;
+        heapRegisters.resize(registerCount);
+        regs = heapRegisters.data();
+    }
+
+    // Gradients inside an instance are in its local frame until its Rescale
+    Vec3<double> localPoints[16];
+    Vec3<double>* points = localPoints;
+    if (pointCount > 16) {
+        thread_local std::vector<Vec3<double>> heapPoints;
+        heapPoints.resize(pointCount);
+        points = heapPoints.data();
+    }
+    points[0] = input;
+
+    const double* constantPool = constants.data();
+    for (const TapeInstruction& ins : instructions) {
+        const double* c = constantPool + ins.constants;
+        Dual result;
+
+        switch (ins.op) {
+            case TapeOp::Sphere: {
+                const Vec3<double>& point = points[ins.lhs];
+                result = radialDual(point.x - c[0], point.y - c[1], point.z - c[2], c[3]);
+                break;
+            }
+            case TapeOp::Box: {
+                const Vec3<double>& point = points[ins.lhs];
+                double wx = point.x - c[0], wy = point.y - c[1], wz = point.z - c[2];
+                double sx = wx < 0.0 ? -1.0 : 1.0, sy = wy < 0.0 ? -1.0 : 1.0, sz = wz < 0.0 ? -1.0 : 1.0;
+                double dx = std::abs(wx) - c[3], dy = std::abs(wy) - c[4], dz = std::abs(wz) - c[5];
+                double g = std::max(dx, std::max(dy, dz));
+                if (g > 0.0) {
+                    double qx = std::max(dx, 0.0), qy = std::max(dy, 0.0), qz = std::max(dz, 0.0);
+                    double length = std::sqrt(qx * qx + qy * qy + qz * qz);
+                    result = { length - c[6], Vec3<double>(sx * qx / length, sy * qy / length, sz * qz / length) };
+                }
+                else if (dx >= dy && dx >= dz) result = { g - c[6], Vec3<double>(sx, 0.0, 0.0) };
+                else if (dy >= dz) result = { g - c[6], Vec3<double>(0.0, sy, 0.0) };
+                else result = { g - c[6], Vec3<double>(0.0, 0.0, sz) };
+                break;
+            }
+            case TapeOp::Plane: {
+                const Vec3<double>& point = points[ins.lhs];
+                result = { c[0] * point.x + c[1] * point.y + c[2] * point.z + c[3], Vec3<double>(c[0], c[1], c[2]) };
+                break;
+            }
+            case TapeOp::Cylinder: {
+                const Vec3<double>& point = points[ins.lhs];
+                double px = point.x - c[0], py = point.y - c[1], pz = point.z - c[2];
+                double h = std::max(0.0, std::min(1.0, (px * c[3] + py * c[4] + pz * c[5]) * c[6]));
+                result = radialDual(px - c[3] * h, py - c[4] * h, pz - c[5] * h, c[7]);
+                break;
+            }
+            case TapeOp::Union:
+                result = selectDual(regs[ins.lhs], regs[ins.rhs], false);
+                break;
+            case TapeOp::Intersection:
+                result = selectDual(regs[ins.lhs], regs[ins.rhs], true);
+                break;
+            case TapeOp::Difference:
+                result = selectDual(regs[ins.lhs], negateDual(regs[ins.rhs]), true);
+                break;
+            case TapeOp::SmoothUnion:
+                result = smoothDual(regs[ins.lhs], regs[ins.rhs], c[0], false);
+                break;
+            case TapeOp::SmoothIntersection:
+                result = smoothDual(regs[ins.lhs], regs[ins.rhs], c[0], true);
+                break;
+            case TapeOp::SmoothDifference:
+                result = smoothDual(regs[ins.lhs], negateDual(regs[ins.rhs]), c[0], true);
+                break;
+            case TapeOp::Negate:
+                result = negateDual(regs[ins.lhs]);
+                break;
+            case TapeOp::Transform:
+                points[ins.out] = transformPoint(c, points[ins.lhs]);
+                continue;
+            case TapeOp::Rescale: {
+                // The scale cancels in the gradient, only the rotation remains
+                const Dual& a = regs[ins.lhs];
+                result = { a.value * c[10], Vec3<double>(c[0] * a.grad.x + c[1] * a.grad.y + c[2] * a.grad.z,
+                                                         c[3] * a.grad.x + c[4] * a.grad.y + c[5] * a.grad.z,
+                                                         c[6] * a.grad.x + c[7] * a.grad.y + c[8] * a.grad.z) };
+                break;
+            }
+            case TapeOp::Surface:
+            default:
+                result.value = externals[ins.constants]->evaluateWithGradient(points[ins.lhs], result.grad);
+                break;
+        }
+
+        regs[ins.out] = result;
+    }
+
+    gradient = regs[resultRegister].grad;
+    return regs[resultRegister].value;
+}
+
+template <typename T>
+void Tape::evaluateBatch(const T* xs, const T* ys, const T* zs, T* distances, size_t count) const {
+    if (instructions.empty()) {
+        std::fill(distances, distances + count, std::numeric_limits<T>::infinity());
+        return;
+    }
+
+    using Vector = simd::Vector<T>;
+    constexpr size_t lanes = Vector::width;
+    constexpr size_t vectors = batchSize / lanes;
+    static_assert(batchSize % lanes == 0, "batch size must be a multiple of the SIMD width");
+
+    // Every register holds one value per point of the batch
+    thread_local std::vector<Vector> registerFile;
+    registerFile.resize(static_cast<size_t>(registerCount) * vectors);
+    Vector* regs = registerFile.data();
+
+    // Point registers hold x, y and z vectors of the batch each
+    thread_local std::vector<Vector> pointFile;
+    pointFile.resize(static_cast<size_t>(pointCount) * 3 * vectors);
+    Vector* points = pointFile.data();
+
+    // Constants stay double in the pool and are rounded when broadcast
+    auto splat = [](double value) { return Vector(static_cast<T>(value)); };
+    const double* constantPool = constants.data();
+    T px[batchSize], py[batchSize], pz[batchSize], result[batchSize];
+
+    for (size_t base = 0; base < count; base += batchSize) {
+        size_t n = std::min(batchSize, count - base);
+
+        // Copy the batch, padding a partial tail with its last point
+        for (size_t i = 0; i < batchSize; ++i) {
+            size_t source = base + std::min(i, n - 1);
+            px[i] = xs[source];
+            py[i] = ys[source];
+            pz[i] = zs[source];
+        }
+
+        for (size_t v = 0; v < vectors; ++v) {
+            points[v] = Vector::load(px + v * lanes);
+            points[vectors + v] = Vector::load(py + v * lanes);
+            points[2 * vectors + v] = Vector::load(pz + v * lanes);
+        }
+
+        for (const TapeInstruction& ins : instructions) {
+            const double* c = constantPool + ins.constants;
+            Vector* out = regs + static_cast<size_t>(ins.out) * vectors;
+            const Vector* a = regs + static_cast<size_t>(ins.lhs) * vectors;
+            const Vector* b = regs + static_cast<size_t>(ins.rhs) * vectors;
+
+            // Primitives read the point register lhs; other operations use lhs as a value register
+            const Vector* X = points + static_cast<size_t>(ins.lhs < pointCount ? ins.lhs : 0) * 3 * vectors;
+            const Vector* Y = X + vectors;
+            const Vector* Z = Y + vectors;
+
+            switch (ins.op) {
+                case TapeOp::Sphere: {
+                    Vector cx = splat(c[0]), cy = splat(c[1]), cz = splat(c[2]), r = splat(c[3]);
+                    for (size_t v = 0; v < vectors; ++v) {
+                        Vector dx = X[v] - cx, dy = Y[v] - cy, dz = Z[v] - cz;
+                        out[v] = sqrt(dx * dx + dy * dy + dz * dz) - r;
+                    }
+                    break;
+                }
+                case TapeOp::Box: {
+                    Vector cx = splat(c[0]), cy = splat(c[1]), cz = splat(c[2]);
+                    Vector hx = splat(c[3]), hy = splat(c[4]), hz = splat(c[5]), s = splat(c[6]), zero = splat(0.0);
+                    for (size_t v = 0; v < vectors; ++v) {
+                        Vector dx = abs(X[v] - cx) - hx;
+                        Vector dy = abs(Y[v] - cy) - hy;
+                        Vector dz = abs(Z[v] - cz) - hz;
+                        Vector ox = max(dx, zero), oy = max(dy, zero), oz = max(dz, zero);
+                        out[v] = sqrt(ox * ox + oy * oy + oz * oz) + min(max(dx, max(dy, dz)), zero) - s;
+                    }
+                    break;
+                }
+                case TapeOp::Plane: {
+                    Vector nx = splat(c[0]), ny = splat(c[1]), nz = splat(c[2]), d = splat(c[3]);
+                    for (size_t v = 0; v < vectors; ++v) {
+                        out[v] = nx * X[v] + ny * Y[v] + nz * Z[v] + d;
+                    }
+                    break;
+                }
+                case TapeOp::Cylinder: {
+                    Vector sx = splat(c[0]), sy = splat(c[1]), sz = splat(c[2]);
+                    Vector ax = splat(c[3]), ay = splat(c[4]), az = splat(c[5]);
+                    Vector inverseLength = splat(c[6]), r = splat(c[7]), zero = splat(0.0), one = splat(1.0);
+                    for (size_t v = 0; v < vectors; ++v) {
+                        Vector qx = X[v] - sx, qy = Y[v] - sy, qz = Z[v] - sz;
+                        Vector h = (qx * ax + qy * ay + qz * az) * inverseLength;
+                        h = max(zero, min(one, h));
+                        qx = qx - ax * h;
+                        qy = qy - ay * h;
+                        qz = qz - az * h;
+                        out[v] = sqrt(qx * qx + qy * qy + qz * qz) - r;
+                    }
+                    break;
+                }
+                case TapeOp::Union:
+                    for (size_t v = 0; v < vectors; ++v) out[v] = min(a[v], b[v]);
+                    break;
+                case TapeOp::Intersection:
+                    for (size_t v = 0; v < vectors; ++v) out[v] = max(a[v], b[v]);
+                    break;
+                case TapeOp::Difference:
+                    for (size_t v = 0; v < vectors; ++v) out[v] = max(a[v], -b[v]);
+                    break;
+                case TapeOp::SmoothUnion:
+                case TapeOp::SmoothIntersection:
+                case TapeOp::SmoothDifference: {
+                    Vector k = splat(c[0]), inverseK = splat(1.0 / c[0]), zero = splat(0.0);
+                    Vector blend = splat(c[0] * (1.0 / 6.0));
+                    for (size_t v = 0; v < vectors; ++v) {
+                        Vector lhs = a[v];
+                        Vector rhs = ins.op == TapeOp::SmoothDifference ? -b[v] : b[v];
+                        Vector h = max(k - abs(lhs - rhs), zero) * inverseK;
+                        Vector correction = h * h * h * blend;
+                        out[v] = ins.op == TapeOp::SmoothUnion ? min(lhs, rhs) - correction
+                                                               : max(lhs, rhs) + correction;
+                    }
+                    break;
+                }
+                case TapeOp::Negate:
+                    for (size_t v = 0; v < vectors; ++v) out[v] = -a[v];
+                    break;
+                case TapeOp::Transform: {
+                    Vector* local = points + static_cast<size_t>(ins.out) * 3 * vectors;
+                    Vector tx = splat(c[0]), ty = splat(c[1]), tz = splat(c[2]), inverseScale = splat(c[12]);
+                    Vector r0 = splat(c[3]), r1 = splat(c[4]), r2 = splat(c[5]);
+                    Vector r3 = splat(c[6]), r4 = splat(c[7]), r5 = splat(c[8]);
+                    Vector r6 = splat(c[9]), r7 = splat(c[10]), r8 = splat(c[11]);
+                    for (size_t v = 0; v < vectors; ++v) {
+                        Vector dx = X[v] - tx, dy = Y[v] - ty, dz = Z[v] - tz;
+                        local[v] = (r0 * dx + r3 * dy + r6 * dz) * inverseScale;
+                        local[vectors + v] = (r1 * dx + r4 * dy + r7 * dz) * inverseScale;
+                        local[2 * vectors + v] = (r2 * dx + r5 * dy + r8 * dz) * inverseScale;
+                    }
+                    break;
+                }
+                case TapeOp::Rescale: {
+                    Vector scale = splat(c[10]);
+                    for (size_t v = 0; v < vectors; ++v) out[v] = a[v] * scale;
+                    break;
+                }
+                case TapeOp::Surface:
+                default: {
+                    T values[batchSize], lx[batchSize], ly[batchSize], lz[batchSize];
+                    for (size_t v = 0; v < vectors; ++v) {
+                        X[v].store(lx + v * lanes);
+                        Y[v].store(ly + v * lanes);
+                        Z[v].store(lz + v * lanes);
+                    }
+                    const ImplicitSurface& surface = *externals[ins.constants];
+                    for (size_t i = 0; i < batchSize; ++i) {
+                        values[i] = static_cast<T>(surface.evaluate(Vec3<double>(lx[i], ly[i], lz[i])));
+                    }
+                    for (size_t v = 0; v < vectors; ++v) out[v] = Vector::load(values + v * lanes);
+                    break;
+                }
+            }
+        }
+
+        const Vector* final = regs + static_cast<size_t>(resultRegister) * vectors;
+        for (size_t v = 0; v < vectors; ++v) {
+            final[v].store(result + v * lanes);
+        }
+        std::copy(result, result + n, distances + base);
+    }
+}
+
+template void Tape::evaluateBatch<double>(const double*, const double*, const double*, double*, size_t) const;
+template void Tape::evaluateBatch<float>(const float*, const float*, const float*, float*, size_t) const;
+
+uint32_t Tape::constantCount(TapeOp op) {
+    switch (op) {
+        case TapeOp::Sphere: return 4;
+        case TapeOp::Box: return 7;
+        case TapeOp::Plane: return 4;
+        case TapeOp::Cylinder: return 8;
+        case TapeOp::SmoothUnion:
+        case TapeOp::SmoothIntersection:
+        case TapeOp::SmoothDifference: return 1;
+        case TapeOp::Transform: return 14;
+        case TapeOp::Rescale: return 11;
+        default: return 0;
+    }
+}
+
+bool Tape::isInterpretable() const {
+    if (instructions.empty() || registerCount > interpreterRegisters || pointCount > interpreterPoints) {
+        return false;
+    }
+    for (const TapeInstruction& ins : instructions) {
+        if (ins.op == TapeOp::Surface) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<float> Tape::packInterpreter() const {
+    std::vector<float> texels = { static_cast<float>(instructions.size()), static_cast<float>(resultRegister), 0.0f, 0.0f };
+    auto push = [&](double x, double y, double z, double w) {
+        texels.insert(texels.end(), { static_cast<float>(x), static_cast<float>(y), static_cast<float>(z), static_cast<float>(w) });
+    };
+
+    for (const TapeInstruction& ins : instructions) {
+        const double* c = constants.data() + ins.constants;
+        bool binary = ins.op >= TapeOp::Union && ins.op <= TapeOp::SmoothDifference;
+        push(static_cast<double>(ins.op), ins.out, ins.lhs, binary ? ins.rhs : 0);
+
+        switch (ins.op) {
+            case TapeOp::Sphere:
+            case TapeOp::Plane:
+                push(c[0], c[1], c[2], c[3]);
+                break;
+            case TapeOp::Box:
+                push(c[0], c[1], c[2], c[6]);
+                push(c[3], c[4], c[5], 0.0);
+                break;
+            case TapeOp::Cylinder:
+                push(c[0], c[1], c[2], c[7]);
+                push(c[3], c[4], c[5], c[6]);
+                break;
+            case TapeOp::SmoothUnion:
+            case TapeOp::SmoothIntersection:
+            case TapeOp::SmoothDifference:
+                push(c[0], 0.0, 0.0, 0.0);
+                break;
+            case TapeOp::Transform:
+                push(c[0], c[1], c[2], c[12]);
+                push(c[3], c[4], c[5], c[13]);
+                push(c[6], c[7], c[8], 0.0);
+                push(c[9], c[10], c[11], 0.0);
+                break;
+            case TapeOp::Rescale:
+                push(c[0], c[1], c[2], c[10]);
+                push(c[3], c[4], c[5], c[9]);
+                push(c[6], c[7], c[8], 0.0);
+                break;
+            default:
+                break;
+        }
+    }
+    return texels;
+}
+
+Interval Tape::primitiveInterval(const TapeInstruction& ins, const AABB& region) const {
+    const double* c = constants.data() + ins.constants;
+
+    switch (ins.op) {
+        case TapeOp::Sphere: {
+            Vec3<double> center(c[0], c[1], c[2]);
+            Vec3<double> far(std::max(std::abs(region.min.x - c[0]), std::abs(region.max.x - c[0])),
+                             std::max(std::abs(region.min.y - c[1]), std::abs(region.max.y - c[1])),
+                             std::max(std::abs(region.min.z - c[2]), std::abs(region.max.z - c[2])));
+            return Interval(region.distance(center) - c[3], far.length() - c[3]);
+        }
+        case TapeOp::Box: {
+            auto axis = [](double lo, double hi, double center, double half) {
+                double a = lo - center, b = hi - center;
+                double nearest = (a <= 0.0 && b >= 0.0) ? 0.0 : std::min(std::abs(a), std::abs(b));
+                return Interval(nearest - half, std::max(std::abs(a), std::abs(b)) - half);
+            };
+            Interval dx = axis(region.min.x, region.max.x, c[0], c[3]);
+            Interval dy = axis(region.min.y, region.max.y, c[1], c[4]);
+            Interval dz = axis(region.min.z, region.max.z, c[2], c[5]);
+            auto outside = [](double x, double y, double z) {
+                return Vec3<double>(std::max(x, 0.0), std::max(y, 0.0), std::max(z, 0.0)).length();
+            };
+            double inLower = std::min(std::max(dx.lower, std::max(dy.lower, dz.lower)), 0.0);
+            double inUpper = std::min(std::max(dx.upper, std::max(dy.upper, dz.upper)), 0.0);
+            return Interval(outside(dx.lower, dy.lower, dz.lower) + inLower - c[6],
+                            outside(dx.upper, dy.upper, dz.upper) + inUpper - c[6]);
+        }
+        case TapeOp::Plane: {
+            auto term = [](double n, double lo, double hi) {
+                return n >= 0.0 ? Interval(n * lo, n * hi) : Interval(n * hi, n * lo);
+            };
+            Interval x = term(c[0], region.min.x, region.max.x);
+            Interval y = term(c[1], region.min.y, region.max.y);
+            Interval z = term(c[2], region.min.z, region.max.z);
+            return Interval(x.lower + y.lower + z.lower + c[3], x.upper + y.upper + z.upper + c[3]);
+        }
+        case TapeOp::Cylinder: {
+            // Exact distance field, so it is 1-Lipschitz around the region center
+            Vec3<double> p = region.center();
+            double px = p.x - c[0], py = p.y - c[1], pz = p.z - c[2];
+            double h = std::max(0.0, std::min(1.0, (px * c[3] + py * c[4] + pz * c[5]) * c[6]));
+            double value = Vec3<double>(px - c[3] * h, py - c[4] * h, pz - c[5] * h).length() - c[7];
+            double radius = region.halfExtent().length();
+            return Interval(value - radius, value + radius);
+        }
+        case TapeOp::Surface:
+        default:
+            return externals[ins.constants]->evaluateInterval(region);
+    }
+}
+
+namespace {
+    bool isPrimitive(TapeOp op) {
+        return op == TapeOp::Sphere || op == TapeOp::Box || op == TapeOp::Plane ||
+               op == TapeOp::Cylinder || op == TapeOp::Surface;
+    }
+
+    // Interval of the cubic smooth minimum/maximum (see BooleanOperation::smoothInterval)
+    Interval smoothInterval(const Interval& a, const Interval& b, double k, bool maximum) {
+        bool separated = a.lower - b.upper >= k || b.lower - a.upper >= k;
+        double correction = separated ? 0.0 : std::max(k, 0.0) / 6.0;
+        if (maximum) {
+            return Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper) + correction);
+        }
+        return Interval(std::min(a.lower, b.lower) - correction, std::min(a.upper, b.upper));
+    }
+}
+
+Interval Tape::evaluateInterval(const AABB& region) const {
+    if (instructions.empty()) {
+        double inf = std::numeric_limits<double>::infinity();
+        return Interval(inf, inf);
+    }
+
+    // Region covered by each point register, bounded in the instance's local frame
+    std::vector<AABB> regions(pointCount);
+    regions[0] = region;
+
+    std::vector<Interval> regs(registerCount);
+    for (const TapeInstruction& ins : instructions) {
+        if (ins.op == TapeOp::Transform) {
+            regions[ins.out] = instructionTransform(constants.data() + ins.constants).toLocal(regions[ins.lhs]);
+            continue;
+        }
+        if (isPrimitive(ins.op)) {
+            regs[ins.out] = primitiveInterval(ins, regions[ins.lhs]);
+            continue;
+        }
+
+        const Interval& a = regs[ins.lhs];
+        const Interval& b = regs[ins.rhs];
+        bool smooth = ins.op == TapeOp::SmoothUnion || ins.op == TapeOp::SmoothIntersection ||
+                      ins.op == TapeOp::SmoothDifference;
+        double k = smooth ? constants[ins.constants] : 0.0;
+        Interval result;
+
+        switch (ins.op) {
+            case TapeOp::Union:
+                result = Interval(std::min(a.lower, b.lower), std::min(a.upper, b.upper));
+                break;
+            case TapeOp::Intersection:
+                result = Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper));
+                break;
+            case TapeOp::Difference:
+                result = Interval(std::max(a.lower, -b.upper), std::max(a.upper, -b.lower));
+                break;
+            case TapeOp::SmoothUnion:
+                result = smoothInterval(a, b, k, false);
+                break;
+            case TapeOp::SmoothIntersection:
+                result = smoothInterval(a, b, k, true);
+                break;
+            case TapeOp::SmoothDifference:
+                result = smoothInterval(a, -b, k, true);
+                break;
+            case TapeOp::Negate:
+                result = -a;
+                break;
+            case TapeOp::Rescale:
+                result = Interval(a.lower * constants[ins.constants + 10], a.upper * constants[ins.constants + 10]);
+                break;
+            default:
+                break;
+        }
+
+        regs[ins.out] = result;
+    }
+
+    return regs[resultRegister];
+}
+
+Tape Tape::specialize(const AABB& region) const {
+    const size_t count = instructions.size();
+    if (count == 0) {
+        return *this;
+    }
+
+    // Work in SSA form: every instruction is identified by its index and
+    // operands refer to the instruction that produced them. An instruction
+    // whose result is provably one of its operands becomes an alias.
+    // Points are values too: primitives and transforms refer to the Transform
+    // instruction that produced their point, -1 being the input point.
+    struct Node {
+        TapeOp op;
+        int lhs, rhs;  // Producing instruction indices
+        int alias;     // Instruction whose value this one forwards, or -1
+        int frame;     // Transform instruction producing the point read, or -1
+    };
+    std::vector<Node> nodes(count);
+    std::vector<Interval> intervals(count);
+    std::vector<int> producer(registerCount, -1);
+    std::vector<int> pointProducer(pointCount, -1);
+    std::vector<AABB> frameRegions(count);
+
+    auto regionOf = [&](int frame) -> const AABB& {
+        return frame >= 0 ? frameRegions[frame] : region;
+    };
+
+    auto resolve = [&](int index) {
+        while (nodes[index].alias >= 0) index = nodes[index].alias;
+        return index;
+    };
+
+    for (size_t i = 0; i < count; ++i) {
+        const TapeInstruction& ins = instructions[i];
+        Node node = { ins.op, -1, -1, -1, -1 };
+        Interval result;
+
+        if (ins.op == TapeOp::Transform) {
+            node.frame = pointProducer[ins.lhs];
+            frameRegions[i] = instructionTransform(constants.data() + ins.constants).toLocal(regionOf(node.frame));
+            nodes[i] = node;
+            pointProducer[ins.out] = static_cast<int>(i);
+            continue;
+        }
+
+        if (isPrimitive(ins.op)) {
+            node.frame = pointProducer[ins.lhs];
+            result = primitiveInterval(ins, regionOf(node.frame));
+        }
+        else {
+            node.lhs = resolve(producer[ins.lhs]);
+            const Interval& a = intervals[node.lhs];
+
+            if (ins.op == TapeOp::Negate) {
+                result = -a;
+            }
+            else if (ins.op == TapeOp::Rescale) {
+                double scale = constants[ins.constants + 10];
+                result = Interval(a.lower * scale, a.upper * scale);
+            }
+            else {
+                node.rhs = resolve(producer[ins.rhs]);
+                Interval b = intervals[node.rhs];
+                // Smooth operations only act like their sharp form once the operands are k apart.
+                // Sharp ones have no constants, and the pool may even be empty.
+                bool smooth = ins.op == TapeOp::SmoothUnion || ins.op == TapeOp::SmoothIntersection ||
+                              ins.op == TapeOp::SmoothDifference;
+                double k = smooth ? constants[ins.constants] : 0.0;
+                double margin = std::max(k, 0.0);
+
+                switch (ins.op) {
+                    case TapeOp::Union:
+                    case TapeOp::SmoothUnion:
+                        if (a.upper <= b.lower - margin) node.alias = node.lhs;
+                        else if (b.upper <= a.lower - margin) node.alias = node.rhs;
+                        else result = ins.op == TapeOp::Union
+                            ? Interval(std::min(a.lower, b.lower), std::min(a.upper, b.upper))
+                            : smoothInterval(a, b, k, false);
+                        break;
+                    case TapeOp::Intersection:
+                    case TapeOp::SmoothIntersection:
+                        if (a.lower >= b.upper + margin) node.alias = node.lhs;
+                        else if (b.lower >= a.upper + margin) node.alias = node.rhs;
+                        else result = ins.op == TapeOp::Intersection
+                            ? Interval(std::max(a.lower, b.lower), std::max(a.upper, b.upper))
+                            : smoothInterval(a, b, k, true);
+                        break;
+                    case TapeOp::Difference:
+                    case TapeOp::SmoothDifference: {
+                        Interval nb = -b;
+                        if (a.lower >= nb.upper + margin) {
+                            node.alias = node.lhs;
+                        }
+                        else if (nb.lower >= a.upper + margin) {
+                            // Only the subtracted operand matters: keep just its negation
+                            node = { TapeOp::Negate, node.rhs, -1, -1, -1 };
+                            result = nb;
+                        }
+                        else {
+                            result = ins.op == TapeOp::Difference
+                                ? Interval(std::max(a.lower, nb.lower), std::max(a.upper, nb.upper))
+                                : smoothInterval(a, nb, k, true);
+                        }
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+        }
+
+        nodes[i] = node;
+        intervals[i] = node.alias >= 0 ? intervals[node.alias] : result;
+        producer[ins.out] = static_cast<int>(i);
+    }
+
+    // Mark the instructions still reachable from the result
+    int root = resolve(producer[resultRegister]);
+    std::vector<char> live(count, 0);
+    live[root] = 1;
+    for (size_t i = count; i-- > 0;) {
+        if (!live[i]) continue;
+        if (nodes[i].lhs >= 0) live[nodes[i].lhs] = 1;
+        if (nodes[i].rhs >= 0) live[nodes[i].rhs] = 1;
+        if (nodes[i].frame >= 0) live[nodes[i].frame] = 1;
+    }
+
+    // Last instruction reading each live value or point, for register reuse
+    std::vector<size_t> lastUse(count, 0);
+    for (size_t i = 0; i < count; ++i) {
+        if (!live[i]) continue;
+        if (nodes[i].lhs >= 0) lastUse[nodes[i].lhs] = i;
+        if (nodes[i].rhs >= 0) lastUse[nodes[i].rhs] = i;
+        if (nodes[i].frame >= 0) lastUse[nodes[i].frame] = i;
+    }
+    lastUse[root] = count;
+
+    // Re-emit the live instructions with compacted constants and registers
+    Tape result;
+    result.externals = externals;
+    std::vector<uint32_t> assigned(count, 0);
+    std::vector<uint32_t> freeRegisters, freePoints;
+
+    for (size_t i = 0; i < count; ++i) {
+        if (!live[i]) continue;
+        const TapeInstruction& ins = instructions[i];
+        const Node& node = nodes[i];
+
+        TapeInstruction out = { node.op, 0, 0, 0, 0 };
+        if (node.lhs >= 0) out.lhs = assigned[node.lhs];
+        if (node.rhs >= 0) out.rhs = assigned[node.rhs];
+        if (node.frame >= 0) out.lhs = assigned[node.frame];
+
+        if (node.op == TapeOp::Surface) {
+            out.constants = ins.constants;
+        }
+        else if (uint32_t n = constantCount(node.op)) {
+            out.constants = static_cast<uint32_t>(result.constants.size());
+            result.constants.insert(result.constants.end(), constants.begin() + ins.constants,
+                                    constants.begin() + ins.constants + n);
+        }
+
+        if (node.op == TapeOp::Transform) {
+            // A point register is only freed after the new frame is allocated, so it is never written in place
+            if (!freePoints.empty()) {
+                out.out = freePoints.back();
+                freePoints.pop_back();
+            }
+            else {
+                out.out = result.pointCount++;
+            }
+            if (node.frame >= 0 && lastUse[node.frame] == i) freePoints.push_back(out.lhs);
+            assigned[i] = out.out;
+            result.instructions.push_back(out);
+            continue;
+        }
+        if (node.frame >= 0 && lastUse[node.frame] == i) freePoints.push_back(out.lhs);
+
+        // Operands read for the last time free their registers before the result is allocated
+        if (node.lhs >= 0 && lastUse[node.lhs] == i) freeRegisters.push_back(out.lhs);
+        if (node.rhs >= 0 && lastUse[node.rhs] == i && node.rhs != node.lhs) freeRegisters.push_back(out.rhs);
+
+        if (!freeRegisters.empty()) {
+            out.out = freeRegisters.back();
+            freeRegisters.pop_back();
+        }
+        else {
+            out.out = result.registerCount++;
+        }
+
+        assigned[i] = out.out;
+        result.instructions.push_back(out);
+    }
+
+    result.resultRegister = assigned[root];
+    return result;
+}
@@ -0,0 +1,102 @@
+﻿#include "TapeOctree.h"
+
+TapeOctree::TapeOctree(const Tape& tape, const AABB& region, int maxDepth, size_t leafSize)
+    : region(region)
+{
+    tapes.push_back(tape);
+    cells.push_back({ region.center(), -1, 0 });
+    if (region.isFinite() && !tape.empty()) {
+        build(0, region, tape, 0, maxDepth, leafSize);
+    }
+}
+
+void TapeOctree::build(uint32_t cellIndex, const AABB& cellBounds, const Tape& parent,
+                       int depth, int maxDepth, size_t leafSize) {
+    Tape specialized = parent.specialize(cellBounds);
+
+    if (depth >= maxDepth || specialized.size() <= leafSize) {
+        cells[cellIndex].tape = static_cast<uint32_t>(tapes.size());
+        tapes.push_back(std::move(specialized));
+        return;
+    }
+
+    int32_t firstChild = static_cast<int32_t>(cells.size());
+    cells[cellIndex].firstChild = firstChild;
+
+    Vec3<double> center = cellBounds.center();
+    Vec3<double> quarter = cellBounds.halfExtent() * 0.5;
+    for (int child = 0; child < 8; ++child) {
+        Vec3<double> childCenter(center.x + ((child & 1) ? quarter.x : -quarter.x),
+                                 center.y + ((child & 2) ? quarter.y : -quarter.y),
+                                 center.z + ((child & 4) ? quarter.z : -quarter.z));
+        cells.push_back({ childCenter, -1, 0 });
+    }
+
+    // Children narrow the parent's already specialized tape, which is much cheaper
+    // than starting from the full program again
+    for (int child = 0; child < 8; ++child) {
+        uint32_t childIndex = static_cast<uint32_t>(firstChild + child);
+        AABB childBounds = AABB::around(cells[childIndex].center, quarter);
+        build(childIndex, childBounds, specialized, depth + 1, maxDepth, leafSize);
+    }
+}
+
+uint32_t TapeOctree::findTapeIndex(const Vec3<double>& point) const {
+    if (!region.contains(point)) {
+        return 0;
+    }
+
+    const Cell* cell = &cells[0];
+    while (cell->firstChild >= 0) {
+        int child = (point.x >= cell->center.x ? 1 : 0) |
+                    (point.y >= cell->center.y ? 2 : 0) |
+                    (point.z >= cell->center.z ? 4 : 0);
+        cell = &cells[cell->firstChild + child];
+    }
+    return cell->tape;
+}
+
+void TapeOctree::evaluateBatch(const double* xs, const double* ys, const double* zs,
+                               double* distances, size_t count) const {
+    thread_local std::vector<uint32_t> leaf, offsets, order;
+    thread_local std::vector<double> gathered;
+
+    // Counting sort of the points by tape so every tape runs over one contiguous group
+    leaf.resize(count);
+    offsets.assign(tapes.size() + 1, 0);
+    for (size_t i = 0; i < count; ++i) {
+        leaf[i] = findTapeIndex(Vec3<double>(xs[i], ys[i], zs[i]));
+        ++offsets[leaf[i] + 1];
+    }
+    for (size_t t = 0; t < tapes.size(); ++t) {
+        offsets[t + 1] += offsets[t];
+    }
+
+    order.resize(count);
+    gathered.resize(count * 4);
+    double* gx = gathered.data();
+    double* gy = gx + count;
+    double* gz = gy + count;
+    double* gd = gz + count;
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (size_t i = 0; i < count; ++i) {
+            uint32_t slot = cursor[leaf[i]]++;
+            order[slot] = static_cast<uint32_t>(i);
+            gx[slot] = xs[i];
+            gy[slot] = ys[i];
+            gz[slot] = zs[i];
+        }
+    }
+
+    for (size_t t = 0; t < tapes.size(); ++t) {
+        size_t begin = offsets[t], end = offsets[t + 1];
+        if (begin < end) {
+            tapes[t].evaluateBatch(gx + begin, gy + begin, gz + begin, gd + begin, end - begin);
+        }
+    }
+
+    for (size_t slot = 0; slot < count; ++slot) {
+        distances[order[slot]] = gd[slot];
+    }
+}
@@ -0,0 +1,133 @@
+﻿#include "ThreadPool.h"
+#include <algorithm>
+
+namespace {
+    // Queue owned by the current thread (the shared caller queue for non-workers)
+    thread_local size_t currentQueue = static_cast<size_t>(-1);
+}
+
+ThreadPool::ThreadPool(unsigned threads)
+    : pending(0), stopping(false)
+{
+    if (threads == 0) {
+        unsigned hardware = std::thread::hardware_concurrency();
+        threads = hardware > 1 ? hardware - 1 : 0;
+    }
+
+    for (unsigned i = 0; i <= threads; ++i) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(&ThreadPool::workerLoop, this, static_cast<size_t>(i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+ThreadPool& ThreadPool::shared() {
+    static ThreadPool pool;
+    return pool;
+}
+
+bool ThreadPool::popTask(size_t queue, Task& task) {
+    // Own work first, oldest chunks first for locality
+    {
+        Queue& own = *queues[queue];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.front();
+            own.tasks.pop_front();
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+
+    // Steal from the back of the other queues
+    for (size_t offset = 1; offset < queues.size(); ++offset) {
+        Queue& victim = *queues[(queue + offset) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.back();
+            victim.tasks.pop_back();
+            pending.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::execute(const Task& task) {
+    (*task.job->body)(task.begin, task.end);
+    if (task.job->remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        finished.notify_all();
+    }
+}
+
+void ThreadPool::workerLoop(size_t index) {
+    currentQueue = index;
+    Task task;
+    for (;;) {
+        if (popTask(index, task)) {
+            execute(task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        wake.wait(lock, [this] { return stopping || pending.load(std::memory_order_relaxed) > 0; });
+        if (stopping && pending.load(std::memory_order_relaxed) == 0) {
+            return;
+        }
+    }
+}
+
+void ThreadPool::run(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    grain = std::max<size_t>(grain, 1);
+    size_t chunks = (count + grain - 1) / grain;
+    if (workers.empty() || chunks == 1) {
+        body(0, count);
+        return;
+    }
+
+    Job job;
+    job.body = &body;
+    job.remaining.store(chunks, std::memory_order_relaxed);
+
+    // Count the tasks before publishing them so pending never underflows
+    {
+        std::lock_guard<std::mutex> lock(wakeMutex);
+        pending.fetch_add(chunks, std::memory_order_relaxed);
+    }
+
+    // Deal chunks round-robin so every worker starts on local work
+    size_t callerQueue = currentQueue < workers.size() ? currentQueue : workers.size();
+    for (size_t chunk = 0; chunk < chunks; ++chunk) {
+        Queue& queue = *queues[chunk % queues.size()];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        queue.tasks.push_back({ &job, chunk * grain, std::min(count, (chunk + 1) * grain) });
+    }
+    wake.notify_all();
+
+    // Help until this job is done; tasks of other jobs are fine to run too
+    Task task;
+    while (job.remaining.load(std::memory_order_acquire) > 0) {
+        if (popTask(callerQueue, task)) {
+            execute(task);
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        finished.wait(lock, [&job] { return job.remaining.load(std::memory_order_acquire) == 0; });
+    }
+}